@@ -27,6 +27,10 @@
 // Import class definition
 #include "TerrainosaurusApplication.hpp"
 #include <terrainosaurus/genetics/terrain-operations.hpp>
+#include <terrainosaurus/util/WorkerPool.hpp>
+#include <terrainosaurus/data/BlendKernelBank.hpp>
+#include <terrainosaurus/util/ContentHash.hpp>
+#include <terrainosaurus/util/FFTPlanCache.hpp>
 typedef ::terrainosaurus::TerrainosaurusApplication  TApp;
 
 // Import Timer definition
@@ -46,6 +50,7 @@ using namespace inca::raster;
 #include <terrainosaurus/io/ConfigParser.h>
 #include <terrainosaurus/io/ConfigListener.h>
 #include <terrainosaurus/io/terrainosaurus-iostream.hpp>
+#include <terrainosaurus/io/AnalysisCache.hpp>
 #include <terrainosaurus/io/FailFastErrorListener.hpp>
 #include <inca/io/FileExceptions.hpp>
 using namespace inca::io;
@@ -53,7 +58,7 @@ using namespace terrainosaurus;
 
 
 #define STRING_PROPERTY_COUNT  1
-#define INTEGER_PROPERTY_COUNT 6
+#define INTEGER_PROPERTY_COUNT 7
 #define SCALAR_PROPERTY_COUNT  16
 
 // Default data file names
@@ -80,6 +85,8 @@ using namespace terrainosaurus;
 // HACK 'd in stuff for loading DEM files and caching them
 #include <sys/stat.h>
 #include <errno.h>
+#include <cstdio>
+#include <sstream>
 
 
 /*---------------------------------------------------------------------------*
@@ -95,7 +102,8 @@ TApp & TApp::instance() {
  *---------------------------------------------------------------------------*/
 // Constructor
 TApp::TerrainosaurusApplication()
-    : _stringProperties(STRING_PROPERTY_COUNT),
+    : _sourceHashesLoaded(false),
+      _stringProperties(STRING_PROPERTY_COUNT),
       _integerProperties(INTEGER_PROPERTY_COUNT),
       _scalarProperties(SCALAR_PROPERTY_COUNT) { }
 
@@ -139,6 +147,13 @@ void TApp::setup(int & argc, char **& argv) {
         exit(1, "Failed to load config file" );
     }
 
+    // Start up the worker threads, and let FFTW use as many (if it can)
+    WorkerPool::instance().setWorkerCount(workerThreads());
+    FFTPlanCache::instance().setThreadCount(WorkerPool::instance().workerCount());
+
+    // Build the blending masks now, rather than in the middle of rendering
+    BlendKernelBank::instance();
+
     // HACK If something wasn't specifed on the command-line, choose a default
 //    if (_mapFilenames.size() == 0)
 //        _mapFilenames.push_back(DEFAULT_MAP);
@@ -598,14 +613,7 @@ void TApp::loadSourceFiles(TerrainSample & ts) {
     if (demLOD != TerrainLOD_Overflow) {
         // We have a DEM file, so load it.
 		std::string path = elevationMapFilename(basename, demLOD);
-        std::ifstream file(path.c_str());
-        if (! file) {
-            FileAccessException e(path);
-            e << "Unable to read DEM file [" << path << "]: does it exist?";
-            throw e;
-        }
-        file >> hf;
-        file.close();
+        loadDEM(hf, path);
         ts[demLOD].createFromRaster(hf);
 #if FORCE_CACHE_WRITE
         ts[demLOD].ensureStudied();
@@ -633,6 +641,124 @@ void TApp::loadSourceFiles(TerrainSample & ts) {
         INCA_INFO("Loaded terrain type map " << path)
     }
 }
+// Fingerprint the source DEM & terrain type map files for a LOD. Hashing a
+// full-sized DEM isn't free, and the same DEM is the source for every LOD of
+// a sample (and is unchanged from one run to the next), so we remember the
+// hash of each file, in memory and in a file in the cache directory, until
+// its size, modification time or inode changes. The hashing itself is done
+// without holding the lock, so that several samples may be fingerprinted at
+// once.
+std::uint64_t TApp::sourceFingerprint(const std::string & basename,
+                                      TerrainLOD lod) {
+    std::string filenames[] = {
+        elevationMapFilename(basename,   bestAvailableElevationMapLOD(basename, lod)),
+        terrainTypeMapFilename(basename, bestAvailableTerrainTypeMapLOD(basename, lod)),
+    };
+
+    ContentHash hash;
+    for (IndexType i = 0; i < 2; ++i) {
+        const std::string & filename = filenames[i];
+
+        // A missing file hashes differently from any existing one
+        struct stat st;
+        if (stat(filename.c_str(), &st) != 0) {
+            hash(std::uint8_t(0));
+            continue;
+        }
+        SourceHash current;
+        current.size     = st.st_size;
+        current.modified = st.st_mtime;
+        current.inode    = st.st_ino;
+
+        // See if we've already hashed this version of the file...
+        bool known = false;
+        {
+            std::lock_guard<std::mutex> lock(_sourceHashMutex);
+            if (! _sourceHashesLoaded)
+                _loadSourceHashes();
+            std::map<std::string, SourceHash>::const_iterator it
+                = _sourceHashes.find(filename);
+            if (it != _sourceHashes.end() && it->second.valid
+                    && it->second.size     == current.size
+                    && it->second.modified == current.modified
+                    && it->second.inode    == current.inode) {
+                current.value = it->second.value;
+                known = true;
+            }
+        }
+
+        // ...and if not, hash it and remember it
+        if (! known) {
+            INCA_INFO("Fingerprinting source file " << filename)
+            current.value = hashFile(filename);
+            current.valid = true;
+
+            std::lock_guard<std::mutex> lock(_sourceHashMutex);
+            _sourceHashes[filename] = current;
+            _storeSourceHashes();
+        }
+        hash(std::uint8_t(1));
+        hash(current.value);
+    }
+    return hash.value();
+}
+
+// Where remembered source file fingerprints are kept between runs
+std::string TApp::sourceHashFilename() const {
+    return cacheDirectory() + "source-fingerprints";
+}
+
+// Read the remembered fingerprints (one file per line: hash, size,
+// modification time, inode, then the filename, which may contain spaces).
+// A missing or damaged file just means re-hashing.
+void TApp::_loadSourceHashes() {
+    _sourceHashesLoaded = true;
+    std::ifstream file(sourceHashFilename().c_str());
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::istringstream ss(line);
+        SourceHash sh;
+        std::string filename;
+        ss >> std::hex >> sh.value >> std::dec >> sh.size >> sh.modified
+           >> sh.inode;
+        if (! ss || ! std::getline(ss >> std::ws, filename) || filename.empty())
+            continue;
+        sh.valid = true;
+        _sourceHashes[filename] = sh;
+    }
+}
+
+// Write them all back out. This is written to a temporary file, then
+// renamed over the old one, so that a reader never sees half a file.
+void TApp::_storeSourceHashes() {
+    std::string filename = sourceHashFilename(),
+                temporary = filename + ".tmp";
+    {
+        std::ofstream file(temporary.c_str());
+        file << "# Terrainosaurus source file fingerprints\n"
+             << "# hash size modification-time inode filename\n";
+        std::map<std::string, SourceHash>::const_iterator it;
+        for (it = _sourceHashes.begin(); it != _sourceHashes.end(); ++it)
+            if (it->second.valid)
+                file << std::hex << it->second.value << std::dec << ' '
+                     << it->second.size << ' ' << it->second.modified << ' '
+                     << it->second.inode << ' ' << it->first << '\n';
+        if (! file) {
+            INCA_WARNING("Unable to write source fingerprints to ["
+                         << temporary << "]: they will be re-calculated next time")
+            std::remove(temporary.c_str());
+            return;
+        }
+    }
+    if (std::rename(temporary.c_str(), filename.c_str()) != 0) {
+        INCA_WARNING("Unable to replace source fingerprint file ["
+                     << filename << "]: they will be re-calculated next time")
+        std::remove(temporary.c_str());
+    }
+}
+
 void TApp::loadAnalysisCache(TerrainSample::LOD & tsl) {
     INCA_INFO("[" << tsl.name() << "]: trying to load cache")
 
@@ -644,23 +770,14 @@ void TApp::loadAnalysisCache(TerrainSample::LOD & tsl) {
         throw e;
     }
 
-    // Find the source DEM/map files for the TS, and the cache for this LOD
+    // Find the cache for this LOD
     TerrainLOD cacheLOD = tsl.levelOfDetail();
-    TerrainLOD demLOD   = bestAvailableElevationMapLOD(basename, cacheLOD);
-	TerrainLOD mapLOD   = bestAvailableTerrainTypeMapLOD(basename, cacheLOD);
     std::string cacheFilename = analysisCacheFilename(basename,  cacheLOD);
-	std::string demFilename   = elevationMapFilename(basename,   demLOD);
-	std::string mapFilename   = terrainTypeMapFilename(basename, mapLOD);
-    
-    // Check each file's existence & timestamp
-    struct stat demStat, mapStat, cacheStat;
-    int ds = stat(demFilename.c_str(),   &demStat);
-    int ms = stat(mapFilename.c_str(),   &mapStat);
-    int cs = stat(cacheFilename.c_str(), &cacheStat);
     
     std::string reason;
     bool cacheValid = true;
     bool cacheExpired = false;
+    AnalysisCachePtr cache;
 
 #if DISABLE_CACHE
     cacheValid = false;
@@ -668,43 +785,54 @@ void TApp::loadAnalysisCache(TerrainSample::LOD & tsl) {
 #endif
     
     // If the cache does not exist, then we can't load it, can we?
-    if (cacheValid && cs != 0) {
+    struct stat cacheStat;
+    if (cacheValid && stat(cacheFilename.c_str(), &cacheStat) != 0) {
         cacheValid   = false;
         cacheExpired = false;
         reason = "cache file '" + cacheFilename + "' does not exist";
     }
 
-    // If the cache exists, but one of the other files is newer, then we
-    // delete it and act as though it had never been
-    if (cacheValid && (ds == 0) && (demStat.st_mtime > cacheStat.st_mtime)) {
+    // Map the file, rather than reading it. The rasters will be paged in
+    // as they're needed (which, for many LODs, will be never). An old (or
+    // corrupt) cache is as good as no cache at all.
+    if (cacheValid) {
+        try {
+            cache = AnalysisCache::open(cacheFilename);
+        } catch (FileFormatException & e) {
+            INCA_DEBUG("Cache open failed: " << e)
+            cacheValid   = false;
+            cacheExpired = true;
+            reason = "cache file is an old format, or corrupt";
+        }
+    }
+
+    // If the cache was calculated from different source data, or with
+    // different analysis parameters, then we delete it and act as though it
+    // had never been. File timestamps don't enter into it: touching (or
+    // copying) a source file doesn't invalidate anything.
+    if (cacheValid && cache->parameterHash()
+                        != TerrainSample::LOD::analysisFingerprint(cacheLOD)) {
         cacheValid   = false;
         cacheExpired = true;
-        reason = "elevation map is newer than cache";
+        reason = "analysis parameters have changed since cache was created";
     }
-    if (cacheValid && (ms == 0) && (mapStat.st_mtime > cacheStat.st_mtime)) {
+    if (cacheValid && cache->sourceHash()
+                        != sourceFingerprint(basename, cacheLOD)) {
         cacheValid   = false;
         cacheExpired = true;
-        reason = "terrain type map is newer than cache";
+        reason = "source files have changed since cache was created";
     }
 
     // Delete the cache file if it's too old
     if (cacheExpired) {
         INCA_INFO("[" << tsl.name() << "]: Deleting expired cache")
+        cache.reset();
         unlink(cacheFilename.c_str());
     }
     
     // Load the cache file, if we've got it, and scream bloody murder if not
     if (cacheValid) {
-        std::ifstream file(cacheFilename.c_str(), std::ios::binary);
-        file.exceptions(std::ios::badbit | std::ios::eofbit);
-        if (! file) {
-            FileAccessException e(cacheFilename);
-            e << "Unable to read TerrainSample::LOD cache file ["
-              << cacheFilename << "]: does it exist?";
-            throw e;
-        }
-        file >> tsl;
-        file.close();
+        attachAnalysisCache(tsl, cache);
         INCA_INFO("[" << tsl.name() << "]: cache load successful")
 
     } else {
@@ -737,8 +865,10 @@ void TApp::storeAnalysisCache(const TerrainSample::LOD & tsl) {
         throw e;
     }
 
-    // Write the TerrainSample::LOD out to the file
-    file << tsl;
+    // Write the TerrainSample::LOD out to the file, stamped with the
+    // fingerprint of the files it came from
+    writeAnalysisCache(file, tsl, sourceFingerprint(basename,
+                                                    tsl.levelOfDetail()));
     file.close();
 
     INCA_INFO("[" << tsl.name() << "]: cache store successful")
@@ -758,6 +888,7 @@ private:
 
     enum class PropertyID {
         CacheDirectory,
+        WorkerThreads,
 
         BoundaryGAPopulationSize,
         BoundaryGAEvolutionCycles,
@@ -822,6 +953,12 @@ public:
         SetProperty<PropertyID::CacheDirectory>(*ctx, ctx->path()->getText(), &TApp::setCacheDirectory);
     }
 
+    void enterWorkerThreadsAssignment(ConfigParser::WorkerThreadsAssignmentContext * /*ctx*/) override { }
+    void exitWorkerThreadsAssignment(ConfigParser::WorkerThreadsAssignmentContext * ctx) override {
+        assert(_currentSection == Section::Application);
+        SetProperty<PropertyID::WorkerThreads>(*ctx, ctx->value, &TApp::setWorkerThreads);
+    }
+
     void enterPopulationSizeAssignment(ConfigParser::PopulationSizeAssignmentContext * /*ctx*/) override { }
     void exitPopulationSizeAssignment(ConfigParser::PopulationSizeAssignmentContext * ctx) override {
         assert(_currentSection == Section::BoundaryGA || _currentSection == Section::HeightfieldGA);
@@ -959,6 +1096,7 @@ void TApp::loadConfigFile(const std::string & path) {
     INCA_INFO("[" << path << "]: loading configuration settings")
 
     setCacheDirectory(CACHE_DIR);
+    setWorkerThreads(0);
 
     setBoundaryGAPopulationSize(60);
     setBoundaryGAEvolutionCycles(20);
@@ -1050,6 +1188,7 @@ TerrainLibraryPtr TApp::lastTerrainLibrary() { return _lastTerrainLibrary; }
 #define HF_XO_W         3
 #define BDR_POP_SZ      4
 #define BDR_EVO_CYCLES  5
+#define WORKER_THREADS  6
 
 // Scalar properties
 #define HF_SEL_R        0
@@ -1074,6 +1213,8 @@ TerrainLibraryPtr TApp::lastTerrainLibrary() { return _lastTerrainLibrary; }
 const std::string & TApp::defaultDataDirectory() const { return _defaultDataDirectory; }
 const std::string & TApp::cacheDirectory() const { return _stringProperties[CACHE_DIR_PATH]; }
 void TApp::setCacheDirectory(const std::string & d) { _stringProperties[CACHE_DIR_PATH] = d; }
+int TApp::workerThreads() const { return _integerProperties[WORKER_THREADS]; }
+void TApp::setWorkerThreads(int n) { _integerProperties[WORKER_THREADS] = n; }
 
 // Heightfield GA settings
 int TApp::heightfieldGAPopulationSize() const { return _integerProperties[HF_POP_SZ]; }
@@ -1122,8 +1263,3 @@ void TApp::setBoundaryGAMutationRatio(scalar_t s) { _scalarProperties[BDR_MUT_R]
 void TApp::setBoundaryGACrossoverProbability(scalar_t s) { _scalarProperties[BDR_XO_P] = s; }
 void TApp::setBoundaryGACrossoverRatio(scalar_t s) { _scalarProperties[BDR_XO_R] = s; }
 void TApp::setBoundaryGAMaxAbsoluteAngle(scalar_t s) { _scalarProperties[BDR_A_A] = s; }
-
-
-// This macro expands to a main() function that instantiates the application
-// and launches it
-APPLICATION_MAIN(terrainosaurus::TerrainosaurusApplication);
@@ -45,8 +45,11 @@ namespace terrainosaurus {
 #include <terrainosaurus/data/TerrainSample.hpp>
 
 
-// Import container definitions
+// Import container & synchronization definitions
 #include <vector>
+#include <map>
+#include <mutex>
+#include <cstdint>
 
 // define this to enable an alternate application mode, for analyzing the
 // terrain library
@@ -145,6 +148,8 @@ public:
 
     void loadAnalysisCache(TerrainSample::LOD & tsl);
     void storeAnalysisCache(const TerrainSample::LOD & tsl);
+    std::uint64_t sourceFingerprint(const std::string & basename,
+                                    TerrainLOD lod);
 
     void loadConfigFile(const std::string & path);
     void storeCofigFile(const std::string & path) const;
@@ -155,6 +160,26 @@ protected:
     // HACK
     TerrainLibraryPtr _lastTerrainLibrary;
 
+    // Remembered source file fingerprints, keyed by filename. These are
+    // kept from one run to the next in a file in the cache directory, and
+    // a remembered fingerprint is used only if the file's size,
+    // modification time and inode are the same as when it was hashed.
+    struct SourceHash {
+        SourceHash() : valid(false) { }
+        bool            valid;
+        std::uint64_t   value;
+        std::int64_t    size;
+        std::int64_t    modified;
+        std::uint64_t   inode;
+    };
+    std::string sourceHashFilename() const;
+    void _loadSourceHashes();       // These expect _sourceHashMutex locked
+    void _storeSourceHashes();
+
+    std::map<std::string, SourceHash>   _sourceHashes;
+    bool                                _sourceHashesLoaded;
+    std::mutex                          _sourceHashMutex;
+
 
 /*---------------------------------------------------------------------------*
  | Configuration settings functions
@@ -164,6 +189,8 @@ public:
     const std::string & defaultDataDirectory() const;
     const std::string & cacheDirectory() const;
     void setCacheDirectory(const std::string & d);
+    int workerThreads() const;
+    void setWorkerThreads(int n);
     
     // Heightfield GA settings
     int heightfieldGAPopulationSize() const;
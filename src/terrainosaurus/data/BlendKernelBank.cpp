@@ -0,0 +1,142 @@
+/*
+ * File: BlendKernelBank.cpp
+ *
+ * Author: Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes.
+ *
+ * Description:
+ */
+
+// Include precompiled header
+#include <terrainosaurus/precomp.h>
+
+// Import class definitions
+#include "BlendKernelBank.hpp"
+
+// Import math & memory functions
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+using namespace terrainosaurus;
+
+
+/*---------------------------------------------------------------------------*
+ | BlendKernel implementation
+ *---------------------------------------------------------------------------*/
+namespace {
+    // Number of floats per alignment boundary
+    const SizeType floatsPerBlock = BlendKernel::alignment / sizeof(float);
+
+    // Round 'n' floats up to a whole number of alignment blocks
+    SizeType padded(SizeType n) {
+        return (n + floatsPerBlock - 1) / floatsPerBlock * floatsPerBlock;
+    }
+}
+
+BlendKernel::BlendKernel(const BlendKernel & k)
+        : _size(0), _stride(0), _weights(NULL), _profile(NULL) {
+    *this = k;
+}
+
+BlendKernel & BlendKernel::operator=(const BlendKernel & k) {
+    if (this != &k) {
+        std::vector<float> weights, profile;
+        if (k._weights)
+            for (IndexType j = 0; j < IndexType(k._size); ++j)
+                weights.insert(weights.end(), k._weights + j * k._stride,
+                               k._weights + j * k._stride + k._size);
+        if (k._profile)
+            profile.assign(k._profile, k._profile + k._size);
+        set(k._size, weights, profile);
+    }
+    return *this;
+}
+
+void BlendKernel::set(SizeType size, const std::vector<float> & weights,
+                      const std::vector<float> & profile) {
+    _size   = size;
+    _stride = padded(size);
+    _storage.assign(floatsPerBlock + _stride * size + padded(profile.size()), 0.0f);
+    _align();
+
+    // Fill in the aligned copies, a row at a time...
+    if (! weights.empty())
+        for (IndexType j = 0; j < IndexType(size); ++j)
+            std::copy(weights.begin() + j * size, weights.begin() + (j + 1) * size,
+                      _weights + j * _stride);
+    if (! profile.empty())
+        std::copy(profile.begin(), profile.end(), _profile);
+    else
+        _profile = NULL;
+
+    // ...and the raster version
+    _image.setSizes(size, size);
+    for (IndexType j = 0; j < IndexType(size); ++j)
+        for (IndexType i = 0; i < IndexType(size); ++i)
+            _image(i, j) = weight(i, j);
+}
+
+void BlendKernel::_align() {
+    // Skip ahead to the first aligned float in the storage buffer
+    std::uintptr_t address = reinterpret_cast<std::uintptr_t>(&_storage[0]);
+    SizeType skip = ((alignment - address % alignment) % alignment) / sizeof(float);
+    _weights = &_storage[0] + skip;
+    _profile = _weights + _stride * _size;
+}
+
+
+/*---------------------------------------------------------------------------*
+ | BlendKernelBank implementation
+ *---------------------------------------------------------------------------*/
+// C++ guarantees that a local static is initialized exactly once, even if
+// several threads get here simultaneously (e.g., from parallel fitness
+// evaluation), so no further locking is needed.
+const BlendKernelBank & BlendKernelBank::instance() {
+    static const BlendKernelBank bank;
+    return bank;
+}
+
+// Build every kernel, for every LOD
+BlendKernelBank::BlendKernelBank() {
+    for (IndexType s = 0; s < ShapeCount; ++s)
+        _kernels[s].resize(TerrainLOD::maximum() + 1);
+
+    for (TerrainLOD lod = TerrainLOD::minimum(); lod <= TerrainLOD::maximum(); ++lod) {
+        SizeType size    = windowSize(lod);
+        IndexType center = IndexType(size / 2);
+        double radius    = double(size) / 2;
+        double sigma     = blendFalloffRadius(lod);
+        std::vector<float> gaussian(size * size), spherical(size * size),
+                           cone(size * size), exponential(size * size),
+                           profile(size);
+
+        // The gaussian is centered one cell before 'center' (as it always
+        // has been), and scaled to be 1 at 'center'. Since it's separable,
+        // we build it from its 1D profile.
+        for (IndexType i = 0; i < IndexType(size); ++i) {
+            double d = double(i - (center - 1));
+            profile[i] = float(std::exp(-(d * d - 1) / (2 * sigma * sigma)));
+        }
+
+        for (IndexType j = 0; j < IndexType(size); ++j)
+            for (IndexType i = 0; i < IndexType(size); ++i) {
+                IndexType k = j * size + i;
+                double dx = double(center - i),
+                       dy = double(center - j),
+                       r2 = dx * dx + dy * dy,
+                       r  = std::sqrt(r2);
+                gaussian[k]    = profile[i] * profile[j];
+                spherical[k]   = float(std::sqrt(std::max(0.0, radius * radius - r2)) / radius);
+                cone[k]        = float(std::max(0.0, 1 - r / radius));
+                exponential[k] = float(std::exp(-r / sigma));
+            }
+
+        _kernels[Gaussian][lod].set(size, gaussian, profile);
+        _kernels[Spherical][lod].set(size, spherical);
+        _kernels[Cone][lod].set(size, cone);
+        _kernels[Exponential][lod].set(size, exponential);
+    }
+}
@@ -0,0 +1,149 @@
+/** -*- C++ -*-
+ *
+ * \file    BlendKernelBank.hpp
+ *
+ * \author  Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes only.
+ *
+ * Description:
+ *      The BlendKernelBank class holds the pixel blending masks (kernels)
+ *      used to splat terrain patches into a heightfield, for every mask
+ *      shape and every LOD. All of them are built together, exactly once, the
+ *      first time the bank is used (the application asks for it at startup),
+ *      and are immutable thereafter, so they may be read from any number of
+ *      threads without locking.
+ *
+ *      Each kernel is a square of windowSize(lod) cells, centered on cell
+ *      (windowSize / 2, windowSize / 2), and is available in two forms:
+ *          * as a GrayscaleImage, for use with the raster operators
+ *          * as a flat array of weights (dimension 0 varying fastest),
+ *            for use by hand-written loops. Each row starts on a cache line
+ *            (the rows are padded out to a whole number of lines), so a loop
+ *            that starts at the beginning of a row may use aligned loads.
+ *      Kernels whose shape is the product of a horizontal and a vertical
+ *      profile (currently, only the gaussian) also provide that 1D profile,
+ *      so that the kernel can be applied as two 1D passes.
+ *
+ *      The shapes are:
+ *          Gaussian        exp(-r^2 / 2 s^2), s = blendFalloffRadius(lod)
+ *          Spherical       sqrt(R^2 - r^2) / R, R = windowSize(lod) / 2
+ *          Cone            1 - r / R
+ *          Exponential     exp(-r / s)
+ *      where r is the distance from the center. Each is scaled so that its
+ *      value at the center cell is 1. (For historical reasons, the gaussian
+ *      actually peaks one cell before the center, in each dimension.)
+ */
+
+#ifndef TERRAINOSAURUS_DATA_BLEND_KERNEL_BANK
+#define TERRAINOSAURUS_DATA_BLEND_KERNEL_BANK
+
+// Import library configuration
+#include <terrainosaurus/terrainosaurus-common.h>
+
+// Import LOD definitions
+#include "TerrainLOD.hpp"
+
+// Import container definitions
+#include <vector>
+
+// This is part of the Terrainosaurus terrain generation engine
+namespace terrainosaurus {
+    // Forward declarations
+    class BlendKernel;
+    class BlendKernelBank;
+};
+
+
+class terrainosaurus::BlendKernel {
+/*---------------------------------------------------------------------------*
+ | Type & constant definitions
+ *---------------------------------------------------------------------------*/
+public:
+    // Weights are aligned to this many bytes
+    static const SizeType alignment = 64;
+
+
+/*---------------------------------------------------------------------------*
+ | Constructors & accessors
+ *---------------------------------------------------------------------------*/
+public:
+    // Default constructor (an empty kernel)
+    explicit BlendKernel()
+        : _size(0), _stride(0), _weights(NULL), _profile(NULL) { }
+
+    // Copy constructor & assignment (the aligned pointers must be fixed up)
+    BlendKernel(const BlendKernel & k);
+    BlendKernel & operator=(const BlendKernel & k);
+
+    // Build a kernel of 'size' x 'size' cells from its weights (dimension 0
+    // varying fastest), and its 1D profile, if it is separable
+    void set(SizeType size, const std::vector<float> & weights,
+             const std::vector<float> & profile = std::vector<float>());
+
+    // Width (and height) of the kernel, in cells
+    SizeType size() const { return _size; }
+
+    // The kernel as a raster
+    const GrayscaleImage & image() const { return _image; }
+
+    // Aligned weights, size() rows of size() each, dimension 0 varying
+    // fastest. Row j starts at weights() + j * stride(), which is aligned.
+    float const * weights() const { return _weights; }
+    SizeType stride() const { return _stride; }
+    float weight(IndexType i, IndexType j) const { return _weights[j * _stride + i]; }
+
+    // Whether weight(i, j) == profile()[i] * profile()[j], and if so, the
+    // (aligned) profile
+    bool separable() const { return _profile != NULL; }
+    float const * profile() const { return _profile; }
+
+protected:
+    // Point _weights & _profile at aligned locations within _storage
+    void _align();
+
+    SizeType            _size, _stride;
+    GrayscaleImage      _image;
+    std::vector<float>  _storage;   // Weights, then profile, plus padding
+    float *             _weights;
+    float *             _profile;
+};
+
+
+class terrainosaurus::BlendKernelBank {
+/*---------------------------------------------------------------------------*
+ | Type definitions
+ *---------------------------------------------------------------------------*/
+public:
+    // The available mask shapes
+    enum Shape {
+        Gaussian,
+        Spherical,
+        Cone,
+        Exponential,
+        ShapeCount
+    };
+
+
+/*---------------------------------------------------------------------------*
+ | Access to the singleton bank
+ *---------------------------------------------------------------------------*/
+public:
+    // Get the bank, building it if this is the first time anybody asked.
+    // This is safe to call from several threads at once.
+    static const BlendKernelBank & instance();
+
+    // Look up a kernel
+    const BlendKernel & kernel(Shape s, TerrainLOD lod) const {
+        return _kernels[s][lod];
+    }
+
+protected:
+    // Constructor (builds every kernel)
+    explicit BlendKernelBank();
+
+    std::vector<BlendKernel> _kernels[ShapeCount];
+};
+
+#endif
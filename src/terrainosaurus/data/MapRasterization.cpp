@@ -24,13 +24,24 @@ typedef MapRasterization::LOD::DistanceMap  DistanceMap;
 #include <inca/raster/operators/arithmetic>
 #include <inca/raster/operators/clamp>
 #include <inca/raster/operators/resample>
-#include <inca/raster/algorithms/flood_fill>
+#include <inca/raster/algorithms/fill>
 using namespace inca::raster;
 
 
 // Import Timer definition
 #include <inca/util/Timer>
 
+// Import tracing support
+#include <terrainosaurus/util/Trace.hpp>
+
+// Import Map scan-conversion & file loading functions
+#include "rasterize-map.hpp"
+#include "distance-transform.hpp"
+#include "label-regions.hpp"
+#include <terrainosaurus/io/terrainosaurus-iostream.hpp>
+#include <inca/io/FileExceptions.hpp>
+#include <fstream>
+
 /*****************************************************************************
  * LOD specialization for MapRasterization
  *****************************************************************************/
@@ -63,117 +74,74 @@ const TerrainType::LOD & LOD<MapRasterization>::terrainType(IndexType i, IndexTy
 // Copy LOD data from an existing heightfield
 void LOD<MapRasterization>::createFromRaster(const IDMap & ids) {
     _terrainTypeIDs = ids;
-    _loaded   = true;
     _analyzed = false;
+    _loaded   = true;
 }
 
-// Load an LOD from a DEM file
+// Scan-convert a vector Map, covering everything in it
+void LOD<MapRasterization>::createFromMap(const Map & m) {
+    Point2D minimum, maximum;
+    if (! mapBounds(minimum, maximum, m)) {
+        INCA_WARNING("Scan-converting an empty map at " << levelOfDetail()
+                     << "...result is an empty raster")
+        createFromRaster(IDMap(SizeArray(0, 0)));
+        return;
+    }
+    scalar_t cellSize = metersPerSampleForLOD(levelOfDetail());
+    SizeArray sz;
+    for (IndexType d = 0; d < 2; ++d)
+        sz[d] = std::max(SizeType(1),
+                    SizeType(std::ceil((maximum[d] - minimum[d]) / cellSize)));
+    createFromMap(m, minimum, sz);
+}
+
+// Scan-convert the 'sz'-cell region of a vector Map starting at 'origin'
+void LOD<MapRasterization>::createFromMap(const Map & m, const Point2D & origin,
+                                                         const SizeArray & sz) {
+    Timer<float, false> timer;
+    timer.start(true);
+    IDMap ids(sz);
+    rasterizeMap(ids, m, origin, metersPerSampleForLOD(levelOfDetail()));
+    timer.stop();
+    INCA_INFO("Scan-converted map at " << levelOfDetail() << " ("
+              << sz[0] << "x" << sz[1] << ") in " << timer() << " seconds")
+    createFromRaster(ids);
+}
+
+// Load an LOD from a map file
 void LOD<MapRasterization>::loadFromFile(const std::string & filename) {
-    INCA_ERROR("MR::loadFromFile not implemented")
+    std::ifstream file(filename.c_str());
+    if (! file) {
+        inca::io::FileAccessException e(filename);
+        e << "Unable to open map file for reading";
+        throw e;
+    }
+
+    // Read the map (which needs the library to resolve terrain type names)
+    MapPtr m(new Map());
+    m->terrainLibrary = object().terrainLibrary();
+    file >> *m;
+    object().setMap(m);
 
     // Record what we did
-    _loaded   = true;
-    _analyzed = false;
+    createFromMap(*m);
 }
 
 // Generate elevation data by resampling from another LOD
 void LOD<MapRasterization>::resampleFromLOD(TerrainLOD lod) {
     _terrainTypeIDs = resample(object()[lod].terrainTypeIDs(),
                                scaleFactor(lod, levelOfDetail()));
-    _loaded   = true;
     _analyzed = false;
+    _loaded   = true;
 }
 
 
-// This is a rather dumb, brute-force approach to finding the minimum distance to boundaries.
-// It first sweeps across the image along 'dim' in both directions and tracks the distance
-// from boundaries. Then it propagates these values in both directions along the other
-// dimension. The actual minimum distance is found by running this algorithm along each
-// dimension of the image and taking the minimum of all passes.
-template <typename R0, typename R1>
-void sweep(R0 & dist, const R1 & map, IndexType dim) {
-    typedef typename R0::ElementType Distance;
-    typedef typename R1::ElementType IDType;
-    Pixel px;
-    IndexType otherDim = (dim == 1) ? 0 : 1;
-
-    // First, sweep both ways along 'dim', storing the distance
-    for (px[otherDim] = map.base(otherDim); px[otherDim] <= map.extent(otherDim); ++px[otherDim]) {
-        bool haveReferencePoint = false;
-        IDType previousCellID = map(map.base(dim), px[otherDim]);
-        Distance linearDistance = std::numeric_limits<Distance>::max();
-        for (px[dim] = map.base(dim); px[dim] <= map.extent(dim); ++px[dim]) {
-            IDType currentCellID = map(px);
-            if (currentCellID != previousCellID) {
-                previousCellID = currentCellID;
-                haveReferencePoint = true;
-                linearDistance = 0;
-            } else if (haveReferencePoint) {
-                ++linearDistance;
-            }
-            Distance & d = dist(px);
-            d = linearDistance;
-        }
-    }
-    for (px[otherDim] = map.base(otherDim); px[otherDim] <= map.extent(otherDim); ++px[otherDim]) {
-        bool haveReferencePoint = false;
-        IDType previousCellID = map(map.extent(dim), px[otherDim]);
-        Distance linearDistance = std::numeric_limits<Distance>::max();
-        for (px[dim] = map.extent(dim); px[dim] >= map.base(dim); --px[dim]) {
-            IDType currentCellID = map(px);
-            if (currentCellID != previousCellID) {
-                previousCellID = currentCellID;
-                haveReferencePoint = true;
-                linearDistance = 0;
-            } else if (haveReferencePoint) {
-                ++linearDistance;
-            }
-            Distance & d = dist(px);
-            if (linearDistance < d)
-                d = linearDistance;
-        }
-    }
-
-    // Now propagate values along the 'otherDim' for contiguous regions
-    Pixel prev;
-    for (px[otherDim] = map.base(otherDim) + 1; px[otherDim] <= map.extent(otherDim); ++px[otherDim]) {
-        prev[otherDim] = px[otherDim] - 1;
-        prev[dim] = map.base(dim);
-        for (px[dim] = map.base(dim); px[dim] <= map.extent(dim); ++px[dim], ++prev[dim]) {
-            IDType currentCellID = map(px);
-            IDType previousCellID = map(prev);
-            if (currentCellID == previousCellID) {
-                Distance & d = dist(px);
-                Distance p = dist(prev) + 1;
-                if (p < d)
-                    d = p;
-            }
-        }
-    }
-    for (px[otherDim] = map.extent(otherDim) - 1; px[otherDim] >= map.base(otherDim); --px[otherDim]) {
-        prev[otherDim] = px[otherDim] + 1;
-        prev[dim] = map.base(dim);
-        for (px[dim] = map.base(dim); px[dim] <= map.extent(dim); ++px[dim], ++prev[dim]) {
-            IDType currentCellID = map(px);
-            IDType previousCellID = map(prev);
-            if (currentCellID == previousCellID) {
-                Distance & d = dist(px);
-                Distance p = dist(prev) + 1;
-                if (p < d)
-                    d = p;
-            }
-        }
-    }
-}
 void LOD<MapRasterization>::_findBoundaryDistances() {
     if (! _multipleTypes) {
         fill(_boundaryDistances,
              std::numeric_limits<DistanceMap::ElementType>::max());
     } else {
-        DistanceMap tmp(_boundaryDistances.bounds());
-        sweep(tmp, _terrainTypeIDs, 0);
-        sweep(_boundaryDistances, _terrainTypeIDs, 1);
-        _boundaryDistances = min(_boundaryDistances, tmp);
+        boundaryDistanceTransform(_boundaryDistances, _terrainTypeIDs);
     }
 }
 void LOD<MapRasterization>::_findTerrainTypes() {
@@ -198,14 +166,10 @@ void LOD<MapRasterization>::_findTerrainTypes() {
     }
 }
 void LOD<MapRasterization>::_findRegions() {
-    IDType nextRegionID = 1;
-    _regionBounds.clear();
-    _regionSeeds.clear();
-    _regionAreas.clear();
-
     const Region & bounds = _regionIDs.bounds();
-    
-    std::cerr << "Stuff: \n";
+
+#ifdef TERRAINOSAURUS_DUMP_MAPS
+    std::cerr << "Terrain type IDs:\n";
     Pixel px;
     for (px[1] = bounds.base(1); px[1] <= bounds.extent(1); ++px[1]) {
         for (px[0] = bounds.base(0); px[0] <= bounds.extent(0); ++px[0]) {
@@ -214,43 +178,21 @@ void LOD<MapRasterization>::_findRegions() {
         std::cerr << '\n';
     }
     std::cerr << '\n';
+#endif
 
     if (! _multipleTypes) {
         fill(_regionIDs, 1);            // Only one region fills the whole thing
+        _regionBounds.clear();
+        _regionSeeds.clear();
+        _regionAreas.clear();
         _regionBounds.push_back(bounds);
         _regionSeeds.push_back(Pixel(bounds.bases()));
         _regionAreas.push_back(bounds.size());
         INCA_DEBUG("Found only one solid, rectangular region")
 
     } else {
-        fill(_regionIDs, 0);            // Start with no regions marked
-
-        Pixel px;
-        for (px[1] = bounds.base(1); px[1] <= bounds.extent(1); ++px[1]) {
-            for (px[0] = bounds.base(0); px[0] <= bounds.extent(0); ++px[0]) {
-                IDType currentTTID = _terrainTypeIDs(px);
-                if (currentTTID != 0) {
-                    IDType currentRegionID = _regionIDs(px);
-                    if (currentRegionID == 0) { // Hey! We found a new region!
-                        std::pair<Region, SizeType> result =
-                            flood_fill(_regionIDs, px,
-                                       EqualsValue<IDMap>(_terrainTypeIDs, currentTTID),
-                                       constant<IDType, 2>(nextRegionID));
-                        _regionBounds.push_back(result.first);
-                        _regionSeeds.push_back(px);
-                        _regionAreas.push_back(result.second);
-                        INCA_DEBUG("Found region #" << nextRegionID << ": "
-                                   << _regionAreas.back()
-                                   << " pixels, spanning "
-                                   << _regionBounds.back())
-                        if (_regionBounds.back().size() == 0)
-                            INCA_DEBUG("Ack!");
-                        ++nextRegionID;
-                    }
-                }
-            }
-        }
-
+        labelRegions(_regionIDs, _regionBounds, _regionSeeds, _regionAreas,
+                     _terrainTypeIDs);
         INCA_DEBUG("Found " << _regionBounds.size() << " regions")
     }
 }
@@ -264,6 +206,8 @@ void LOD<MapRasterization>::analyze() {
     // Resize all rasters to the correct size
     setSizes(_terrainTypeIDs.sizes());
 
+    TraceSpan span("analyze map", "data");
+    span.setArgument("lod", levelOfDetail());
     Timer<float, false> total, phase;
     total.start();
 
@@ -306,7 +250,7 @@ void LOD<MapRasterization>::analyze() {
 
 
 void LOD<MapRasterization>::ensureLoaded() const {
-    if (! loaded()) {
+    _loadOnce([this]() {
         // First, see if our parent object has a file that it hasn't
         // loaded yet. We might be in that file.
 //        object().ensureFileLoaded();
@@ -332,6 +276,12 @@ void LOD<MapRasterization>::ensureLoaded() const {
                              "Resampling from " << ref << std::endl;
                 const_cast<MapRasterization::LOD *>(this)->resampleFromLOD(ref);
 
+            // If this is the first LOD, and we have the vector Map we came
+            // from, scan-convert it. Later LODs resample this one, so that
+            // every LOD's size is consistent with the others.
+            } else if (map()) {
+                const_cast<MapRasterization::LOD *>(this)->createFromMap(*map());
+
             // If that STILL didn't work...I don't know what to tell you
             } else {
                 std::cerr << "MR::ensureLoaded(" << levelOfDetail() << "): "
@@ -339,11 +289,12 @@ void LOD<MapRasterization>::ensureLoaded() const {
                              "no filename was specified...giving up" << std::endl;
             }
         }
-    }
+    });
 }
 void LOD<MapRasterization>::ensureAnalyzed() const {
-    if (! analyzed())
+    _analyzeOnce([this]() {
         const_cast<MapRasterization::LOD *>(this)->analyze();
+    });
 }
 void LOD<MapRasterization>::ensureStudied() const {
     _studied = true;
@@ -451,15 +402,26 @@ GrayscaleImage LOD<MapRasterization>::regionMask(IDType regionID, int borderWidt
     bounds.expand(borderWidth / 2);                 // Expand to hold fuzzy border
     bounds.clipAgainst(_regionIDs.bounds());        // Keepin' it legal
     INCA_DEBUG("Bounds are " << bounds)
-    GrayscaleImage mask(bounds);
+
+    // Find the signed distance to the edge of this region, looking one cell
+    // beyond the mask so that the edges along its sides are found too
+    Region window = bounds;
+    window.expand(1);
+    window.clipAgainst(_regionIDs.bounds());
+    IDMap ids(window);
     Pixel px;
+    for (px[1] = ids.base(1); px[1] <= ids.extent(1); ++px[1])
+        for (px[0] = ids.base(0); px[0] <= ids.extent(0); ++px[0])
+            ids(px) = _regionIDs(px);
+    DistanceMap distances;
+    signedDistanceTransform(distances, ids, regionID + 1);
+
+    GrayscaleImage mask(bounds);
     float scale = 2.0f / borderWidth;
-    for (px[0] = mask.base(0); px[0] <= mask.extent(0); ++px[0])
-        for (px[1] = mask.base(1); px[1] <= mask.extent(1); ++px[1])
-            if (_regionIDs(px) == regionID + 1) // Inside region
-                mask(px) = 0.5f * std::min(2.0f, 1.0f + _boundaryDistances(px) * scale);
-            else                                // Outside region
-                mask(px) = 0.5f * std::max(0.0f, 1.0f - _boundaryDistances(px) * scale);
+    for (px[1] = mask.base(1); px[1] <= mask.extent(1); ++px[1])
+        for (px[0] = mask.base(0); px[0] <= mask.extent(0); ++px[0])
+            mask(px) = 0.5f * std::max(0.0f, std::min(2.0f,
+                                1.0f + distances(px) * scale));
     return mask;
 }
 
@@ -493,6 +455,11 @@ MapRasterization::MapRasterization(TerrainLibraryPtr tl) {
     setTerrainLibrary(tl);
 }
 
+MapRasterization::MapRasterization(MapPtr m) {
+    setTerrainLibrary(m->terrainLibrary());
+    setMap(m);
+}
+
 
 /*---------------------------------------------------------------------------*
  | Properties
@@ -99,6 +99,9 @@ public:
         createFromRaster(Heightfield(r));
     }
     void createFromRaster(const IDMap & ids);
+    void createFromMap(const Map & m);
+    void createFromMap(const Map & m, const Point2D & origin,
+                                      const SizeArray & sz);
     void loadFromFile(const std::string & filename);
     void resampleFromLOD(TerrainLOD lod);
     void analyze();
@@ -193,8 +196,9 @@ public:
     // Create a MapRasterization
     explicit MapRasterization(TerrainLibraryPtr tl);
 
-    // Create a MapRasterization from a Map
-//    explicit MapRasterization(MapPtr m);
+    // Create a MapRasterization from a Map. Each LOD is scan-converted
+    // from the Map the first time it is needed.
+    explicit MapRasterization(MapPtr m);
 
     // Create a MapRasterization from a raster of IDs representing a
     // particular LOD
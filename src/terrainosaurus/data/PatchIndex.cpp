@@ -0,0 +1,192 @@
+/*
+ * File: PatchIndex.cpp
+ *
+ * Author: Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes.
+ *
+ * Description:
+ */
+
+// Include precompiled header
+#include <terrainosaurus/precomp.h>
+
+// Import class definitions
+#include "PatchIndex.hpp"
+#include "TerrainSample.hpp"
+
+// Import math functions & algorithms
+#include <cmath>
+#include <algorithm>
+
+using namespace terrainosaurus;
+
+
+// Local helper functions
+namespace {
+    typedef std::pair<scalar_t, IndexType> Neighbor;
+
+    // Orders candidates by one of their features
+    struct FeatureLess {
+        explicit FeatureLess(IndexType f) : feature(f) { }
+        bool operator()(const PatchIndex::Candidate & a,
+                        const PatchIndex::Candidate & b) const {
+            return a.features[feature] < b.features[feature];
+        }
+        IndexType feature;
+    };
+}
+
+
+// Default constructor
+PatchIndex::PatchIndex() {
+    for (IndexType f = 0; f < IndexType(featureCount); ++f)
+        _scale[f] = scalar_t(1);
+}
+
+
+// Build the index from scratch
+void PatchIndex::build(const std::vector<LOD<TerrainSample> const *> & samples,
+                       SizeType radius, SizeType spacing) {
+    _candidates.clear();
+    spacing = std::max(spacing, SizeType(1));
+
+    // Measure every candidate patch
+    for (IndexType s = 0; s < IndexType(samples.size()); ++s) {
+        const TerrainSample::LOD & ts = *samples[s];
+        IndexType last0 = IndexType(ts.size(0)) - 1 - IndexType(radius),
+                  last1 = IndexType(ts.size(1)) - 1 - IndexType(radius);
+        Candidate c;
+        c.sample       = s;
+        c.splitFeature = 0;
+        for (c.center[1] = radius; c.center[1] <= last1; c.center[1] += spacing)
+            for (c.center[0] = radius; c.center[0] <= last0; c.center[0] += spacing) {
+                c.features = measure(ts, c.center);
+                _candidates.push_back(c);
+            }
+    }
+    if (_candidates.empty())
+        return;
+
+    // Normalize each feature by its standard deviation
+    for (IndexType f = 0; f < IndexType(featureCount); ++f) {
+        double sum = 0, sumSquares = 0;
+        for (IndexType i = 0; i < IndexType(_candidates.size()); ++i) {
+            double x = _candidates[i].features[f];
+            sum += x;
+            sumSquares += x * x;
+        }
+        double n = double(_candidates.size()),
+               variance = std::max(0.0, sumSquares / n - (sum / n) * (sum / n));
+        _scale[f] = (variance > 0) ? scalar_t(1 / std::sqrt(variance)) : scalar_t(1);
+        for (IndexType i = 0; i < IndexType(_candidates.size()); ++i)
+            _candidates[i].features[f] *= _scale[f];
+    }
+
+    // Arrange them into a k-d tree
+    _build(0, IndexType(_candidates.size()));
+}
+
+void PatchIndex::_build(IndexType first, IndexType last) {
+    if (last - first < 2)
+        return;
+
+    // Split on whichever feature varies the most across this subtree
+    IndexType split = 0;
+    scalar_t widest = -1;
+    for (IndexType f = 0; f < IndexType(featureCount); ++f) {
+        scalar_t lo = _candidates[first].features[f], hi = lo;
+        for (IndexType i = first + 1; i < last; ++i) {
+            lo = std::min(lo, _candidates[i].features[f]);
+            hi = std::max(hi, _candidates[i].features[f]);
+        }
+        if (hi - lo > widest) {
+            widest = hi - lo;
+            split  = f;
+        }
+    }
+
+    // Put the median at the root, with smaller values before it and larger
+    // values after it, then do the same for each half
+    IndexType mid = (first + last) / 2;
+    std::nth_element(_candidates.begin() + first, _candidates.begin() + mid,
+                     _candidates.begin() + last, FeatureLess(split));
+    _candidates[mid].splitFeature = split;
+    _build(first, mid);
+    _build(mid + 1, last);
+}
+
+
+// Measure a patch's characteristics
+PatchIndex::Features PatchIndex::measure(const TerrainSample::LOD & ts,
+                                         const Pixel & px) {
+    Features f;
+    const Vector2D & elevationLimits = ts.localElevationLimits(px);
+    f[0] = ts.localElevationMean(px);
+    f[1] = inca::math::magnitude(ts.localGradientMean(px));
+    f[2] = elevationLimits[1] - elevationLimits[0];
+    f[3] = ts.localSlopeLimits(px)[1];
+    return f;
+}
+
+
+// Find the k nearest candidates
+void PatchIndex::nearest(std::vector<IndexType> & result,
+                         const Features & query, SizeType k) const {
+    result.clear();
+    if (k == 0 || _candidates.empty())
+        return;
+
+    Features q;
+    for (IndexType f = 0; f < IndexType(featureCount); ++f)
+        q[f] = query[f] * _scale[f];
+
+    // 'heap' is a max-heap of the best candidates so far, with the worst of
+    // them at the front
+    std::vector<Neighbor> heap;
+    heap.reserve(k + 1);
+    _search(0, IndexType(_candidates.size()), q, k, heap);
+
+    std::sort_heap(heap.begin(), heap.end());
+    result.reserve(heap.size());
+    for (IndexType i = 0; i < IndexType(heap.size()); ++i)
+        result.push_back(heap[i].second);
+}
+
+void PatchIndex::_search(IndexType first, IndexType last, const Features & q,
+                         SizeType k, std::vector<Neighbor> & heap) const {
+    if (first >= last)
+        return;
+
+    // Consider the root of this subtree
+    IndexType mid = (first + last) / 2;
+    const Candidate & c = _candidates[mid];
+    scalar_t d2 = 0;
+    for (IndexType f = 0; f < IndexType(featureCount); ++f) {
+        scalar_t d = q[f] - c.features[f];
+        d2 += d * d;
+    }
+    Neighbor n(d2, mid);
+    if (heap.size() < k) {
+        heap.push_back(n);
+        std::push_heap(heap.begin(), heap.end());
+    } else if (n < heap.front()) {
+        std::pop_heap(heap.begin(), heap.end());
+        heap.back() = n;
+        std::push_heap(heap.begin(), heap.end());
+    }
+
+    // Search the side of the split containing the query first, then the
+    // other side, if anything there could be closer than what we have
+    scalar_t diff = q[c.splitFeature] - c.features[c.splitFeature];
+    if (diff < 0) {
+        _search(first, mid, q, k, heap);
+        if (heap.size() < k || diff * diff <= heap.front().first)
+            _search(mid + 1, last, q, k, heap);
+    } else {
+        _search(mid + 1, last, q, k, heap);
+        if (heap.size() < k || diff * diff <= heap.front().first)
+            _search(first, mid, q, k, heap);
+    }
+}
@@ -0,0 +1,136 @@
+/** -*- C++ -*-
+ *
+ * \file    PatchIndex.hpp
+ *
+ * \author  Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes only.
+ *
+ * Description:
+ *      The PatchIndex class is a spatial index over the candidate source
+ *      patches of a set of TerrainSample LODs (generally, those belonging to
+ *      one TerrainType at one LOD), allowing the GA to find patches whose
+ *      local characteristics resemble those of some location in the pattern
+ *      heightfield, rather than picking patches blindly.
+ *
+ *      Each candidate patch is described by a feature vector, calculated
+ *      from the windowed ("studied") properties of its TerrainSample at the
+ *      patch's center:
+ *          0. local elevation mean
+ *          1. local gradient mean magnitude
+ *          2. local elevation range
+ *          3. local maximum slope
+ *      The gradient's direction is not used, since genes may be rotated to
+ *      match any direction. Each feature is normalized by its standard
+ *      deviation across all the candidates, so that each contributes equally
+ *      to the distance between two patches.
+ *
+ *      Candidate centers are laid out on a regular grid (every 'spacing'
+ *      cells), covering the part of each sample far enough from the edges
+ *      that a whole patch fits.
+ *
+ * Implementation notes:
+ *      The index is a k-d tree, stored implicitly in a single array: the
+ *      root of the (sub)tree covering [first, last) is the median element,
+ *      at (first + last) / 2, with the lower half of the range to its left
+ *      and the upper half to its right. Each node splits on the feature
+ *      having the greatest spread within its subtree. There are no
+ *      pointers, and a query touches only the candidates array.
+ *
+ *      The index is immutable once built, so it may be queried from any
+ *      number of threads at once.
+ */
+
+#ifndef TERRAINOSAURUS_DATA_PATCH_INDEX
+#define TERRAINOSAURUS_DATA_PATCH_INDEX
+
+// Import library configuration
+#include <terrainosaurus/terrainosaurus-common.h>
+
+// Import LOD template declaration
+#include "TerrainLOD.hpp"
+
+// This is part of the Terrainosaurus terrain generation engine
+namespace terrainosaurus {
+    // Forward declarations
+    class PatchIndex;
+    class TerrainSample;
+};
+
+// Import container definitions
+#include <vector>
+#include <utility>
+
+
+class terrainosaurus::PatchIndex {
+/*---------------------------------------------------------------------------*
+ | Type & constant definitions
+ *---------------------------------------------------------------------------*/
+public:
+    // Number of features describing each patch
+    static const SizeType featureCount = 4;
+
+    // The characteristics of a single patch
+    struct Features {
+        scalar_t f[featureCount];
+        scalar_t   operator[](IndexType i) const { return f[i]; }
+        scalar_t & operator[](IndexType i)       { return f[i]; }
+    };
+
+    // A candidate patch: which sample, and where within it
+    struct Candidate {
+        IndexType   sample;         // Index into the list of samples
+        Pixel       center;         // Center of the patch
+        Features    features;       // (Normalized) characteristics
+        IndexType   splitFeature;   // k-d tree split dimension at this node
+    };
+
+
+/*---------------------------------------------------------------------------*
+ | Constructor & index construction
+ *---------------------------------------------------------------------------*/
+public:
+    // Default constructor (an empty index)
+    explicit PatchIndex();
+
+    // Build the index over the patches of 'samples', each of which must be
+    // studied. Patch centers are placed every 'spacing' cells, and at least
+    // 'radius' cells from the edge of each sample.
+    void build(const std::vector<LOD<TerrainSample> const *> & samples,
+               SizeType radius, SizeType spacing);
+
+    // Measure the characteristics of the patch centered at 'px' in 'ts'
+    // (un-normalized, exactly as stored in the TerrainSample)
+    static Features measure(const LOD<TerrainSample> & ts, const Pixel & px);
+
+
+/*---------------------------------------------------------------------------*
+ | Queries
+ *---------------------------------------------------------------------------*/
+public:
+    // How many candidate patches we have
+    SizeType size() const { return _candidates.size(); }
+    bool empty() const    { return _candidates.empty(); }
+
+    // Access to a candidate
+    const Candidate & candidate(IndexType i) const { return _candidates[i]; }
+
+    // Find the 'k' candidates whose features are closest to 'query' (which
+    // should be un-normalized, as returned by measure()). Their indices are
+    // stored in 'result', nearest first. If there are fewer than 'k'
+    // candidates, all of them are returned.
+    void nearest(std::vector<IndexType> & result, const Features & query,
+                 SizeType k) const;
+
+protected:
+    // Recursively build/search the subtree covering [first, last)
+    void _build(IndexType first, IndexType last);
+    void _search(IndexType first, IndexType last, const Features & q,
+                 SizeType k, std::vector<std::pair<scalar_t, IndexType> > & heap) const;
+
+    std::vector<Candidate>  _candidates;    // The tree, in implicit form
+    Features                _scale;         // Feature normalization factors
+};
+
+#endif
@@ -0,0 +1,158 @@
+/*
+ * File: ResidencyManager.cpp
+ *
+ * Author: Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes.
+ *
+ * Description:
+ */
+
+// Include precompiled header
+#include <terrainosaurus/precomp.h>
+
+// Import class definition
+#include "ResidencyManager.hpp"
+
+// Import algorithms
+#include <algorithm>
+
+using namespace terrainosaurus;
+typedef ResidencyManager::Resident  Resident;
+typedef ResidencyManager::ByteCount ByteCount;
+
+
+// The application-wide manager
+ResidencyManager & ResidencyManager::instance() {
+    static ResidencyManager manager;
+    return manager;
+}
+
+// The current epoch (see the implementation notes in the header)
+std::atomic<std::uint64_t> ResidencyManager::_epoch(1);
+
+
+// Constructor
+ResidencyManager::ResidencyManager()
+    : _budget(0), _residentBytes(0), _evictions(0), _reloads(0),
+      _evictedBytes(0), _reloadedBytes(0) { }
+
+
+/*---------------------------------------------------------------------------*
+ | Memory budget
+ *---------------------------------------------------------------------------*/
+void ResidencyManager::setBudget(SizeType bytes) {
+    _budget.store(bytes, std::memory_order_relaxed);
+    enforceBudget();
+}
+
+void ResidencyManager::enforceBudget() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _enforceBudget();
+}
+
+void ResidencyManager::_enforceBudget() {
+    // Start a new epoch, so that we can tell what gets used from here on
+    std::uint64_t now = _epoch.fetch_add(1, std::memory_order_relaxed);
+
+    ByteCount limit = ByteCount(budget());
+    if (limit == 0 || _residentBytes <= limit)
+        return;
+
+    // Anything used since we last did this is likely still being used, so
+    // it stays. Everything else goes, oldest first, until we're under budget.
+    std::vector<Resident *> order;
+    order.reserve(_residents.size());
+    for (IndexType i = 0; i < IndexType(_residents.size()); ++i)
+        if (_residents[i]->_lastUse.load(std::memory_order_relaxed) < now
+                && _residents[i]->residentBytes() > 0)
+            order.push_back(_residents[i]);
+    std::sort(order.begin(), order.end(),
+              [](const Resident * a, const Resident * b) {
+        return a->_lastUse.load(std::memory_order_relaxed)
+             < b->_lastUse.load(std::memory_order_relaxed);
+    });
+
+    for (IndexType i = 0; i < IndexType(order.size())
+                          && _residentBytes > limit; ++i) {
+        ByteCount freed = order[i]->_evict();
+        if (freed > 0) {
+            order[i]->_bytes.fetch_sub(freed, std::memory_order_relaxed);
+            _residentBytes -= freed;
+            _evictedBytes  += freed;
+            ++_evictions;
+        }
+    }
+}
+
+
+/*---------------------------------------------------------------------------*
+ | Residents
+ *---------------------------------------------------------------------------*/
+void ResidencyManager::add(Resident * r, ByteCount bytes) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    r->touch();
+    r->_bytes.store(bytes, std::memory_order_relaxed);
+    _residents.push_back(r);
+    _residentBytes += bytes;
+    _enforceBudget();
+}
+
+void ResidencyManager::remove(Resident * r) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::vector<Resident *>::iterator it = std::find(_residents.begin(),
+                                                     _residents.end(), r);
+    if (it != _residents.end()) {
+        *it = _residents.back();
+        _residents.pop_back();
+        _residentBytes -= r->residentBytes();
+    }
+}
+
+void ResidencyManager::charge(Resident * r, ByteCount bytes, bool reloaded) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    r->touch();
+    r->_bytes.fetch_add(bytes, std::memory_order_relaxed);
+    _residentBytes += bytes;
+    if (reloaded) {
+        _reloadedBytes += bytes;
+        ++_reloads;
+    }
+    _enforceBudget();
+}
+
+
+/*---------------------------------------------------------------------------*
+ | Counters
+ *---------------------------------------------------------------------------*/
+ByteCount ResidencyManager::residentBytes() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _residentBytes;
+}
+SizeType ResidencyManager::residentCount() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _residents.size();
+}
+SizeType ResidencyManager::evictionCount() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _evictions;
+}
+ByteCount ResidencyManager::evictedBytes() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _evictedBytes;
+}
+SizeType ResidencyManager::reloadCount() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _reloads;
+}
+ByteCount ResidencyManager::reloadedBytes() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _reloadedBytes;
+}
+
+void ResidencyManager::resetCounters() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _evictions = _reloads = 0;
+    _evictedBytes = _reloadedBytes = 0;
+}
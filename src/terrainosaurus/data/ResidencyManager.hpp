@@ -0,0 +1,211 @@
+/** -*- C++ -*-
+ *
+ * \file    ResidencyManager.hpp
+ *
+ * \author  Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes only.
+ *
+ * Description:
+ *      The ResidencyManager class keeps the memory used by TerrainSample LOD
+ *      rasters within a budget. A TerrainSample::LOD that has been loaded
+ *      from (or stored to) a memory-mapped analysis cache file can always get
+ *      its rasters back from that file, so when the total size of such
+ *      rasters goes over budget, the least-recently-used LODs are asked to
+ *      give theirs up. The next time one of those rasters is asked for, it is
+ *      paged back in from the file, just as it was the first time.
+ *
+ *      Only the bulky, derived rasters (the gradient and the windowed
+ *      properties) are ever given up. The elevations (which nearly everything
+ *      needs, if only for the size of the LOD), the statistics, features and
+ *      frequency spectrum always stay put. LODs that have no cache file
+ *      (e.g., the ones the GA is working on) are not managed at all.
+ *
+ *      By default, there is no budget, and nothing is ever evicted.
+ *
+ *      The manager counts how many bytes are resident, and how often (and
+ *      how much) it has evicted and reloaded, so that the budget can be
+ *      tuned.
+ *
+ *      The contract for code using a managed LOD is:
+ *          * Evicting a raster invalidates every reference into it, and
+ *            every CellIterator over its LOD. Every accessor of an evictable
+ *            raster hands out such a reference, including the per-cell ones
+ *            (e.g., localElevationMean(i, j)).
+ *          * The budget is enforced whenever any managed LOD is added or
+ *            pages a raster in, which may happen on any thread, at any time.
+ *          * So an LOD must be pinned (see ResidencyPins, below) for as long
+ *            as anything is using its evictable rasters. Pinned LODs are
+ *            never evicted.
+ *          * Accessing an unpinned LOD's evictable rasters is not an error,
+ *            but since there's then no telling when the reference will be
+ *            let go of, that LOD is "held" (with a warning) and is never
+ *            evicted again. Unpinned access is thus always safe, but it
+ *            takes that LOD out of the budget.
+ *
+ * Implementation notes:
+ *      Pinned and held LODs are never evicted, nor are those used since the
+ *      budget was last enforced.
+ *
+ *      Rather than keeping a list in LRU order (which would have to be
+ *      updated on every access, from every thread), each Resident is stamped
+ *      with the current "epoch" when it is used, and the manager starts a new
+ *      epoch each time it enforces the budget (i.e., whenever anything is
+ *      paged in). Eviction goes oldest-stamp first.
+ *
+ *      Byte counts are signed, since a raster may be evicted in the moment
+ *      between its being paged in and the manager hearing about it.
+ */
+
+#ifndef TERRAINOSAURUS_DATA_RESIDENCY_MANAGER
+#define TERRAINOSAURUS_DATA_RESIDENCY_MANAGER
+
+// Import library configuration
+#include <terrainosaurus/terrainosaurus-common.h>
+
+// Import container & threading definitions
+#include <cstdint>
+#include <vector>
+#include <atomic>
+#include <mutex>
+
+// This is part of the Terrainosaurus terrain generation engine
+namespace terrainosaurus {
+    // Forward declarations
+    class ResidencyManager;
+    template <class T> class ResidencyPins;
+};
+
+
+class terrainosaurus::ResidencyManager {
+/*---------------------------------------------------------------------------*
+ | Type definitions
+ *---------------------------------------------------------------------------*/
+public:
+    typedef std::int64_t ByteCount;
+
+    // Something holding memory that it can give back on request
+    class Resident {
+    friend class ResidencyManager;
+    public:
+        explicit Resident() : _bytes(0), _lastUse(0) { }
+        virtual ~Resident() { }
+
+        // Record that this was just used
+        void touch() const {
+            std::uint64_t now = _epoch.load(std::memory_order_relaxed);
+            if (_lastUse.load(std::memory_order_relaxed) != now)
+                _lastUse.store(now, std::memory_order_relaxed);
+        }
+
+        // How much memory the manager thinks this is using
+        ByteCount residentBytes() const {
+            return _bytes.load(std::memory_order_relaxed);
+        }
+
+    protected:
+        // Give back whatever can be given back (nothing, if it's pinned),
+        // returning how many bytes that was. This is called with the
+        // manager's lock held, so it must not call back into the manager.
+        virtual ByteCount _evict() = 0;
+
+        std::atomic<ByteCount>              _bytes;
+        mutable std::atomic<std::uint64_t>  _lastUse;
+    };
+
+
+/*---------------------------------------------------------------------------*
+ | Access to the application-wide manager
+ *---------------------------------------------------------------------------*/
+public:
+    static ResidencyManager & instance();
+
+
+/*---------------------------------------------------------------------------*
+ | Constructor
+ *---------------------------------------------------------------------------*/
+public:
+    explicit ResidencyManager();
+
+
+/*---------------------------------------------------------------------------*
+ | Memory budget
+ *---------------------------------------------------------------------------*/
+public:
+    // How many bytes of managed rasters may be resident (zero for no limit).
+    // Only LODs loaded (or stored) after a budget is set are managed, so it
+    // should be set at startup.
+    SizeType budget() const { return _budget.load(std::memory_order_relaxed); }
+    void setBudget(SizeType bytes);
+    bool enabled() const { return budget() > 0; }
+
+    // Evict until we're within budget (or until nothing more can go)
+    void enforceBudget();
+
+
+/*---------------------------------------------------------------------------*
+ | Residents
+ *---------------------------------------------------------------------------*/
+public:
+    // Start or stop managing 'r', which is already using 'bytes'
+    void add(Resident * r, ByteCount bytes);
+    void remove(Resident * r);
+
+    // Record that 'r' has grown by 'bytes' (by bringing back something that
+    // was evicted, if 'reloaded' is true), then enforce the budget
+    void charge(Resident * r, ByteCount bytes, bool reloaded);
+
+
+/*---------------------------------------------------------------------------*
+ | Counters
+ *---------------------------------------------------------------------------*/
+public:
+    ByteCount residentBytes() const;        // Managed bytes in memory now
+    SizeType residentCount() const;         // How many LODs are managed
+    SizeType evictionCount() const;         // How many times one was evicted
+    ByteCount evictedBytes() const;         // ...and how much it gave back
+    SizeType reloadCount() const;           // How many rasters came back
+    ByteCount reloadedBytes() const;        // ...and how big they were
+    void resetCounters();
+
+protected:
+    // Evict, with the lock held
+    void _enforceBudget();
+
+    static std::atomic<std::uint64_t> _epoch;   // Current time, for touch()
+
+    std::atomic<SizeType>   _budget;
+    std::vector<Resident *> _residents;
+    ByteCount               _residentBytes;
+    SizeType                _evictions, _reloads;
+    ByteCount               _evictedBytes, _reloadedBytes;
+    mutable std::mutex      _mutex;
+};
+
+
+// Pins a group of LODs (or anything else with pinRasters() and
+// unpinRasters() methods) in memory for as long as it exists
+template <class T>
+class terrainosaurus::ResidencyPins {
+public:
+    explicit ResidencyPins() { }
+    ~ResidencyPins() {
+        for (IndexType i = 0; i < IndexType(_pinned.size()); ++i)
+            _pinned[i]->unpinRasters();
+    }
+
+    void add(const T & t) {
+        t.pinRasters();
+        _pinned.push_back(&t);
+    }
+
+protected:
+    std::vector<T const *> _pinned;
+
+private:
+    ResidencyPins(const ResidencyPins &);
+    ResidencyPins & operator=(const ResidencyPins &);
+};
+
+#endif
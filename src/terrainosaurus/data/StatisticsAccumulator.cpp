@@ -0,0 +1,381 @@
+/*
+ * File: StatisticsAccumulator.cpp
+ *
+ * Author: Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes.
+ *
+ * Description:
+ */
+
+// Include precompiled header
+#include <terrainosaurus/precomp.h>
+
+// Import class definition
+#include "StatisticsAccumulator.hpp"
+
+// Import math functions & algorithms
+#include <cmath>
+#include <algorithm>
+
+using namespace terrainosaurus;
+
+
+// Local helper functions
+namespace {
+    // Binomial coefficients, C(k, j) for k <= 4
+    const double binomial[5][5] = {
+        { 1 }, { 1, 1 }, { 1, 2, 1 }, { 1, 3, 3, 1 }, { 1, 4, 6, 4, 1 }
+    };
+
+    // How wide the bins start out (as a power of two). This is finer than
+    // any difference in elevation we care about, but the bins are widened
+    // as soon as the samples need it.
+    const int startExponent = -16;
+
+    // The narrowest the bins can be for samples as large as 'x', so that
+    // bin indices stay well within range
+    inline int minimumExponent(double x) {
+        return (x == 0.0 || x != x) ? startExponent
+                                    : std::max(startExponent,
+                                               std::ilogb(x) - 40);
+    }
+
+    // floor(i / 2^shift), for negative i as well as positive
+    inline std::int64_t floorShift(std::int64_t i, int shift) {
+        return i >= 0 ? (i >> shift) : -((-i - 1) >> shift) - 1;
+    }
+
+    // How many slots a Statistics object's array has (it may be an inca
+    // Array or a std::vector -- see also terrainosaurus-iostream.cpp)
+    template <typename T, inca::SizeType dim>
+    SizeType slotCount(const inca::Array<T, dim> &) { return dim; }
+    template <typename T>
+    SizeType slotCount(const std::vector<T> & v) { return v.size(); }
+}
+
+
+/*---------------------------------------------------------------------------*
+ | Constructors & accumulation
+ *---------------------------------------------------------------------------*/
+// Default constructor
+StatisticsAccumulator::StatisticsAccumulator() {
+    reset();
+}
+
+// Forget all the samples
+void StatisticsAccumulator::reset() {
+    _count = 0;
+    _min = _max = scalar_t(0);
+    _pivot = 0.0;
+    for (int k = 0; k < 5; ++k)
+        _sums[k] = 0.0;
+    _binExponent = startExponent;
+    _firstBin = 0;
+    _bins.clear();
+}
+
+// Start over from a first sample
+void StatisticsAccumulator::_start(scalar_t x) {
+    reset();
+    _min = _max = x;
+    _pivot = x;
+    _binExponent = minimumExponent(x);
+    _firstBin = std::int64_t(std::floor(std::ldexp(double(x), -_binExponent)))
+              - std::int64_t(binCount / 2);
+    _bins.assign(binCount, 0);
+}
+
+// Widen the bins to cover [lo, hi]
+void StatisticsAccumulator::_fit(scalar_t lo, scalar_t hi, int exponent) {
+    int e = std::max(std::max(_binExponent, exponent),
+                     std::max(minimumExponent(lo), minimumExponent(hi)));
+    std::int64_t first, last;
+    for (;; ++e) {
+        first = std::int64_t(std::floor(std::ldexp(double(lo), -e)));
+        last  = std::int64_t(std::floor(std::ldexp(double(hi), -e)));
+        if (last - first < std::int64_t(binCount))
+            break;
+    }
+
+    // Leave as much room on either side
+    first -= (std::int64_t(binCount) - 1 - (last - first)) / 2;
+    if (e == _binExponent && first == _firstBin)
+        return;
+
+    // Move everything into the new bins
+    std::vector<std::uint32_t> bins(binCount, 0);
+    int shift = e - _binExponent;
+    for (SizeType i = 0; i < binCount; ++i)
+        if (_bins[i] != 0)
+            bins[floorShift(_firstBin + std::int64_t(i), shift) - first]
+                += _bins[i];
+    _bins.swap(bins);
+    _binExponent = e;
+    _firstBin = first;
+}
+
+// Add a single sample
+void StatisticsAccumulator::add(scalar_t x) {
+    add(&x, 1);
+}
+
+// Add a run of samples. This is the inner loop of any statistics gathering.
+void StatisticsAccumulator::add(const scalar_t * samples, SizeType count) {
+    // Start from the first sample that isn't a NaN
+    if (_count == 0) {
+        while (count > 0 && samples[0] != samples[0]) {
+            ++samples;
+            --count;
+        }
+        if (count == 0)
+            return;
+        _start(samples[0]);
+    }
+
+    // First, the power sums & extrema, each lane taking every laneCount'th
+    // sample (and the last few going into the first few lanes)
+    double s1[laneCount], s2[laneCount], s3[laneCount], s4[laneCount];
+    scalar_t lo[laneCount], hi[laneCount];
+    for (SizeType j = 0; j < laneCount; ++j) {
+        s1[j] = s2[j] = s3[j] = s4[j] = 0.0;
+        lo[j] = _min;
+        hi[j] = _max;
+    }
+    const double pivot = _pivot;
+    auto accumulate = [&](SizeType j, scalar_t x) {
+        double d = double(x) - pivot, d2 = d * d;
+        s1[j] += d;
+        s2[j] += d2;
+        s3[j] += d2 * d;
+        s4[j] += d2 * d2;
+        lo[j] = (x < lo[j]) ? x : lo[j];
+        hi[j] = (x > hi[j]) ? x : hi[j];
+    };
+    SizeType whole = count - count % laneCount;
+    for (SizeType i = 0; i < whole; i += laneCount)
+        for (SizeType j = 0; j < laneCount; ++j)
+            accumulate(j, samples[i + j]);
+    for (SizeType j = 0; whole + j < count; ++j)
+        accumulate(j, samples[whole + j]);
+    double sums[5] = { 0.0, 0.0, 0.0, 0.0, 0.0 };
+    scalar_t newMin = _min, newMax = _max;
+    for (SizeType j = 0; j < laneCount; ++j) {
+        sums[1] += s1[j];
+        sums[2] += s2[j];
+        sums[3] += s3[j];
+        sums[4] += s4[j];
+        newMin = std::min(newMin, lo[j]);
+        newMax = std::max(newMax, hi[j]);
+    }
+
+    // A NaN anywhere makes the sums NaN too. That's rare, so rather than
+    // checking each sample, add the stretches between the NaNs separately.
+    if (sums[1] != sums[1]) {
+        SizeType i = 0;
+        while (i < count) {
+            SizeType start = i;
+            while (i < count && samples[i] == samples[i])
+                ++i;
+            if (i > start)
+                add(samples + start, i - start);
+            while (i < count && samples[i] != samples[i])
+                ++i;
+        }
+        return;
+    }
+    _count += count;
+    for (int k = 1; k <= 4; ++k)
+        _sums[k] += sums[k];
+    _min = newMin;
+    _max = newMax;
+
+    // Then count them into the bins, widening the bins first if need be.
+    // Every sample is at or above the start of the first bin, so truncating
+    // its offset from there is the same as rounding down.
+    double scale  = std::ldexp(1.0, -_binExponent),
+           origin = std::ldexp(double(_firstBin), _binExponent);
+    if (_min < origin || (double(_max) - origin) * scale >= double(binCount)) {
+        _fit(_min, _max, _binExponent);
+        scale  = std::ldexp(1.0, -_binExponent);
+        origin = std::ldexp(double(_firstBin), _binExponent);
+    }
+    std::uint32_t * bins = &_bins[0];
+    for (SizeType i = 0; i < count; ++i)
+        ++bins[SizeType((double(samples[i]) - origin) * scale)];
+}
+
+// Take away a sample
+bool StatisticsAccumulator::remove(scalar_t x) {
+    if (x != x || _count == 0)
+        return true;
+    if (x == _min || x == _max)
+        return false;
+
+    double d = x - _pivot, d2 = d * d;
+    _sums[1] -= d;
+    _sums[2] -= d2;
+    _sums[3] -= d2 * d;
+    _sums[4] -= d2 * d2;
+    --_count;
+
+    double bin = std::floor(std::ldexp(double(x), -_binExponent))
+               - double(_firstBin);
+    if (bin >= 0.0 && bin < double(binCount) && _bins[SizeType(bin)] > 0)
+        --_bins[SizeType(bin)];
+    return true;
+}
+
+// Add the samples from another accumulator
+void StatisticsAccumulator::merge(const StatisticsAccumulator & a) {
+    if (a._count == 0)
+        return;
+    if (_count == 0) {
+        *this = a;
+        return;
+    }
+
+    // Move a's power sums over to our pivot:
+    //      sum (x - p)^k = sum_j C(k, j) (q - p)^(k - j) sum (x - q)^j
+    double delta = a._pivot - _pivot;
+    double sums[5] = { double(a._count), a._sums[1], a._sums[2],
+                       a._sums[3], a._sums[4] };
+    for (int k = 1; k <= 4; ++k) {
+        double s = 0.0, power = 1.0;
+        for (int j = k; j >= 0; --j) {
+            s += binomial[k][j] * power * sums[j];
+            power *= delta;
+        }
+        _sums[k] += s;
+    }
+
+    // Line up the bins, and add a's in
+    _fit(std::min(_min, a._min), std::max(_max, a._max), a._binExponent);
+    int shift = _binExponent - a._binExponent;
+    for (SizeType i = 0; i < binCount; ++i)
+        if (a._bins[i] != 0)
+            _bins[floorShift(a._firstBin + std::int64_t(i), shift) - _firstBin]
+                += a._bins[i];
+
+    _count += a._count;
+    _min = std::min(_min, a._min);
+    _max = std::max(_max, a._max);
+}
+
+
+/*---------------------------------------------------------------------------*
+ | Results
+ *---------------------------------------------------------------------------*/
+double StatisticsAccumulator::sum() const {
+    return _count * _pivot + _sums[1];
+}
+double StatisticsAccumulator::mean() const {
+    return _count > 0 ? _pivot + _sums[1] / _count : 0.0;
+}
+
+// The central moments, from the power sums about the pivot:
+//      m_k = 1/n sum_j C(k, j) (p - mean)^(k - j) sum (x - p)^j
+double StatisticsAccumulator::centralMoment(int k) const {
+    if (_count == 0)
+        return 0.0;
+    double n = double(_count), delta = -_sums[1] / n;
+    double sums[5] = { n, _sums[1], _sums[2], _sums[3], _sums[4] };
+    double m = 0.0, power = 1.0;
+    for (int j = k; j >= 0; --j) {
+        m += binomial[k][j] * power * sums[j];
+        power *= delta;
+    }
+    return m / n;
+}
+
+// The unbiased estimators of the cumulants
+double StatisticsAccumulator::kStatistic(int k) const {
+    double n  = double(_count),
+           m2 = centralMoment(2);
+    switch (k) {
+    case 1:     return mean();
+    case 2:     return n * m2 / (n - 1);
+    case 3:     return n * n * centralMoment(3) / ((n - 1) * (n - 2));
+    case 4:     return n * n * ((n + 1) * centralMoment(4)
+                                - 3 * (n - 1) * m2 * m2)
+                     / ((n - 1) * (n - 2) * (n - 3));
+    default:    return 0.0;
+    }
+}
+
+// Split the bins up among equal divisions of [min, max]. A bin that
+// straddles two divisions is split between them in proportion.
+void StatisticsAccumulator::histogram(std::vector<double> & buckets,
+                                      SizeType count) const {
+    buckets.assign(count, 0.0);
+    if (_count == 0 || count == 0)
+        return;
+    double range = double(_max) - _min;
+    if (range <= 0.0) {
+        buckets[0] = 1.0;
+        return;
+    }
+
+    double width = std::ldexp(1.0, _binExponent),
+           scale = count / range;
+    for (SizeType i = 0; i < binCount; ++i) {
+        if (_bins[i] == 0)
+            continue;
+        double start = double(_firstBin + std::int64_t(i)) * width,
+               lo = (std::max(start, double(_min)) - _min) * scale,
+               hi = (std::min(start + width, double(_max)) - _min) * scale,
+               fraction = double(_bins[i]) / _count;
+        if (hi <= lo) {
+            buckets[std::min(count - 1, SizeType(lo))] += fraction;
+            continue;
+        }
+        for (SizeType j = SizeType(lo); lo < hi; ++j) {
+            double end = std::min(hi, double(j + 1));
+            buckets[std::min(count - 1, j)] += fraction * (end - lo)
+                                                        / (hi - lo);
+            lo = end;
+        }
+    }
+}
+
+// Fill in a Statistics object's arrays, just as reading it from the
+// analysis cache does
+void StatisticsAccumulator::store(Stat & s) const {
+    // Have the Statistics object size its arrays, by finishing both of its
+    // passes over no samples
+    s.reset();
+    s.finish();
+    s.finish();
+
+    // The histogram holds the number of samples in each bucket
+    SizeType buckets = slotCount(s.histogram());
+    std::vector<double> fractions;
+    histogram(fractions, buckets);
+    for (SizeType i = 0; i < buckets; ++i)
+        s.histogram()[i] = scalar_t(fractions[i] * _count);
+
+    // The central moments & k-statistics are indexed by their order. We
+    // keep sums up to the fourth power, which is as far as either goes.
+    for (SizeType k = 0; k < slotCount(s.centralMoments()); ++k)
+        s.centralMoments()[k] = scalar_t(k <= 4 ? centralMoment(int(k)) : 0.0);
+    for (SizeType k = 0; k < slotCount(s.kStatistics()); ++k)
+        s.kStatistics()[k] = scalar_t(kStatistic(int(k)));
+
+    // Everything else
+    for (SizeType i = 0; i < slotCount(s.miscellaneous()); ++i) {
+        double value;
+        switch (i) {
+        case SumSlot:       value = sum();              break;
+        case MinSlot:       value = _min;               break;
+        case MaxSlot:       value = _max;               break;
+        case MeanSlot:      value = mean();             break;
+        case VarianceSlot:  value = centralMoment(2);   break;
+        default:            value = 0.0;                break;
+        }
+        s.miscellaneous()[i] = scalar_t(value);
+    }
+
+    s.sampleSize() = _count;
+    s.validate();
+}
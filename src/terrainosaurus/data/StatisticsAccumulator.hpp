@@ -0,0 +1,166 @@
+/** -*- C++ -*-
+ *
+ * \file    StatisticsAccumulator.hpp
+ *
+ * \author  Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes only.
+ *
+ * Description:
+ *      The StatisticsAccumulator class gathers the statistics of a set of
+ *      samples in a single pass, keeping only a fixed amount of state: the
+ *      count, the extrema, the power sums up to the fourth, and a histogram
+ *      of a fixed number of bins. Unlike an inca Statistics object (which
+ *      has to see every sample twice, since the second pass needs the range
+ *      and mean from the first), it can be fed from anywhere, in any order:
+ *          * one row (or any other run of samples) at a time
+ *          * in pieces, on separate threads, that are merged afterwards
+ *          * incrementally, by removing the old value of a sample and
+ *            adding the new one
+ *      Once everything has been added, store() fills in a Statistics object
+ *      as though it had run over the samples itself, since that is what
+ *      everything downstream (the DistributionMatchers, the analysis cache,
+ *      etc.) works with. NaNs are ignored.
+ *
+ * Implementation notes:
+ *      The power sums are of the distance from a pivot (the first sample
+ *      added), in double precision, so that the central moments don't lose
+ *      everything to cancellation. When accumulators are merged, the sums of
+ *      the one being merged in are moved to the other's pivot by binomial
+ *      expansion. add() makes two sweeps over each run of samples: one for
+ *      the sums & extrema, kept in several independent lanes so that the
+ *      compiler can vectorize it, and one to count the samples into the
+ *      histogram bins. Neither has a branch per sample. A NaN shows up as a
+ *      NaN sum at the end of the first sweep, in which case the run is
+ *      added again in pieces, between the NaNs.
+ *
+ *      The histogram's bins are a power of two wide, and start at a multiple
+ *      of their width, so bins from any two accumulators line up once the
+ *      finer one is coarsened to match. Bins start out very narrow, and
+ *      whenever a run of samples falls outside them, their width is doubled
+ *      (merging pairs of bins) until it fits. Thus, unless the samples are
+ *      all within a tiny fraction of a meter of each other, they cover at
+ *      least half of the bins. A Statistics object's histogram spans exactly
+ *      the range of the samples, so its buckets are made up from the bins,
+ *      splitting the bins that straddle two buckets in proportion. This is
+ *      the one approximate result: a bucket may be off by a fraction of the
+ *      samples in a single bin.
+ *
+ *      Removing a sample can't bring back the extremum it might have been,
+ *      so remove() returns false when it takes away the minimum or maximum,
+ *      after which the caller must start over.
+ *
+ *      store() fills in the Statistics object's arrays in the order the
+ *      Statistics class keeps them (the same arrays the analysis cache reads
+ *      and writes in terrainosaurus-iostream.cpp), then has it validate()
+ *      them, just as reading it from the cache does. The arrays are sized by
+ *      having the Statistics object finish both passes over no samples.
+ *      src/test/statistics_accumulator.cpp checks the results against the
+ *      Statistics object's own two passes.
+ */
+
+#ifndef TERRAINOSAURUS_DATA_STATISTICS_ACCUMULATOR
+#define TERRAINOSAURUS_DATA_STATISTICS_ACCUMULATOR
+
+// Import library configuration
+#include <terrainosaurus/terrainosaurus-common.h>
+
+// This is part of the Terrainosaurus terrain generation engine
+namespace terrainosaurus {
+    // Forward declarations
+    class StatisticsAccumulator;
+};
+
+// Import Statistics definition
+#include <inca/math/statistics/Statistics>
+
+// Import container definitions
+#include <vector>
+#include <cstdint>
+
+
+class terrainosaurus::StatisticsAccumulator {
+/*---------------------------------------------------------------------------*
+ | Type & constant definitions
+ *---------------------------------------------------------------------------*/
+public:
+    typedef inca::math::Statistics<scalar_t>    Stat;
+
+    // How many bins the histogram has
+    static const SizeType binCount = 2048;
+
+    // How many independent lanes the sums are kept in
+    static const SizeType laneCount = 8;
+
+    // The order of the quantities in a Statistics object's miscellaneous()
+    // array. The central moments and k-statistics are indexed by their order.
+    enum MiscellaneousSlot {
+        SumSlot, MinSlot, MaxSlot, MeanSlot, VarianceSlot,
+        MiscellaneousSlotCount
+    };
+
+
+/*---------------------------------------------------------------------------*
+ | Constructors & accumulation
+ *---------------------------------------------------------------------------*/
+public:
+    // Default constructor (no samples)
+    explicit StatisticsAccumulator();
+
+    // Forget all the samples
+    void reset();
+
+    // Add one sample, or 'count' contiguous samples
+    void add(scalar_t x);
+    void add(const scalar_t * samples, SizeType count);
+
+    // Take away a sample that was added before. This returns false if it
+    // was the minimum or maximum, after which the accumulator must be reset
+    // and the remaining samples added again.
+    bool remove(scalar_t x);
+
+    // Add all of the samples that 'a' has
+    void merge(const StatisticsAccumulator & a);
+
+
+/*---------------------------------------------------------------------------*
+ | Results
+ *---------------------------------------------------------------------------*/
+public:
+    SizeType count() const { return _count; }
+    scalar_t min() const   { return _min; }
+    scalar_t max() const   { return _max; }
+    double sum() const;
+    double mean() const;
+
+    // The k'th central moment & k-statistic (0 <= k <= 4)
+    double centralMoment(int k) const;
+    double kStatistic(int k) const;
+
+    // The fraction of the samples falling into each of 'count' equal
+    // divisions of [min, max]
+    void histogram(std::vector<double> & buckets, SizeType count) const;
+
+    // Fill in 's' with the statistics of these samples
+    void store(Stat & s) const;
+
+protected:
+    // Start over from the sample 'x'
+    void _start(scalar_t x);
+
+    // Widen the bins until [lo, hi] fits, and they are at least
+    // 2^'exponent' wide
+    void _fit(scalar_t lo, scalar_t hi, int exponent);
+
+    SizeType            _count;
+    scalar_t            _min, _max;
+    double              _pivot;         // The power sums are about this
+    double              _sums[5];       // Sum of (x - pivot)^k
+    int                 _binExponent;   // Bins are 2^_binExponent wide...
+    std::int64_t        _firstBin;      // ...and the first is this many
+                                        // widths from zero
+    std::vector<std::uint32_t> _bins;
+};
+
+#endif
@@ -16,12 +16,9 @@
 #include "TerrainLOD.hpp"
 using namespace terrainosaurus;
 
-// Import raster operators
-#include <inca/raster/generators/gaussian>
-#include <inca/raster/operators/select>
-#include <inca/raster/operators/arithmetic>
+// Import blending mask definitions
+#include "BlendKernelBank.hpp"
 using namespace inca::math;
-using namespace inca::raster;
 
 
 // Spatial resolution for a terrain LOD
@@ -85,54 +82,18 @@ DifferenceType terrainosaurus::blendPatchSpacing(TerrainLOD lod) {
     return DifferenceType(windowSize(lod) * (1 - blendOverlapRatio(lod)));
 }
 
-//#include <inca/raster/operators/statistic>
-
-// Pixel blending masks
+// Pixel blending masks. These all come from the kernel bank, which builds
+// them exactly once and may be used from multiple threads at once (e.g., by
+// parallel fitness evaluation).
 const GrayscaleImage & terrainosaurus::gaussianMask(TerrainLOD lod) {
-    // Only create these the first time
-    static bool initialized = false;
-    static std::vector<GrayscaleImage> masks(TerrainLOD::maximum() + 1);
-    if (! initialized) {
-        typedef inca::Array<scalar_t, 2> ScalarArray;
-        for (TerrainLOD tl = TerrainLOD::minimum(); tl <= TerrainLOD::maximum(); ++tl) {
-            SizeType winSize = windowSize(tl);
-            masks[tl] = select(gaussian(ScalarArray(blendFalloffRadius(lod)),
-                                        ScalarArray(scalar_t(winSize) / 2 - 1)),
-                               inca::Array<SizeType, 2>(winSize));
-            masks[tl] /= masks[tl](winSize / 2, winSize / 2);
-        }
-    }
-
-    return masks[lod];
+    return BlendKernelBank::instance().kernel(BlendKernelBank::Gaussian, lod).image();
 }
 const GrayscaleImage & terrainosaurus::sphericalMask(TerrainLOD lod) {
-    // Only create these the first time
-    static bool initialized = false;
-    static std::vector<GrayscaleImage> masks(TerrainLOD::maximum() + 1);
-    if (! initialized) {
-        typedef inca::Array<scalar_t, 2> ScalarArray;
-        for (TerrainLOD tl = TerrainLOD::minimum(); tl <= TerrainLOD::maximum(); ++tl) {
-            GrayscaleImage & m = masks[tl];
-            SizeType winSize = windowSize(tl);
-            m.setSizes(winSize, winSize);
-            scalar_t radius = scalar_t(winSize) / 2;
-            Pixel px;
-            for (px[0] = 0; px[0] < winSize; ++px[0])
-                for (px[1] = 0; px[1] < winSize; ++px[1]) {
-                    Dimension d(winSize / 2 - px[0], winSize / 2 - px[1]);
-                    m(px) = std::max(scalar_t(0),
-                                     scalar_t(std::sqrt(radius*radius - d[0]*d[0] - d[1]*d[1])) / radius);
-                }
-        }
-    }
-
-    return masks[lod];
+    return BlendKernelBank::instance().kernel(BlendKernelBank::Spherical, lod).image();
 }
 const GrayscaleImage & terrainosaurus::coneMask(TerrainLOD lod) {
-    static GrayscaleImage img;
-    return img;
+    return BlendKernelBank::instance().kernel(BlendKernelBank::Cone, lod).image();
 }
 const GrayscaleImage & terrainosaurus::exponentialMask(TerrainLOD lod) {
-    static GrayscaleImage img;
-    return img;
+    return BlendKernelBank::instance().kernel(BlendKernelBank::Exponential, lod).image();
 }
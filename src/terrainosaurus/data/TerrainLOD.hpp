@@ -50,6 +50,10 @@
 // Import upgraded enumeration type
 #include <inca/util/Enumeration.hpp>
 
+// Import threading primitives
+#include <atomic>
+#include <mutex>
+
 
 // This is part of the Terrainosaurus terrain generation engine
 namespace terrainosaurus {
@@ -100,6 +104,23 @@ namespace terrainosaurus {
 
 
     // The LOD view base class template
+    //
+    // Each LOD moves through the states unloaded -> loaded -> analyzed ->
+    // studied, lazily, as its data are asked for. Each transition is made
+    // (at most) once, by whichever thread first needs it; any other thread
+    // needing it in the meantime blocks until it is finished. Loading an LOD
+    // may involve other LODs of the same object (e.g., resampling from a
+    // neighboring LOD, or reloading the object's source files), so loading is
+    // serialized across the whole multi-rez object. Analysis and study
+    // involve only the LOD itself (once loaded), so different LODs may be
+    // analyzed and studied concurrently.
+    //
+    // The locks are recursive, so a transition may freely call ensure*() on
+    // its own LOD (analyze() calling ensureLoaded(), say). A transition
+    // should not, however, wait on work that might itself be waiting on that
+    // transition (see WorkerPool.hpp for why waiting on a TaskGroup may do
+    // this), which is why the GA loads everything up front, in dependency
+    // order, rather than letting the worker threads discover it.
     template <typename T>
     class LODBase {
     public:
@@ -107,6 +128,8 @@ namespace terrainosaurus {
         typedef T                               ObjectType;
         typedef shared_ptr<ObjectType const>    ObjectConstPtr;
         typedef shared_ptr<ObjectType>          ObjectPtr;
+        typedef std::recursive_mutex            StateMutex;
+        typedef std::lock_guard<StateMutex>     StateLock;
 
         // Default (no-init) constructor
         explicit LODBase()
@@ -118,6 +141,21 @@ namespace terrainosaurus {
             : _object(obj), _levelOfDetail(lod),
               _loaded(false), _analyzed(false), _studied(false) { }
 
+        // Copying an LOD view copies what it refers to and how far along it
+        // is, but not its lock, which belongs to the original
+        LODBase(const LODBase & l)
+            : _object(l._object), _levelOfDetail(l._levelOfDetail),
+              _loaded(l.loaded()), _analyzed(l.analyzed()),
+              _studied(l.studied()) { }
+        LODBase & operator=(const LODBase & l) {
+            _object        = l._object;
+            _levelOfDetail = l._levelOfDetail;
+            _loaded        = l.loaded();
+            _analyzed      = l.analyzed();
+            _studied       = l.studied();
+            return *this;
+        }
+
         // Parent object accessors
               ObjectType & object()       { return *_object; }
         const ObjectType & object() const { return *_object; }
@@ -138,9 +176,40 @@ namespace terrainosaurus {
         virtual void ensureStudied()  const = 0;
 
     protected:
+        // Make a lazy state transition, once only: if it hasn't happened yet,
+        // run 'step' (which must set the corresponding flag if it succeeds)
+        // while holding the lock for that transition. If another thread is
+        // already doing it, we wait for it to finish, then find that there's
+        // nothing left to do.
+        template <typename Step>
+        void _loadOnce(Step step) const {
+            if (! _loaded) {
+                StateLock lock(_object->loadMutex());
+                if (! _loaded)
+                    step();
+            }
+        }
+        template <typename Step>
+        void _analyzeOnce(Step step) const {
+            if (! _analyzed) {
+                StateLock lock(_stateMutex);
+                if (! _analyzed)
+                    step();
+            }
+        }
+        template <typename Step>
+        void _studyOnce(Step step) const {
+            if (! _studied) {
+                StateLock lock(_stateMutex);
+                if (! _studied)
+                    step();
+            }
+        }
+
         TerrainLOD  _levelOfDetail;
         ObjectPtr   _object;
-        mutable bool _loaded, _analyzed, _studied;
+        mutable std::atomic<bool>   _loaded, _analyzed, _studied;
+        mutable StateMutex          _stateMutex;    // Guards analysis & study
     };
 
     // The actual LOD template, which must be specialized for different object
@@ -157,20 +226,20 @@ namespace terrainosaurus {
         static const int lodCount = TerrainLOD::count;
 
         // Constructor
-        explicit MultiResolutionObject() : initialized(false) { }
+        explicit MultiResolutionObject() { }
 
         // LOD accessors
         LOD & operator[](TerrainLOD lod) {
-            if (! initialized)
-                initialize();
+            std::call_once(_initialized, [this]() { initialize(); });
             return _lods[lod];
         }
         const LOD & operator[](TerrainLOD lod) const {
-            if (! initialized)
-                const_cast<MultiResolutionObject<TP>*>(this)->initialize();
-            return _lods[lod];
+            return const_cast<MultiResolutionObject<TP> &>(*this)[lod];
         }
 
+        // The lock serializing the loading of this object's LODs
+        std::recursive_mutex & loadMutex() const { return _loadMutex; }
+
         // LOD search functions
         TerrainLOD nearestLoadedLODAbove(TerrainLOD lod) const {
             do {
@@ -229,11 +298,11 @@ namespace terrainosaurus {
                 _lods[lod].setLevelOfDetail(lod);
                 _lods[lod].setObject(this->shared_from_this());
             }
-            initialized = true;
         }
 
-        bool initialized;
-        inca::Array<LOD, lodCount> _lods;
+        std::once_flag                  _initialized;
+        mutable std::recursive_mutex    _loadMutex;
+        inca::Array<LOD, lodCount>      _lods;
     };
 
 
@@ -374,27 +374,29 @@ void TLL::analyze() {
 
 
 void TLL::ensureLoaded() const {
-    if (! loaded()) {
+    _loadOnce([this]() {
         for (IndexType i = 0; i < size(); ++i)
             terrainType(i).ensureLoaded();
         _loaded = true;
-    }
+    });
 }
 void TLL::ensureAnalyzed() const {
-    if (! analyzed()) {
+    _analyzeOnce([this]() {
 //        ensureLoaded();
 //        for (IndexType i = 0; i < size(); ++i)
 //            terrainType(i).ensureAnalyzed();
         const_cast<TLL *>(this)->analyze();
-    }
+    });
 }
 void TLL::ensureStudied() const {
-    if (! studied()) {
+    // The library must be analyzed before we go studying its TerrainTypes,
+    // which (being analyzed themselves) will need the library's analysis
+    ensureAnalyzed();
+    _studyOnce([this]() {
         for (IndexType i = 0; i < size(); ++i)
             terrainType(i).ensureStudied();
-        ensureAnalyzed();
         _studied = true;
-    }
+    });
 }
 
 
@@ -0,0 +1,307 @@
+/*
+ * File: TerrainPrefetcher.cpp
+ *
+ * Author: Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes.
+ *
+ * Description:
+ */
+
+// Include precompiled header
+#include <terrainosaurus/precomp.h>
+
+// Import class definition
+#include "TerrainPrefetcher.hpp"
+
+// Import thread pool
+#include <terrainosaurus/util/WorkerPool.hpp>
+
+// Import string formatting & algorithms
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+using namespace terrainosaurus;
+
+
+// Local helper functions
+namespace {
+    // How expensive each stage is, relative to loading. These needn't be
+    // accurate: they just keep the ETA from lurching about too much as we
+    // go from loading to analysis.
+    float stageCost(int stage) {
+        static const float costs[] = { 1.0f, 4.0f, 2.0f, 0.5f };
+        return costs[stage];
+    }
+
+    // How much bigger an LOD is than the coarsest one
+    float lodSize(TerrainLOD lod) {
+        scalar_t s = scaleFactor(TerrainLOD::minimum(), lod);
+        return float(s * s);
+    }
+
+    // Write a duration in seconds as [h:]mm:ss
+    void writeDuration(std::ostream & os, float seconds) {
+        long s = long(seconds + 0.5f);
+        char fill = os.fill('0');
+        if (s >= 3600)
+            os << s / 3600 << ':' << std::setw(2) << (s / 60) % 60;
+        else
+            os << s / 60;
+        os << ':' << std::setw(2) << s % 60;
+        os.fill(fill);
+    }
+}
+
+
+// Constructor
+TerrainPrefetcher::TerrainPrefetcher()
+    : _pool(NULL), _inFlight(0), _finished(0), _reported(0),
+      _totalWeight(0.0f), _doneWeight(0.0f) { }
+
+
+/*---------------------------------------------------------------------------*
+ | Describing what to fetch
+ *---------------------------------------------------------------------------*/
+void TerrainPrefetcher::addTerrainLibrary(TerrainLibraryConstPtr tl,
+                                          TerrainLOD startLOD,
+                                          TerrainLOD endLOD) {
+    for (IndexType i = 0; i < IndexType(tl->size()); ++i)
+        addTerrainType(tl->terrainType(i), startLOD, endLOD);
+}
+
+void TerrainPrefetcher::addTerrainType(TerrainTypeConstPtr tt,
+                                       TerrainLOD startLOD,
+                                       TerrainLOD endLOD) {
+    _types.push_back(tt);
+
+    // Work from fine to coarse, so that each coarser LOD (if it has to be
+    // resampled) comes after the finer one it's resampled from
+    for (TerrainLOD lod = endLOD; lod >= startLOD; --lod) {
+        const TerrainType::LOD & ttl = (*tt)[lod];
+        std::ostringstream ttName;
+        ttName << ttl.name() << '[' << lod << ']';
+        IndexType studyType = _task(StudyType, ttl, ttName.str());
+
+        for (IndexType i = 0; i < IndexType(ttl.size()); ++i) {
+            const TerrainSample::LOD & tsl = ttl.terrainSample(i);
+            IndexType load    = _task(Load,    tsl, tsl.name()),
+                      analyze = _task(Analyze, tsl, tsl.name()),
+                      study   = _task(Study,   tsl, tsl.name());
+            _depend(analyze, load);
+            _depend(study, analyze);
+            _depend(studyType, study);
+            if (lod < endLOD)
+                _depend(load, _task(Load, (*tsl.getObject())[lod + 1],
+                                    (*tsl.getObject())[lod + 1].name()));
+        }
+    }
+}
+
+// Find (or add) the task for doing 'stage' to 'lod'
+template <class LODType>
+IndexType TerrainPrefetcher::_task(Stage stage, const LODType & lod,
+                                   const std::string & name) {
+    TaskKey key(&lod, stage);
+    TaskMap::const_iterator it = _taskIndex.find(key);
+    if (it != _taskIndex.end())
+        return it->second;
+
+    static const char * verbs[] = { "load", "analyze", "study", "study" };
+    Task t;
+    t.stage       = stage;
+    t.description = std::string(verbs[stage]) + ' ' + name;
+    t.weight      = stageCost(stage) * lodSize(lod.levelOfDetail());
+    t.unmet       = 0;
+    LODType const * l = &lod;
+    switch (stage) {
+    case Load:
+        t.done = [l]() { return l->loaded(); };
+        t.work = [l]() { l->ensureLoaded(); };
+        break;
+    case Analyze:
+        t.done = [l]() { return l->analyzed(); };
+        t.work = [l]() { l->ensureAnalyzed(); };
+        break;
+    case Study:
+    case StudyType:
+        t.done = [l]() { return l->studied(); };
+        t.work = [l]() { l->ensureStudied(); };
+        break;
+    }
+
+    IndexType index = IndexType(_tasks.size());
+    _tasks.push_back(t);
+    _taskIndex[key] = index;
+    return index;
+}
+
+// Record that 'task' must wait for 'dependency'
+void TerrainPrefetcher::_depend(IndexType task, IndexType dependency) {
+    std::vector<IndexType> & d = _tasks[dependency].dependents;
+    if (std::find(d.begin(), d.end(), task) == d.end()) {
+        d.push_back(task);
+        ++_tasks[task].unmet;
+    }
+}
+
+
+/*---------------------------------------------------------------------------*
+ | Execution
+ *---------------------------------------------------------------------------*/
+void TerrainPrefetcher::run() {
+    run(WorkerPool::instance());
+}
+
+void TerrainPrefetcher::run(WorkerPool & pool) {
+    _pool     = &pool;
+    _caller   = std::this_thread::get_id();
+    _start    = Clock::now();
+    _inFlight = _finished = _reported = 0;
+    _doneWeight = _totalWeight = 0.0f;
+    _error    = std::exception_ptr();
+    for (IndexType t = 0; t < IndexType(_tasks.size()); ++t)
+        _totalWeight += _tasks[t].weight;
+
+    INCA_INFO("Prefetching terrain data: " << _tasks.size() << " tasks on "
+              << pool.workerCount() << " thread(s)")
+
+    // Start everything that doesn't have to wait for anything else
+    std::vector<IndexType> ready;
+    for (IndexType t = 0; t < IndexType(_tasks.size()); ++t)
+        if (_tasks[t].unmet == 0)
+            ready.push_back(t);
+    for (IndexType i = 0; i < IndexType(ready.size()); ++i)
+        _submit(ready[i]);
+
+    // Help out until it's all done, letting the callback know how it's going
+    // as we go along
+    while (true) {
+        _report();
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_inFlight == 0)
+                break;
+        }
+        if (! pool.runPendingTask()) {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _changed.wait_for(lock, std::chrono::milliseconds(100), [this]() {
+                return _inFlight == 0 || (_callback && _finished != _reported);
+            });
+        }
+    }
+    _report();
+
+    INCA_INFO("Prefetching finished: " << _finished << " of " << _tasks.size()
+              << " tasks done in "
+              << std::chrono::duration<float>(Clock::now() - _start).count()
+              << " seconds")
+
+    // Pass along the first error, if there was one
+    std::exception_ptr error;
+    std::swap(error, _error);
+    if (error)
+        std::rethrow_exception(error);
+}
+
+// Hand a task to the pool, and deal with the aftermath when it's done
+void TerrainPrefetcher::_submit(IndexType t) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        ++_inFlight;
+    }
+    _pool->submit([this, t]() {
+        std::exception_ptr error;
+        bool didWork = false;
+        try {
+            if (! _tasks[t].done()) {
+                _tasks[t].work();
+                didWork = true;
+            }
+        } catch (...) {
+            error = std::current_exception();
+        }
+        _finish(t, didWork, error);
+    });
+}
+
+void TerrainPrefetcher::_finish(IndexType t, bool didWork,
+                                std::exception_ptr error) {
+    Task & task = _tasks[t];
+    std::vector<IndexType> ready;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        ++_finished;
+        _lastTask = task.description;
+        if (didWork)    _doneWeight  += task.weight;
+        else            _totalWeight -= task.weight;   // Freebie
+
+        // If this failed, nothing that depends on it can be done
+        if (error) {
+            INCA_ERROR("Prefetching failed to " << task.description)
+            if (! _error)
+                _error = error;
+        } else {
+            for (IndexType i = 0; i < IndexType(task.dependents.size()); ++i)
+                if (--_tasks[task.dependents[i]].unmet == 0)
+                    ready.push_back(task.dependents[i]);
+        }
+    }
+
+    // Start whatever's now unblocked (before we stop being in-flight,
+    // so that run() doesn't think we're done)
+    for (IndexType i = 0; i < IndexType(ready.size()); ++i)
+        _submit(ready[i]);
+    _report();
+
+    // Once we're no longer in-flight, run() may return at any moment, so
+    // this must be the last time we touch anything
+    std::lock_guard<std::mutex> lock(_mutex);
+    --_inFlight;
+    _changed.notify_all();
+}
+
+// Tell the callback how it's going. This does nothing unless we're on the
+// thread that called run(), and there's been some progress since last time.
+void TerrainPrefetcher::_report() {
+    if (! _callback || std::this_thread::get_id() != _caller)
+        return;
+
+    Progress p;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_finished == _reported)
+            return;
+        _reported   = _finished;
+        p.finished  = _finished;
+        p.total     = _tasks.size();
+        p.elapsed   = std::chrono::duration<float>(Clock::now() - _start).count();
+        p.remaining = (_doneWeight > 0.0f)
+                    ? p.elapsed * (_totalWeight - _doneWeight) / _doneWeight
+                    : -1.0f;
+        if (p.finished == p.total)
+            p.remaining = 0.0f;
+        p.task      = _lastTask;
+    }
+    _callback(p);
+}
+
+
+// Progress summary
+std::ostream & terrainosaurus::operator<<(std::ostream & os,
+                                    const TerrainPrefetcher::Progress & p) {
+    os << p.finished << '/' << p.total << " tasks ("
+       << int(100 * p.fraction()) << "%), ";
+    writeDuration(os, p.elapsed);
+    os << " elapsed";
+    if (p.remaining >= 0) {
+        os << ", about ";
+        writeDuration(os, p.remaining);
+        os << " left";
+    }
+    if (! p.task.empty())
+        os << " [" << p.task << ']';
+    return os;
+}
@@ -0,0 +1,197 @@
+/** -*- C++ -*-
+ *
+ * \file    TerrainPrefetcher.hpp
+ *
+ * \author  Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes only.
+ *
+ * Description:
+ *      The TerrainPrefetcher class gets the terrain library data needed for
+ *      some piece of work (usually a run of the HeightfieldGA) loaded,
+ *      analyzed and studied up front, using every worker thread, rather than
+ *      leaving it to be lazily loaded one TerrainSample at a time.
+ *
+ *      The caller says which TerrainTypes (or whole TerrainLibrary) will be
+ *      needed, and over what range of LODs. The prefetcher then discovers
+ *      every TerrainSample x TerrainLOD pair involved, and builds a graph
+ *      of tasks, each of which depends on the ones before it:
+ *          load        the sample LOD, from its analysis cache if it has a
+ *                      current one, or else by resampling the next finer
+ *                      LOD (which is loaded first), or else from the
+ *                      original source files
+ *          analyze     the sample LOD
+ *          study       the sample LOD (which also stores its analysis
+ *                      cache, for next time)
+ *          study type  the TerrainType LOD, once all its samples are studied
+ *      Each task is handed to the WorkerPool as soon as everything it depends
+ *      on is finished. Tasks whose work has already been done (e.g., by an
+ *      earlier run) finish immediately.
+ *
+ *      As tasks finish, the prefetcher reports its progress (and an estimate
+ *      of the time remaining) to an optional callback, which is always
+ *      called on the thread that called run(), so that a GUI may safely
+ *      update itself from it.
+ *
+ * Implementation notes:
+ *      Tasks on the same sample are serialized anyway (see the notes on
+ *      LODBase in TerrainLOD.hpp), so the parallelism comes from working on
+ *      many samples at once. Since no task starts until its dependencies
+ *      are done, no task ever waits for work happening in another, which
+ *      is what makes it safe to run them as pool tasks.
+ *
+ *      The time remaining is estimated from the time taken so far, with
+ *      each task weighted by the (relative) number of cells at its LOD.
+ *      Tasks that turn out to have nothing to do (e.g., analyzing an LOD
+ *      whose analysis came from its cache) are dropped from the estimate.
+ */
+
+#ifndef TERRAINOSAURUS_DATA_TERRAIN_PREFETCHER
+#define TERRAINOSAURUS_DATA_TERRAIN_PREFETCHER
+
+// Import library configuration
+#include <terrainosaurus/terrainosaurus-common.h>
+
+// This is part of the Terrainosaurus terrain generation engine
+namespace terrainosaurus {
+    // Forward declarations
+    class TerrainPrefetcher;
+    class WorkerPool;
+};
+
+// Import data class definitions
+#include "TerrainLibrary.hpp"
+#include "TerrainType.hpp"
+
+// Import container, threading & time definitions
+#include <string>
+#include <iosfwd>
+#include <vector>
+#include <map>
+#include <functional>
+#include <exception>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+
+
+class terrainosaurus::TerrainPrefetcher {
+/*---------------------------------------------------------------------------*
+ | Type definitions
+ *---------------------------------------------------------------------------*/
+public:
+    // A snapshot of how far along we are
+    struct Progress {
+        SizeType    finished,       // How many tasks are done
+                    total;          // How many tasks there are in all
+        float       elapsed,        // Seconds since run() started
+                    remaining;      // Estimated seconds to go (< 0 if unknown)
+        std::string task;           // The most recently finished task
+
+        // What fraction of the work is done, in [0, 1]
+        float fraction() const {
+            return total > 0 ? float(finished) / float(total) : 1.0f;
+        }
+    };
+
+    typedef std::function<void (const Progress &)> ProgressCallback;
+
+
+/*---------------------------------------------------------------------------*
+ | Constructor
+ *---------------------------------------------------------------------------*/
+public:
+    explicit TerrainPrefetcher();
+
+
+/*---------------------------------------------------------------------------*
+ | Describing what to fetch
+ *---------------------------------------------------------------------------*/
+public:
+    // Fetch every TerrainType in the library, for LODs in [startLOD, endLOD]
+    void addTerrainLibrary(TerrainLibraryConstPtr tl,
+                           TerrainLOD startLOD, TerrainLOD endLOD);
+
+    // Fetch one TerrainType (and all its samples) for LODs in
+    // [startLOD, endLOD]. Adding the same thing twice does no harm.
+    void addTerrainType(TerrainTypeConstPtr tt,
+                        TerrainLOD startLOD, TerrainLOD endLOD);
+
+    // How many tasks there are to do
+    SizeType taskCount() const { return _tasks.size(); }
+
+    // The function to call as tasks finish
+    void setProgressCallback(const ProgressCallback & cb) { _callback = cb; }
+
+
+/*---------------------------------------------------------------------------*
+ | Execution
+ *---------------------------------------------------------------------------*/
+public:
+    // Do all the tasks, returning when they're all finished. If any task
+    // throws, the tasks depending on it are skipped, and the first such
+    // exception is rethrown here once everything else is done. A prefetcher
+    // may only be run once.
+    void run(WorkerPool & pool);
+    void run();
+
+protected:
+    enum Stage { Load, Analyze, Study, StudyType };
+
+    struct Task {
+        Stage                       stage;
+        std::string                 description;
+        float                       weight;         // Relative cost
+        std::function<bool ()>      done;           // Already done?
+        std::function<void ()>      work;           // Do it
+        SizeType                    unmet;          // Unfinished dependencies
+        std::vector<IndexType>      dependents;     // Who's waiting on us
+    };
+
+    // Find (or add) the task for doing 'stage' to 'lod'
+    template <class LODType>
+    IndexType _task(Stage stage, const LODType & lod,
+                    const std::string & name);
+
+    // Record that 'task' must wait for 'dependency'
+    void _depend(IndexType task, IndexType dependency);
+
+    // Hand a task to the pool, and deal with the aftermath when it's done
+    void _submit(IndexType t);
+    void _finish(IndexType t, bool didWork, std::exception_ptr error);
+
+    // Tell the callback how it's going (if we're on the right thread)
+    void _report();
+
+    typedef std::pair<void const *, Stage>  TaskKey;
+    typedef std::map<TaskKey, IndexType>    TaskMap;
+    typedef std::chrono::steady_clock       Clock;
+
+    std::vector<Task>   _tasks;
+    TaskMap             _taskIndex;
+    std::vector<TerrainTypeConstPtr> _types;    // Keep these alive
+
+    // Execution state (guarded by _mutex)
+    WorkerPool *        _pool;
+    std::thread::id     _caller;
+    Clock::time_point   _start;
+    SizeType            _inFlight, _finished, _reported;
+    float               _totalWeight, _doneWeight;
+    std::string         _lastTask;
+    std::exception_ptr  _error;
+    ProgressCallback    _callback;
+    std::mutex          _mutex;
+    std::condition_variable _changed;
+};
+
+
+namespace terrainosaurus {
+    // Write a one-line summary of how far along a prefetch is, like
+    //      42/130 tasks (32%), 1:05 elapsed, about 2:10 left [analyze ...]
+    std::ostream & operator<<(std::ostream & os,
+                              const TerrainPrefetcher::Progress & p);
+};
+
+#endif
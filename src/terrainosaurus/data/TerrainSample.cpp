@@ -26,20 +26,48 @@ namespace std {
 }
 
 // Import raster operations
-#include <inca/raster/algorithms/scale_space_project>
 #include <inca/raster/algorithms/find_edges>
 #include <inca/raster/algorithms/find_ridges>
 #include <inca/raster/operators/select>
 #include <inca/raster/operators/arithmetic>
 #include <inca/raster/operators/gradient>
 #include <inca/raster/operators/resample>
-#include <inca/raster/operators/fourier>
 #include <inca/raster/operators/magnitude>
 #include <inca/raster/operators/statistic>
 
+// Import windowed statistics & scale-space functions
+#include "windowed-statistics.hpp"
+#include "scale-space.hpp"
+
+// Import parallel execution support
+#include <terrainosaurus/util/WorkerPool.hpp>
+
+// Import cache fingerprinting support
+#include <terrainosaurus/util/ContentHash.hpp>
+#include <terrainosaurus/io/terrainosaurus-iostream.hpp>
+
+// Import Fourier transform support
+#include <terrainosaurus/util/FFTPlanCache.hpp>
+
+// Import tracing support
+#include <terrainosaurus/util/Trace.hpp>
+
+// Import memory budget support
+#include "ResidencyManager.hpp"
+
+// Import single-pass statistics
+#include "StatisticsAccumulator.hpp"
+
 // Import Inca file-related exceptions
 #include <inca/io/FileExceptions.hpp>
 
+// Import synchronization primitives
+#include <atomic>
+#include <mutex>
+
+// Import container definitions
+#include <map>
+
 namespace terrainosaurus {
     // Forward declaration
     class FeatureTracker;
@@ -67,6 +95,101 @@ typedef TerrainSample::LOD::FeatureList         FeatureList;
 #define FIND_FEATURES FIND_PEAKS || FIND_EDGES || FIND_RIDGES
 
 
+// Local helper functions
+namespace {
+    // The scales at which to look for features
+    std::vector<scalar_t> featureScales() {
+        std::vector<scalar_t> scales;
+        scales.push_back(0.0f);
+        scales.push_back(1.0f);
+        scales.push_back(2.0f);
+        scales.push_back(3.0f);
+        return scales;
+    }
+
+    // Label a trace span with the sample LOD it's working on
+    void describeSpan(TraceSpan & span, const TerrainSample::LOD & tsl) {
+        if (span) {
+            span.setArgument("sample", tsl.name());
+            span.setArgument("index", tsl.index());
+            span.setArgument("lod", tsl.levelOfDetail());
+        }
+    }
+
+    // Which frequency band each cell of a W x H DFT falls into, for a
+    // particular LOD. Each entry in 'cells' is (band, index within the
+    // half-spectrum from FFTPlanCache::magnitudeSpectrum()), and 'counts'
+    // is the number of cells in each band.
+    struct SpectrumBins {
+        std::vector< std::pair<int, IndexType> > cells;
+        FrequencySpectrum counts;
+    };
+
+    // The band assignment depends only on the shape and LOD, so we work it
+    // out once for each, and keep it around
+    const SpectrumBins & spectrumBins(SizeType width, SizeType height,
+                                      TerrainLOD lod) {
+        typedef std::pair<std::pair<SizeType, SizeType>, int> Key;
+        static std::mutex mutex;
+        static std::map<Key, SpectrumBins> cache;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        Key key(std::make_pair(width, height), int(lod));
+        std::map<Key, SpectrumBins>::iterator it = cache.find(key);
+        if (it != cache.end())
+            return it->second;
+
+        SpectrumBins & bins = cache[key];
+        bins.counts = FrequencySpectrum(0.0f);
+        scalar_t period = metersPerSampleForLOD(lod);
+        scalar_t nyquist = 1.0f / period;
+        scalar_t maxFreq = nyquist / 2.0f;    // Samples per meter
+        SizeType half = width / 2 + 1;
+
+        // Bands are assigned by each cell's position within the spectrum
+        // with the DC term moved to the center (as they always have been),
+        // so we need to find the DFT cell that ended up at each position.
+        // Those with u > W / 2 aren't in the half-spectrum, but have the
+        // same magnitude as their conjugate, which is.
+        Pixel px;
+        for (px[1] = 0; px[1] < IndexType(height); ++px[1])
+            for (px[0] = 0; px[0] < IndexType(width); ++px[0]) {
+                scalar_t freqX = scalar_t(px[0]) / width * nyquist;
+                scalar_t freqY = scalar_t(px[1]) / height * nyquist;
+                scalar_t freq = std::sqrt(freqX*freqX + freqY*freqY);
+                int bucket = int(freq / maxFreq * TerrainSample::LOD::frequencyBands);
+                if (bucket >= int(TerrainSample::LOD::frequencyBands))
+                    continue;
+
+                IndexType u = (px[0] + width - width / 2) % width,
+                          v = (px[1] + height - height / 2) % height;
+                if (u >= IndexType(half)) {
+                    u = width - u;
+                    v = (height - v) % height;
+                }
+                bins.cells.push_back(std::make_pair(bucket, v * half + u));
+                bins.counts[bucket] += 1.0f;
+            }
+        return bins;
+    }
+
+    // How much memory a raster's elements take up
+    template <typename R>
+    ResidencyManager::ByteCount rasterBytes(const R & r) {
+        return ResidencyManager::ByteCount(r.size())
+             * sizeof(typename R::ElementType);
+    }
+
+    // Throw away a raster's elements, returning how much memory that freed
+    template <typename R>
+    ResidencyManager::ByteCount releaseRaster(R & r) {
+        ResidencyManager::ByteCount bytes = rasterBytes(r);
+        r = R();
+        return bytes;
+    }
+}
+
+
 // Edge-detection tracker class
 class terrainosaurus::FeatureTracker {
 public:
@@ -209,6 +332,12 @@ LOD<TerrainSample>::LOD()
 LOD<TerrainSample>::LOD(TerrainSamplePtr ts, TerrainLOD lod)
     : LODBase<TerrainSample>(ts, lod) { }
 
+// Destructor (the ResidencyManager must forget about us before our rasters
+// go away, lest it try to evict them)
+LOD<TerrainSample>::~LOD() {
+    _detachCache();
+}
+
 
 // Access to related LOD objects
 TerrainType::LOD & LOD<TerrainSample>::terrainType() {
@@ -227,101 +356,154 @@ const MapRasterization::LOD & LOD<TerrainSample>::mapRasterization() const {
 
 // Initialization & analysis of elevation data
 void LOD<TerrainSample>::createFromRaster(const Heightfield & hf) {
+    _detachCache();
     _elevations = hf;
-    _loaded   = true;
-    _analyzed = false;
     _studied  = false;
+    _analyzed = false;
+    _loaded   = true;
 }
 void LOD<TerrainSample>::resampleFromLOD(TerrainLOD lod) {
+    _detachCache();
+
     // Resample the fundamental raster properties
     _elevations = resample(object()[lod].elevations(),
                            scaleFactor(lod, levelOfDetail()));
-    _loaded = true;
     _analyzed = false;
+    _loaded = true;
 }
 void LOD<TerrainSample>::_calculateFrequencySpectrum() {
-    scalar_t period = metersPerSampleForLOD(levelOfDetail());
-    scalar_t nyquist = 1.0f / period;
-    scalar_t maxFreq = nyquist / 2.0f;    // Samples per meter
-
-    Heightfield fftMag = dcToCenter(cmagnitude(dft(_elevations)));
-//                         / std::sqrt(scalar_t(size()));
-//        cerr << "Period is " << period << endl;
-//        cerr << "Nyquist is " << nyquist << endl;
-//        cerr << "Max freq is " << maxFreq << endl;
-    FrequencySpectrum counts(0.0f);
-    Pixel px;
-    for (px[0] = fftMag.base(0); px[0] <= fftMag.extent(0); ++px[0])
-        for (px[1] = fftMag.base(1); px[1] <= fftMag.extent(1); ++px[1]) {
-            scalar_t freqX = scalar_t(px[0]) / fftMag.size(0) * nyquist;
-            scalar_t freqY = scalar_t(px[1]) / fftMag.size(1) * nyquist;
-            scalar_t freq = std::sqrt(freqX*freqX + freqY*freqY);
-            int bucket = int(freq / maxFreq * frequencyBands);
-            if (bucket < _frequencySpectrum.size()) {
-                _frequencySpectrum[bucket] += fftMag(px);
-                counts[bucket] += 1.0f;
-            }
-        }
+    std::vector<float> fftMag;
+    FFTPlanCache::instance().magnitudeSpectrum(fftMag, _elevations);
+
+    const SpectrumBins & bins = spectrumBins(_elevations.size(0), _elevations.size(1),
+                                             levelOfDetail());
+    for (IndexType i = 0; i < IndexType(bins.cells.size()); ++i)
+        _frequencySpectrum[bins.cells[i].first] += fftMag[bins.cells[i].second];
     for (int i = 0; i < _frequencySpectrum.size(); ++i)
-        _frequencySpectrum[i] /= counts[i];
+        _frequencySpectrum[i] /= bins.counts[i];
 }
 
 void LOD<TerrainSample>::_calculateStatistics() {
     // Determine whether we need to calculate per-region stats too
     bool hasRegions = (regionCount() > 1);
-
-    // Calculate the gradient magnitude
-    Heightfield gradientMag = raster::magnitude(_gradients);
+    SizeType regions = regionCount();
 
     // Resize & reset the statistics objects
-    _globalElevationStatistics.reset();
-    _globalSlopeStatistics.reset();
     _globalEdgeStrengthStatistics.reset();
     _globalEdgeLengthStatistics.reset();
     _globalEdgeScaleStatistics.reset();
     if (hasRegions) {
-        _regionElevationStatistics.resize(regionCount());
-        _regionSlopeStatistics.resize(regionCount());
-        _regionEdgeStrengthStatistics.resize(regionCount());
-        _regionEdgeLengthStatistics.resize(regionCount());
-        _regionEdgeScaleStatistics.resize(regionCount());
-        for (IDType r = 0; r < IDType(regionCount()); ++r) {
-            _regionElevationStatistics[r].reset();
-            _regionSlopeStatistics[r].reset();
+        _regionElevationStatistics.resize(regions);
+        _regionSlopeStatistics.resize(regions);
+        _regionEdgeStrengthStatistics.resize(regions);
+        _regionEdgeLengthStatistics.resize(regions);
+        _regionEdgeScaleStatistics.resize(regions);
+        for (IDType r = 0; r < IDType(regions); ++r) {
             _regionEdgeStrengthStatistics[r].reset();
             _regionEdgeLengthStatistics[r].reset();
             _regionEdgeScaleStatistics[r].reset();
-        }            
+        }
     }
-    
-    // Get a pointer to the map, if necessary
+
+    // Get a pointer to the map, if necessary. If it doesn't cover this LOD,
+    // we can't use it, and treat the whole LOD as one region, just as
+    // rowBegin()'s iterators do.
     const MapRasterization::LOD * mr = NULL;
-    if (hasRegions)
+    if (hasRegions) {
         mr = &(this->mapRasterization());
-        
-    // TODO: Implement unified iterator & replace here
-    for (int pass = 1; pass <= 2; ++pass) {
-        // Collect per-pixel quantities
-        Pixel px;
-        for (px[1] = base(1); px[1] <= extent(1); ++px[1])
-            for (px[0] = base(0); px[0] <= extent(0); ++px[0]) {
-                scalar_t h = elevation(px);
-                scalar_t s = gradientMag(px);
-
-                _globalElevationStatistics(h);
-                _globalSlopeStatistics(s);
+        if (mr->sizes() != sizes()) {
+            INCA_WARNING(name() << ": map is " << mr->sizes() << ", not "
+                         << sizes() << "...treating it as a single region")
+            mr = NULL;
+        }
+    }
 
-                if (hasRegions) {
-                    IDType rID = mr->regionID(px);
-                    _regionElevationStatistics[rID - 1](h);
-                    _regionSlopeStatistics[rID - 1](s);
+    // Gather the elevations & slopes a band of rows at a time, walking each
+    // row once. Each band has its own accumulators (global, and for each
+    // region), which are merged afterwards, in order. Region IDs come in
+    // runs along a row, so each run is added to its region all at once. The
+    // iterators find the region IDs (falling back to region 1 when the map
+    // doesn't match).
+    IndexType rows  = IndexType(size(1)), b1 = base(1);
+    IndexType grain = IndexType(windowedTileSize(size(1), 1));
+    IndexType bands = (rows + grain - 1) / grain;
+    std::vector<StatisticsAccumulator> elevations(bands), slopes(bands),
+                                       regionElevations, regionSlopes;
+    if (hasRegions) {
+        regionElevations.resize(bands * regions);
+        regionSlopes.resize(bands * regions);
+    }
+    ResidencyPins<TerrainSample::LOD> pins;
+    pins.add(*this);
+    parallelFor(0, bands, 1, [&](IndexType first, IndexType last) {
+        std::vector<scalar_t> rowSlopes(size(0));
+        for (IndexType b = first; b < last; ++b) {
+            StatisticsAccumulator * regionElevation = NULL,
+                                  * regionSlope     = NULL;
+            if (hasRegions) {
+                regionElevation = &regionElevations[b * regions];
+                regionSlope     = &regionSlopes[b * regions];
+            }
+            IndexType end = std::min(rows, (b + 1) * grain);
+            for (IndexType j = b * grain; j < end; ++j) {
+                CellIterator it = rowBegin(b1 + j);
+                const Scalar * e = &it.elevation();
+                const Vector * g = &it.gradient();
+                SizeType n = it.rowRemaining();
+                for (SizeType k = 0; k < n; ++k)
+                    rowSlopes[k] = std::sqrt(g[k][0] * g[k][0]
+                                           + g[k][1] * g[k][1]);
+                elevations[b].add(e, n);
+                slopes[b].add(&rowSlopes[0], n);
+
+                if (! hasRegions)
+                    continue;
+                for (SizeType k = 0; k < n; ) {
+                    IDType id = it.regionID();
+                    SizeType start = k;
+                    do {
+                        ++it;
+                        ++k;
+                    } while (k < n && it.regionID() == id);
+                    if (id > 0 && id <= IDType(regions)) {
+                        regionElevation[id - 1].add(e + start, k - start);
+                        regionSlope[id - 1].add(&rowSlopes[start], k - start);
+                    }
                 }
             }
-            
-        // Collect per-feature quantities
-        FeatureList::const_iterator fi;
-        
+        }
+    });
+
+    // Merge the bands, and hand the results over to the Statistics objects
+    TaskGroup group;
+    group.run([&]() {
+        for (IndexType b = 1; b < bands; ++b)
+            elevations[0].merge(elevations[b]);
+        elevations[0].store(_globalElevationStatistics);
+    });
+    group.run([&]() {
+        for (IndexType b = 1; b < bands; ++b)
+            slopes[0].merge(slopes[b]);
+        slopes[0].store(_globalSlopeStatistics);
+    });
+    if (hasRegions) {
+        for (SizeType r = 0; r < regions; ++r)
+            group.run([&, r]() {
+                StatisticsAccumulator elevation, slope;
+                for (IndexType b = 0; b < bands; ++b) {
+                    elevation.merge(regionElevations[b * regions + r]);
+                    slope.merge(regionSlopes[b * regions + r]);
+                }
+                elevation.store(_regionElevationStatistics[r]);
+                slope.store(_regionSlopeStatistics[r]);
+            });
+    }
+
+    // Collect per-feature quantities (there are few enough of these that
+    // it's not worth gathering them first)
+    for (int pass = 1; pass <= 2; ++pass) {
 #if FIND_EDGES
+        FeatureList::const_iterator fi;
         for (fi = _edges.begin(); fi != _edges.end(); ++fi) {
             const Feature & f = *fi;
             _globalEdgeLengthStatistics(f.length);
@@ -333,8 +515,10 @@ void LOD<TerrainSample>::_calculateStatistics() {
                 _globalEdgeStrengthStatistics(p[3]);
 
                 if (hasRegions) {
-                    IDType rID = mr->regionID(static_cast<int>(p[0]),
-                                              static_cast<int>(p[1]));
+                    IDType rID = 1;
+                    if (mr)
+                        rID = mr->regionID(static_cast<int>(p[0]),
+                                           static_cast<int>(p[1]));
                     if (rID != lastRegion) {
                         if (lastRegion != 0)
                             _regionEdgeLengthStatistics[lastRegion - 1](regionLength);
@@ -350,45 +534,37 @@ void LOD<TerrainSample>::_calculateStatistics() {
         }
 #endif
 
-        // Finalize this pass and (possibly) prepare for the next        
-        _globalElevationStatistics.finish();
-        _globalSlopeStatistics.finish();
+        // Finalize this pass and (possibly) prepare for the next
         _globalEdgeStrengthStatistics.finish();
         _globalEdgeLengthStatistics.finish();
         _globalEdgeScaleStatistics.finish();
         if (hasRegions) {
-            for (IDType r = 0; r < IDType(regionCount()); ++r) {
-                _regionElevationStatistics[r].finish();
-                _regionSlopeStatistics[r].finish();
+            for (IDType r = 0; r < IDType(regions); ++r) {
                 _regionEdgeStrengthStatistics[r].finish();
                 _regionEdgeLengthStatistics[r].finish();
                 _regionEdgeScaleStatistics[r].finish();
             }
         }
     }
-        
+    group.wait();
+
     Stat & s = _globalEdgeStrengthStatistics;
     INCA_DEBUG("Statistics: ")
     INCA_DEBUG("  Mean:     " << s.mean())
     INCA_DEBUG("  Variance: " << s.variance())
     INCA_DEBUG("  Skewness: " << s.skewness())
     INCA_DEBUG("  Kurtosis: " << s.kurtosis())
-    
 }
 void LOD<TerrainSample>::_findFeatures() {
     inca::Timer<float, false> phase;
     
     // Create the scale-space representation of the heightfield
-    std::vector<scalar_t> scales;
-    scales.push_back(0.0f);
-    scales.push_back(1.0f);
-    scales.push_back(2.0f);
-    scales.push_back(3.0f);
+    std::vector<scalar_t> scales = featureScales();
 
     ScaleSpaceImage scaleSpace;
 
     phase.start(true);
-        scale_space_project(scaleSpace, elevations(), scales);
+        gaussianScaleSpace(scaleSpace, elevations(), scales);
     phase.stop();
     INCA_DEBUG("Creating scale space projection (" << scales.size() << " scales)..."
                << phase() << " seconds")
@@ -441,6 +617,8 @@ void LOD<TerrainSample>::analyze() {
     setSizes(_elevations.sizes());
 
     INCA_INFO("Analyzing TerrainSample<" << name() << "> (" << sizes() << ')')
+    TraceSpan span("analyze", "data");
+    describeSpan(span, *this);
     inca::Timer<float, false> total, phase;
     total.start();
 
@@ -450,35 +628,62 @@ void LOD<TerrainSample>::analyze() {
         report << " from " << object().filename();
     report << "...\n";
 
-    // Calculate the per-cell gradient
+    // The frequency spectrum depends only on the elevations, so it can be
+    // calculated alongside everything else
+    TaskGroup passes;
+    inca::Timer<float, false> spectrumPhase;
+    passes.run([this, &spectrumPhase]() {
+        TraceSpan span("spectrum", "data");
+        describeSpan(span, *this);
+        spectrumPhase.start(true);
+            _calculateFrequencySpectrum();
+        spectrumPhase.stop();
+    });
+
+    // Calculate the per-cell gradient, one tile at a time
+    TraceSpan gradientSpan("gradient", "data");
     phase.start(true);
-        _gradients = raster::gradient(_elevations,
-                                      metersPerSampleForLOD(levelOfDetail()));
+        _gradients.setSizes(sizes());
+        scalar_t mps = metersPerSampleForLOD(levelOfDetail());
+        auto gradient = raster::gradient(_elevations, mps);
+        IndexType b0 = base(0), e0 = extent(0);
+        parallelFor(base(1), extent(1) + 1, windowedTileSize(size(1), 1),
+                    [&](IndexType first, IndexType last) {
+            Pixel px;
+            for (px[1] = first; px[1] < last; ++px[1])
+                for (px[0] = b0; px[0] <= e0; ++px[0])
+                    _gradients(px) = gradient(px);
+        });
     phase.stop();
+    gradientSpan.end();
     report << "\tCalculating gradient..." << phase() << " seconds\n";
 
-
-    // Determine the frequency content of the heightfield
-    phase.start(true);
-        _calculateFrequencySpectrum();
-    phase.stop();
-    report << "\tCalculating frequency content..." << phase() << " seconds\n";
-
 #if FIND_FEATURES
     // Find edges, ridges, etc. in the HF
+    TraceSpan featureSpan("features", "data");
     phase.start(true);
         _findFeatures();
     phase.stop();
+    featureSpan.end();
     report << "\tFinding features..." << phase() << " seconds\n";
 #endif
 
     // Calculate global and per-region statistics for elevation, slope, etc.
+    TraceSpan statisticsSpan("statistics", "data");
     phase.start(true);
         _calculateStatistics();
     phase.stop();
+    statisticsSpan.end();
     report << "\tCalculating global & per-region statistics..."
            << phase() << " seconds\n";
 
+    // Wait for the frequency spectrum to finish
+    TraceSpan waitSpan("wait for spectrum", "data");
+    passes.wait();
+    waitSpan.end();
+    report << "\tCalculating frequency content (concurrently)..."
+           << spectrumPhase() << " seconds\n";
+
     total.stop();
     report << "Analysis took " << total() << " seconds\n";
 
@@ -487,9 +692,31 @@ void LOD<TerrainSample>::analyze() {
     _analyzed = true;
 }
 
+// Which way elevation & slope statistics (including the windowed ones from
+// study()) are gathered (bump this whenever that changes what they come out
+// as). Revision 3 sums windowed means in double precision, which doesn't
+// round the same way as mean() over each window did.
+const std::uint32_t statisticsRevision = 3;
+
+// Fingerprint of everything that affects the results of analyze() & study()
+std::uint64_t LOD<TerrainSample>::analysisFingerprint(TerrainLOD lod) {
+    ContentHash hash;
+    hash(demImportRevision);
+    hash(statisticsRevision);
+    hash(std::uint32_t(windowSize(lod)));
+    hash(std::uint32_t(frequencyBands));
+    hash(std::uint8_t(FIND_PEAKS));
+    hash(std::uint8_t(FIND_EDGES));
+    hash(std::uint8_t(FIND_RIDGES));
+    hash(featureScales());
+    return hash.value();
+}
+
 // Lazy loading and analysis mechanism
 void LOD<TerrainSample>::ensureLoaded() const {
-    if (! loaded()) {
+    _loadOnce([this]() {
+        TraceSpan span("load", "data");
+        describeSpan(span, *this);
         TerrainosaurusApplication & app = TerrainosaurusApplication::instance();
 
         try {
@@ -546,22 +773,26 @@ void LOD<TerrainSample>::ensureLoaded() const {
                         "no filename was specified...giving up")
             }
         }
-    }
+    });
 }
 void LOD<TerrainSample>::ensureAnalyzed() const {
     ensureLoaded();
-    if (! analyzed())
+    _analyzeOnce([this]() {
         const_cast<TerrainSample::LOD *>(this)->analyze();
+    });
 }
 void LOD<TerrainSample>::ensureStudied() const {
     ensureAnalyzed();
-    if (! studied())
+    _studyOnce([this]() {
         const_cast<TerrainSample::LOD *>(this)->study();
+    });
 }
 
 void LOD<TerrainSample>::study() {
     INCA_INFO("Studying TerrainSample<" << name() << "> (" << sizes() << ')')
-    inca::Timer<float, false> total, phase;
+    TraceSpan span("study", "data");
+    describeSpan(span, *this);
+    inca::Timer<float, false> total;
     total.start();
 
     std::stringstream report;
@@ -570,60 +801,52 @@ void LOD<TerrainSample>::study() {
         report << " from " << object().filename();
     report << "...\n";
 
-    // Calculate the local mean elevation, mean gradient and range
-    SizeType halfWin = windowSize(levelOfDetail()) / 2;
-    SizeArray windowSizes(windowSize(levelOfDetail()));
-    Pixel px, start;
-
-    report << "\tCalculating local elevation means...";
-    phase.start(true);
-    _localElevationMeans.setSizes(sizes());
-    for (px[0] = 0; px[0] < size(0); ++px[0])
-        for (px[1] = 0; px[1] < size(1); ++px[1]) {
-            start = Pixel(px[0] - halfWin, px[1] - halfWin);
-            _localElevationMeans(px) = mean(selectBS(_elevations, start, windowSizes));
-        }
-    phase.stop();
-    report << phase() << " seconds\n";
-
-    report << "\tCalculating local gradient means...";
-    phase.start(true);
-    _localGradientMeans.setSizes(sizes());
-    for (px[0] = 0; px[0] < size(0); ++px[0])
-        for (px[1] = 0; px[1] < size(1); ++px[1]) {
-            start = Pixel(px[0] - halfWin, px[1] - halfWin);
-            _localGradientMeans(px) = mean(selectBS(_gradients, start, windowSizes));
-        }
-    phase.stop();
-    report << phase() << " seconds\n";
-
-    report << "\tCalculating local elevation ranges...";
-    phase.start(true);
-    _localElevationLimits.setSizes(sizes());
-    for (px[0] = 0; px[0] < size(0); ++px[0])
-        for (px[1] = 0; px[1] < size(1); ++px[1]) {
-            start = Pixel(px[0] - halfWin, px[1] - halfWin);
-            _localElevationLimits(px) = Vector2D(range(selectBS(_elevations, start, windowSizes)));
-        }
-    phase.stop();
-    report << phase() << " seconds\n";
-
-    report << "\tCalculating gradient magnitude...";
-    phase.start(true);
-    Heightfield gradientMag = raster::magnitude(_gradients);
-    phase.stop();
-    report << phase() << " seconds\n";
-
-    report << "\tCalculating local slope ranges...";
-    phase.start(true);
-    _localSlopeLimits.setSizes(sizes());
-    for (px[0] = 0; px[0] < size(0); ++px[0])
-        for (px[1] = 0; px[1] < size(1); ++px[1]) {
-            start = Pixel(px[0] - halfWin, px[1] - halfWin);
-            _localSlopeLimits(px)   = Vector2D(range(selectBS(gradientMag, start, windowSizes)));
-        }
-    phase.stop();
-    report << phase() << " seconds\n";
+    // Calculate the local mean elevation, mean gradient and range. These
+    // run in time proportional to the size of the LOD, regardless of the
+    // window size (see windowed-statistics.hpp). Since they are independent
+    // of one another, we run them all at once (and each of them is further
+    // split into tiles).
+    SizeType winSize = windowSize(levelOfDetail());
+    inca::Timer<float, false> elevationMeanPhase, gradientMeanPhase,
+                              elevationRangePhase, slopeRangePhase;
+    TaskGroup passes;
+    passes.run([&]() {
+        TraceSpan span("local elevation means", "data");
+        elevationMeanPhase.start(true);
+            windowedMeans(_localElevationMeans, _elevations, winSize);
+        elevationMeanPhase.stop();
+    });
+    passes.run([&]() {
+        TraceSpan span("local gradient means", "data");
+        gradientMeanPhase.start(true);
+            windowedMeans(_localGradientMeans, _gradients, winSize);
+        gradientMeanPhase.stop();
+    });
+    passes.run([&]() {
+        TraceSpan span("local elevation ranges", "data");
+        elevationRangePhase.start(true);
+            windowedLimits(_localElevationLimits, _elevations, winSize);
+        elevationRangePhase.stop();
+    });
+    passes.run([&]() {
+        TraceSpan span("local slope ranges", "data");
+        slopeRangePhase.start(true);
+            Heightfield gradientMag = raster::magnitude(_gradients);
+            windowedLimits(_localSlopeLimits, gradientMag, winSize);
+        slopeRangePhase.stop();
+    });
+    TraceSpan waitSpan("wait for local statistics", "data");
+    passes.wait();
+    waitSpan.end();
+
+    report << "\tCalculating local elevation means..."
+           << elevationMeanPhase() << " seconds\n"
+           << "\tCalculating local gradient means..."
+           << gradientMeanPhase() << " seconds\n"
+           << "\tCalculating local elevation ranges..."
+           << elevationRangePhase() << " seconds\n"
+           << "\tCalculating local slope ranges..."
+           << slopeRangePhase() << " seconds\n";
 
     total.stop();
     report << "Study took " << total() << " seconds\n";
@@ -634,45 +857,272 @@ void LOD<TerrainSample>::study() {
 
     // Write to the cache file, if we have an associated filename...
     if (object().filename() != "") {
+        TraceSpan cacheSpan("store cache", "io");
         TerrainosaurusApplication & app = TerrainosaurusApplication::instance();
         app.storeAnalysisCache(*this);
+
+        //...and if memory is limited, keep it around to evict our rasters to
+        if (ResidencyManager::instance().enabled()) {
+            try {
+                _attachCache(AnalysisCache::open(app.analysisCacheFilename(
+                                object().filename(), levelOfDetail())), true);
+            } catch (inca::StreamException & e) {
+                INCA_WARNING("Unable to reopen analysis cache ("
+                             << e << "): " << name() << " stays resident")
+            }
+        }
     }
 }
 
 
+// State shared by everyone paging rasters in from the same cache file. If
+// there's a memory budget, this is what the ResidencyManager keeps track of.
+struct LOD<TerrainSample>::CachePaging : public ResidencyManager::Resident {
+    explicit CachePaging(LOD<TerrainSample> * o, AnalysisCachePtr c,
+                         unsigned p)
+        : owner(o), cache(c), pending(p), evicted(0), pins(0),
+          held(false), managed(false) { }
+    ~CachePaging() {
+        if (managed)
+            ResidencyManager::instance().remove(this);
+    }
+
+    // Give the derived rasters back to the file, unless we're pinned or
+    // held (the elevations stay, since nearly everything looks at them)
+    ResidencyManager::ByteCount _evict() {
+        static const AnalysisCache::SectionID evictable[] = {
+            AnalysisCache::GradientSection,
+            AnalysisCache::LocalElevationMeanSection,
+            AnalysisCache::LocalGradientMeanSection,
+            AnalysisCache::LocalElevationLimitsSection,
+            AnalysisCache::LocalSlopeLimitsSection,
+        };
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (pins > 0 || held)
+            return 0;
+
+        ResidencyManager::ByteCount freed = 0;
+        unsigned out = pending.load(std::memory_order_relaxed);
+        for (IndexType i = 0; i < IndexType(sizeof(evictable) / sizeof(evictable[0])); ++i) {
+            unsigned bit = 1u << evictable[i];
+            if (out & bit)
+                continue;       // Not here to begin with
+            switch (evictable[i]) {
+            case AnalysisCache::GradientSection:
+                freed += releaseRaster(owner->_gradients);              break;
+            case AnalysisCache::LocalElevationMeanSection:
+                freed += releaseRaster(owner->_localElevationMeans);    break;
+            case AnalysisCache::LocalGradientMeanSection:
+                freed += releaseRaster(owner->_localGradientMeans);     break;
+            case AnalysisCache::LocalElevationLimitsSection:
+                freed += releaseRaster(owner->_localElevationLimits);   break;
+            case AnalysisCache::LocalSlopeLimitsSection:
+                freed += releaseRaster(owner->_localSlopeLimits);       break;
+            default:
+                break;
+            }
+            out     |= bit;
+            evicted |= bit;
+        }
+        pending.store(out, std::memory_order_release);
+        return freed;
+    }
+
+    LOD<TerrainSample> *    owner;
+    AnalysisCachePtr        cache;      // The file (until we're done with it)
+    std::atomic<unsigned>   pending;    // Bit-set of un-paged SectionIDs
+    unsigned                evicted;    // ...and those that have been evicted
+    std::atomic<unsigned>   pins;       // How many times we've been pinned
+    std::atomic<bool>       held;       // Handed out a reference unpinned?
+    bool                    managed;    // Does the ResidencyManager know us?
+    std::mutex              mutex;      // Serializes the actual paging
+};
+
+// Leave the rasters in 'cache' until somebody asks for them
+void LOD<TerrainSample>::_attachCache(AnalysisCachePtr cache, bool resident) {
+    static const AnalysisCache::SectionID rasters[] = {
+        AnalysisCache::ElevationSection,
+        AnalysisCache::GradientSection,
+        AnalysisCache::LocalElevationMeanSection,
+        AnalysisCache::LocalGradientMeanSection,
+        AnalysisCache::LocalElevationLimitsSection,
+        AnalysisCache::LocalSlopeLimitsSection,
+    };
+
+    unsigned pending = 0;
+    if (! resident)
+        for (IndexType i = 0; i < IndexType(sizeof(rasters) / sizeof(rasters[0])); ++i)
+            if (cache->hasSection(rasters[i]))
+                pending |= 1u << rasters[i];
+
+    _paging.reset(new CachePaging(this, cache, pending));
+
+    // Evicting to a file that's been read into memory would gain nothing
+    ResidencyManager & rm = ResidencyManager::instance();
+    if (rm.enabled() && cache->mapped()) {
+        _paging->managed = true;
+        rm.add(_paging.get(), residentBytes());
+    }
+}
+
+// Forget about any cache file (our rasters are being replaced)
+void LOD<TerrainSample>::_detachCache() {
+    _paging.reset();
+}
+
+// Copy a raster in from the cache file, if it hasn't been already
+void LOD<TerrainSample>::_pageIn(AnalysisCache::SectionID id) const {
+    if (! _paging)
+        return;
+
+    _paging->touch();
+    unsigned bit = 1u << id;
+    if (! (_paging->pending.load(std::memory_order_acquire) & bit))
+        return;
+
+    // Somebody else may have beaten us to it while we waited
+    ResidencyManager::ByteCount bytes = 0;
+    bool reloaded;
+    {
+        std::lock_guard<std::mutex> lock(_paging->mutex);
+        if (! (_paging->pending.load(std::memory_order_relaxed) & bit))
+            return;
+
+        LOD<TerrainSample> & self = const_cast<LOD<TerrainSample> &>(*this);
+        const AnalysisCache & cache = *_paging->cache;
+        switch (id) {
+        case AnalysisCache::ElevationSection:
+            bytes -= rasterBytes(self._elevations);
+            cache.readRaster(id, self._elevations);
+            bytes += rasterBytes(self._elevations);             break;
+        case AnalysisCache::GradientSection:
+            bytes -= rasterBytes(self._gradients);
+            cache.readRaster(id, self._gradients);
+            bytes += rasterBytes(self._gradients);              break;
+        case AnalysisCache::LocalElevationMeanSection:
+            bytes -= rasterBytes(self._localElevationMeans);
+            cache.readRaster(id, self._localElevationMeans);
+            bytes += rasterBytes(self._localElevationMeans);    break;
+        case AnalysisCache::LocalGradientMeanSection:
+            bytes -= rasterBytes(self._localGradientMeans);
+            cache.readRaster(id, self._localGradientMeans);
+            bytes += rasterBytes(self._localGradientMeans);     break;
+        case AnalysisCache::LocalElevationLimitsSection:
+            bytes -= rasterBytes(self._localElevationLimits);
+            cache.readRaster(id, self._localElevationLimits);
+            bytes += rasterBytes(self._localElevationLimits);   break;
+        case AnalysisCache::LocalSlopeLimitsSection:
+            bytes -= rasterBytes(self._localSlopeLimits);
+            cache.readRaster(id, self._localSlopeLimits);
+            bytes += rasterBytes(self._localSlopeLimits);       break;
+        default:
+            break;
+        }
+        reloaded = (_paging->evicted & bit) != 0;
+        _paging->evicted &= ~bit;
+
+        // Once everything is in, we don't need the file any more (unless
+        // we might need to evict things back to it)
+        unsigned left = _paging->pending.fetch_and(~bit, std::memory_order_release)
+                      & ~bit;
+        if (left == 0 && ! _paging->managed)
+            _paging->cache.reset();
+    }
+
+    // Now that we're bigger, something else may have to go
+    if (_paging->managed)
+        ResidencyManager::instance().charge(_paging.get(), bytes, reloaded);
+}
+
+// Hand out references to our evictable rasters. This must only be done
+// while we're pinned; if we aren't, there's no telling when the reference
+// will be let go of, so our rasters stay resident from then on.
+void LOD<TerrainSample>::_retainRasters() const {
+    if (! _paging || ! _paging->managed
+                  || _paging->pins.load(std::memory_order_acquire) > 0
+                  || _paging->held.load(std::memory_order_acquire))
+        return;
+
+    std::lock_guard<std::mutex> lock(_paging->mutex);
+    if (_paging->pins == 0 && ! _paging->held) {
+        _paging->held = true;
+        INCA_WARNING(name() << ": rasters used without being pinned "
+                     "(see ResidencyManager.hpp)...keeping them resident")
+    }
+}
+
+// Keeping our rasters in memory
+void LOD<TerrainSample>::pinRasters() const {
+    if (_paging) {
+        std::lock_guard<std::mutex> lock(_paging->mutex);
+        ++_paging->pins;
+    }
+}
+void LOD<TerrainSample>::unpinRasters() const {
+    if (_paging) {
+        std::lock_guard<std::mutex> lock(_paging->mutex);
+        if (_paging->pins > 0)
+            --_paging->pins;
+    }
+}
+
+// How big our rasters are (whether they came from a file or not)
+SizeType LOD<TerrainSample>::residentBytes() const {
+    std::unique_lock<std::mutex> lock;
+    if (_paging)
+        lock = std::unique_lock<std::mutex>(_paging->mutex);
+    return SizeType(rasterBytes(_elevations)
+                  + rasterBytes(_gradients)
+                  + rasterBytes(_featureMap)
+                  + rasterBytes(_localElevationMeans)
+                  + rasterBytes(_localGradientMeans)
+                  + rasterBytes(_localElevationLimits)
+                  + rasterBytes(_localSlopeLimits));
+}
+
+
 /*---------------------------------------------------------------------------*
  | Raster geometry accessors
  *---------------------------------------------------------------------------*/
 SizeType LOD<TerrainSample>::size() const {
     ensureLoaded();
+    _pageIn(AnalysisCache::ElevationSection);
     return _elevations.size();
 }
 SizeType LOD<TerrainSample>::size(IndexType d) const {
     ensureLoaded();
+    _pageIn(AnalysisCache::ElevationSection);
     return _elevations.size(d);
 }
 IndexType LOD<TerrainSample>::base(IndexType d) const {
     ensureLoaded();
+    _pageIn(AnalysisCache::ElevationSection);
     return _elevations.base(d);
 }
 IndexType LOD<TerrainSample>::extent(IndexType d) const {
     ensureLoaded();
+    _pageIn(AnalysisCache::ElevationSection);
     return _elevations.extent(d);
 }
 const LOD<TerrainSample>::SizeArray & LOD<TerrainSample>::sizes() const {
     ensureLoaded();
+    _pageIn(AnalysisCache::ElevationSection);
     return _elevations.sizes();
 }
 const LOD<TerrainSample>::IndexArray & LOD<TerrainSample>::bases() const {
     ensureLoaded();
+    _pageIn(AnalysisCache::ElevationSection);
     return _elevations.bases();
 }
 const LOD<TerrainSample>::IndexArray & LOD<TerrainSample>::extents() const {
     ensureLoaded();
+    _pageIn(AnalysisCache::ElevationSection);
     return _elevations.extents();
 }
 const LOD<TerrainSample>::Region & LOD<TerrainSample>::bounds() const {
     ensureLoaded();
+    _pageIn(AnalysisCache::ElevationSection);
     return _elevations.bounds();
 }
 
@@ -690,15 +1140,68 @@ void LOD<TerrainSample>::setSizes(const SizeArray & sz) {
 /*---------------------------------------------------------------------------*
  | Per-cell properties
  *---------------------------------------------------------------------------*/
+// Unified iteration over every cell, in storage order
+LOD<TerrainSample>::CellIterator LOD<TerrainSample>::cellsBegin() const {
+    return rowBegin(base(1));
+}
+LOD<TerrainSample>::CellIterator LOD<TerrainSample>::cellsEnd() const {
+    CellIterator it;
+    it._offset = IndexType(size());
+    return it;
+}
+LOD<TerrainSample>::CellIterator LOD<TerrainSample>::rowBegin(IndexType j) const {
+    // Make sure everything is in memory before we start pointing at it
+    ensureLoaded();
+    _retainRasters();
+    _pageIn(AnalysisCache::ElevationSection);
+    _pageIn(AnalysisCache::GradientSection);
+    _pageIn(AnalysisCache::LocalElevationMeanSection);
+    _pageIn(AnalysisCache::LocalGradientMeanSection);
+    _pageIn(AnalysisCache::LocalElevationLimitsSection);
+    _pageIn(AnalysisCache::LocalSlopeLimitsSection);
+
+    CellIterator it;
+    it._base0   = _elevations.base(0);
+    it._extent0 = _elevations.extent(0);
+    it._px[0]   = it._base0;
+    it._px[1]   = j;
+    it._offset  = (j - _elevations.base(1)) * IndexType(_elevations.size(0));
+
+    // Only point at rasters that actually cover the whole LOD
+    const SizeArray & sz = _elevations.sizes();
+    it._elevations = _elevations.elements();
+    if (_gradients.sizes() == sz)
+        it._gradients = _gradients.elements();
+    if (_localElevationMeans.sizes() == sz)
+        it._localElevationMeans = _localElevationMeans.elements();
+    if (_localGradientMeans.sizes() == sz)
+        it._localGradientMeans = _localGradientMeans.elements();
+    if (_localElevationLimits.sizes() == sz)
+        it._localElevationLimits = _localElevationLimits.elements();
+    if (_localSlopeLimits.sizes() == sz)
+        it._localSlopeLimits = _localSlopeLimits.elements();
+    if (object().mapRasterization()) {
+        const MapRasterization::LOD & mr = mapRasterization();
+        if (mr.sizes() == sz) {
+            it._regionIDs      = mr.regionIDs().elements();
+            it._terrainTypeIDs = mr.terrainTypeIDs().elements();
+        }
+    }
+    return it;
+}
+
 // Fundamental properties (initialized at load-time)
 const Heightfield & LOD<TerrainSample>::elevations() const {
     ensureLoaded();
+    _pageIn(AnalysisCache::ElevationSection);
     return _elevations;
 }
 
 // Derived properties (initialized at analysis-time)
 const VectorMap & LOD<TerrainSample>::gradients() const {
     ensureAnalyzed();
+    _retainRasters();
+    _pageIn(AnalysisCache::GradientSection);
     return _gradients;
 }
 const ColorImage & LOD<TerrainSample>::featureMaps() const {
@@ -709,18 +1212,26 @@ const ColorImage & LOD<TerrainSample>::featureMaps() const {
 // Windowed properties (initialized at study-time)
 const Heightfield & LOD<TerrainSample>::localElevationMeans() const {
     ensureStudied();
+    _retainRasters();
+    _pageIn(AnalysisCache::LocalElevationMeanSection);
     return _localElevationMeans;
 }
 const VectorMap & LOD<TerrainSample>::localGradientMeans() const {
     ensureStudied();
+    _retainRasters();
+    _pageIn(AnalysisCache::LocalGradientMeanSection);
     return _localGradientMeans;
 }
 const VectorMap & LOD<TerrainSample>::localElevationLimitss() const {
     ensureStudied();
+    _retainRasters();
+    _pageIn(AnalysisCache::LocalElevationLimitsSection);
     return _localElevationLimits;
 }
 const VectorMap & LOD<TerrainSample>::localSlopeLimitss() const {
     ensureStudied();
+    _retainRasters();
+    _pageIn(AnalysisCache::LocalSlopeLimitsSection);
     return _localSlopeLimits;
 }
 
@@ -43,14 +43,17 @@
  *      separate raster objects, these are all guaranteed to have the same
  *      size and bounds, and the LOD exposes an iterator interface allowing
  *      the grid to be traversed and accessed as though it were a single raster
- *      of structs.
- *      TODO: LOD iterator interface has not been implemented
+ *      of structs (see CellIterator below). The iterator also reaches through
+ *      to the associated MapRasterization::LOD, if there is one.
  *
  * Implementation notes:
  *      Using the iterator interface described above, which treats the entire
- *      LOD as a unified raster, is likely to be more efficient than accessing
- *      the individual rasters separately, since the 2D -> 1D address
- *      calculation can be cached.
+ *      LOD as a unified raster, is more efficient than accessing the
+ *      individual rasters separately, since the 2D -> 1D address calculation
+ *      is done once per cell rather than once per raster, and the cells are
+ *      visited in storage order (dimension 0 varying fastest). The lazy
+ *      loading checks are also done once, when the iterator is created,
+ *      rather than on every access.
  *
  *      Since loading, analyzing and studying terrains are rather expensive
  *      processes, these are done on a lazy basis, allowing the TerrainSample
@@ -75,6 +78,9 @@
 // Import LOD template declaration
 #include "TerrainLOD.hpp"
 
+// Import analysis cache file definition
+#include <terrainosaurus/io/AnalysisCache.hpp>
+
 // This is part of the Terrainosaurus terrain generation engine
 namespace terrainosaurus {
     // Forward declarations
@@ -83,6 +89,9 @@ namespace terrainosaurus {
 
     std::istream & operator>>(std::istream &, LOD<TerrainSample> &);
     std::ostream & operator<<(std::ostream &, const LOD<TerrainSample> &);
+    void attachAnalysisCache(LOD<TerrainSample> &, AnalysisCachePtr);
+    void writeAnalysisCache(std::ostream &, const LOD<TerrainSample> &,
+                            std::uint64_t);
 
     // Pointer typedefs
     typedef shared_ptr<TerrainSample>       TerrainSamplePtr;
@@ -112,6 +121,11 @@ public:
                                                        LOD<TerrainSample> &);
     friend std::ostream & ::terrainosaurus::operator<<(std::ostream &,
                                                        const LOD<TerrainSample> &);
+    friend void ::terrainosaurus::attachAnalysisCache(LOD<TerrainSample> &,
+                                                      AnalysisCachePtr);
+    friend void ::terrainosaurus::writeAnalysisCache(std::ostream &,
+                                                     const LOD<TerrainSample> &,
+                                                     std::uint64_t);
 
     // How many "buckets" do we break up the frequency spectrum into?
     static const SizeType frequencyBands = 10;
@@ -164,6 +178,9 @@ public:
     explicit LOD();
     explicit LOD(TerrainSamplePtr ts, TerrainLOD lod);
 
+    // Destructor
+    ~LOD();
+
     // Access to related LOD objects
           LOD<TerrainType> & terrainType();
     const LOD<TerrainType> & terrainType() const;
@@ -191,12 +208,46 @@ public:
     void ensureAnalyzed() const;
     void ensureStudied() const;
 
+    // A fingerprint of the parameters controlling import, analysis & study
+    // of a LOD (DEM import revision, window size, feature switches, etc.).
+    // Cached results calculated with different parameters must not be reused.
+    static std::uint64_t analysisFingerprint(TerrainLOD lod);
+
 protected:
     // Analysis steps
     void _calculateFrequencySpectrum();
     void _calculateStatistics();
     void _findFeatures();
 
+public:
+    // Residency of rasters in memory. If there's a memory budget (see
+    // ResidencyManager.hpp), a pinned LOD's rasters are never evicted. Any
+    // access to the gradient or windowed rasters (the rasters themselves,
+    // their cells, or a CellIterator) hands out a reference into them, and
+    // so must be done with the LOD pinned. An LOD accessed without a pin is
+    // never evicted again. Pins nest.
+    void pinRasters() const;
+    void unpinRasters() const;
+    SizeType residentBytes() const;     // How big our rasters are right now
+
+protected:
+    // Note that a reference to an evictable raster is being handed out
+    void _retainRasters() const;
+
+protected:
+    // Paging of rasters from an analysis cache file. When an LOD is loaded
+    // from a cache, its rasters stay in the (memory-mapped) file until
+    // something asks for them, and if there's a memory budget, they may be
+    // evicted back to it later. Paging is safe to do from multiple threads.
+    // If 'resident' is true, our rasters are already the same as the
+    // cache's, and so nothing needs to be paged in.
+    struct CachePaging;
+    void _attachCache(AnalysisCachePtr cache, bool resident = false);
+    void _detachCache();
+    void _pageIn(AnalysisCache::SectionID id) const;
+
+    shared_ptr<CachePaging> _paging;
+
 
 /*---------------------------------------------------------------------------*
  | Raster geometry accessors
@@ -233,6 +284,12 @@ public:
     RASTER_PROPERTY_ACCESSORS(VectorMap,    localElevationLimits)
     RASTER_PROPERTY_ACCESSORS(VectorMap,    localSlopeLimits)
 
+    // Unified, storage-order iteration over every cell of the LOD
+    class CellIterator;
+    CellIterator cellsBegin() const;
+    CellIterator cellsEnd() const;
+    CellIterator rowBegin(IndexType j) const;   // First cell in row 'j'
+
 protected:
     Heightfield _elevations;
 
@@ -303,6 +360,82 @@ public:
 };
 
 
+/*****************************************************************************
+ * Zipped iterator over the per-cell rasters of a TerrainSample::LOD
+ *****************************************************************************/
+// A CellIterator walks every cell of the LOD in storage order (dimension 0
+// varying fastest), keeping a single linear offset into all of the per-cell
+// rasters. Creating one doesn't trigger analysis or study, so properties
+// that haven't been calculated yet (e.g., the windowed properties, before
+// study()) must not be accessed through it. The map properties come from the
+// associated MapRasterization::LOD, if there is one, and otherwise act as
+// though the whole LOD were a single region.
+class terrainosaurus::LOD<terrainosaurus::TerrainSample>::CellIterator {
+friend class LOD<TerrainSample>;
+public:
+    typedef LOD<TerrainSample>::Scalar  Scalar;
+    typedef LOD<TerrainSample>::Vector  Vector;
+
+    // Default constructor
+    CellIterator() : _offset(0), _elevations(NULL), _gradients(NULL),
+                     _localElevationMeans(NULL), _localGradientMeans(NULL),
+                     _localElevationLimits(NULL), _localSlopeLimits(NULL),
+                     _regionIDs(NULL), _terrainTypeIDs(NULL) { }
+
+    // Position
+    const Pixel & pixel() const { return _px; }
+    IndexType offset() const    { return _offset; }
+
+    // Whether there is an associated map
+    bool hasRegions() const     { return _regionIDs != NULL; }
+
+    // Per-cell properties
+    Scalar elevation() const { return _elevations[_offset]; }
+    const Vector & gradient() const { return _gradients[_offset]; }
+    Scalar slope() const {
+        const Vector & g = _gradients[_offset];
+        return std::sqrt(g[0] * g[0] + g[1] * g[1]);
+    }
+    Scalar localElevationMean() const   { return _localElevationMeans[_offset]; }
+    const Vector & localGradientMean() const   { return _localGradientMeans[_offset]; }
+    const Vector & localElevationLimits() const { return _localElevationLimits[_offset]; }
+    const Vector & localSlopeLimits() const    { return _localSlopeLimits[_offset]; }
+    IDType regionID() const { return _regionIDs ? _regionIDs[_offset] : 1; }
+    IDType terrainTypeID() const {
+        return _terrainTypeIDs ? _terrainTypeIDs[_offset] : 0;
+    }
+
+    // Traversal
+    CellIterator & operator++() {
+        ++_offset;
+        if (++_px[0] > _extent0) {
+            _px[0] = _base0;
+            ++_px[1];
+        }
+        return *this;
+    }
+    bool operator==(const CellIterator & it) const { return _offset == it._offset; }
+    bool operator!=(const CellIterator & it) const { return _offset != it._offset; }
+
+    // How many cells are left in the current row, including this one. Loops
+    // that only need the raw properties can iterate over this many cells
+    // directly (e.g., &it.gradient() + k), which lets the compiler vectorize.
+    SizeType rowRemaining() const { return SizeType(_extent0 - _px[0] + 1); }
+
+protected:
+    Pixel           _px;
+    IndexType       _offset, _base0, _extent0;
+    Scalar const *  _elevations;
+    Vector const *  _gradients;
+    Scalar const *  _localElevationMeans;
+    Vector const *  _localGradientMeans,
+                 *  _localElevationLimits,
+                 *  _localSlopeLimits;
+    IDType const *  _regionIDs,
+                 *  _terrainTypeIDs;
+};
+
+
 class terrainosaurus::TerrainSample
         : public MultiResolutionObject<TerrainSample> {
 /*---------------------------------------------------------------------------*
@@ -20,6 +20,12 @@ using namespace terrainosaurus;
 #include <inca/math/generator/RandomUniform>
 using inca::math::RandomUniform;
 
+// Import tracing support
+#include <terrainosaurus/util/Trace.hpp>
+
+// Import memory budget support
+#include "ResidencyManager.hpp"
+
 // Convenient aliases for long names
 typedef TerrainType                 TT;
 typedef TT::LOD                     TTL;
@@ -134,26 +140,46 @@ void TTL::analyze() {
 }
 
 void TTL::ensureLoaded() const {
-    if (! loaded()) {
+    _loadOnce([this]() {
         for (IndexType i = 0; i < size(); ++i)
             terrainSample(i).ensureLoaded();
         _loaded = true;
-    }
+    });
 }
 void TTL::ensureAnalyzed() const {
-    if (! analyzed()) {
-        ensureLoaded();
+    ensureLoaded();
+    _analyzeOnce([this]() {
         const_cast<TTL *>(this)->analyze();
-        _analyzed = true;
-    }
+    });
 }
 void TTL::ensureStudied() const {
-    if (! studied()) {       
-        ensureAnalyzed();
-        for (IndexType i = 0; i < size(); ++i)
+    ensureAnalyzed();
+    _studyOnce([this]() {
+        // Indexing reads the samples' rasters, so they must stay put while
+        // it's going on
+        std::vector<TerrainSample::LOD const *> samples;
+        ResidencyPins<TerrainSample::LOD> pins;
+        for (IndexType i = 0; i < size(); ++i) {
             terrainSample(i).ensureStudied();
+            pins.add(terrainSample(i));
+            samples.push_back(&terrainSample(i));
+        }
+
+        // Index the patches the GA may draw from, using the same safe
+        // region as when picking them at random, and placing candidates
+        // twice as densely as genes are placed
+        TraceSpan span("index patches", "data");
+        if (span) {
+            span.setArgument("type", name());
+            span.setArgument("lod", levelOfDetail());
+        }
+        const_cast<TTL *>(this)->_patchIndex.build(samples,
+                SizeType(blendFalloffRadius(levelOfDetail())),
+                SizeType(blendPatchSpacing(levelOfDetail()) / 2));
+        INCA_DEBUG("Indexed " << _patchIndex.size() << " source patches for "
+                   "TerrainType(" << name() << ")")
         _studied = true;
-    }
+    });
 }
 
 
@@ -208,6 +234,15 @@ scalar_t TTL::agreement() const {
 }
 
 
+/*---------------------------------------------------------------------------*
+ | Source patch selection
+ *---------------------------------------------------------------------------*/
+const PatchIndex & TTL::patchIndex() const {
+    ensureStudied();
+    return _patchIndex;
+}
+
+
 /*---------------------------------------------------------------------------*
  | Access to parent TerrainType properties
  *---------------------------------------------------------------------------*/
@@ -37,6 +37,9 @@ namespace terrainosaurus {
 // Import statistical analysis tools
 #include <inca/math/statistics/DistributionMatcher>
 
+// Import source patch index
+#include "PatchIndex.hpp"
+
 
 /*****************************************************************************
  * LOD specialization for TerrainType
@@ -113,6 +116,20 @@ protected:
              _edgeStrengthWeight;
 
     scalar_t _agreement;
+
+
+/*---------------------------------------------------------------------------*
+ | Source patch selection
+ *---------------------------------------------------------------------------*/
+public:
+    // An index over the candidate source patches of all our TerrainSamples,
+    // for finding those resembling some other terrain (see PatchIndex.hpp).
+    // This is built when the TerrainType is studied. Candidate indices
+    // refer to terrainSample(i).
+    const PatchIndex & patchIndex() const;
+
+protected:
+    PatchIndex _patchIndex;
     
 
 /*---------------------------------------------------------------------------*
@@ -0,0 +1,241 @@
+/*
+ * File: distance-transform.cpp
+ *
+ * Author: Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes.
+ *
+ * Description:
+ */
+
+// Include precompiled header
+#include <terrainosaurus/precomp.h>
+
+// Import function prototypes
+#include "distance-transform.hpp"
+
+// Import parallel execution support
+#include <terrainosaurus/util/WorkerPool.hpp>
+
+// Import container definitions
+#include <vector>
+#include <limits>
+#include <cmath>
+
+using namespace terrainosaurus;
+
+
+// Local helper functions
+namespace {
+    // What a cell with no boundary anywhere is given
+    const scalar_t FAR_AWAY = std::numeric_limits<scalar_t>::max();
+
+    // Choose a band size for splitting 'size' rows (or columns) among the
+    // available workers, a few bands per worker
+    SizeType bandSize(SizeType size) {
+        SizeType bands = 4 * WorkerPool::instance().workerCount();
+        return std::max(SizeType(16), (size + bands - 1) / bands);
+    }
+
+    // Whether two IDs are on the same side of a boundary: either they're
+    // equal, or (for a signed transform) they're both in or both out of
+    // the region of interest
+    struct SameID {
+        bool operator()(IDType a, IDType b) const { return a == b; }
+    };
+    struct SameSide {
+        explicit SameSide(IDType i) : id(i) { }
+        bool operator()(IDType a, IDType b) const {
+            return (a == id) == (b == id);
+        }
+        IDType id;
+    };
+
+    // The state shared by both passes. Everything is stored row-by-row,
+    // with indices relative to the bases of the IDMap.
+    struct Transform {
+        SizeType width, height;
+        std::vector<unsigned char>  boundary;   // Whether each cell is one
+        std::vector<IndexType>      column;     // Nearest boundary in row
+    };
+
+    // Mark the boundary cells in rows [first, last)
+    template <typename Same>
+    void findBoundaries(Transform & t, const IDMap & ids, Same same,
+                        IndexType first, IndexType last) {
+        IndexType w = IndexType(t.width), h = IndexType(t.height);
+        IndexType b0 = ids.base(0), b1 = ids.base(1);
+        for (IndexType j = first; j < last; ++j) {
+            unsigned char * row = &t.boundary[j * w];
+            for (IndexType i = 0; i < w; ++i) {
+                IDType c = ids(b0 + i, b1 + j);
+                row[i] = (i > 0     && ! same(c, ids(b0 + i - 1, b1 + j)))
+                      || (i < w - 1 && ! same(c, ids(b0 + i + 1, b1 + j)))
+                      || (j > 0     && ! same(c, ids(b0 + i, b1 + j - 1)))
+                      || (j < h - 1 && ! same(c, ids(b0 + i, b1 + j + 1)));
+            }
+        }
+    }
+
+    // First pass: find the nearest boundary cell in the same row as each
+    // cell in rows [first, last), by scanning each row both ways
+    void transformRows(Transform & t, IndexType first, IndexType last) {
+        IndexType w = IndexType(t.width);
+        for (IndexType j = first; j < last; ++j) {
+            const unsigned char * row = &t.boundary[j * w];
+            IndexType * nearest = &t.column[j * w];
+
+            IndexType previous = -1;
+            for (IndexType i = 0; i < w; ++i) {
+                if (row[i])
+                    previous = i;
+                nearest[i] = previous;
+            }
+            IndexType next = -1;
+            for (IndexType i = w - 1; i >= 0; --i) {
+                if (row[i])
+                    next = i;
+                if (next >= 0 && (nearest[i] < 0 || next - i < i - nearest[i]))
+                    nearest[i] = next;
+            }
+        }
+    }
+
+    // Second pass: for each column in [first, last), find the lower envelope
+    // of the parabolas rooted at each row having a boundary cell, and from
+    // it, the squared distance to the nearest boundary cell overall. The
+    // results are passed to 'store' as (i, j, squared distance, nearest).
+    template <typename Store>
+    void transformColumns(const Transform & t, Store & store,
+                          IndexType first, IndexType last) {
+        typedef long long Squared;      // Squared distances, exactly
+        IndexType w = IndexType(t.width), h = IndexType(t.height);
+        std::vector<IndexType>  roots(h);       // Rows of envelope parabolas
+        std::vector<Squared>    heights(h);     // ...their minimum values
+        std::vector<double>     starts(h);      // ...where each takes over
+
+        for (IndexType i = first; i < last; ++i) {
+            // Build the lower envelope, discarding each parabola that is
+            // hidden by the one being added
+            IndexType k = -1;
+            for (IndexType q = 0; q < h; ++q) {
+                IndexType c = t.column[q * w + i];
+                if (c < 0)
+                    continue;       // No boundary in this row at all
+                Squared fq = Squared(i - c) * (i - c);
+                double s = 0.0;
+                while (k >= 0) {
+                    IndexType p = roots[k];
+                    s = double((fq + Squared(q) * q)
+                             - (heights[k] + Squared(p) * p)) / (2.0 * (q - p));
+                    if (s <= starts[k])
+                        --k;
+                    else
+                        break;
+                }
+                ++k;
+                roots[k]   = q;
+                heights[k] = fq;
+                starts[k]  = (k == 0) ? -std::numeric_limits<double>::max() : s;
+            }
+
+            // Then read it off, row by row
+            if (k < 0) {
+                for (IndexType j = 0; j < h; ++j)
+                    store(i, j, -1, -1);
+            } else {
+                IndexType m = 0;
+                for (IndexType j = 0; j < h; ++j) {
+                    while (m < k && starts[m + 1] < j)
+                        ++m;
+                    IndexType p = roots[m];
+                    store(i, j, Squared(j - p) * (j - p) + heights[m],
+                          p * w + t.column[p * w + i]);
+                }
+            }
+        }
+    }
+
+    // Writes the results of the second pass into the result rasters,
+    // flipping the sign of the distance outside the region (if any)
+    template <typename Inside>
+    struct StoreDistance {
+        StoreDistance(DistanceField & r, NearestCellMap * n,
+                      const IDMap & m, Inside in)
+            : result(r), nearest(n), ids(m), inside(in),
+              b0(m.base(0)), b1(m.base(1)) { }
+
+        void operator()(IndexType i, IndexType j, long long squared,
+                        IndexType cell) {
+            scalar_t d = (squared < 0) ? FAR_AWAY
+                                       : scalar_t(std::sqrt(double(squared)));
+            result(b0 + i, b1 + j) = inside(ids(b0 + i, b1 + j)) ? d : -d;
+            if (nearest)
+                (*nearest)(b0 + i, b1 + j) = cell;
+        }
+
+        DistanceField &     result;
+        NearestCellMap *    nearest;
+        const IDMap &       ids;
+        Inside              inside;
+        IndexType           b0, b1;
+    };
+    struct Everywhere {
+        bool operator()(IDType) const { return true; }
+    };
+    struct InRegion {
+        explicit InRegion(IDType i) : id(i) { }
+        bool operator()(IDType a) const { return a == id; }
+        IDType id;
+    };
+
+    // Do the whole transform, with 'same' deciding where the boundaries are
+    // and 'inside' deciding the sign of the distance
+    template <typename Same, typename Inside>
+    void distanceTransform(DistanceField & result, NearestCellMap * nearest,
+                           const IDMap & ids, Same same, Inside inside) {
+        result.setBounds(ids.bases(), ids.extents());
+        if (nearest)
+            nearest->setBounds(ids.bases(), ids.extents());
+        if (ids.size() == 0)
+            return;
+
+        Transform t;
+        t.width  = ids.size(0);
+        t.height = ids.size(1);
+        t.boundary.resize(t.width * t.height);
+        t.column.resize(t.width * t.height);
+
+        IndexType w = IndexType(t.width), h = IndexType(t.height);
+        parallelFor(0, h, bandSize(t.height),
+                    [&](IndexType first, IndexType last) {
+            findBoundaries(t, ids, same, first, last);
+        });
+        parallelFor(0, h, bandSize(t.height),
+                    [&](IndexType first, IndexType last) {
+            transformRows(t, first, last);
+        });
+        parallelFor(0, w, bandSize(t.width),
+                    [&](IndexType first, IndexType last) {
+            StoreDistance<Inside> store(result, nearest, ids, inside);
+            transformColumns(t, store, first, last);
+        });
+    }
+}
+
+
+/*---------------------------------------------------------------------------*
+ | Distance transform functions
+ *---------------------------------------------------------------------------*/
+void terrainosaurus::boundaryDistanceTransform(DistanceField & result,
+                                               const IDMap & ids,
+                                               NearestCellMap * nearest) {
+    distanceTransform(result, nearest, ids, SameID(), Everywhere());
+}
+
+void terrainosaurus::signedDistanceTransform(DistanceField & result,
+                                             const IDMap & ids, IDType id,
+                                             NearestCellMap * nearest) {
+    distanceTransform(result, nearest, ids, SameSide(id), InRegion(id));
+}
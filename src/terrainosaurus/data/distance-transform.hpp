@@ -0,0 +1,64 @@
+/*
+ * File: distance-transform.hpp
+ *
+ * Author: Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes.
+ *
+ * Description:
+ *      This file declares functions for finding the exact Euclidean distance
+ *      (in cells) from each cell of an IDMap to the nearest boundary, where
+ *      a boundary cell is one having a 4-neighbor with a different ID. Thus,
+ *      the cells on both sides of a change in ID are at distance zero, and
+ *      a cell right next to them is at distance one.
+ *
+ *      The signed version considers only the boundary of the cells having a
+ *      particular ID, and makes distances negative outside of them, which is
+ *      what's wanted for blending a region into its surroundings.
+ *
+ *      Optionally, the nearest boundary cell to each cell may be found as
+ *      well. It is recorded as its linear index relative to the bases of
+ *      the IDMap (i.e., (i - base(0)) + (j - base(1)) * size(0)), or as -1
+ *      if there are no boundary cells at all, in which case the distance is
+ *      the largest representable scalar_t.
+ *
+ *      The results have the same bounds as the IDMap.
+ *
+ * Implementation notes:
+ *      The distance is found in two separable passes, each O(N), after
+ *      Felzenszwalb & Huttenlocher ("Distance Transforms of Sampled
+ *      Functions", Cornell TR2004-1963, 2004). The first pass finds the
+ *      nearest boundary cell in the same row as each cell. The second finds,
+ *      for each column, the lower envelope of the parabolas (y - j)^2 + d_j^2
+ *      rooted at each row 'j' (d_j being the row distance found by the first
+ *      pass) and reads off the minimum at each cell. Rows (and then columns)
+ *      are independent, so each pass is split into bands which are processed
+ *      in parallel using the application WorkerPool.
+ */
+
+#ifndef TERRAINOSAURUS_DATA_DISTANCE_TRANSFORM
+#define TERRAINOSAURUS_DATA_DISTANCE_TRANSFORM
+
+// Import library configuration
+#include <terrainosaurus/terrainosaurus-common.h>
+
+// This is part of the Terrainosaurus terrain generation engine
+namespace terrainosaurus {
+    // Raster types for the results
+    typedef inca::raster::MultiArrayRaster<scalar_t, 2>     DistanceField;
+    typedef inca::raster::MultiArrayRaster<IndexType, 2>    NearestCellMap;
+
+    // Find the distance from each cell of 'ids' to the nearest boundary
+    // between different IDs (and, if 'nearest' is not NULL, which cell that is)
+    void boundaryDistanceTransform(DistanceField & result, const IDMap & ids,
+                                   NearestCellMap * nearest = NULL);
+
+    // Find the signed distance from each cell of 'ids' to the nearest boundary
+    // of the cells having ID 'id', which is positive for those cells and
+    // negative for all others
+    void signedDistanceTransform(DistanceField & result, const IDMap & ids,
+                                 IDType id, NearestCellMap * nearest = NULL);
+};
+
+#endif
@@ -0,0 +1,294 @@
+/*
+ * File: label-regions.cpp
+ *
+ * Author: Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes.
+ *
+ * Description:
+ */
+
+// Include precompiled header
+#include <terrainosaurus/precomp.h>
+
+// Import function prototypes
+#include "label-regions.hpp"
+
+// Import parallel execution support
+#include <terrainosaurus/util/WorkerPool.hpp>
+
+// Import container definitions
+#include <unordered_map>
+#include <limits>
+
+using namespace terrainosaurus;
+
+
+// Local helper functions
+namespace {
+    typedef IDMap::Region       Region;
+    typedef IDMap::IndexArray   IndexArray;
+
+    // A disjoint-set forest over the cells of a raster (numbered row by row),
+    // in which each set is represented by its lowest-numbered cell
+    struct Forest {
+        std::vector<IndexType> parent;
+
+        // Find the representative of 'c', halving the path to it on the way
+        IndexType find(IndexType c) {
+            while (parent[c] != c) {
+                parent[c] = parent[parent[c]];
+                c = parent[c];
+            }
+            return c;
+        }
+
+        // Same thing, but without changing anything, so that any number of
+        // threads may do it at once
+        IndexType root(IndexType c) const {
+            while (parent[c] != c)
+                c = parent[c];
+            return c;
+        }
+
+        // Merge the sets containing 'a' and 'b'
+        void join(IndexType a, IndexType b) {
+            a = find(a);
+            b = find(b);
+            if      (a < b)     parent[b] = a;
+            else if (b < a)     parent[a] = b;
+        }
+    };
+
+    // The bounds & area of one region within one band
+    struct RegionExtent {
+        IndexType   minimum[2], maximum[2];
+        SizeType    area;
+    };
+
+    // The extents of the regions found in one band, in no particular order
+    struct BandExtents {
+        std::vector<IDType>         regions;
+        std::vector<RegionExtent>   extents;
+    };
+
+    // Choose a band size for splitting 'size' rows among the available
+    // workers, a few bands per worker
+    SizeType bandSize(SizeType size) {
+        SizeType bands = 4 * WorkerPool::instance().workerCount();
+        return std::max(SizeType(16), (size + bands - 1) / bands);
+    }
+
+    // First pass: join each cell in rows [first, last) with its matching
+    // neighbors to the left and above (but only within those rows)
+    void joinBand(Forest & forest, const IDMap & ids,
+                  IndexType first, IndexType last) {
+        IndexType w = IndexType(ids.size(0));
+        IndexType b0 = ids.base(0), b1 = ids.base(1);
+        for (IndexType j = first; j < last; ++j) {
+            for (IndexType i = 0; i < w; ++i) {
+                IndexType c = j * w + i;
+                forest.parent[c] = c;
+                IDType id = ids(b0 + i, b1 + j);
+                if (id == 0)
+                    continue;
+                if (i > 0 && ids(b0 + i - 1, b1 + j) == id)
+                    forest.join(c, c - 1);
+                if (j > first && ids(b0 + i, b1 + j - 1) == id)
+                    forest.join(c, c - w);
+            }
+        }
+    }
+
+    // Count the seeds (the cells that represent their regions) in rows
+    // [first, last)
+    SizeType countSeeds(const Forest & forest, const IDMap & ids,
+                        IndexType first, IndexType last) {
+        IndexType w = IndexType(ids.size(0));
+        IndexType b0 = ids.base(0), b1 = ids.base(1);
+        SizeType count = 0;
+        for (IndexType j = first; j < last; ++j)
+            for (IndexType i = 0; i < w; ++i)
+                if (forest.parent[j * w + i] == j * w + i
+                        && ids(b0 + i, b1 + j) != 0)
+                    ++count;
+        return count;
+    }
+
+    // Number the seeds in rows [first, last), starting with 'next'
+    void numberSeeds(IDMap & regionIDs, std::vector<Pixel> & seeds,
+                     const Forest & forest, const IDMap & ids,
+                     IndexType first, IndexType last, IDType next) {
+        IndexType w = IndexType(ids.size(0));
+        IndexType b0 = ids.base(0), b1 = ids.base(1);
+        Pixel px;
+        for (IndexType j = first; j < last; ++j) {
+            px[1] = b1 + j;
+            for (IndexType i = 0; i < w; ++i) {
+                px[0] = b0 + i;
+                if (forest.parent[j * w + i] == j * w + i && ids(px) != 0) {
+                    regionIDs(px) = next;
+                    seeds[next - 1] = px;
+                    ++next;
+                }
+            }
+        }
+    }
+
+    // Second pass: give each cell in rows [first, last) the number of its
+    // region's seed, and find the extents of the regions within these rows
+    void labelBand(IDMap & regionIDs, BandExtents & band,
+                   const Forest & forest, const IDMap & ids,
+                   IndexType first, IndexType last) {
+        IndexType w = IndexType(ids.size(0));
+        IndexType b0 = ids.base(0), b1 = ids.base(1);
+        std::unordered_map<IDType, SizeType> slots;
+        IDType lastRegion = 0;
+        RegionExtent * extent = NULL;
+        for (IndexType j = first; j < last; ++j) {
+            for (IndexType i = 0; i < w; ++i) {
+                IndexType c = j * w + i;
+                if (ids(b0 + i, b1 + j) == 0) {
+                    regionIDs(b0 + i, b1 + j) = 0;
+                    continue;
+                }
+
+                // Seeds already know their numbers; everybody else asks
+                // their seed
+                IDType region;
+                IndexType s = forest.root(c);
+                if (s == c) {
+                    region = regionIDs(b0 + i, b1 + j);
+                } else {
+                    region = regionIDs(b0 + s % w, b1 + s / w);
+                    regionIDs(b0 + i, b1 + j) = region;
+                }
+
+                // Neighboring cells are usually in the same region, so only
+                // look up its extent when that changes
+                if (region != lastRegion) {
+                    std::pair<std::unordered_map<IDType, SizeType>::iterator,
+                              bool> slot = slots.insert(std::make_pair(
+                                            region, band.extents.size()));
+                    if (slot.second) {
+                        RegionExtent e;
+                        e.minimum[0] = e.maximum[0] = b0 + i;
+                        e.minimum[1] = e.maximum[1] = b1 + j;
+                        e.area = 0;
+                        band.regions.push_back(region);
+                        band.extents.push_back(e);
+                    }
+                    extent = &band.extents[slot.first->second];
+                    lastRegion = region;
+                }
+                extent->minimum[0] = std::min(extent->minimum[0], b0 + i);
+                extent->maximum[0] = std::max(extent->maximum[0], b0 + i);
+                extent->maximum[1] = b1 + j;    // Rows only increase
+                ++extent->area;
+            }
+        }
+    }
+}
+
+
+/*---------------------------------------------------------------------------*
+ | Region labelling function
+ *---------------------------------------------------------------------------*/
+void terrainosaurus::labelRegions(IDMap & regionIDs,
+                                  std::vector<Region> & bounds,
+                                  std::vector<Pixel> & seeds,
+                                  std::vector<SizeType> & areas,
+                                  const IDMap & ids) {
+    regionIDs.setBounds(ids.bases(), ids.extents());
+    bounds.clear();
+    seeds.clear();
+    areas.clear();
+    if (ids.size() == 0)
+        return;
+
+    // Split the raster into bands of rows
+    IndexType w = IndexType(ids.size(0)), h = IndexType(ids.size(1));
+    IndexType grain = IndexType(bandSize(ids.size(1)));
+    IndexType bandCount = (h + grain - 1) / grain;
+
+    // Join up the cells within each band...
+    Forest forest;
+    forest.parent.resize(ids.size());
+    parallelFor(0, bandCount, 1, [&](IndexType first, IndexType last) {
+        for (IndexType b = first; b < last; ++b)
+            joinBand(forest, ids, b * grain, std::min(h, (b + 1) * grain));
+    });
+
+    //...then across the seams between them
+    IndexType b0 = ids.base(0), b1 = ids.base(1);
+    for (IndexType j = grain; j < h; j += grain)
+        for (IndexType i = 0; i < w; ++i) {
+            IDType id = ids(b0 + i, b1 + j);
+            if (id != 0 && ids(b0 + i, b1 + j - 1) == id)
+                forest.join(j * w + i, (j - 1) * w + i);
+        }
+
+    // Number the seeds in scan order, which means knowing how many there
+    // are in the bands before each one
+    std::vector<SizeType> seedCounts(bandCount);
+    parallelFor(0, bandCount, 1, [&](IndexType first, IndexType last) {
+        for (IndexType b = first; b < last; ++b)
+            seedCounts[b] = countSeeds(forest, ids, b * grain,
+                                       std::min(h, (b + 1) * grain));
+    });
+    std::vector<IDType> firstNumbers(bandCount);
+    SizeType regionCount = 0;
+    for (IndexType b = 0; b < bandCount; ++b) {
+        firstNumbers[b] = IDType(regionCount + 1);
+        regionCount += seedCounts[b];
+    }
+    seeds.resize(regionCount);
+    parallelFor(0, bandCount, 1, [&](IndexType first, IndexType last) {
+        for (IndexType b = first; b < last; ++b)
+            numberSeeds(regionIDs, seeds, forest, ids, b * grain,
+                        std::min(h, (b + 1) * grain), firstNumbers[b]);
+    });
+
+    // Label everything else, and measure the regions
+    std::vector<BandExtents> bands(bandCount);
+    parallelFor(0, bandCount, 1, [&](IndexType first, IndexType last) {
+        for (IndexType b = first; b < last; ++b)
+            labelBand(regionIDs, bands[b], forest, ids, b * grain,
+                      std::min(h, (b + 1) * grain));
+    });
+
+    // Finally, merge the measurements from all of the bands. A region's
+    // top row is that of its seed.
+    std::vector<RegionExtent> extents(regionCount);
+    for (SizeType r = 0; r < regionCount; ++r) {
+        RegionExtent & e = extents[r];
+        e.minimum[0] = std::numeric_limits<IndexType>::max();
+        e.maximum[0] = std::numeric_limits<IndexType>::min();
+        e.minimum[1] = seeds[r][1];
+        e.maximum[1] = seeds[r][1];
+        e.area = 0;
+    }
+    for (IndexType b = 0; b < bandCount; ++b) {
+        const BandExtents & band = bands[b];
+        for (SizeType k = 0; k < band.regions.size(); ++k) {
+            RegionExtent & e = extents[band.regions[k] - 1];
+            const RegionExtent & be = band.extents[k];
+            e.minimum[0] = std::min(e.minimum[0], be.minimum[0]);
+            e.maximum[0] = std::max(e.maximum[0], be.maximum[0]);
+            e.maximum[1] = std::max(e.maximum[1], be.maximum[1]);
+            e.area += be.area;
+        }
+    }
+    bounds.reserve(regionCount);
+    areas.reserve(regionCount);
+    for (SizeType r = 0; r < regionCount; ++r) {
+        IndexArray bs, ex;
+        for (IndexType d = 0; d < 2; ++d) {
+            bs[d] = extents[r].minimum[d];
+            ex[d] = extents[r].maximum[d];
+        }
+        bounds.push_back(Region(bs, ex));
+        areas.push_back(extents[r].area);
+    }
+}
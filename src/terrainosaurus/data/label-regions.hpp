@@ -0,0 +1,55 @@
+/*
+ * File: label-regions.hpp
+ *
+ * Author: Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes.
+ *
+ * Description:
+ *      This file declares a function for dividing a raster of terrain type
+ *      IDs into regions: maximal 4-connected groups of cells having the same
+ *      terrain type. Cells with an ID of zero belong to no region.
+ *
+ *      Regions are numbered from 1, in the order in which their first cells
+ *      are reached when scanning the raster a row at a time (i.e., with
+ *      dimension 0 varying fastest), and that first cell is the region's
+ *      "seed". Each cell of the resulting IDMap holds the number of the
+ *      region containing it (or zero), and region 'n' is described by
+ *      element 'n - 1' of each of the lists of bounds, seeds and areas.
+ *
+ * Implementation notes:
+ *      This is a two-pass, union-find connected-component labeller. The
+ *      raster is split into bands of rows, and in the first pass, the cells
+ *      in each band are joined with their matching neighbors above and to
+ *      the left, in parallel, using the application WorkerPool. Since a set
+ *      is always represented by its lowest-numbered cell, the representative
+ *      of each region is its seed. Next, the bands are stitched together by
+ *      joining the cells on either side of each seam, and the seeds are
+ *      numbered. In the second pass, each cell is given the number of its
+ *      region's seed, and the bounds & area of each region within each band
+ *      are accumulated, again in parallel; these are then merged.
+ */
+
+#ifndef TERRAINOSAURUS_DATA_LABEL_REGIONS
+#define TERRAINOSAURUS_DATA_LABEL_REGIONS
+
+// Import library configuration
+#include <terrainosaurus/terrainosaurus-common.h>
+
+// Import container definitions
+#include <vector>
+
+// This is part of the Terrainosaurus terrain generation engine
+namespace terrainosaurus {
+    // Find the regions of 'ids', storing the number of the region containing
+    // each cell in 'regionIDs' (which is made the same size as 'ids'), and
+    // the bounds, seed and area of each region in the corresponding list
+    void labelRegions(IDMap & regionIDs,
+                      std::vector<IDMap::Region> & bounds,
+                      std::vector<Pixel> & seeds,
+                      std::vector<SizeType> & areas,
+                      const IDMap & ids);
+};
+
+#endif
@@ -0,0 +1,206 @@
+/*
+ * File: rasterize-map.cpp
+ *
+ * Author: Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes.
+ *
+ * Description:
+ */
+
+// Include precompiled header
+#include <terrainosaurus/precomp.h>
+
+// Import function prototypes
+#include "rasterize-map.hpp"
+
+// Import parallel execution support
+#include <terrainosaurus/util/WorkerPool.hpp>
+
+// Import container & algorithm definitions
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace terrainosaurus;
+
+
+// Local helper classes & functions
+namespace {
+    // The closed outline of a single face
+    struct FaceOutline {
+        IDType                  id;         // Terrain type ID to fill with
+        std::vector<Point2D>    points;     // Vertices, in order
+        scalar_t                minY, maxY; // Vertical extent
+    };
+    typedef std::vector<FaceOutline> OutlineList;
+
+    // Walk around each face, collecting the points along its boundary (in
+    // the same way that MapRendering tesselates it)
+    void buildOutlines(OutlineList & outlines, const Map & m) {
+        const Map::FacePtrList & faces = m.faces();
+        Map::FacePtrList::const_iterator fs;
+        for (fs = faces.begin(); fs != faces.end(); ++fs) {
+            Map::FacePtr f = *fs;
+            if (! f->terrainType())
+                continue;       // Nothing to fill it with
+
+            FaceOutline o;
+            o.id = f->terrainType()->terrainTypeID();
+            Map::Face::ccw_edge_iterator es, end_e;
+            for (es = f->edgesCCW(); es != end_e; ++es) {
+                Map::EdgePtr e = *es;
+                bool forward = (e->startVertex() == e->vertexCW(f));
+                if (e->isRefined()) {
+                    // Skip first (duplicated) point
+                    const Map::PointList & points = e->refinement();
+                    if (forward)
+                        o.points.insert(o.points.end(),
+                                        ++points.begin(), points.end());
+                    else
+                        o.points.insert(o.points.end(),
+                                        ++points.rbegin(), points.rend());
+                } else {
+                    o.points.push_back(forward ? e->endVertex()->position()
+                                               : e->startVertex()->position());
+                }
+            }
+            if (o.points.size() < 3)
+                continue;       // Degenerate: covers nothing
+
+            o.minY = o.maxY = o.points[0][1];
+            for (IndexType i = 1; i < IndexType(o.points.size()); ++i) {
+                o.minY = std::min(o.minY, o.points[i][1]);
+                o.maxY = std::max(o.maxY, o.points[i][1]);
+            }
+            outlines.push_back(o);
+        }
+    }
+
+    // The index of the first cell whose center is at or after 'x', given
+    // the first cell's minimum edge and the cell size
+    inline IndexType firstCellAfter(scalar_t x, scalar_t start,
+                                    scalar_t cellSize, IndexType base) {
+        return base + IndexType(std::ceil((x - start) / cellSize
+                                          - scalar_t(0.5)));
+    }
+
+    // Fill the rows [first, last) of 'ids' with the faces in 'outlines'
+    void rasterizeBand(IDMap & ids, const OutlineList & outlines,
+                       const Point2D & origin, scalar_t cellSize,
+                       IndexType first, IndexType last) {
+        IndexType firstCol = ids.base(0),
+                  endCol   = ids.extent(0) + 1;
+        std::vector< std::vector<scalar_t> > crossings(last - first);
+
+        for (IndexType f = 0; f < IndexType(outlines.size()); ++f) {
+            const FaceOutline & o = outlines[f];
+
+            // Skip faces that don't touch this band at all
+            IndexType faceFirst = firstCellAfter(o.minY, origin[1], cellSize, ids.base(1)),
+                      faceLast  = firstCellAfter(o.maxY, origin[1], cellSize, ids.base(1));
+            if (faceLast <= first || faceFirst >= last)
+                continue;
+
+            // Find where each segment crosses the center line of each row.
+            // Each segment covers the rows whose centers are in [lo, hi), so
+            // a vertex shared by two segments is only counted once.
+            for (IndexType k = 0; k < IndexType(crossings.size()); ++k)
+                crossings[k].clear();
+            SizeType n = o.points.size();
+            for (SizeType s = 0; s < n; ++s) {
+                Point2D lo = o.points[s],
+                        hi = o.points[(s + 1) % n];
+                if (lo[1] == hi[1])
+                    continue;       // Horizontal: crosses no center lines
+                if (hi[1] < lo[1])
+                    std::swap(lo, hi);
+
+                IndexType j0 = std::max(first, firstCellAfter(lo[1], origin[1], cellSize, ids.base(1))),
+                          j1 = std::min(last,  firstCellAfter(hi[1], origin[1], cellSize, ids.base(1)));
+                scalar_t slope = (hi[0] - lo[0]) / (hi[1] - lo[1]);
+                for (IndexType j = j0; j < j1; ++j) {
+                    scalar_t y = origin[1] + (j - ids.base(1) + scalar_t(0.5)) * cellSize;
+                    crossings[j - first].push_back(lo[0] + (y - lo[1]) * slope);
+                }
+            }
+
+            // Fill between each pair of crossings
+            for (IndexType j = std::max(first, faceFirst); j < std::min(last, faceLast); ++j) {
+                std::vector<scalar_t> & xs = crossings[j - first];
+                std::sort(xs.begin(), xs.end());
+                for (SizeType k = 0; k + 1 < xs.size(); k += 2) {
+                    IndexType i0 = std::max(firstCol, firstCellAfter(xs[k],     origin[0], cellSize, firstCol)),
+                              i1 = std::min(endCol,   firstCellAfter(xs[k + 1], origin[0], cellSize, firstCol));
+                    for (IndexType i = i0; i < i1; ++i)
+                        ids(i, j) = o.id;
+                }
+            }
+        }
+    }
+}
+
+
+// Scan-convert the whole map
+void terrainosaurus::rasterizeMap(IDMap & ids, const Map & m,
+                                  const Point2D & origin, scalar_t cellSize,
+                                  IDType background) {
+    // Start with a clean slate
+    for (IndexType j = ids.base(1); j <= ids.extent(1); ++j)
+        for (IndexType i = ids.base(0); i <= ids.extent(0); ++i)
+            ids(i, j) = background;
+    if (ids.size() == 0)
+        return;
+
+    OutlineList outlines;
+    buildOutlines(outlines, m);
+
+    // Split it into bands, a few per worker
+    SizeType rows  = ids.size(1);
+    SizeType bands = 4 * WorkerPool::instance().workerCount();
+    SizeType grain = std::max(SizeType(16), (rows + bands - 1) / bands);
+    parallelFor(ids.base(1), ids.extent(1) + 1, grain,
+                [&](IndexType first, IndexType last) {
+        rasterizeBand(ids, outlines, origin, cellSize, first, last);
+    });
+}
+
+
+// Find the extent of the map
+bool terrainosaurus::mapBounds(Point2D & minimum, Point2D & maximum,
+                               const Map & m) {
+    minimum = Point2D(std::numeric_limits<scalar_t>::max());
+    maximum = Point2D(-std::numeric_limits<scalar_t>::max());
+
+    const Map::VertexPtrList & vertices = m.vertices();
+    Map::VertexPtrList::const_iterator vi;
+    for (vi = vertices.begin(); vi != vertices.end(); ++vi) {
+        Point2D p = (*vi)->position();
+        for (IndexType d = 0; d < 2; ++d) {
+            minimum[d] = std::min(minimum[d], p[d]);
+            maximum[d] = std::max(maximum[d], p[d]);
+        }
+    }
+
+    // Refined boundaries can wander outside the vertices' bounding box
+    const Map::EdgePtrList & edges = m.edges();
+    Map::EdgePtrList::const_iterator ei;
+    for (ei = edges.begin(); ei != edges.end(); ++ei) {
+        const Map::PointList & points = (*ei)->refinement();
+        Map::PointList::const_iterator pt;
+        for (pt = points.begin(); pt != points.end(); ++pt)
+            for (IndexType d = 0; d < 2; ++d) {
+                minimum[d] = std::min(minimum[d], (*pt)[d]);
+                maximum[d] = std::max(maximum[d], (*pt)[d]);
+            }
+    }
+
+    // Nothing at all, and the box is inside-out
+    if (minimum[0] > maximum[0] || minimum[1] > maximum[1]) {
+        minimum = maximum = Point2D(0);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,58 @@
+/*
+ * File: rasterize-map.hpp
+ *
+ * Author: Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes.
+ *
+ * Description:
+ *      This file declares functions for scan-converting a vector Map into a
+ *      raster of terrain type IDs (the raw material for a MapRasterization),
+ *      entirely on the CPU. Unlike drawing the map with OpenGL and reading
+ *      back the framebuffer, this works without a display, and at any size
+ *      and resolution.
+ *
+ *      Each face of the map is filled using the refined version of each of
+ *      its edges (if there is one), or else the straight edge between its
+ *      vertices. A cell gets the terrain type ID of the face containing its
+ *      center, or the "background" ID if no face contains it. Cells along a
+ *      boundary shared by two faces always go to exactly one of them (there
+ *      are no gaps or double-covered cells).
+ *
+ * Implementation notes:
+ *      This is a classic even-odd scanline fill. Each face's outline is
+ *      intersected with the horizontal line through the cell centers of each
+ *      row, and the spans between pairs of crossings are filled. Crossings
+ *      are always computed from the lower end of a segment, so the two faces
+ *      sharing an edge see exactly the same crossings.
+ *
+ *      The raster is split into bands of rows, which are filled in parallel
+ *      using the application WorkerPool.
+ */
+
+#ifndef TERRAINOSAURUS_DATA_RASTERIZE_MAP
+#define TERRAINOSAURUS_DATA_RASTERIZE_MAP
+
+// Import library configuration
+#include <terrainosaurus/terrainosaurus-common.h>
+
+// Import Map definition
+#include "Map.hpp"
+
+// This is part of the Terrainosaurus terrain generation engine
+namespace terrainosaurus {
+    // Scan-convert 'm' into 'ids', which must already be the desired size.
+    // Cell (i, j) is the map-space square of side 'cellSize' whose minimum
+    // corner is 'origin + (i - ids.base(0), j - ids.base(1)) * cellSize'.
+    void rasterizeMap(IDMap & ids, const Map & m,
+                      const Point2D & origin, scalar_t cellSize,
+                      IDType background = 0);
+
+    // Find the map-space bounding box of everything in 'm' (including the
+    // refined boundaries). If 'm' is empty, there is no such box, so this
+    // returns false and gives the empty box at the origin.
+    bool mapBounds(Point2D & minimum, Point2D & maximum, const Map & m);
+};
+
+#endif
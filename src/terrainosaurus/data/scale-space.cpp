@@ -0,0 +1,352 @@
+/*
+ * File: scale-space.cpp
+ *
+ * Author: Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes.
+ *
+ * Description:
+ */
+
+// Include precompiled header
+#include <terrainosaurus/precomp.h>
+
+// Import function prototypes
+#include "scale-space.hpp"
+
+// Import parallel execution support
+#include <terrainosaurus/util/WorkerPool.hpp>
+
+// Import math functions & algorithms
+#include <cmath>
+#include <algorithm>
+
+using namespace terrainosaurus;
+
+
+// Local helper functions
+namespace {
+    // Blurs at least this large use the recursive filter
+    const scalar_t RECURSIVE_SIGMA = 3.0f;
+
+    // One level of the scale space, with dimension 0 varying fastest
+    struct Plane {
+        SizeType            width, height;
+        std::vector<float>  cells;
+
+        void resize(SizeType w, SizeType h) {
+            width = w;
+            height = h;
+            cells.resize(w * h);
+        }
+        float *       row(IndexType j)       { return &cells[j * width]; }
+        const float * row(IndexType j) const { return &cells[j * width]; }
+        void swap(Plane & p) {
+            std::swap(width, p.width);
+            std::swap(height, p.height);
+            cells.swap(p.cells);
+        }
+    };
+
+    // Choose a tile size for splitting 'size' rows (or columns) among the
+    // available workers
+    SizeType tileSize(SizeType size) {
+        SizeType tiles = 4 * WorkerPool::instance().workerCount();
+        return std::max((size + tiles - 1) / tiles, SizeType(16));
+    }
+
+    // Clamp an index to [0, n - 1]
+    inline IndexType clampIndex(IndexType i, SizeType n) {
+        return i < 0 ? 0 : (i >= IndexType(n) ? IndexType(n) - 1 : i);
+    }
+
+
+    /*-----------------------------------------------------------------------*
+     | Sampled Gaussian kernel (for small blurs)
+     *-----------------------------------------------------------------------*/
+    // The center and right half of the discrete analogue of the Gaussian
+    // (Lindeberg's e^-t I_n(t), with t = sigma^2), cut off 4 standard
+    // deviations out and normalized. Unlike the sampled Gaussian, blurring by
+    // this twice is the same as blurring once by the combined amount, which
+    // is what lets us build each level from the last one. The Bessel
+    // functions are found by Miller's backward recurrence, starting well
+    // beyond the cut-off.
+    void gaussianKernel(std::vector<float> & k, scalar_t sigma) {
+        IndexType radius = IndexType(std::ceil(4.0f * sigma));
+        IndexType start  = 2 * radius + 16;
+        double t = double(sigma) * sigma;
+        std::vector<double> bessel(radius + 1);
+        double above = 0.0, here = 1e-30;
+        for (IndexType n = start; n > 0; --n) {
+            double below = above + (2.0 * n / t) * here;
+            above = here;
+            here  = below;
+            if (here > 1e250) {         // Rescale before we overflow
+                above /= here;
+                for (IndexType r = n; r <= radius; ++r)
+                    bessel[r] /= here;
+                here = 1.0;
+            }
+            if (n - 1 <= radius)
+                bessel[n - 1] = here;
+        }
+
+        double sum = 0.0;
+        for (IndexType r = 0; r <= radius; ++r)
+            sum += (r == 0 ? 1 : 2) * bessel[r];
+        k.resize(radius + 1);
+        for (IndexType r = 0; r <= radius; ++r)
+            k[r] = float(bessel[r] / sum);
+    }
+
+    // Convolve rows [first, last) of 'src' with the kernel along dimension
+    // 0. 'line' is scratch space.
+    void convolveRows(Plane & dst, const Plane & src, const std::vector<float> & k,
+                      IndexType first, IndexType last, std::vector<float> & line) {
+        IndexType radius = IndexType(k.size()) - 1;
+        IndexType w = IndexType(src.width);
+        line.resize(w + 2 * radius);
+        for (IndexType j = first; j < last; ++j) {
+            // Edge-extend the row, so the inner loop needs no clamping
+            const float * in = src.row(j);
+            for (IndexType i = -radius; i < w + radius; ++i)
+                line[i + radius] = in[clampIndex(i, w)];
+
+            const float * center = &line[radius];
+            float * out = dst.row(j);
+            for (IndexType i = 0; i < w; ++i) {
+                float sum = k[0] * center[i];
+                for (IndexType r = 1; r <= radius; ++r)
+                    sum += k[r] * (center[i - r] + center[i + r]);
+                out[i] = sum;
+            }
+        }
+    }
+
+    // Convolve rows [first, last) of 'src' with the kernel along dimension
+    // 1. Whole rows are combined at a time, so that memory is read in order.
+    void convolveColumns(Plane & dst, const Plane & src, const std::vector<float> & k,
+                         IndexType first, IndexType last) {
+        IndexType radius = IndexType(k.size()) - 1;
+        SizeType w = src.width, h = src.height;
+        for (IndexType j = first; j < last; ++j) {
+            float * out = dst.row(j);
+            const float * in = src.row(j);
+            for (SizeType i = 0; i < w; ++i)
+                out[i] = k[0] * in[i];
+            for (IndexType r = 1; r <= radius; ++r) {
+                const float * above = src.row(clampIndex(j - r, h));
+                const float * below = src.row(clampIndex(j + r, h));
+                for (SizeType i = 0; i < w; ++i)
+                    out[i] += k[r] * (above[i] + below[i]);
+            }
+        }
+    }
+
+
+    /*-----------------------------------------------------------------------*
+     | Recursive Gaussian (for large blurs)
+     *-----------------------------------------------------------------------*/
+    // The Young/van Vliet filter coefficients for a given sigma (normalized
+    // so that b0 == 1)
+    struct RecursiveFilter {
+        explicit RecursiveFilter(scalar_t sigma)
+                : tail(SizeType(std::ceil(6.0f * sigma)) + 1) {
+            double q = (sigma >= 2.5f)
+                     ? 0.98711 * sigma - 0.96330
+                     : 3.97156 - 4.14554 * std::sqrt(1.0 - 0.26891 * sigma);
+            double q2 = q * q, q3 = q2 * q;
+            double b0 =  1.57825 + 2.44413 * q + 1.4281 * q2 + 0.422205 * q3;
+            b1 = float(( 2.44413 * q + 2.85619 * q2 + 1.26661 * q3) / b0);
+            b2 = float(-(1.4281 * q2 + 1.26661 * q3) / b0);
+            b3 = float(  0.422205 * q3 / b0);
+            B  = 1.0f - (b1 + b2 + b3);
+        }
+
+        // Filter 'n' contiguous values in place: first causally, then
+        // anti-causally. The edges are treated as continuing forever at the
+        // value of the edge cell. This is exact for the causal pass (which
+        // starts from the steady state for the first cell). The anti-causal
+        // pass can't start from a steady state, so the causal pass is run on
+        // past the end for a few standard deviations ('tail' cells), by
+        // which time the difference has died away.
+        void operator()(float * x, SizeType n, std::vector<float> & t) const {
+            float u = x[n - 1];
+            float w1 = x[0], w2 = x[0], w3 = x[0];
+            for (SizeType i = 0; i < n; ++i) {
+                float w0 = B * x[i] + b1 * w1 + b2 * w2 + b3 * w3;
+                x[i] = w0;
+                w3 = w2;  w2 = w1;  w1 = w0;
+            }
+            t.resize(tail);
+            for (SizeType i = 0; i < tail; ++i) {
+                float w0 = B * u + b1 * w1 + b2 * w2 + b3 * w3;
+                t[i] = w0;
+                w3 = w2;  w2 = w1;  w1 = w0;
+            }
+
+            float y1 = t[tail - 1], y2 = y1, y3 = y1;
+            for (SizeType i = tail; i-- > 0; ) {
+                float y0 = B * t[i] + b1 * y1 + b2 * y2 + b3 * y3;
+                y3 = y2;  y2 = y1;  y1 = y0;
+            }
+            for (SizeType i = n; i-- > 0; ) {
+                float y0 = B * x[i] + b1 * y1 + b2 * y2 + b3 * y3;
+                x[i] = y0;
+                y3 = y2;  y2 = y1;  y1 = y0;
+            }
+        }
+
+        // Filter columns [first, last) of 'p' in place, in the same way.
+        // Rows are swept one at a time across the whole band of columns, so
+        // that memory is read in order, rather than one column at a time.
+        void columns(Plane & p, IndexType first, IndexType last) const {
+            IndexType h = IndexType(p.height);
+            SizeType  n = SizeType(last - first);
+            std::vector<float> u(p.row(h - 1) + first, p.row(h - 1) + last),
+                               s1(p.row(0) + first, p.row(0) + last),
+                               s2(s1), s3(s1), t(tail * n);
+
+            // Causal pass (carrying on into the tail)
+            for (IndexType j = 0; j < h + IndexType(tail); ++j) {
+                float * x = (j < h ? p.row(j) + first : &t[(j - h) * n]);
+                const float * in = (j < h ? x : &u[0]);
+                for (SizeType i = 0; i < n; ++i) {
+                    float w0 = B * in[i] + b1 * s1[i] + b2 * s2[i] + b3 * s3[i];
+                    x[i] = w0;
+                    s3[i] = s2[i];  s2[i] = s1[i];  s1[i] = w0;
+                }
+            }
+
+            // Anti-causal pass (starting from the end of the tail)
+            s2 = s1;
+            s3 = s1;
+            for (IndexType j = h + IndexType(tail); j-- > 0; ) {
+                float * x = (j < h ? p.row(j) + first : &t[(j - h) * n]);
+                for (SizeType i = 0; i < n; ++i) {
+                    float y0 = B * x[i] + b1 * s1[i] + b2 * s2[i] + b3 * s3[i];
+                    x[i] = y0;
+                    s3[i] = s2[i];  s2[i] = s1[i];  s1[i] = y0;
+                }
+            }
+        }
+
+        SizeType tail;
+        float B, b1, b2, b3;
+    };
+
+
+    /*-----------------------------------------------------------------------*
+     | Whole-plane operations
+     *-----------------------------------------------------------------------*/
+    // Blur 'src' by 'sigma' into 'dst', using 'scratch' for the intermediate
+    // result. 'dst' may be the same plane as 'src'.
+    void blurPlane(Plane & dst, const Plane & src, scalar_t sigma,
+                   Plane & scratch) {
+        SizeType w = src.width, h = src.height;
+        if (sigma <= 0.0f) {
+            if (&dst != &src)
+                dst = src;
+            return;
+        }
+        scratch.resize(w, h);
+
+        if (sigma < RECURSIVE_SIGMA) {
+            std::vector<float> k;
+            gaussianKernel(k, sigma);
+            parallelFor(0, IndexType(h), tileSize(h),
+                        [&](IndexType first, IndexType last) {
+                std::vector<float> line;
+                convolveRows(scratch, src, k, first, last, line);
+            });
+            dst.resize(w, h);
+            parallelFor(0, IndexType(h), tileSize(h),
+                        [&](IndexType first, IndexType last) {
+                convolveColumns(dst, scratch, k, first, last);
+            });
+
+        } else {
+            RecursiveFilter filter(sigma);
+            parallelFor(0, IndexType(h), tileSize(h),
+                        [&](IndexType first, IndexType last) {
+                std::vector<float> tail;
+                for (IndexType j = first; j < last; ++j) {
+                    std::copy(src.row(j), src.row(j) + w, scratch.row(j));
+                    filter(scratch.row(j), w, tail);
+                }
+            });
+            parallelFor(0, IndexType(w), tileSize(w),
+                        [&](IndexType first, IndexType last) {
+                filter.columns(scratch, first, last);
+            });
+            dst.swap(scratch);
+        }
+    }
+
+    // Copy a heightfield into a plane
+    void toPlane(Plane & p, const Heightfield & hf) {
+        SizeType w = hf.size(0), h = hf.size(1);
+        IndexType b0 = hf.base(0), b1 = hf.base(1);
+        p.resize(w, h);
+        parallelFor(0, IndexType(h), tileSize(h),
+                    [&](IndexType first, IndexType last) {
+            for (IndexType j = first; j < last; ++j) {
+                float * out = p.row(j);
+                for (IndexType i = 0; i < IndexType(w); ++i)
+                    out[i] = hf(b0 + i, b1 + j);
+            }
+        });
+    }
+}
+
+
+void terrainosaurus::gaussianScaleSpace(ScaleSpaceImage & result,
+                                        const Heightfield & hf,
+                                        const std::vector<scalar_t> & scales) {
+    SizeType w = hf.size(0), h = hf.size(1), n = scales.size();
+    result.setSizes(inca::Array<SizeType, 3>(w, h, n));
+    if (w == 0 || h == 0 || n == 0)
+        return;
+
+    // Each level adds whatever blur the one before it is missing. If the
+    // scales aren't in increasing order, we may have to start over from the
+    // original heightfield.
+    Plane original, level, scratch;
+    toPlane(original, hf);
+    scalar_t levelSigma = 0.0f;
+    for (IndexType k = 0; k < IndexType(n); ++k) {
+        scalar_t sigma = std::max(scales[k], scalar_t(0));
+        if (k == 0 || sigma < levelSigma)
+            blurPlane(level, original, sigma, scratch);
+        else
+            blurPlane(level, level, std::sqrt(sigma * sigma
+                                              - levelSigma * levelSigma),
+                      scratch);
+        levelSigma = sigma;
+
+        std::copy(level.cells.begin(), level.cells.end(),
+                  result.elements() + k * w * h);
+    }
+}
+
+void terrainosaurus::gaussianBlur(Heightfield & result, const Heightfield & hf,
+                                  scalar_t sigma) {
+    result.setSizes(hf.sizes());
+    if (hf.size() == 0)
+        return;
+
+    Plane p, scratch;
+    toPlane(p, hf);
+    blurPlane(p, p, sigma, scratch);
+
+    IndexType b0 = hf.base(0), b1 = hf.base(1);
+    parallelFor(0, IndexType(p.height), tileSize(p.height),
+                [&](IndexType first, IndexType last) {
+        for (IndexType j = first; j < last; ++j) {
+            const float * in = p.row(j);
+            for (IndexType i = 0; i < IndexType(p.width); ++i)
+                result(b0 + i, b1 + j) = in[i];
+        }
+    });
+}
@@ -0,0 +1,75 @@
+/*
+ * File: scale-space.hpp
+ *
+ * Author: Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes.
+ *
+ * Description:
+ *      This file declares functions for building the Gaussian scale space of
+ *      a heightfield: a stack of progressively blurrier copies of it, one per
+ *      scale, which the feature detectors (find_peaks, find_edges, etc.)
+ *      search for features of different sizes.
+ *
+ *      Scales are given as the standard deviation (in cells) of the Gaussian
+ *      blur, with 0 meaning "unblurred". Level 'k' of the result is the
+ *      heightfield blurred to scales[k], stored as a ScaleSpaceImage with
+ *      the scale as the third dimension, and all indices starting at zero.
+ *      Cells beyond the edge of the heightfield take the value of the nearest
+ *      edge cell, as in windowed-statistics.hpp.
+ *
+ *      gaussianBlur() does a single blur of any size, without building the
+ *      whole stack.
+ *
+ * Implementation notes:
+ *      The Gaussian is separable, so each level is blurred along dimension 0
+ *      and then dimension 1, and each of those passes is split into tiles
+ *      which are processed in parallel using the application WorkerPool.
+ *
+ *      Each level is derived from the one before it, rather than from the
+ *      original heightfield: since blurring by s1 and then by s2 is the same
+ *      as blurring by sqrt(s1^2 + s2^2), each level needs only to add the
+ *      blur that the last one is missing, which is much less than the total.
+ *
+ *      Small blurs (less than 3 cells) are done by convolution with the
+ *      discrete analogue of the Gaussian (extending 4 standard deviations
+ *      either side), for which blurring in steps gives the same result as
+ *      blurring all at once. Larger ones use the recursive (IIR)
+ *      approximation of Young & van Vliet ("Recursive implementation of the
+ *      Gaussian filter", Signal Processing 44, 1995), which costs the same
+ *      per cell no matter how large the blur is, but is less accurate for
+ *      small blurs. Near the edges of the heightfield, blurring in steps is
+ *      not quite the same as blurring all at once, since the edge cells are
+ *      replicated at each step.
+ *
+ *      The recursive filter matches the Gaussian closely near its peak, but
+ *      has heavier tails (its variance is about 1.2 sigma^2). The scales the
+ *      feature detectors use (0 - 3 cells) never need a step as large as its
+ *      threshold, so only gaussianBlur() with a large sigma exercises it;
+ *      src/test/scale_space.cpp checks both filters against a brute-force
+ *      Gaussian.
+ */
+
+#ifndef TERRAINOSAURUS_DATA_SCALE_SPACE
+#define TERRAINOSAURUS_DATA_SCALE_SPACE
+
+// Import library configuration
+#include <terrainosaurus/terrainosaurus-common.h>
+
+// Import container definitions
+#include <vector>
+
+// This is part of the Terrainosaurus terrain generation engine
+namespace terrainosaurus {
+    // Build the Gaussian scale space of 'hf' at each of 'scales'
+    void gaussianScaleSpace(ScaleSpaceImage & result, const Heightfield & hf,
+                            const std::vector<scalar_t> & scales);
+
+    // Blur 'hf' by a Gaussian with standard deviation 'sigma' (in cells).
+    // 'result' may not be the same raster as 'hf'.
+    void gaussianBlur(Heightfield & result, const Heightfield & hf,
+                      scalar_t sigma);
+};
+
+#endif
@@ -0,0 +1,267 @@
+/*
+ * File: windowed-statistics.cpp
+ *
+ * Author: Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes.
+ *
+ * Description:
+ */
+
+// Include precompiled header
+#include <terrainosaurus/precomp.h>
+
+// Import function prototypes and class definitions
+#include "windowed-statistics.hpp"
+
+// Import parallel execution support
+#include <terrainosaurus/util/WorkerPool.hpp>
+
+using namespace terrainosaurus;
+
+
+// Local helper functions
+namespace {
+    // Build the lookup table mapping each index along one axis of the
+    // edge-extended domain back to the source index it replicates. The
+    // domain covers the windows around the cells [first, last), and thus
+    // includes the halo cells on either side.
+    void extendedIndices(std::vector<IndexType> & indices,
+                         IndexType base, SizeType size, SizeType windowSize,
+                         IndexType first, IndexType last) {
+        IndexType halfWin = IndexType(windowSize / 2);
+        IndexType extent  = base + IndexType(size) - 1;
+        indices.resize(SizeType(last - first) + windowSize - 1);
+        for (IndexType k = 0; k < IndexType(indices.size()); ++k) {
+            IndexType i = first + k - halfWin;
+            indices[k] = (i < base ? base : (i > extent ? extent : i));
+        }
+    }
+
+    // Compute the running extremum (minimum or maximum, depending on 'pick')
+    // of a window of size 'w' sliding along an (already edge-extended) line
+    // of values, using the van Herk/Gil-Werman algorithm. The line is split
+    // into blocks of 'w' values, and the prefix & suffix extrema are computed
+    // within each block. Any window spans at most two blocks, so its extremum
+    // is the combination of the suffix extremum at its start and the prefix
+    // extremum at its end.
+    template <typename Pick>
+    void slidingExtremes(std::vector<scalar_t> & result,
+                         const std::vector<scalar_t> & line, SizeType w,
+                         std::vector<scalar_t> & scratch, Pick pick) {
+        SizeType length = line.size();
+        SizeType count  = length - w + 1;
+        scratch.resize(2 * length);
+        scalar_t * g = &scratch[0];
+        scalar_t * h = g + length;
+
+        // Prefix extrema, restarting at the start of each block
+        for (SizeType k = 0; k < length; ++k)
+            g[k] = (k % w == 0) ? line[k] : pick(g[k - 1], line[k]);
+
+        // Suffix extrema, restarting at the end of each block
+        for (SizeType k = length; k-- > 0; )
+            h[k] = (k == length - 1 || (k + 1) % w == 0)
+                        ? line[k] : pick(h[k + 1], line[k]);
+
+        // Combine them
+        result.resize(count);
+        for (SizeType i = 0; i < count; ++i)
+            result[i] = pick(h[i], g[i + w - 1]);
+    }
+
+    inline scalar_t pickMin(scalar_t a, scalar_t b) { return b < a ? b : a; }
+    inline scalar_t pickMax(scalar_t a, scalar_t b) { return a < b ? b : a; }
+}
+
+
+/*---------------------------------------------------------------------------*
+ | SummedAreaTable implementation
+ *---------------------------------------------------------------------------*/
+SummedAreaTable::SummedAreaTable(const Heightfield & hf, SizeType windowSize,
+                                 IndexType first, IndexType last)
+        : _windowSize(windowSize) {
+    _build([&hf](IndexType i, IndexType j) {
+               return Accumulator(hf(i, j));
+           }, hf.bases(), hf.sizes(), first, last);
+}
+
+SummedAreaTable::SummedAreaTable(const VectorMap & vm, IndexType component,
+                                 SizeType windowSize,
+                                 IndexType first, IndexType last)
+        : _windowSize(windowSize) {
+    _build([&vm, component](IndexType i, IndexType j) {
+               return Accumulator(vm(i, j)[component]);
+           }, vm.bases(), vm.sizes(), first, last);
+}
+
+template <typename Accessor>
+void SummedAreaTable::_build(const Accessor & get, const IndexArray & bases,
+                                                   const SizeArray & sizes,
+                                                   IndexType first,
+                                                   IndexType last) {
+    _origin[0] = first;
+    _origin[1] = bases[1];
+
+    // Figure out which source cell each extended cell replicates
+    std::vector<IndexType> rows, cols;
+    extendedIndices(rows, bases[0], sizes[0], _windowSize, first, last);
+    extendedIndices(cols, bases[1], sizes[1], _windowSize,
+                    bases[1], bases[1] + IndexType(sizes[1]));
+
+    // Integrate, one row at a time. The first row and column are zeroes,
+    // so that window sums need no special cases at the edges.
+    _stride = cols.size() + 1;
+    _sums.assign((rows.size() + 1) * _stride, Accumulator(0));
+    for (SizeType a = 1; a <= rows.size(); ++a) {
+        const Accumulator * above = &_sums[(a - 1) * _stride];
+              Accumulator * here  = &_sums[a * _stride];
+        Accumulator rowSum(0);
+        for (SizeType b = 1; b <= cols.size(); ++b) {
+            rowSum += get(rows[a - 1], cols[b - 1]);
+            here[b] = above[b] + rowSum;
+        }
+    }
+}
+
+SummedAreaTable::Accumulator
+SummedAreaTable::windowSum(const Pixel & px) const {
+    // The window around 'px' starts at 'px - w/2' in source coordinates,
+    // which is exactly 'px - origin' in extended coordinates
+    IndexType i0 = px[0] - _origin[0],  i1 = i0 + _windowSize,
+              j0 = px[1] - _origin[1],  j1 = j0 + _windowSize;
+    return _at(i1, j1) - _at(i0, j1) - _at(i1, j0) + _at(i0, j0);
+}
+
+SummedAreaTable::Accumulator
+SummedAreaTable::windowMean(const Pixel & px) const {
+    return windowSum(px) / Accumulator(_windowSize * _windowSize);
+}
+
+
+/*---------------------------------------------------------------------------*
+ | Windowed statistics functions
+ *---------------------------------------------------------------------------*/
+SizeType terrainosaurus::windowedTileSize(SizeType size,
+                                          SizeType windowSize) {
+    // Aim for a few tiles per worker, so that they balance out, but don't
+    // let the halo (w - 1 extra cells per tile) be more than a quarter of it
+    SizeType tiles = 4 * WorkerPool::instance().workerCount();
+    SizeType tile  = (size + tiles - 1) / tiles;
+    return std::max(tile, 4 * windowSize);
+}
+
+void terrainosaurus::windowedMeans(Heightfield & result,
+                                   const Heightfield & hf,
+                                   SizeType windowSize) {
+    result.setSizes(hf.sizes());
+    if (hf.size() == 0)
+        return;
+
+    parallelFor(hf.base(0), hf.extent(0) + 1,
+                windowedTileSize(hf.size(0), windowSize),
+                [&](IndexType first, IndexType last) {
+        windowedMeans(result, hf, windowSize, first, last);
+    });
+}
+
+void terrainosaurus::windowedMeans(VectorMap & result,
+                                   const VectorMap & vm,
+                                   SizeType windowSize) {
+    result.setSizes(vm.sizes());
+    if (vm.size() == 0)
+        return;
+
+    parallelFor(vm.base(0), vm.extent(0) + 1,
+                windowedTileSize(vm.size(0), windowSize),
+                [&](IndexType first, IndexType last) {
+        windowedMeans(result, vm, windowSize, first, last);
+    });
+}
+
+void terrainosaurus::windowedLimits(VectorMap & result,
+                                    const Heightfield & hf,
+                                    SizeType windowSize) {
+    result.setSizes(hf.sizes());
+    if (hf.size() == 0)
+        return;
+
+    parallelFor(hf.base(0), hf.extent(0) + 1,
+                windowedTileSize(hf.size(0), windowSize),
+                [&](IndexType first, IndexType last) {
+        windowedLimits(result, hf, windowSize, first, last);
+    });
+}
+
+void terrainosaurus::windowedMeans(Heightfield & result,
+                                   const Heightfield & hf,
+                                   SizeType windowSize,
+                                   IndexType first, IndexType last) {
+    SummedAreaTable sat(hf, windowSize, first, last);
+    Pixel px;
+    for (px[0] = first; px[0] < last; ++px[0])
+        for (px[1] = hf.base(1); px[1] <= hf.extent(1); ++px[1])
+            result(px[0] - hf.base(0) + result.base(0),
+                   px[1] - hf.base(1) + result.base(1))
+                = scalar_t(sat.windowMean(px));
+}
+
+void terrainosaurus::windowedMeans(VectorMap & result,
+                                   const VectorMap & vm,
+                                   SizeType windowSize,
+                                   IndexType first, IndexType last) {
+    SummedAreaTable satX(vm, 0, windowSize, first, last),
+                    satY(vm, 1, windowSize, first, last);
+    Pixel px;
+    for (px[0] = first; px[0] < last; ++px[0])
+        for (px[1] = vm.base(1); px[1] <= vm.extent(1); ++px[1])
+            result(px[0] - vm.base(0) + result.base(0),
+                   px[1] - vm.base(1) + result.base(1))
+                = Vector2D(scalar_t(satX.windowMean(px)),
+                           scalar_t(satY.windowMean(px)));
+}
+
+void terrainosaurus::windowedLimits(VectorMap & result,
+                                    const Heightfield & hf,
+                                    SizeType windowSize,
+                                    IndexType first, IndexType last) {
+    SizeType n0 = SizeType(last - first),
+             n1 = hf.size(1);
+    std::vector<IndexType> rows, cols;
+    extendedIndices(rows, hf.base(0), hf.size(0), windowSize, first, last);
+    extendedIndices(cols, hf.base(1), n1, windowSize,
+                    hf.base(1), hf.extent(1) + 1);
+
+    // Running min/max along the first axis, for every column
+    std::vector<scalar_t> colMins(n0 * n1), colMaxes(n0 * n1);
+    std::vector<scalar_t> line, mins, maxes, scratch;
+    line.resize(rows.size());
+    for (SizeType j = 0; j < n1; ++j) {
+        for (SizeType k = 0; k < rows.size(); ++k)
+            line[k] = hf(rows[k], hf.base(1) + IndexType(j));
+        slidingExtremes(mins,  line, windowSize, scratch, pickMin);
+        slidingExtremes(maxes, line, windowSize, scratch, pickMax);
+        for (SizeType i = 0; i < n0; ++i) {
+            colMins[i * n1 + j]  = mins[i];
+            colMaxes[i * n1 + j] = maxes[i];
+        }
+    }
+
+    // ...then along the second axis, for every row. Since the min of mins
+    // (and max of maxes) is separable, this gives the 2D window limits.
+    IndexType r0 = first - hf.base(0) + result.base(0);
+    std::vector<scalar_t> minLine(cols.size()), maxLine(cols.size());
+    for (SizeType i = 0; i < n0; ++i) {
+        for (SizeType k = 0; k < cols.size(); ++k) {
+            SizeType j = cols[k] - hf.base(1);
+            minLine[k] = colMins[i * n1 + j];
+            maxLine[k] = colMaxes[i * n1 + j];
+        }
+        slidingExtremes(mins,  minLine, windowSize, scratch, pickMin);
+        slidingExtremes(maxes, maxLine, windowSize, scratch, pickMax);
+        for (SizeType j = 0; j < n1; ++j)
+            result(r0 + IndexType(i),
+                   result.base(1) + IndexType(j)) = Vector2D(mins[j], maxes[j]);
+    }
+}
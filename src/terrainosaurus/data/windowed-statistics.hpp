@@ -0,0 +1,140 @@
+/*
+ * File: windowed-statistics.hpp
+ *
+ * Author: Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes.
+ *
+ * Description:
+ *      This file declares functions for calculating windowed (neighborhood)
+ *      statistics over an entire raster, such as the mean or the range of
+ *      the values in the square window around each cell. These are used to
+ *      "study" a TerrainSample LOD.
+ *
+ *      The window around cell 'px' is 'w' cells on a side, starting 'w / 2'
+ *      cells before 'px' along each axis (i.e., the same window as
+ *      selectBS(r, px - w / 2, w)). Cells falling outside the raster take the
+ *      value of the nearest edge cell, just as reading off the edge of a
+ *      raster does.
+ *
+ *      The whole-raster versions of these functions split the raster into
+ *      tiles (bands along the first axis), which are processed in parallel
+ *      using the application WorkerPool. Each tile reads a "halo" of
+ *      'w - 1' cells from its neighbors, so the results are identical to
+ *      processing the raster as a single tile. The single-tile versions are
+ *      also available, for callers doing their own scheduling.
+ *
+ * Implementation notes:
+ *      Doing this the obvious way (applying mean() or range() to a fresh
+ *      window around every cell) costs O(N * w^2), which gets very expensive
+ *      for large, high-resolution terrains. Instead, these functions run in
+ *      O(N), independent of the window size:
+ *          * means are computed from a summed-area table, which answers the
+ *            sum over any rectangle with four lookups. The table is built
+ *            over the edge-extended raster and accumulated in double
+ *            precision, so large terrains don't lose precision. This means
+ *            they aren't bit-for-bit what mean() gives for the same window
+ *            (it sums in single precision, so it's the one that's off, by up
+ *            to the rounding error of its sum), which is why
+ *            statisticsRevision in TerrainSample.cpp changed with them.
+ *          * minima & maxima are computed separably (rows, then columns)
+ *            using the van Herk/Gil-Werman algorithm, which needs about
+ *            three comparisons per cell, regardless of the window size.
+ *            These are exact.
+ */
+
+#ifndef TERRAINOSAURUS_DATA_WINDOWED_STATISTICS
+#define TERRAINOSAURUS_DATA_WINDOWED_STATISTICS
+
+// Import library configuration
+#include <terrainosaurus/terrainosaurus-common.h>
+
+// This is part of the Terrainosaurus terrain generation engine
+namespace terrainosaurus {
+    // Forward declarations
+    class SummedAreaTable;
+
+    // Compute the mean of the window around each cell
+    void windowedMeans(Heightfield & result, const Heightfield & hf,
+                       SizeType windowSize);
+    void windowedMeans(VectorMap & result, const VectorMap & vm,
+                       SizeType windowSize);
+
+    // Compute the range (min, max) of the window around each cell
+    void windowedLimits(VectorMap & result, const Heightfield & hf,
+                        SizeType windowSize);
+
+    // Single-tile versions of the above, computing only the cells whose
+    // first coordinate is in [first, last). 'result' must already have the
+    // same size as the input raster.
+    void windowedMeans(Heightfield & result, const Heightfield & hf,
+                       SizeType windowSize, IndexType first, IndexType last);
+    void windowedMeans(VectorMap & result, const VectorMap & vm,
+                       SizeType windowSize, IndexType first, IndexType last);
+    void windowedLimits(VectorMap & result, const Heightfield & hf,
+                        SizeType windowSize, IndexType first, IndexType last);
+
+    // Choose a tile size (along the first axis) for splitting 'size' cells
+    // among the available workers, given the window size. Tiles are kept
+    // big enough that the halo doesn't dominate the work.
+    SizeType windowedTileSize(SizeType size, SizeType windowSize);
+};
+
+
+/*****************************************************************************
+ * Summed-area table over an edge-extended scalar raster
+ *****************************************************************************/
+class terrainosaurus::SummedAreaTable {
+/*---------------------------------------------------------------------------*
+ | Type & constant definitions
+ *---------------------------------------------------------------------------*/
+public:
+    typedef double  Accumulator;
+
+
+/*---------------------------------------------------------------------------*
+ | Constructors
+ *---------------------------------------------------------------------------*/
+public:
+    // Build a table able to answer window queries of size 'windowSize' over
+    // every cell of 'hf' (or of a single component of 'vm') whose first
+    // coordinate is in [first, last)
+    explicit SummedAreaTable(const Heightfield & hf, SizeType windowSize,
+                             IndexType first, IndexType last);
+    explicit SummedAreaTable(const VectorMap & vm, IndexType component,
+                             SizeType windowSize,
+                             IndexType first, IndexType last);
+
+protected:
+    // Fill in the table using a cell accessor function
+    template <typename Accessor>
+    void _build(const Accessor & get, const IndexArray & bases,
+                                      const SizeArray & sizes,
+                                      IndexType first, IndexType last);
+
+
+/*---------------------------------------------------------------------------*
+ | Window queries
+ *---------------------------------------------------------------------------*/
+public:
+    SizeType windowSize() const { return _windowSize; }
+
+    // Sum & mean over the window around 'px'
+    Accumulator windowSum(const Pixel & px) const;
+    Accumulator windowMean(const Pixel & px) const;
+
+protected:
+    // Table lookup (in extended coordinates, with a leading row & column of
+    // zeroes)
+    Accumulator _at(IndexType i, IndexType j) const {
+        return _sums[i * _stride + j];
+    }
+
+    SizeType    _windowSize,        // Size of the window we'll be queried with
+                _stride;            // Row length of the table
+    IndexArray  _origin;            // First cell we can be queried for
+    std::vector<Accumulator> _sums; // The (extended) summed-area table
+};
+
+#endif
@@ -0,0 +1,209 @@
+/*
+ * File: GeneMeasurementCache.cpp
+ *
+ * Author: Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes.
+ *
+ * Description:
+ */
+
+// Include precompiled header
+#include <terrainosaurus/precomp.h>
+
+// Import class definition
+#include "GeneMeasurementCache.hpp"
+
+// Import the uncached measurement functions
+#include "terrain-operations.hpp"
+
+// Import hashing, memory & algorithm functions
+#include <functional>
+#include <cstring>
+#include <algorithm>
+
+using namespace terrainosaurus;
+
+
+// Local helper functions
+namespace {
+    // Mix 'v' into the hash value 'h'
+    inline void hashCombine(std::size_t & h, std::size_t v) {
+        h ^= v + 0x9e3779b9 + (h << 6) + (h >> 2);
+    }
+
+    // Hash a scalar by its bits, so that hashing agrees with == (except for
+    // -0 vs. +0, which we normalize)
+    inline std::size_t hashScalar(scalar_t s) {
+        if (s == scalar_t(0))
+            s = scalar_t(0);
+        unsigned char bytes[sizeof(scalar_t)];
+        std::memcpy(bytes, &s, sizeof(scalar_t));
+        std::size_t h = 0;
+        for (SizeType b = 0; b < sizeof(scalar_t); ++b)
+            hashCombine(h, bytes[b]);
+        return h;
+    }
+
+    // The transformation-independent part of a gene's identity
+    template <class Key>
+    void fillPatchKey(Key & k, const TerrainChromosome::Gene & g) {
+        k.sample = &g.terrainSample();
+        k.i      = g.sourceCenter()[0];
+        k.j      = g.sourceCenter()[1];
+        k.lod    = int(g.levelOfDetail());
+    }
+}
+
+
+std::size_t GeneMeasurementCache::KeyHash::operator()(const PatchKey & k) const {
+    std::size_t h = std::hash<void const *>()(k.sample);
+    hashCombine(h, std::hash<IndexType>()(k.i));
+    hashCombine(h, std::hash<IndexType>()(k.j));
+    hashCombine(h, std::hash<int>()(k.lod));
+    return h;
+}
+
+std::size_t GeneMeasurementCache::KeyHash::operator()(const GeneKey & k) const {
+    std::size_t h = (*this)(k.patch);
+    hashCombine(h, hashScalar(k.rotation));
+    hashCombine(h, hashScalar(k.scale));
+    hashCombine(h, hashScalar(k.offset));
+    return h;
+}
+
+
+// Generational tables
+template <class Key, class Value>
+bool GeneMeasurementCache::Generations<Key, Value>::find(const Key & k,
+                                                         Value & v,
+                                                         SizeType limit) {
+    typename Table::const_iterator it = current.find(k);
+    if (it != current.end()) {
+        v = it->second;
+        return true;
+    }
+    it = previous.find(k);
+    if (it != previous.end()) {
+        // Move it into the current generation, just like a new entry (which
+        // may mean starting a new generation, so it's taken out of this one
+        // first)
+        v = it->second;
+        previous.erase(it);
+        insert(k, v, limit);
+        return true;
+    }
+    return false;
+}
+
+template <class Key, class Value>
+const Value &
+GeneMeasurementCache::Generations<Key, Value>::insert(const Key & k,
+                                                      const Value & v,
+                                                      SizeType limit) {
+    if (current.size() >= limit && current.find(k) == current.end()) {
+        previous.swap(current);
+        current.clear();
+    }
+    return current.insert(std::make_pair(k, v)).first->second;
+}
+
+
+// Constructor
+GeneMeasurementCache::GeneMeasurementCache()
+    : _shardCapacity((SizeType(1) << 18) / shardCount),
+      _geneHits(0), _geneMisses(0), _patchHits(0), _patchMisses(0) { }
+
+
+// Measure a gene. The transformed measurements are calculated from the
+// patch's just as in elevationMean(g), gradientMean(g) and
+// elevationRange(g), so the results are identical.
+GeneMeasurementCache::GeneMeasurements
+GeneMeasurementCache::measure(const Gene & g) {
+    GeneKey k;
+    fillPatchKey(k.patch, g);
+    k.rotation = g.rotation();
+    k.scale    = g.scale();
+    k.offset   = g.offset();
+
+    GeneMeasurements m;
+    Shard & s = _shard(k.patch);
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if (s.genes.find(k, m, _shardCapacity)) {
+            ++_geneHits;
+            return m;
+        }
+    }
+    ++_geneMisses;
+
+    // Measure it without holding the lock, then add it, unless somebody
+    // beat us to it
+    m.patch         = measurePatch(g);
+    m.elevationMean = m.patch.elevationMean + g.offset();
+    m.gradientMean  = inca::math::rotate(m.patch.gradientMean, g.rotation())
+                        * g.scale();
+    Vector2D limits = m.patch.elevationLimits * g.scale()
+                    + Vector2D(g.offset() + m.patch.elevationMean * (1 - g.scale()));
+    m.elevationRange = limits[1] - limits[0];
+
+    std::lock_guard<std::mutex> lock(s.mutex);
+    return s.genes.insert(k, m, _shardCapacity);
+}
+
+// Measure just the source patch
+GeneMeasurementCache::PatchMeasurements
+GeneMeasurementCache::measurePatch(const Gene & g) {
+    PatchKey k;
+    fillPatchKey(k, g);
+
+    PatchMeasurements m;
+    Shard & s = _shard(k);
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if (s.patches.find(k, m, _shardCapacity)) {
+            ++_patchHits;
+            return m;
+        }
+    }
+    ++_patchMisses;
+
+    const TerrainSample::LOD & ts = g.terrainSample();
+    m.elevationMean     = ts.localElevationMean(g.sourceCenter());
+    m.gradientMean      = ts.localGradientMean(g.sourceCenter());
+    m.elevationLimits   = ts.localElevationLimits(g.sourceCenter());
+    m.terrainTypeElevationVariance = terrainTypeElevationVariance(g);
+    m.terrainTypeSlopeVariance     = terrainTypeSlopeVariance(g);
+    m.terrainTypeAngleVariance     = terrainTypeAngleVariance(g);
+
+    std::lock_guard<std::mutex> lock(s.mutex);
+    return s.patches.insert(k, m, _shardCapacity);
+}
+
+GeneMeasurementCache::Shard &
+GeneMeasurementCache::_shard(const PatchKey & k) {
+    return _shards[KeyHash()(k) % shardCount];
+}
+
+
+// Throw away all the cached measurements
+void GeneMeasurementCache::clear() {
+    for (SizeType i = 0; i < shardCount; ++i) {
+        std::lock_guard<std::mutex> lock(_shards[i].mutex);
+        _shards[i].patches.clear();
+        _shards[i].genes.clear();
+    }
+}
+
+// How big the cache may get
+SizeType GeneMeasurementCache::capacity() const {
+    return _shardCapacity * shardCount;
+}
+void GeneMeasurementCache::setCapacity(SizeType n) {
+    _shardCapacity = std::max(SizeType(1), (n + shardCount - 1) / shardCount);
+}
+
+void GeneMeasurementCache::resetCounters() {
+    _geneHits = _geneMisses = _patchHits = _patchMisses = 0;
+}
@@ -0,0 +1,189 @@
+/** -*- C++ -*-
+ *
+ * \file    GeneMeasurementCache.hpp
+ *
+ * \author  Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes.
+ *
+ * Description:
+ *      The GeneMeasurementCache class memoizes the Gene measurement functions
+ *      from terrain-operations.hpp (elevationMean(g), gradientMean(g), etc.)
+ *      over the course of a GA run. Most genes are unchanged from one
+ *      generation to the next, and are measured again every time their
+ *      chromosome's fitness is evaluated, so most lookups are hits.
+ *
+ *      Measurements are stored at two levels:
+ *          * per source patch, keyed by (TerrainSample, source center, LOD):
+ *            everything that doesn't depend on the gene's transformation
+ *            (the local statistics of the source data, and the variances
+ *            of its TerrainType)
+ *          * per transformed gene, keyed by the patch plus the gene's
+ *            rotation, scale and offset: the measurements of the
+ *            transformed data, calculated from the patch's
+ *      so a gene that has only been rotated, scaled or offset still finds
+ *      its patch already measured.
+ *
+ *      The cached values are exactly those that the uncached functions
+ *      would return.
+ *
+ *      The cache may be used from several threads at once (e.g., from
+ *      parallel fitness evaluation). Entries are spread across a number of
+ *      independently-locked shards, so that threads rarely wait for each
+ *      other. Hit and miss counts are kept at each level, and accumulate
+ *      until resetCounters() is called (clear() does not reset them).
+ *
+ *      The cache holds at most capacity() entries at each level (default:
+ *      2^18), so a long run can't grow it without bound. Entries age out
+ *      in generations: each shard keeps its entries in a current and a
+ *      previous table, and when the current one fills up, it becomes the
+ *      previous one (discarding whatever was there) and a new current one
+ *      is started. An entry found in the previous table is moved back into
+ *      the current one (which counts as adding it, so a full current table
+ *      is retired first), so anything looked up regularly survives, and
+ *      anything not looked up for a whole generation is dropped.
+ *
+ * Implementation notes:
+ *      Measuring a patch reads the source TerrainSample (which may mean
+ *      paging it in), so nothing is measured with a shard locked. A miss
+ *      unlocks the shard, does the measuring, then re-locks it and inserts
+ *      the result only if nobody else did in the meantime. Two threads
+ *      missing on the same gene at once may thus both measure it, but
+ *      since the results are identical, it doesn't matter whose is kept.
+ */
+
+#ifndef TERRAINOSAURUS_GENETICS_GENE_MEASUREMENT_CACHE
+#define TERRAINOSAURUS_GENETICS_GENE_MEASUREMENT_CACHE
+
+// Import library configuration
+#include <terrainosaurus/terrainosaurus-common.h>
+
+// This is part of the Terrainosaurus terrain generation engine
+namespace terrainosaurus {
+    // Forward declarations
+    class GeneMeasurementCache;
+};
+
+// Import Chromosome definition
+#include "TerrainChromosome.hpp"
+
+// Import container & threading definitions
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+
+
+class terrainosaurus::GeneMeasurementCache {
+/*---------------------------------------------------------------------------*
+ | Type definitions
+ *---------------------------------------------------------------------------*/
+public:
+    typedef TerrainChromosome::Gene     Gene;
+
+    // Measurements of a source patch that don't depend on the transformation
+    struct PatchMeasurements {
+        scalar_t elevationMean;                 // Untransformed local stats
+        Vector2D gradientMean;
+        Vector2D elevationLimits;
+        scalar_t terrainTypeElevationVariance;  // TerrainType stats
+        scalar_t terrainTypeSlopeVariance;
+        scalar_t terrainTypeAngleVariance;
+    };
+
+    // Measurements of a transformed gene
+    struct GeneMeasurements {
+        scalar_t elevationMean;
+        Vector2D gradientMean;
+        scalar_t elevationRange;
+        PatchMeasurements patch;
+    };
+
+protected:
+    // Cache keys
+    struct PatchKey {
+        TerrainSample::LOD const * sample;
+        IndexType   i, j;
+        int         lod;
+        bool operator==(const PatchKey & k) const {
+            return sample == k.sample && i == k.i && j == k.j && lod == k.lod;
+        }
+    };
+    struct GeneKey {
+        PatchKey    patch;
+        scalar_t    rotation, scale, offset;
+        bool operator==(const GeneKey & k) const {
+            return patch == k.patch && rotation == k.rotation
+                && scale == k.scale && offset == k.offset;
+        }
+    };
+    struct KeyHash {
+        std::size_t operator()(const PatchKey & k) const;
+        std::size_t operator()(const GeneKey & k) const;
+    };
+
+    // A table of entries, aged in two generations (see above)
+    template <class Key, class Value>
+    struct Generations {
+        typedef std::unordered_map<Key, Value, KeyHash> Table;
+        Table current, previous;
+
+        // Look up 'k', reviving it if it's from the previous generation
+        // (which counts against 'limit' just as insert() does)
+        bool find(const Key & k, Value & v, SizeType limit);
+
+        // Add 'k' if it isn't there yet, starting a new generation first if
+        // the current one has 'limit' entries. Either way, return its value.
+        const Value & insert(const Key & k, const Value & v, SizeType limit);
+
+        void clear() { current.clear(); previous.clear(); }
+    };
+
+    // One independently-locked piece of the cache
+    struct Shard {
+        std::mutex mutex;
+        Generations<PatchKey, PatchMeasurements>    patches;
+        Generations<GeneKey, GeneMeasurements>      genes;
+    };
+    static const SizeType shardCount = 32;
+
+
+/*---------------------------------------------------------------------------*
+ | Constructor & cache operations
+ *---------------------------------------------------------------------------*/
+public:
+    // Constructor (the cache starts out empty)
+    explicit GeneMeasurementCache();
+
+    // Measure a gene, looking it up if we've seen it before
+    GeneMeasurements measure(const Gene & g);
+
+    // Measure a gene's source patch
+    PatchMeasurements measurePatch(const Gene & g);
+
+    // Throw away everything we've cached
+    void clear();
+
+    // How many entries to keep at each level (patches & genes), not
+    // counting those from the previous generation
+    SizeType capacity() const;
+    void setCapacity(SizeType n);
+
+    // Lookup statistics
+    SizeType geneHits() const    { return _geneHits; }
+    SizeType geneMisses() const  { return _geneMisses; }
+    SizeType patchHits() const   { return _patchHits; }
+    SizeType patchMisses() const { return _patchMisses; }
+    void resetCounters();
+
+protected:
+    // Shard that holds everything to do with a patch
+    Shard & _shard(const PatchKey & k);
+
+    Shard _shards[shardCount];
+    std::atomic<SizeType> _shardCapacity;   // Per-shard share of capacity()
+    std::atomic<SizeType> _geneHits, _geneMisses,
+                          _patchHits, _patchMisses;
+};
+
+#endif
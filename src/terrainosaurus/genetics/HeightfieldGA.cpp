@@ -38,6 +38,7 @@ namespace terrainosaurus {
     class HorizontalTranslationMutationOperator;
     class HorizontalJitterMutationOperator;
     class RandomSourceDataMutationOperator;
+    class MatchedSourceDataMutationOperator;
     class ConformMutationOperator;
 
     class GeneCompatibilityFitnessOperator;
@@ -49,6 +50,13 @@ namespace terrainosaurus {
 #include <terrainosaurus/TerrainosaurusApplication.hpp>
 using namespace terrainosaurus;
 
+// Import parallel execution support
+#include <terrainosaurus/util/WorkerPool.hpp>
+#include <atomic>
+
+// Import memory budget support
+#include <terrainosaurus/data/ResidencyManager.hpp>
+
 
 // HACK: is there a better way to do this?? Maybe something that could be
 // integrated cleanly into the GeneticAlgorithm class?
@@ -144,14 +152,64 @@ protected:
 };
 
 
+/**
+ * The MatchedSourceDataMutationOperator implements a mutation operator that
+ * replaces a gene's source data with a patch whose local characteristics
+ * resemble those of the pattern heightfield underneath the gene, according
+ * to the TerrainType's PatchIndex. The patch is picked at random from among
+ * the closest few matches, so that the population keeps some diversity.
+ */
+class terrainosaurus::MatchedSourceDataMutationOperator
+        : public HeightfieldGA::MutationOperator {
+public:
+    // Constructor, specifying how many of the best matches to choose among
+    explicit MatchedSourceDataMutationOperator(SizeType k = 8)
+        : _neighbors(k) { }
+
+    void operator()(Gene & g) {
+        // If there's nothing indexed (e.g., every sample is too small to
+        // hold a whole patch), we can't do any better than random
+        const TerrainType::LOD & tt = g.terrainType();
+        const PatchIndex & index = tt.patchIndex();
+        if (index.empty()) {
+            _pickRandomSourceData(g);
+            return;
+        }
+
+        // Find the patches most like the pattern under this gene...
+        PatchIndex::Features query = PatchIndex::measure(g.parent().pattern(),
+                                                         g.targetCenter());
+        index.nearest(_matches, query, _neighbors);
+
+        // ...and pick one of them
+        const PatchIndex::Candidate & match
+            = index.candidate(_matches[randomInt(0, int(_matches.size()) - 1)]);
+        g.setTerrainSample(tt.terrainSample(match.sample));
+        g.setSourceCenter(match.center);
+    }
+
+protected:
+    SizeType                _neighbors;
+    std::vector<IndexType>  _matches;
+    RandomUniform<int>      randomInt;
+    RandomSourceDataMutationOperator _pickRandomSourceData;
+};
+
+
 /**
  * The RandomSourceDataInitializationOperator implements a simple
  * initialization operator that populates the chromosome with random data from
- * the TerrainLibrary.
+ * the TerrainLibrary. If 'matched' is true, the data for each gene is instead
+ * chosen from among the source patches that best match the pattern (see
+ * MatchedSourceDataMutationOperator).
  */
 class terrainosaurus::RandomSourceDataInitializationOperator
         : public terrainosaurus::BasicInitializationOperator {
 public:
+    // Constructor
+    explicit RandomSourceDataInitializationOperator(bool matched = false)
+        : _matched(matched) { }
+
     void operator()(Chromosome & c) {
         // Set the basic properties of the chromosome
         BasicInitializationOperator::operator()(c);
@@ -169,7 +227,8 @@ public:
                            << " is " << g.terrainType().name())
                 
                 // Pick some random sample data from the TT
-                _pickRandomSourceData(g);
+                if (_matched)   _pickMatchedSourceData(g);
+                else            _pickRandomSourceData(g);
 
                 // Reset the transformation parameters
                 g.reset();
@@ -180,7 +239,9 @@ public:
     }
     
 protected:
-    RandomSourceDataMutationOperator _pickRandomSourceData;
+    bool                              _matched;
+    RandomSourceDataMutationOperator  _pickRandomSourceData;
+    MatchedSourceDataMutationOperator _pickMatchedSourceData;
 };
 
 
@@ -248,6 +309,8 @@ public:
 
     // Function call operator
     void operator()(Chromosome & c1, Chromosome & c2) {
+        static_cast<HeightfieldGA &>(owner()).enterTracePhase(HeightfieldGA::CrossoverPhase);
+
         // Make sure the two chromosomes are the same size
         if (c1.sizes() != c2.sizes()) {
             GeneticAlgorithmException e;
@@ -428,18 +491,36 @@ protected:
 class terrainosaurus::ConformMutationOperator
         : public HeightfieldGA::MutationOperator {
 public:
+    // Constructor, optionally using a cache for the gene's measurements
+    explicit ConformMutationOperator(GeneMeasurementCache * cache = NULL)
+        : _cache(cache) { }
+
     void operator()(Gene & g) {
-        scalar_t myRange = elevationRange(g);
-        scalar_t changeMean  = patternElevationMean(g)  - elevationMean(g);
+        scalar_t myRange, myMean;
+        Vector2D myGradient;
+        if (_cache) {
+            GeneMeasurementCache::GeneMeasurements m = _cache->measure(g);
+            myRange    = m.elevationRange;
+            myMean     = m.elevationMean;
+            myGradient = m.gradientMean;
+        } else {
+            myRange    = elevationRange(g);
+            myMean     = elevationMean(g);
+            myGradient = gradientMean(g);
+        }
+        scalar_t changeMean  = patternElevationMean(g)  - myMean;
         scalar_t changeScale = (myRange == scalar_t(0))
                                 ? scalar_t(1)
                                 : patternElevationRange(g) / myRange;
         scalar_t changeAngle = signedAngle(patternGradientMean(g),
-                                           gradientMean(g));
+                                           myGradient);
         g.setOffset(g.offset() + changeMean);
 //        g.setScale(g.scale() * changeScale);
 //        g.setRotation(g.rotation() + changeAngle);
     }
+
+protected:
+    GeneMeasurementCache * _cache;
 };
 
 
@@ -461,8 +542,11 @@ class terrainosaurus::GeneCompatibilityFitnessOperator
 public:
     Scalar operator()(Chromosome & c) {
         INCA_DEBUG("Evaluating gene compat for chromosome " << owner().indexOf(c))
+        TraceSpan span("gene compatibility", "ga");
 
-        ConformMutationOperator conform;
+        GeneMeasurementCache & cache
+            = static_cast<HeightfieldGA &>(owner()).measurementCache();
+        ConformMutationOperator conform(&cache);
         Scalar compat = 0;
         Pixel px;
         for (px[0] = 0; px[0] < c.size(0); ++px[0])
@@ -477,14 +561,15 @@ public:
                 Scalar targetSlope = magnitude(targetGradient);
                 Scalar targetAngle = 0;
 
-                Scalar currentElevation = elevationMean(g);
-                Vector2D currentGradient = gradientMean(g);
+                GeneMeasurementCache::GeneMeasurements m = cache.measure(g);
+                Scalar currentElevation = m.elevationMean;
+                Vector2D currentGradient = m.gradientMean;
                 Scalar currentSlope = magnitude(currentGradient);
                 Scalar currentAngle = signedAngle(currentGradient, targetGradient);
 
-                Scalar elevationVariance = terrainTypeElevationVariance(g);
-                Scalar slopeVariance     = terrainTypeSlopeVariance(g);
-                Scalar angleVariance     = terrainTypeAngleVariance(g);
+                Scalar elevationVariance = m.patch.terrainTypeElevationVariance;
+                Scalar slopeVariance     = m.patch.terrainTypeSlopeVariance;
+                Scalar angleVariance     = m.patch.terrainTypeAngleVariance;
 
                 g.compatibility().elevation() = gauss_project(targetElevation,
                                                               elevationVariance,
@@ -540,21 +625,22 @@ class terrainosaurus::RegionSimilarityFitnessOperator
 public:
     Scalar operator()(Chromosome & c) {
         INCA_DEBUG("Evaluating region fitnesses for chromosome " << owner().indexOf(c))
+        TraceSpan span("region similarity", "ga");
 
-        // Retrieve the "scratch pad" TerrainSample for the Chromosome and its map
-        TerrainSample::LOD    & terrain = c.scratch();
-        MapRasterization::LOD & map     = terrain.mapRasterization();
+        // Retrieve the map from the Chromosome's "scratch pad" TerrainSample
+        const MapRasterization::LOD & map = c.scratch().mapRasterization();
 
-        // Render the Chromosome to the scratch TS
-        renderChromosome(terrain, c);
-        c.setRegionCount(terrain.regionCount());
+        // Bring the Chromosome's rendering up-to-date. Only the genes that
+        // have changed since the last time need to be re-rendered.
+        updateRendering(c, map);
+        c.setRegionCount(map.regionCount());
 
         // Compare each region's measured characteristics with its reference
         Scalar fitness = 0;
         for (IDType rID = 0; rID < IDType(map.regionCount()); ++rID) {
             // Find individual fitness components for this region
             Chromosome::RegionSimilarityMeasure & regFit = c.regionFitness(rID);
-            regFit = terrainRegionSimilarity(terrain, rID, true);
+            regFit = terrainRegionSimilarity(c, rID, true);
 
             Scalar regArea = Scalar(map.regionArea(rID));
             fitness += regFit.overall() * regArea;
@@ -570,6 +656,9 @@ HeightfieldGA::HeightfieldGA(TerrainSamplePtr ts, TerrainSamplePtr ps) {
     // Not doing anything yet...
     _running = false;
     _currentLOD = TerrainLOD::minimum();
+    _tracePhase = NoPhase;
+    _traceGeneration = 0;
+    _traceBred = false;
 
     // Set up the TerrainSample
     setTerrainSample(ts);
@@ -577,6 +666,7 @@ HeightfieldGA::HeightfieldGA(TerrainSamplePtr ts, TerrainSamplePtr ps) {
 
     // Set up the initialization operators
     addInitializationOperator(new RandomSourceDataInitializationOperator());
+    addInitializationOperator(new RandomSourceDataInitializationOperator(true));
     addInitializationOperator(new PatternCloneInitializationOperator(), 0.0f);
 
     // Set up the crossover operators
@@ -592,6 +682,7 @@ HeightfieldGA::HeightfieldGA(TerrainSamplePtr ts, TerrainSamplePtr ps) {
     addMutationOperator(new VerticalRotationMutationOperator(1.5f));
     addMutationOperator(new HorizontalTranslationMutationOperator());
     addMutationOperator(new RandomSourceDataMutationOperator());
+    addMutationOperator(new MatchedSourceDataMutationOperator());
 //    addMutationOperator(new HorizontalJitterMutationOperator());
 
     // Set up the fitness calculation operators
@@ -645,6 +736,36 @@ TerrainLOD HeightfieldGA::currentLOD() const { return _currentLOD; }
 bool HeightfieldGA::running() const { return _running; }
 
 
+// How long each part of the last run took
+float HeightfieldGA::totalTime()   const { return _totalTime(); }
+float HeightfieldGA::loadingTime() const { return _loadingTime(); }
+float HeightfieldGA::lodTime(TerrainLOD lod) const {
+    return IndexType(lod) < IndexType(_lodTimes.size()) ? _lodTimes[lod]() : 0.0f;
+}
+float HeightfieldGA::setupTime(TerrainLOD lod) const {
+    return IndexType(lod) < IndexType(_setupTimes.size()) ? _setupTimes[lod]() : 0.0f;
+}
+float HeightfieldGA::processingTime(TerrainLOD lod) const {
+    return IndexType(lod) < IndexType(_processingTimes.size()) ? _processingTimes[lod]() : 0.0f;
+}
+
+
+// The memoized gene measurements for the current run
+GeneMeasurementCache & HeightfieldGA::measurementCache() {
+    return _measurements;
+}
+const GeneMeasurementCache & HeightfieldGA::measurementCache() const {
+    return _measurements;
+}
+
+
+// Progress reporting during preloading
+void HeightfieldGA::setPreloadProgressCallback(
+        const TerrainPrefetcher::ProgressCallback & cb) {
+    _preloadProgress = cb;
+}
+
+
 // Functions to run the GA and generate a TerrainSample
 void HeightfieldGA::run(TerrainLOD targetLOD) {
     run(currentLOD(), targetLOD);
@@ -685,36 +806,68 @@ void HeightfieldGA::run(TerrainLOD startLOD, TerrainLOD targetLOD) {
         _processingTimes.resize(int(targetLOD) + 1);
 
         // Reset and start timing
+        TraceSpan runSpan("generate terrain", "ga");
+        if (runSpan) {
+            runSpan.setArgument("start_lod", startLOD);
+            runSpan.setArgument("target_lod", targetLOD);
+        }
         _totalTime.start(true);
+        _measurements.resetCounters();
 
         // Preload all of the TerrainTypes we'll be using, for every LOD we'll be
-        // using.
+        // using, on as many threads as we've got
+        TraceSpan preloadSpan("preload", "ga");
         _loadingTime.start(true);
         INCA_INFO("Preloading terrain sample data")
+        TerrainPrefetcher prefetcher;
         for (IndexType i = 0; i < (*ps)[targetLOD].regionCount(); ++i)
-            (*mr)[targetLOD].regionTerrainType(i).ensureStudied();
-//            (*mr)[targetLOD].regionTerrainType(i).object().ensureStudied(startLOD, targetLOD);
+            prefetcher.addTerrainType((*mr)[targetLOD].regionTerrainType(i).getObject(),
+                                      startLOD, targetLOD);
+        prefetcher.setProgressCallback(_preloadProgress);
+        prefetcher.run();
         _loadingTime.stop();
+        preloadSpan.end();
 
         // Run the GA for every LOD from the coarsest up to the requested
         for (_currentLOD = startLOD; _currentLOD <= targetLOD; ++_currentLOD) {
+            TraceSpan lodSpan("lod", "ga");
+            lodSpan.setArgument("lod", currentLOD());
             _lodTimes[currentLOD()].start(true);
             
             TerrainSample::LOD & pattern = (*ps)[currentLOD()];
             TerrainSample::LOD & terrain = (*ts)[currentLOD()];
 
             // Create the low-rez pattern we want the GA to refine
+            TraceSpan setupSpan("setup", "ga");
             _setupTimes[currentLOD()].start(true);
             if (currentLOD() != TerrainLOD::minimum()) {
                 pattern.resampleFromLOD(currentLOD() - 1);
             }
             tl->ensureAnalyzed(currentLOD());
+
+            // The GA reads the source samples' rasters from every thread,
+            // so they have to stay in memory until it's done with them
+            ResidencyPins<TerrainSample::LOD> sourcePins;
+            for (IndexType i = 0; i < (*ps)[targetLOD].regionCount(); ++i) {
+                const TerrainType::LOD & tt = (*mr)[targetLOD].regionTerrainType(i)
+                                                  .object()[currentLOD()];
+                for (IndexType j = 0; j < IndexType(tt.size()); ++j)
+                    sourcePins.add(tt.terrainSample(j));
+            }
             _setupTimes[currentLOD()].stop();
+            setupSpan.end();
 
-            // Now, make a better version at this LOD using the GA
+            // Now, make a better version at this LOD using the GA. Nothing
+            // measured at the last LOD will be looked at again.
+            TraceSpan processingSpan("processing", "ga");
             _processingTimes[currentLOD()].start(true);
+            _measurements.clear();
             if (currentLOD() != TerrainLOD::minimum()) {
+                _beginTracePhases();
                 const Chromosome & best = Superclass::run();
+                _endTracePhases();
+
+                TraceSpan renderSpan("render best", "ga");
                 renderChromosome(terrain, best);
                 pattern.createFromRaster(terrain.elevations());
             }
@@ -741,10 +894,16 @@ void HeightfieldGA::run(TerrainLOD startLOD, TerrainLOD targetLOD) {
                                            << std::setw(15) << (*terrainSample())[lod].sizes().stringifyElements("x"))
         INCA_INFO("-------------------------------------------------------------")
         INCA_INFO("Total elapsed time: " << _totalTime() << " seconds")
+        INCA_INFO("Gene measurement cache: "
+                  << _measurements.geneHits() << " hits, "
+                  << _measurements.geneMisses() << " misses ("
+                  << _measurements.patchHits() << " / "
+                  << _measurements.patchMisses() << " for source patches)")
 
         _running = false;   // All done!
 
     } catch (GeneticAlgorithmException & e) {
+        _endTracePhases();
         _running = false;   // We're not running anymore...stuff blew up
         throw e;            // Re-throw for anyone who cares
     }
@@ -754,6 +913,7 @@ void HeightfieldGA::run(TerrainLOD startLOD, TerrainLOD targetLOD) {
 // on.
 const HeightfieldGA::PMF &
 HeightfieldGA::initializationOperatorPMF(const Chromosome & c) const {
+    enterTracePhase(InitializationPhase);
     return _initializationOperatorPMF;
 }
 
@@ -761,6 +921,7 @@ HeightfieldGA::initializationOperatorPMF(const Chromosome & c) const {
 // the current gene.
 const HeightfieldGA::PMF &
 HeightfieldGA::mutationOperatorPMF(const Gene & g) const {
+    enterTracePhase(MutationPhase);
     IndexType offsetOp = mutationOperatorCatalog[OFFSET_OPERATOR];
     IndexType scaleOp  = mutationOperatorCatalog[SCALE_OPERATOR];
     IndexType rotateOp = mutationOperatorCatalog[ROTATION_OPERATOR];
@@ -784,10 +945,137 @@ HeightfieldGA::mutationOperatorPMF(const Gene & g) const {
 
 // Modified fitness calculation function to cache fitness results in Chromosome
 HeightfieldGA::Scalar HeightfieldGA::calculateFitness(Chromosome & c) {
-    c.fitness().overall() = Superclass::calculateFitness(c);
+    // If it hasn't changed since we last looked, there's nothing to do
+    if (c.fitnessCurrent())
+        return c.fitness().overall();
+
+    // The GA framework asks for fitnesses one chromosome at a time, but
+    // they're expensive enough that we'd rather do the whole population at
+    // once. So we bring everybody up-to-date now, and the later requests
+    // will find their answers already waiting.
+    evaluatePopulation();
+
+    // If 'c' isn't part of the population, it didn't get done above
+    if (! c.fitnessCurrent()) {
+        _prepareForEvaluation(c);
+        _evaluateChromosome(c);
+    }
     return c.fitness().overall();
 }
 
+// Calculate the fitness of every out-of-date chromosome, in parallel
+void HeightfieldGA::evaluatePopulation() {
+    // Figure out which chromosomes need (re)evaluation
+    std::vector<Chromosome *> stale;
+    for (IndexType i = 0; i < IndexType(populationSize()); ++i)
+        if (! chromosome(i).fitnessCurrent())
+            stale.push_back(&chromosome(i));
+    if (stale.empty())
+        return;
+
+    enterTracePhase(FitnessPhase);
+    TraceSpan span("evaluate population", "ga");
+    span.setArgument("chromosomes", stale.size());
+
+    // Load and analyze anything shared between the evaluations before we
+    // start. Lazy loading is safe from several threads at once, but the
+    // workers would only end up waiting on whichever of them got there first
+    // (and see TerrainLOD.hpp for why we'd rather not analyze from inside a
+    // task).
+    for (IndexType i = 0; i < IndexType(stale.size()); ++i)
+        _prepareForEvaluation(*stale[i]);
+
+    // Each worker keeps claiming chromosomes until there are none left. This
+    // keeps everybody busy, even though some chromosomes are much quicker to
+    // evaluate than others (e.g., those with only a few modified genes).
+    SizeType workers = std::min(WorkerPool::instance().workerCount(),
+                                SizeType(stale.size()));
+    std::atomic<SizeType> next(0);
+    TaskGroup evaluations;
+    for (SizeType w = 0; w < workers; ++w)
+        evaluations.run([this, &stale, &next]() {
+            for (SizeType i = next++; i < stale.size(); i = next++)
+                _evaluateChromosome(*stale[i]);
+        });
+    evaluations.wait();
+    span.end();
+
+    // Whatever the framework does next with the fitnesses is selection
+    enterTracePhase(SelectionPhase);
+}
+
+// Load/analyze everything that evaluating 'c' will look at
+void HeightfieldGA::_prepareForEvaluation(const Chromosome & c) const {
+    c.pattern().ensureStudied();
+
+    // The scratch sample's map & terrain types
+    if (c.scratchSample()->mapRasterization()) {
+        const MapRasterization::LOD & map = c.scratch().mapRasterization();
+        map.ensureAnalyzed();
+        for (IDType rID = 0; rID < IDType(map.regionCount()); ++rID)
+            map.regionTerrainType(rID).ensureAnalyzed();
+    }
+
+    // The source data for each gene
+    Pixel idx;
+    for (idx[0] = 0; idx[0] < c.size(0); ++idx[0])
+        for (idx[1] = 0; idx[1] < c.size(1); ++idx[1]) {
+            const Gene & g = c(idx);
+            g.terrainSample().ensureStudied();
+            g.terrainType().ensureAnalyzed();
+        }
+}
+
+// Calculate the fitness of a single chromosome. Each chromosome renders into
+// its own RenderCache, so several may be evaluated at once.
+void HeightfieldGA::_evaluateChromosome(Chromosome & c) {
+    TraceSpan span("evaluate chromosome", "ga");
+    c.fitness().overall() = Superclass::calculateFitness(c);
+    c.setFitnessCurrent();
+}
+
+
+// Trace the steps of each generation. When we're not tracing, _tracePhase
+// stays at NoPhase, so this is cheap enough to call for every gene.
+void HeightfieldGA::enterTracePhase(TracePhase p) const {
+    if (_tracePhase == NoPhase || _tracePhase == p)
+        return;
+
+    static const char * names[] = {
+        "", "initialization", "fitness", "selection", "crossover", "mutation"
+    };
+    Tracer & tracer = Tracer::instance();
+    Tracer::Clock::time_point now = Tracer::Clock::now();
+    std::ostringstream args;
+    args << "\"generation\":" << _traceGeneration;
+    tracer.record(names[_tracePhase], "ga", _tracePhaseStart, now, args.str());
+
+    // Fitness after breeding means we've started a new generation (and
+    // stopping altogether means we've finished the last one)
+    if ((p == FitnessPhase && _traceBred) || p == NoPhase) {
+        tracer.record("generation", "ga", _traceGenerationStart, now, args.str());
+        _traceGenerationStart = now;
+        ++_traceGeneration;
+        _traceBred = false;
+    } else if (p == CrossoverPhase || p == MutationPhase) {
+        _traceBred = true;
+    }
+
+    _tracePhase = p;
+    _tracePhaseStart = now;
+}
+
+void HeightfieldGA::_beginTracePhases() const {
+    _tracePhase = Tracer::enabled() ? InitializationPhase : NoPhase;
+    _tracePhaseStart = _traceGenerationStart = Tracer::Clock::now();
+    _traceGeneration = 0;
+    _traceBred = false;
+}
+
+void HeightfieldGA::_endTracePhases() const {
+    enterTracePhase(NoPhase);
+}
+
 
 // XXX Junk function
 void HeightfieldGA::test(TerrainLOD lod) {
@@ -34,6 +34,15 @@ namespace terrainosaurus {
 // Import Chromosome definition
 #include "TerrainChromosome.hpp"
 
+// Import gene measurement cache definition
+#include "GeneMeasurementCache.hpp"
+
+// Import terrain library prefetcher
+#include <terrainosaurus/data/TerrainPrefetcher.hpp>
+
+// Import tracing support
+#include <terrainosaurus/util/Trace.hpp>
+
 
 class terrainosaurus::HeightfieldGA
         : public inca::GeneticAlgorithm<TerrainChromosome, float> {
@@ -42,6 +51,16 @@ public:
     typedef std::vector<Timer>          TimerArray;
     typedef inca::GeneticAlgorithm<TerrainChromosome, float>    Superclass;
 
+    // The steps of a generation, as they appear in traces
+    enum TracePhase {
+        NoPhase,
+        InitializationPhase,
+        FitnessPhase,
+        SelectionPhase,
+        CrossoverPhase,
+        MutationPhase
+    };
+
 
     // Constructor
     explicit HeightfieldGA(TerrainSamplePtr t = TerrainSamplePtr(),
@@ -67,6 +86,24 @@ public:
     // Whether the GA is running
     bool running() const;
 
+    // How long (in seconds) each part of the last run took
+    float totalTime() const;
+    float loadingTime() const;
+    float lodTime(TerrainLOD lod) const;
+    float setupTime(TerrainLOD lod) const;
+    float processingTime(TerrainLOD lod) const;
+
+    // The cache of gene measurements used during fitness evaluation. This is
+    // emptied at the start of each LOD, and its hit/miss counters are reset
+    // at the start of each run.
+          GeneMeasurementCache & measurementCache();
+    const GeneMeasurementCache & measurementCache() const;
+
+    // The function to call as the terrain library data are preloaded at the
+    // start of each run (see TerrainPrefetcher.hpp). It is called on the
+    // thread that called run().
+    void setPreloadProgressCallback(const TerrainPrefetcher::ProgressCallback & cb);
+
     // Run the GA, and return the generated TS
     void run(TerrainLOD targetLOD);
     void run(TerrainLOD startLOD, TerrainLOD targetLOD);
@@ -77,14 +114,40 @@ public:
     // Change the mutation PMF based on gene compatibility
     const PMF & mutationOperatorPMF(const Gene & g) const;
     
-    // Modified fitness calculation function to cache fitness results in Chromosome
+    // Modified fitness calculation function to cache fitness results in
+    // Chromosome. If the chromosome is out-of-date, the rest of the
+    // population is brought up-to-date along with it (see below).
     Scalar calculateFitness(Chromosome & c);
 
+    // Calculate the fitness of every chromosome in the population that has
+    // changed since its fitness was last calculated. The chromosomes are
+    // evaluated in parallel, each rendering into its own RenderCache. Since
+    // fitness evaluation is deterministic and each chromosome is evaluated
+    // independently, the results are identical no matter how many threads
+    // are used.
+    void evaluatePopulation();
+
+    // Note (when tracing) that the GA framework has moved on to another step
+    // of the current generation. The framework's main loop isn't ours to
+    // instrument, so we work out where it's up to from which of our hooks it
+    // calls: each step is traced from the first hook belonging to it until
+    // the first hook belonging to the next one. A new generation starts with
+    // the first fitness evaluation after some crossover or mutation.
+    void enterTracePhase(TracePhase p) const;
+
     // XXX -- misc test function
     void test(TerrainLOD lod);
     TerrainSamplePtr redo(TerrainSamplePtr ts, TerrainLOD lod);
 
 protected:
+    // Parallel fitness evaluation helpers
+    void _prepareForEvaluation(const Chromosome & c) const;
+    void _evaluateChromosome(Chromosome & c);
+
+    // Start/finish tracing the steps of Superclass::run()
+    void _beginTracePhases() const;
+    void _endTracePhases() const;
+
     TerrainSamplePtr    _patternSample;
     TerrainSamplePtr    _terrainSample;
     bool        _running;           // Whether we're currently doing anything
@@ -94,6 +157,14 @@ protected:
     TimerArray  _lodTimes,          // Time spent on each LOD
                 _setupTimes,        // Time spent setting up for the GA, per LOD
                 _processingTimes;   // Time spent running the GA, per LOD
+    GeneMeasurementCache _measurements; // Memoized gene measurements
+    TerrainPrefetcher::ProgressCallback _preloadProgress;
+
+    // Trace-phase bookkeeping (see enterTracePhase())
+    mutable TracePhase  _tracePhase;        // NoPhase unless tracing a run
+    mutable Tracer::Clock::time_point _tracePhaseStart, _traceGenerationStart;
+    mutable SizeType    _traceGeneration;
+    mutable bool        _traceBred;         // Crossover/mutation seen yet?
 };
 
 #endif
@@ -17,10 +17,11 @@ using namespace inca::raster;
  *---------------------------------------------------------------------------*/
 // Constructor
 TerrainChromosome::TerrainChromosome()
-    : _alive(false) { }
+    : _alive(false), _revision(1), _fitnessRevision(0) { }
 
 // Copy constructor
-TerrainChromosome::TerrainChromosome(const TerrainChromosome & tc) {
+TerrainChromosome::TerrainChromosome(const TerrainChromosome & tc)
+        : _revision(1), _fitnessRevision(0) {
     // We're alive only if he is
     _alive = tc.isAlive();
 
@@ -35,6 +36,9 @@ TerrainChromosome::TerrainChromosome(const TerrainChromosome & tc) {
 
     // Now copy tc's gene data
     genes() = tc.genes();
+
+    // Since our genes are just like his, so is our rendering
+    _renderCache = tc._renderCache;
 }
 
 // Notify each gene of its place in the world
@@ -43,7 +47,7 @@ void TerrainChromosome::claimGenes() {
     Pixel idx;
     TerrainLOD lod = levelOfDetail();
     for (idx[0] = 0; idx[0] < size(0); ++idx[0])
-        for (idx[1] = 0; idx[1] < size(0); ++idx[1])
+        for (idx[1] = 0; idx[1] < size(1); ++idx[1])
             gene(idx).claim(this, lod, idx);
 }
 
@@ -54,6 +58,9 @@ void TerrainChromosome::claimGenes() {
 void TerrainChromosome::resize(const Dimension &sz,
                                bool preserveContents) {
     genes().setSizes(sz, preserveContents); // Become the new size
+    _renderCache.valid = false;             // Start over next time (before
+                                            // claiming, which marks genes
+                                            // modified in the old cache)
     claimGenes();                           // Notify the newcomers
 }
 void TerrainChromosome::resize(SizeType si, SizeType sj,
@@ -141,6 +148,39 @@ void TerrainChromosome::setAlive(bool alive) {
     _alive = alive;
 }
 
+// Fitness bookkeeping
+bool TerrainChromosome::fitnessCurrent() const {
+    return _fitnessRevision == _revision;
+}
+void TerrainChromosome::setFitnessCurrent() {
+    _fitnessRevision = _revision;
+}
+void TerrainChromosome::markModified() {
+    ++_revision;
+}
+void TerrainChromosome::markModified(const Pixel & idx) {
+    markModified();
+    if (! _renderCache.valid)
+        return;
+
+    // A gene outside the grid the cache was rendered with means the cache
+    // doesn't match our shape any more
+    const RenderCache::FlagGrid & modified = _renderCache.modified;
+    if (idx[0] < 0 || idx[0] >= IndexType(modified.size(0))
+            || idx[1] < 0 || idx[1] >= IndexType(modified.size(1)))
+        _renderCache.valid = false;
+    else
+        _renderCache.modified(idx) = true;
+}
+
+// Cached rendering of our genes
+TerrainChromosome::RenderCache & TerrainChromosome::renderCache() {
+    return _renderCache;
+}
+const TerrainChromosome::RenderCache & TerrainChromosome::renderCache() const {
+    return _renderCache;
+}
+
 
 /*****************************************************************************
  * Gene class corresponding to TerrainChromosome
@@ -158,6 +198,12 @@ void TerrainChromosome::Gene::claim(TerrainChromosome * p,
     setJitter(Offset(0, 0));
 }
 
+// Notify our parent that we've changed
+void TerrainChromosome::Gene::markModified() {
+    if (_parent != NULL)
+        _parent->markModified(_indices);
+}
+
 // Access to the parent TerrainChromosome
 TerrainChromosome & TerrainChromosome::Gene::parent() {
     return *_parent;
@@ -181,14 +227,20 @@ const TerrainType::LOD & TerrainChromosome::Gene::terrainType() const {
     return *_terrainType;
 }
 void TerrainChromosome::Gene::setTerrainType(const TerrainType::LOD & tt) {
+    if (_terrainType == & tt)
+        return;
     _terrainType = & tt;
+    markModified();
 }
 const TerrainSample::LOD & TerrainChromosome::Gene::terrainSample() const {
     return *_terrainSample;
 }
 void TerrainChromosome::Gene::setTerrainSample(const TerrainSample::LOD & ts) {
     setTerrainType(ts.terrainType());
+    if (_terrainSample == & ts)
+        return;
     _terrainSample = & ts;
+    markModified();
 }
 
 // How well do we match our pattern geometry?
@@ -205,6 +257,12 @@ TerrainChromosome::Gene::compatibility() const {
 /*---------------------------------------------------------------------------*
  | Data fields
  *---------------------------------------------------------------------------*/
+// Default constructor
+TerrainChromosome::Gene::Gene()
+    : _parent(NULL), _terrainType(NULL), _terrainSample(NULL),
+      _sourceCenter(0), _targetCenter(0),
+      _rotation(0), _scale(1), _offset(0), _jitter(0) { }
+
 // Assignment operator (only copies data fields)
 TerrainChromosome::Gene &
 TerrainChromosome::Gene::operator=(const TerrainChromosome::Gene & g) {
@@ -242,7 +300,10 @@ const Pixel & TerrainChromosome::Gene::sourceCenter() const {
     return _sourceCenter;
 }
 void TerrainChromosome::Gene::setSourceCenter(const Pixel & p) {
+    if (_sourceCenter == p)
+        return;
     _sourceCenter = p;
+    markModified();
 }
 
 // The pixel indices (within the resulting, generated heightfield) where
@@ -257,7 +318,10 @@ scalar_t TerrainChromosome::Gene::rotation() const {
     return _rotation;
 }
 void TerrainChromosome::Gene::setRotation(scalar_arg_t r) {
+    if (_rotation == r)
+        return;
     _rotation = r;
+    markModified();
 }
 
 
@@ -268,8 +332,11 @@ scalar_t TerrainChromosome::Gene::scale() const {
     return _scale;
 }
 void TerrainChromosome::Gene::setScale(scalar_arg_t s) {
-    if (s > scalar_t(0))    _scale = s;
-    else                    _scale = scalar_t(1);
+    scalar_t scale = (s > scalar_t(0)) ? scalar_t(s) : scalar_t(1);
+    if (_scale == scale)
+        return;
+    _scale = scale;
+    markModified();
 }
 
 // A scalar amount by which to offset the elevation data from its local
@@ -278,7 +345,10 @@ scalar_t TerrainChromosome::Gene::offset() const {
     return _offset;
 }
 void TerrainChromosome::Gene::setOffset(scalar_arg_t o) {
+    if (_offset == o)
+        return;
     _offset = o;
+    markModified();
 }
 
 // An amount in pixels by which to jitter the gene's target center-point.
@@ -286,8 +356,12 @@ const Offset & TerrainChromosome::Gene::jitter() const {
     return _jitter;
 }
 void TerrainChromosome::Gene::setJitter(const Offset & j) {
+    Pixel target = indices() * blendPatchSpacing(levelOfDetail()) + j;
+    if (_jitter == j && _targetCenter == target)
+        return;
     _jitter = j;
-    _targetCenter  = indices() * blendPatchSpacing(levelOfDetail()) + j;
+    _targetCenter = target;
+    markModified();
 }
 
 
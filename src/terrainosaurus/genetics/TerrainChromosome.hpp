@@ -37,6 +37,7 @@ namespace terrainosaurus {
     class RegionSimilarityMeasure;
     class GeneCompatibilityMeasure;
     class GeneShape;
+    class ChromosomeRenderCache;
     class TerrainChromosome;
 };
 
@@ -50,6 +51,7 @@ namespace terrainosaurus {
 #include <terrainosaurus/data/TerrainType.hpp>
 #include <terrainosaurus/data/TerrainSample.hpp>
 #include <terrainosaurus/data/MapRasterization.hpp>
+#include <terrainosaurus/data/StatisticsAccumulator.hpp>
 
 
 // These macros make it easy to create named accessor functions in the fitness
@@ -156,6 +158,81 @@ protected:
 #undef INDEXED_ACCESSOR
 
 
+/*****************************************************************************
+ * The cached rendering of a TerrainChromosome. This holds the heightfield
+ * (and its per-region statistics) generated from the chromosome's genes, as
+ * well as enough information to undo the contribution of each gene. This
+ * allows the rendering to be brought up-to-date after a mutation by
+ * re-splatting only the genes that actually changed.
+ *
+ * The rasters are the size of the whole heightfield, so copies of a
+ * chromosome (which start out with the same rendering) share them, and they
+ * are only copied when one of the copies goes to change them.
+ *****************************************************************************/
+class terrainosaurus::ChromosomeRenderCache {
+public:
+    // The parameters of a Gene, as they were when it was rendered
+    struct Splat {
+        TerrainSample::LOD const *  terrainSample;
+        Pixel                       sourceCenter,
+                                    targetCenter;
+        scalar_t                    rotation,
+                                    scale,
+                                    offset;
+    };
+
+    // The accumulated gene data, the blended result, and running statistics
+    // of the result in each region
+    struct Buffers {
+        Heightfield elevationSums,      // Sum of masked gene elevations
+                    weightSums,         // Sum of gene masks
+                    elevations,         // Blended elevations (sums / weights)
+                    slopes;             // Gradient magnitude of the elevations
+        std::vector<StatisticsAccumulator> regionElevations,
+                                           regionSlopes;
+    };
+    typedef shared_ptr<Buffers>         BuffersPtr;
+
+    typedef inca::MultiArray<Splat, 2>  SplatGrid;
+    typedef inca::MultiArray<bool, 2>   FlagGrid;
+    typedef TerrainSample::LOD::Stat    Stat;
+    typedef TerrainSample::LOD::StatList StatList;
+
+    // Constructor
+    explicit ChromosomeRenderCache() : valid(false), updates(0), map(NULL) { }
+
+    // The buffers, for changing. If another copy shares them, they are
+    // copied first; if 'discard' is true, their contents are about to be
+    // thrown away, so an empty set is made instead.
+    Buffers & modifiableBuffers(bool discard = false) {
+        if (! buffers || (discard && buffers.use_count() > 1))
+            buffers.reset(new Buffers());
+        else if (buffers.use_count() > 1)
+            buffers.reset(new Buffers(*buffers));
+        return *buffers;
+    }
+
+    bool        valid;          // Does this reflect the genes at all?
+    SizeType    updates;        // Incremental updates since the last full one
+    TerrainLOD  levelOfDetail;  // The LOD we rendered at
+
+    // The map we computed region statistics against
+    MapRasterization::LOD const * map;
+
+    // The genes as they were rendered, and which ones have changed since
+    SplatGrid   splats;
+    FlagGrid    modified;
+
+    // The rendering itself (possibly shared with other copies)
+    BuffersPtr  buffers;
+
+    // Per-region statistics of the blended elevations
+    StatList    regionElevationStatistics,
+                regionSlopeStatistics;
+    Stat        emptyStatistics;    // For measurements we don't track
+};
+
+
 /*****************************************************************************
  * The chromosome for the terrain-construction algorithm
  *****************************************************************************/
@@ -168,6 +245,9 @@ public:
     // small patch of terrain.
     class Gene;
 
+    // The results of the last rendering of the chromosome
+    typedef terrainosaurus::ChromosomeRenderCache    RenderCache;
+
     // Multivariate fitness & compatibility measures
     typedef terrainosaurus::ChromosomeFitnessMeasure ChromosomeFitnessMeasure;
     typedef terrainosaurus::RegionSimilarityMeasure  RegionSimilarityMeasure;
@@ -284,6 +364,22 @@ public:
     bool isAlive() const;
     void setAlive(bool alive);
 
+    // Is the fitness measure up-to-date? Any change to a gene marks the
+    // chromosome as modified, invalidating its fitness until it is
+    // recalculated.
+    bool fitnessCurrent() const;
+    void setFitnessCurrent();
+    void markModified();
+
+    // Mark a single gene as modified. In addition to invalidating the
+    // fitness, this flags the gene as needing to be re-rendered.
+    void markModified(const Pixel & idx);
+
+    // Access to the cached rendering of the chromosome (see
+    // updateRendering() in terrain-operations.hpp)
+          RenderCache & renderCache();
+    const RenderCache & renderCache() const;
+
 protected:
     // The height field layout & structure we're trying to match
     TerrainSampleConstPtr   _patternSample;
@@ -294,9 +390,16 @@ protected:
     bool            _alive;     // Is it allowed to go to the next cycle?
     std::vector<RegionSimilarityMeasure>   _regionFitnesses;
     ChromosomeFitnessMeasure            _fitness;
+
+    // Modification counters & cached rendering (these must follow _genes, so
+    // that the default assignment operator copies them after the genes)
+    SizeType        _revision,          // Bumped by every gene modification
+                    _fitnessRevision;   // Revision when fitness was calculated
+    RenderCache     _renderCache;       // Last rendering of our genes
 };
 
 
+
 /*****************************************************************************
  * The gene for the terrain-construction algorithm
  *****************************************************************************/
@@ -318,6 +421,12 @@ protected:
     // ownership and to inform it of its X,Y coordinates within the grid
     void claim(TerrainChromosome * p, TerrainLOD lod, const Pixel & idx);
 
+    // Notify our parent that we've changed. The setters call this only when
+    // a field's value actually changes, so that setting a gene to what it
+    // already is (as ConformMutationOperator does on every evaluation)
+    // doesn't force it to be re-rendered.
+    void markModified();
+
     // Link to the parent Chromosome, and position within parent
     TerrainChromosome *     _parent;        // Daddy!
     Pixel                   _indices;       // My genetic coordinates
@@ -351,6 +460,9 @@ protected:
  | Data fields
  *---------------------------------------------------------------------------*/
 public:
+    // Default constructor (the Gene is unowned until claimed)
+    Gene();
+
     // Assignment operator (preserves parent pointer and indices, but
     // copies data fields)
     Gene & operator=(const Gene & g);
@@ -0,0 +1,332 @@
+/*
+ * File: TiledTerrainGenerator.cpp
+ *
+ * Author: Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes.
+ *
+ * Description:
+ */
+
+// Include precompiled header
+#include <terrainosaurus/precomp.h>
+
+// Import class definition
+#include "TiledTerrainGenerator.hpp"
+
+// Import data & algorithm definitions
+#include <terrainosaurus/data/MapRasterization.hpp>
+#include <terrainosaurus/data/BlendKernelBank.hpp>
+#include <terrainosaurus/data/rasterize-map.hpp>
+#include "terrain-operations.hpp"
+
+// Import tracing support
+#include <terrainosaurus/util/Trace.hpp>
+
+// Import file exception definitions
+#include <inca/io/FileExceptions.hpp>
+
+// Import algorithms & C library functions
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+using namespace terrainosaurus;
+
+// How wide a border naiveBlend gives each region (as in the UI)
+#define BORDER_WIDTH    2
+
+// How far beyond its tile (in base LOD cells) a tile's starting pattern is
+// made, so that the fuzzy borders of regions just outside the tile reach in
+#define PATTERN_BORDER  (BORDER_WIDTH / 2 + 1)
+
+
+// Local helper functions
+namespace {
+    // Round 'n' up to a multiple of 'm'
+    SizeType roundUp(SizeType n, SizeType m) {
+        return (n + m - 1) / m * m;
+    }
+
+    // The blend profile, 'u' cells in from its edge (0 <= u <= half its
+    // size), interpolated between cells
+    float profileAt(const BlendKernel & k, scalar_t u) {
+        IndexType i = IndexType(u);
+        scalar_t f = u - i;
+        IndexType next = std::min(i + 1, IndexType(k.size() / 2));
+        return float(k.profile()[i] * (1 - f) + k.profile()[next] * f);
+    }
+
+    // Find the blend weight along one dimension of a tile covering cells
+    // [first, last) of [0, size), whose core is [coreFirst, coreLast). It
+    // ramps up over the 2 * overlap cells centered on each edge of the core
+    // that has a neighbor beyond it, and is one everywhere else.
+    void blendWeights(std::vector<float> & weights,
+                      IndexType first, IndexType last,
+                      IndexType coreFirst, IndexType coreLast, IndexType size,
+                      SizeType overlap, const BlendKernel & k) {
+        weights.assign(last - first, 1.0f);
+        if (overlap == 0)
+            return;
+
+        IndexType o = IndexType(overlap);
+        scalar_t half = scalar_t(k.size() / 2);
+        for (IndexType x = first; x < last; ++x) {
+            float & w = weights[x - first];
+            if (coreFirst > 0 && x < coreFirst + o) {
+                scalar_t t = (x - (coreFirst - o) + scalar_t(0.5)) / (2 * o);
+                w = std::min(w, profileAt(k, t * half));
+            }
+            if (coreLast < size && x >= coreLast - o) {
+                scalar_t t = (x - (coreLast - o) + scalar_t(0.5)) / (2 * o);
+                w = std::min(w, profileAt(k, (1 - t) * half));
+            }
+        }
+    }
+
+    // Complain about the scratch file
+    void scratchFailed(const std::string & filename, const char * what) {
+        inca::io::FileAccessException e(filename);
+        e << "Unable to " << what << " tile scratch file [" << filename
+          << "]: check disk space and directory/file permissions";
+        throw e;
+    }
+}
+
+
+// Constructor
+TiledTerrainGenerator::TiledTerrainGenerator(MapPtr m)
+    : _map(m), _tileSize(1024), _tileOverlap(0),
+      _startLOD(TerrainLOD::minimum()), _baseLOD(TerrainLOD::minimum()),
+      _targetLOD(TerrainLOD::minimum()), _ratio(1),
+      _runTileSize(0), _runTileOverlap(0), _sizes(0), _tileCount(0) { }
+
+
+/*---------------------------------------------------------------------------*
+ | Tiling parameters
+ *---------------------------------------------------------------------------*/
+SizeType TiledTerrainGenerator::tileSize() const { return _tileSize; }
+void TiledTerrainGenerator::setTileSize(SizeType sz) { _tileSize = sz; }
+
+SizeType TiledTerrainGenerator::tileOverlap() const { return _tileOverlap; }
+void TiledTerrainGenerator::setTileOverlap(SizeType sz) { _tileOverlap = sz; }
+
+
+/*---------------------------------------------------------------------------*
+ | Terrain generation
+ *---------------------------------------------------------------------------*/
+      HeightfieldGA & TiledTerrainGenerator::ga()       { return _ga; }
+const HeightfieldGA & TiledTerrainGenerator::ga() const { return _ga; }
+
+SizeArray TiledTerrainGenerator::sizes() const { return _sizes; }
+SizeType TiledTerrainGenerator::tileCount() const { return _tileCount; }
+
+void TiledTerrainGenerator::run(TerrainLOD startLOD, TerrainLOD targetLOD,
+                                const std::string & filename) {
+    TraceSpan runSpan("generate tiled terrain", "ga");
+    _startLOD  = startLOD;
+    _targetLOD = targetLOD;
+    _baseLOD   = (startLOD == TerrainLOD::minimum()) ? startLOD : startLOD - 1;
+    _ratio     = SizeType(scaleFactor(_baseLOD, _targetLOD) + scalar_t(0.5));
+
+    // Line the tiles up with the cells of the starting pattern
+    _runTileSize    = roundUp(std::max(_tileSize, SizeType(1)), _ratio);
+    _runTileOverlap = std::min(roundUp(_tileOverlap > 0 ? _tileOverlap
+                                                        : windowSize(targetLOD),
+                                       _ratio),
+                               _runTileSize / 2 / _ratio * _ratio);
+
+    // Figure out how big the whole terrain is, exactly as
+    // MapRasterization::LOD::createFromMap() would
+    Point2D maximum;
+    if (! mapBounds(_origin, maximum, *_map)) {
+        inca::GeneticAlgorithmException e;
+        e << "Unable to generate terrain for an empty map";
+        throw e;
+    }
+    scalar_t cellSize = metersPerSampleForLOD(targetLOD);
+    SizeArray tiles;
+    for (IndexType d = 0; d < 2; ++d) {
+        _sizes[d] = std::max(SizeType(1),
+                        SizeType(std::ceil((maximum[d] - _origin[d]) / cellSize)));
+        tiles[d] = (_sizes[d] + _runTileSize - 1) / _runTileSize;
+    }
+    _tileCount = tiles[0] * tiles[1];
+    if (runSpan) {
+        runSpan.setArgument("width", _sizes[0]);
+        runSpan.setArgument("height", _sizes[1]);
+        runSpan.setArgument("tiles", _tileCount);
+    }
+    INCA_INFO("Generating " << _sizes[0] << "x" << _sizes[1] << " terrain as "
+              << tiles[0] << "x" << tiles[1] << " tiles of " << _runTileSize
+              << " cells, overlapping by " << _runTileOverlap)
+
+    // Zero out the scratch file, one row at a time
+    std::string scratchFilename = filename + ".tiles";
+    std::fstream scratch(scratchFilename.c_str(), std::ios::in | std::ios::out
+                                    | std::ios::binary | std::ios::trunc);
+    if (! scratch)
+        scratchFailed(scratchFilename, "create");
+    std::vector<float> row(2 * _sizes[0], 0.0f);
+    for (IndexType j = 0; j < IndexType(_sizes[1]); ++j)
+        scratch.write(reinterpret_cast<char const *>(&row[0]),
+                      row.size() * sizeof(float));
+    if (! scratch)
+        scratchFailed(scratchFilename, "write");
+
+    // Generate each tile in turn
+    Pixel core;
+    IndexType tile = 0;
+    for (core[1] = 0; core[1] < IndexType(_sizes[1]); core[1] += _runTileSize)
+        for (core[0] = 0; core[0] < IndexType(_sizes[0]); core[0] += _runTileSize) {
+            INCA_INFO("Generating tile " << ++tile << " of " << _tileCount)
+            _generateTile(core, scratch);
+            if (! scratch)
+                scratchFailed(scratchFilename, "update");
+        }
+
+    // Finally, divide out the weights and write the result
+    TraceSpan storeSpan("store tiles", "io");
+    std::ofstream file(filename.c_str(), std::ios::out | std::ios::binary);
+    if (! file) {
+        inca::io::FileAccessException e(filename);
+        e << "Unable to write terrain file [" << filename
+          << "]: check directory/file permissions";
+        throw e;
+    }
+    std::vector<float> elevations(_sizes[0]);
+    scratch.seekg(0);
+    for (IndexType j = 0; j < IndexType(_sizes[1]); ++j) {
+        scratch.read(reinterpret_cast<char *>(&row[0]),
+                     row.size() * sizeof(float));
+        for (IndexType i = 0; i < IndexType(_sizes[0]); ++i)
+            elevations[i] = (row[2 * i + 1] > 0.0f) ? row[2 * i] / row[2 * i + 1]
+                                                    : 0.0f;
+        file.write(reinterpret_cast<char const *>(&elevations[0]),
+                   elevations.size() * sizeof(float));
+    }
+    if (! scratch)
+        scratchFailed(scratchFilename, "read");
+    if (! file) {
+        inca::io::FileAccessException e(filename);
+        e << "Unable to write terrain file [" << filename
+          << "]: check disk space";
+        throw e;
+    }
+    file.close();
+    scratch.close();
+    std::remove(scratchFilename.c_str());
+}
+
+
+void TiledTerrainGenerator::_generateTile(const Pixel & core,
+                                          std::fstream & scratch) {
+    // Figure out what this tile covers: its core, plus the overlap on every
+    // side, as far as the edges of the map
+    IndexArray first, last, coreLast;
+    SizeArray sz;
+    for (IndexType d = 0; d < 2; ++d) {
+        coreLast[d] = std::min(core[d] + IndexType(_runTileSize),
+                               IndexType(_sizes[d]));
+        first[d] = std::max(core[d] - IndexType(_runTileOverlap), IndexType(0));
+        last[d]  = std::min(coreLast[d] + IndexType(_runTileOverlap),
+                            IndexType(_sizes[d]));
+        sz[d] = last[d] - first[d];
+    }
+    TraceSpan span("tile", "ga");
+    if (span) {
+        span.setArgument("x", first[0]);
+        span.setArgument("y", first[1]);
+        span.setArgument("width", sz[0]);
+        span.setArgument("height", sz[1]);
+    }
+
+    // Scan-convert just this tile of the map. Coarser LODs are resampled
+    // from this one.
+    scalar_t cellSize = metersPerSampleForLOD(_targetLOD);
+    Point2D origin;
+    for (IndexType d = 0; d < 2; ++d)
+        origin[d] = _origin[d] + first[d] * cellSize;
+    MapRasterizationPtr mr(new MapRasterization(_map));
+    (*mr)[_targetLOD].createFromMap(*_map, origin, sz);
+
+    // Start from this tile's own starting pattern. The GA never works at
+    // the coarsest LOD, so if it starts there, so does the terrain.
+    TerrainSamplePtr ts(new TerrainSample());
+    TerrainSamplePtr ps(new TerrainSample());
+    ts->setMapRasterization(mr);
+    ps->setMapRasterization(mr);
+    (*ps)[_baseLOD].createFromRaster(_basePattern(first, (*mr)[_baseLOD].sizes()));
+    if (_startLOD == TerrainLOD::minimum())
+        (*ts)[_baseLOD] = (*ps)[_baseLOD];
+
+    // Evolve it
+    _ga.setTerrainSample(ts);
+    _ga.setPatternSample(ps);
+    _ga.run(_startLOD, _targetLOD);
+
+    // Add it into the scratch file, a row at a time
+    TraceSpan blendSpan("blend tile", "io");
+    const Heightfield & hf = (*ts)[_targetLOD].elevations();
+    const BlendKernel & k = BlendKernelBank::instance().kernel(
+                                BlendKernelBank::Gaussian, _targetLOD);
+    std::vector<float> w0, w1;
+    blendWeights(w0, first[0], last[0], core[0], coreLast[0],
+                 IndexType(_sizes[0]), _runTileOverlap, k);
+    blendWeights(w1, first[1], last[1], core[1], coreLast[1],
+                 IndexType(_sizes[1]), _runTileOverlap, k);
+
+    // The GA's LODs are resampled from one another, so the result might be
+    // a cell short of the map at the edges
+    IndexType w = std::min(IndexType(sz[0]), IndexType(hf.size(0))),
+              h = std::min(IndexType(sz[1]), IndexType(hf.size(1)));
+    std::vector<float> row(2 * sz[0]);
+    for (IndexType j = 0; j < h; ++j) {
+        std::streamoff offset = std::streamoff(sizeof(float)) * 2
+                              * ((first[1] + j) * std::streamoff(_sizes[0])
+                                 + first[0]);
+        scratch.seekg(offset);
+        scratch.read(reinterpret_cast<char *>(&row[0]),
+                     row.size() * sizeof(float));
+        for (IndexType i = 0; i < w; ++i) {
+            float weight = w0[i] * w1[j];
+            row[2 * i]     += weight * hf(hf.base(0) + i, hf.base(1) + j);
+            row[2 * i + 1] += weight;
+        }
+        scratch.seekp(offset);
+        scratch.write(reinterpret_cast<char const *>(&row[0]),
+                      row.size() * sizeof(float));
+    }
+}
+
+
+// Make the starting pattern for one tile, just as the UI does, but at the
+// LOD before the GA's first. The map is scan-converted at that LOD over the
+// tile plus a border, blended, then cropped to the tile.
+Heightfield TiledTerrainGenerator::_basePattern(const IndexArray & first,
+                                                const SizeArray & sz) const {
+    TraceSpan span("base pattern", "ga");
+    scalar_t cellSize = metersPerSampleForLOD(_baseLOD);
+    IndexType border = PATTERN_BORDER;
+    Point2D origin;
+    SizeArray bordered;
+    for (IndexType d = 0; d < 2; ++d) {
+        origin[d] = _origin[d] + (first[d] / IndexType(_ratio) - border) * cellSize;
+        bordered[d] = sz[d] + 2 * border;
+    }
+    MapRasterizationPtr mr(new MapRasterization(_map));
+    (*mr)[_baseLOD].createFromMap(*_map, origin, bordered);
+    TerrainSamplePtr ps(new TerrainSample());
+    ps->setMapRasterization(mr);
+    naiveBlend((*ps)[_baseLOD], BORDER_WIDTH);
+
+    const Heightfield & blended = (*ps)[_baseLOD].elevations();
+    Heightfield pattern(sz);
+    for (IndexType j = 0; j < IndexType(sz[1]); ++j)
+        for (IndexType i = 0; i < IndexType(sz[0]); ++i)
+            pattern(pattern.base(0) + i, pattern.base(1) + j)
+                = blended(blended.base(0) + border + i,
+                          blended.base(1) + border + j);
+    return pattern;
+}
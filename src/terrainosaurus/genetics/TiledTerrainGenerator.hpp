@@ -0,0 +1,142 @@
+/** -*- C++ -*-
+ *
+ * \file    TiledTerrainGenerator.hpp
+ *
+ * \author  Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes only.
+ *
+ * Description:
+ *      The TiledTerrainGenerator class generates terrain for a Map too large
+ *      for the whole thing to be generated at once, writing the elevations
+ *      straight to a raw file (native-endian 32-bit floats, dimension 0
+ *      varying fastest, just as terrainosaurus-batch writes them).
+ *
+ *      The map is divided into a grid of square tiles, each of which is
+ *      scan-converted and run through the HeightfieldGA on its own, with
+ *      only its own MapRasterization, pattern & terrain resident. Each tile
+ *      is extended by an overlap on every side that has a neighbor, and
+ *      where tiles overlap, their elevations are blended together, weighted
+ *      by the gaussian blend profile (see BlendKernelBank.hpp), ramping from
+ *      the edge of one tile to the core of the other.
+ *
+ *      Each tile also makes its own starting pattern (the one naiveBlend
+ *      makes at the LOD before the first one the GA works on), from the
+ *      part of the map under the tile plus a border of a few cells, so
+ *      that the blending between regions at the tile's edges comes out as
+ *      it would for the whole map. Nothing the size of the whole map is
+ *      ever in memory. The finished terrain is taken from the tile's
+ *      terrain sample, just as terrainosaurus-batch takes it.
+ *
+ * Implementation notes:
+ *      The tiles' blended elevations are accumulated in a scratch file
+ *      beside the output (the output filename plus ".tiles"), as a weighted
+ *      sum and a total weight for each cell. Each tile is added in by
+ *      reading, adding to and rewriting its rows of the scratch file, and
+ *      once every tile is done, the scratch file is turned into the output
+ *      a row at a time, then removed. Thus, the memory needed is that for a
+ *      single tile, plus a few rows of the whole map.
+ *
+ *      The tile size and overlap are rounded up to multiples of the ratio
+ *      between the target LOD and the starting pattern's LOD, so that each
+ *      tile lines up exactly with cells of the starting pattern, and the
+ *      overlap is limited to half the tile size, so that the blend zones on
+ *      opposite sides of a tile never meet.
+ *
+ *      The GA never works at the coarsest LOD, so when it starts there, the
+ *      starting pattern is copied into the terrain sample (as the UI does),
+ *      which is then the result if the target is the coarsest LOD, too.
+ */
+
+#ifndef TERRAINOSAURUS_GENETICS_TILED_TERRAIN_GENERATOR
+#define TERRAINOSAURUS_GENETICS_TILED_TERRAIN_GENERATOR
+
+// Import library configuration
+#include <terrainosaurus/terrainosaurus-common.h>
+
+// This is part of the Terrainosaurus terrain generation engine
+namespace terrainosaurus {
+    // Forward declarations
+    class TiledTerrainGenerator;
+};
+
+// Import data object definitions
+#include <terrainosaurus/data/Map.hpp>
+#include <terrainosaurus/data/TerrainSample.hpp>
+
+// Import the GA that generates each tile
+#include "HeightfieldGA.hpp"
+
+// Import container & I/O definitions
+#include <vector>
+#include <string>
+#include <fstream>
+
+
+class terrainosaurus::TiledTerrainGenerator {
+/*---------------------------------------------------------------------------*
+ | Constructor
+ *---------------------------------------------------------------------------*/
+public:
+    explicit TiledTerrainGenerator(MapPtr m);
+
+
+/*---------------------------------------------------------------------------*
+ | Tiling parameters
+ *---------------------------------------------------------------------------*/
+public:
+    // The width & height of a tile (not counting its overlap), in cells at
+    // the target LOD (default: 1024)
+    SizeType tileSize() const;
+    void setTileSize(SizeType sz);
+
+    // How far each tile extends into its neighbors, in cells at the target
+    // LOD (zero, the default, means the window size at the target LOD)
+    SizeType tileOverlap() const;
+    void setTileOverlap(SizeType sz);
+
+
+/*---------------------------------------------------------------------------*
+ | Terrain generation
+ *---------------------------------------------------------------------------*/
+public:
+    // The GA used for each tile (e.g., to set its preload callback). Its
+    // timings are those of the last tile.
+          HeightfieldGA & ga();
+    const HeightfieldGA & ga() const;
+
+    // Generate terrain for the whole map from 'startLOD' to 'targetLOD',
+    // writing the elevations at 'targetLOD' to the raw file 'filename'
+    void run(TerrainLOD startLOD, TerrainLOD targetLOD,
+             const std::string & filename);
+
+    // What the last run did
+    SizeArray sizes() const;        // Size of the whole terrain, in cells
+    SizeType tileCount() const;     // How many tiles it was divided into
+
+protected:
+    // Generate the tile whose core starts at 'core' (in cells at the target
+    // LOD), and add it into the scratch file
+    void _generateTile(const Pixel & core, std::fstream & scratch);
+
+    // Make the starting pattern for the tile covering target LOD cells
+    // from 'first', whose pattern is 'sz' cells at the base LOD
+    Heightfield _basePattern(const IndexArray & first,
+                             const SizeArray & sz) const;
+
+    MapPtr          _map;
+    HeightfieldGA   _ga;
+    SizeType        _tileSize, _tileOverlap;
+
+    // State of the current run
+    TerrainLOD      _startLOD, _baseLOD, _targetLOD;
+    SizeType        _ratio;         // Target LOD cells per base LOD cell
+    SizeType        _runTileSize,   // Tile size & overlap, as rounded
+                    _runTileOverlap;
+    Point2D         _origin;        // Where the map starts, in meters
+    SizeArray       _sizes;         // Whole terrain size at the target LOD
+    SizeType        _tileCount;
+};
+
+#endif
@@ -0,0 +1,338 @@
+/*
+ * File: splat-kernel.cpp
+ *
+ * Author: Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes.
+ *
+ * Description:
+ */
+
+// Include precompiled header
+#include <terrainosaurus/precomp.h>
+
+// Import function prototypes
+#include "splat-kernel.hpp"
+
+// Import math functions
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+// Import SIMD intrinsics. With GCC & Clang on x86, the AVX2 code is compiled
+// regardless of the target flags, and used only if the CPU turns out to
+// support it. Elsewhere, it's there only if the compiler targets AVX2.
+#if defined(__AVX2__)
+#   define SPLAT_AVX2
+#   define SPLAT_AVX2_TARGET
+#elif (defined(__GNUC__) || defined(__clang__)) \
+        && (defined(__x86_64__) || defined(__i386__))
+#   define SPLAT_AVX2
+#   define SPLAT_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#if defined(SPLAT_AVX2)
+#   include <immintrin.h>
+#elif defined(__ARM_NEON)
+#   include <arm_neon.h>
+#endif
+
+// Import atomic flags
+#include <atomic>
+
+using namespace terrainosaurus;
+
+
+// Local helper functions
+namespace {
+    // A heightfield, as raw memory
+    struct Grid {
+        Grid(const Heightfield & hf)
+            : data(const_cast<float *>(hf.elements())),
+              stride(IndexType(hf.size(0))),
+              width(IndexType(hf.size(0))), height(IndexType(hf.size(1))),
+              base0(hf.base(0)), base1(hf.base(1)) { }
+
+        float * cell(IndexType i, IndexType j) const {
+            return data + (j - base1) * stride + (i - base0);
+        }
+
+        float *     data;
+        IndexType   stride, width, height, base0, base1;
+    };
+
+    // The splat transformation, pre-multiplied by the sign
+    struct Transform {
+        float a, b, sign;   // v = a * z + b, weight = sign * w
+    };
+
+    // Accumulate cells [k, count) of a contiguous row, one at a time
+    inline void accumulateRowScalar(float * e, float * s, float const * z,
+                                    float const * w, IndexType k,
+                                    IndexType count, const Transform & t) {
+        for (; k < count; ++k) {
+            e[k] += w[k] * (t.a * z[k] + t.b);
+            s[k] += t.sign * w[k];
+        }
+    }
+
+    // Bilinearly sample 'g' at (qx, qy), relative to its base
+    inline float sample(const Grid & g, float qx, float qy) {
+        qx = std::min(std::max(qx, 0.0f), float(g.width - 1));
+        qy = std::min(std::max(qy, 0.0f), float(g.height - 1));
+        IndexType x0 = IndexType(qx), y0 = IndexType(qy);
+        IndexType x1 = std::min(x0 + 1, g.width - 1),
+                  y1 = std::min(y0 + 1, g.height - 1);
+        float fx = qx - float(x0), fy = qy - float(y0);
+        float const * r0 = g.data + y0 * g.stride,
+                    * r1 = g.data + y1 * g.stride;
+        float top    = r0[x0] + fx * (r0[x1] - r0[x0]);
+        float bottom = r1[x0] + fx * (r1[x1] - r1[x0]);
+        return top + fy * (bottom - top);
+    }
+
+    // Accumulate cells [k, count) of a row whose source is rotated, one at
+    // a time. (qx, qy) is the source location of cell 0 (relative to the
+    // source's base), and (dqx, dqy) is the step from one cell to the next.
+    inline void accumulateRotatedRowScalar(float * e, float * s,
+                                           const Grid & src,
+                                           float qx, float qy,
+                                           float dqx, float dqy,
+                                           float const * w, IndexType k,
+                                           IndexType count,
+                                           const Transform & t) {
+        for (; k < count; ++k) {
+            float z = sample(src, qx + float(k) * dqx, qy + float(k) * dqy);
+            e[k] += w[k] * (t.a * z + t.b);
+            s[k] += t.sign * w[k];
+        }
+    }
+
+#if defined(SPLAT_AVX2)
+    // Whether the CPU we're running on can execute the AVX2 code. GCC's
+    // check includes whether the OS saves the AVX registers.
+    bool cpuHasAVX2() {
+#   if defined(__AVX2__)
+        return true;
+#   else
+        static const bool has = __builtin_cpu_supports("avx2");
+        return has;
+#   endif
+    }
+
+    // Whether 'w' may be loaded with aligned vector loads. Mask rows start
+    // aligned (see BlendKernel::weights()), so this is true unless the
+    // splat was clipped on its left edge.
+    inline bool vectorAligned(float const * w) {
+        return reinterpret_cast<std::uintptr_t>(w) % sizeof(__m256) == 0;
+    }
+
+    // Load 8 mask weights, with an aligned load if we know we can
+    template <bool Aligned>
+    SPLAT_AVX2_TARGET inline __m256 loadWeights(float const * w) {
+        return Aligned ? _mm256_load_ps(w) : _mm256_loadu_ps(w);
+    }
+
+    // Accumulate 'count' contiguous cells, 8 at a time. The target & source
+    // rows may start anywhere, but the weights are aligned if
+    // 'AlignedWeights' is.
+    template <bool AlignedWeights>
+    SPLAT_AVX2_TARGET
+    void accumulateRowAVX2(float * e, float * s, float const * z,
+                           float const * w, IndexType count,
+                           const Transform & t) {
+        IndexType k = 0;
+        __m256 a = _mm256_set1_ps(t.a), b = _mm256_set1_ps(t.b),
+               sign = _mm256_set1_ps(t.sign);
+        for (; k + 8 <= count; k += 8) {
+            __m256 wk = loadWeights<AlignedWeights>(w + k);
+            __m256 v  = _mm256_add_ps(_mm256_mul_ps(a, _mm256_loadu_ps(z + k)), b);
+            _mm256_storeu_ps(e + k, _mm256_add_ps(_mm256_loadu_ps(e + k),
+                                                  _mm256_mul_ps(wk, v)));
+            _mm256_storeu_ps(s + k, _mm256_add_ps(_mm256_loadu_ps(s + k),
+                                                  _mm256_mul_ps(sign, wk)));
+        }
+        accumulateRowScalar(e, s, z, w, k, count, t);
+    }
+
+    // Accumulate 'count' cells of a rotated row, 8 at a time, using gathers
+    // for the bilinear lookups
+    template <bool AlignedWeights>
+    SPLAT_AVX2_TARGET
+    void accumulateRotatedRowAVX2(float * e, float * s, const Grid & src,
+                                  float qx, float qy, float dqx, float dqy,
+                                  float const * w, IndexType count,
+                                  const Transform & t) {
+        IndexType k = 0;
+        __m256 a = _mm256_set1_ps(t.a), b = _mm256_set1_ps(t.b),
+               sign = _mm256_set1_ps(t.sign);
+        __m256 steps = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+        __m256 zero  = _mm256_setzero_ps(),
+               maxX  = _mm256_set1_ps(float(src.width - 1)),
+               maxY  = _mm256_set1_ps(float(src.height - 1));
+        __m256i one    = _mm256_set1_epi32(1),
+                lastX  = _mm256_set1_epi32(int(src.width - 1)),
+                lastY  = _mm256_set1_epi32(int(src.height - 1)),
+                stride = _mm256_set1_epi32(int(src.stride));
+        for (; k + 8 <= count; k += 8) {
+            __m256 kk = _mm256_add_ps(_mm256_set1_ps(float(k)), steps);
+            __m256 x  = _mm256_add_ps(_mm256_set1_ps(qx), _mm256_mul_ps(kk, _mm256_set1_ps(dqx)));
+            __m256 y  = _mm256_add_ps(_mm256_set1_ps(qy), _mm256_mul_ps(kk, _mm256_set1_ps(dqy)));
+            x = _mm256_min_ps(_mm256_max_ps(x, zero), maxX);
+            y = _mm256_min_ps(_mm256_max_ps(y, zero), maxY);
+            __m256i x0 = _mm256_cvttps_epi32(x), y0 = _mm256_cvttps_epi32(y);
+            __m256i x1 = _mm256_min_epi32(_mm256_add_epi32(x0, one), lastX),
+                    y1 = _mm256_min_epi32(_mm256_add_epi32(y0, one), lastY);
+            __m256 fx = _mm256_sub_ps(x, _mm256_cvtepi32_ps(x0)),
+                   fy = _mm256_sub_ps(y, _mm256_cvtepi32_ps(y0));
+            __m256i r0 = _mm256_mullo_epi32(y0, stride),
+                    r1 = _mm256_mullo_epi32(y1, stride);
+            __m256 z00 = _mm256_i32gather_ps(src.data, _mm256_add_epi32(r0, x0), 4),
+                   z10 = _mm256_i32gather_ps(src.data, _mm256_add_epi32(r0, x1), 4),
+                   z01 = _mm256_i32gather_ps(src.data, _mm256_add_epi32(r1, x0), 4),
+                   z11 = _mm256_i32gather_ps(src.data, _mm256_add_epi32(r1, x1), 4);
+            __m256 top    = _mm256_add_ps(z00, _mm256_mul_ps(fx, _mm256_sub_ps(z10, z00))),
+                   bottom = _mm256_add_ps(z01, _mm256_mul_ps(fx, _mm256_sub_ps(z11, z01))),
+                   z      = _mm256_add_ps(top, _mm256_mul_ps(fy, _mm256_sub_ps(bottom, top)));
+
+            __m256 wk = _mm256_loadu_ps(w + k);
+            __m256 v  = _mm256_add_ps(_mm256_mul_ps(a, z), b);
+            _mm256_storeu_ps(e + k, _mm256_add_ps(_mm256_loadu_ps(e + k),
+                                                  _mm256_mul_ps(wk, v)));
+            _mm256_storeu_ps(s + k, _mm256_add_ps(_mm256_loadu_ps(s + k),
+                                                  _mm256_mul_ps(sign, wk)));
+        }
+        accumulateRotatedRowScalar(e, s, src, qx, qy, dqx, dqy, w, k, count, t);
+    }
+#elif defined(__ARM_NEON)
+    // Accumulate 'count' contiguous cells, 4 at a time
+    void accumulateRowNEON(float * e, float * s, float const * z,
+                           float const * w, IndexType count,
+                           const Transform & t) {
+        IndexType k = 0;
+        float32x4_t a = vdupq_n_f32(t.a), b = vdupq_n_f32(t.b),
+                    sign = vdupq_n_f32(t.sign);
+        for (; k + 4 <= count; k += 4) {
+            float32x4_t wk = vld1q_f32(w + k);
+            float32x4_t v  = vaddq_f32(vmulq_f32(a, vld1q_f32(z + k)), b);
+            vst1q_f32(e + k, vaddq_f32(vld1q_f32(e + k), vmulq_f32(wk, v)));
+            vst1q_f32(s + k, vaddq_f32(vld1q_f32(s + k), vmulq_f32(sign, wk)));
+        }
+        accumulateRowScalar(e, s, z, w, k, count, t);
+    }
+#endif
+
+    // Whether SIMD code is compiled in, and usable on this CPU
+    bool simdAvailable() {
+#if defined(SPLAT_AVX2)
+        return cpuHasAVX2();
+#elif defined(__ARM_NEON)
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // Whether to use it (see setSplatVectorized())
+    std::atomic<bool> simdEnabled(true);
+
+    // Accumulate 'count' contiguous cells, with SIMD code if we have it
+    void accumulateRow(float * e, float * s, float const * z, float const * w,
+                       IndexType count, const Transform & t, bool simd) {
+#if defined(SPLAT_AVX2)
+        if (simd) {
+            if (vectorAligned(w))   accumulateRowAVX2<true>(e, s, z, w, count, t);
+            else                    accumulateRowAVX2<false>(e, s, z, w, count, t);
+            return;
+        }
+#elif defined(__ARM_NEON)
+        if (simd) {
+            accumulateRowNEON(e, s, z, w, count, t);
+            return;
+        }
+#endif
+        accumulateRowScalar(e, s, z, w, 0, count, t);
+    }
+
+    // Accumulate 'count' cells of a rotated row, with SIMD code if we have it
+    void accumulateRotatedRow(float * e, float * s, const Grid & src,
+                              float qx, float qy, float dqx, float dqy,
+                              float const * w, IndexType count,
+                              const Transform & t, bool simd) {
+#if defined(SPLAT_AVX2)
+        if (simd) {
+            if (vectorAligned(w))
+                accumulateRotatedRowAVX2<true>(e, s, src, qx, qy, dqx, dqy,
+                                               w, count, t);
+            else
+                accumulateRotatedRowAVX2<false>(e, s, src, qx, qy, dqx, dqy,
+                                                w, count, t);
+            return;
+        }
+#endif
+        accumulateRotatedRowScalar(e, s, src, qx, qy, dqx, dqy, w, 0, count, t);
+    }
+}
+
+
+bool terrainosaurus::splatVectorized() {
+    return simdEnabled.load(std::memory_order_relaxed) && simdAvailable();
+}
+
+void terrainosaurus::setSplatVectorized(bool enabled) {
+    simdEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+void terrainosaurus::splatKernel(Heightfield & elevations, Heightfield & sum,
+                                 const Heightfield & source,
+                                 const Pixel & sourceCenter, scalar_t rotation,
+                                 scalar_t scale, scalar_t offset,
+                                 const Pixel & targetCenter,
+                                 const BlendKernel & mask, scalar_t sign) {
+    IndexType n      = IndexType(mask.size());
+    IndexType half   = n / 2;
+    IndexType stride = IndexType(mask.stride());
+    Grid e(elevations), s(sum), src(source);
+    Transform t = { float(sign * scale), float(sign * offset), float(sign) };
+    bool simd = splatVectorized();
+
+    // Clip the target window to the target heightfield
+    IndexType t0 = targetCenter[0] - half, t1 = targetCenter[1] - half;
+    IndexType iFirst = std::max(t0, e.base0),
+              iLast  = std::min(t0 + n, e.base0 + e.width),
+              jFirst = std::max(t1, e.base1),
+              jLast  = std::min(t1 + n, e.base1 + e.height);
+    if (iFirst >= iLast || jFirst >= jLast)
+        return;
+    IndexType count = iLast - iFirst;
+
+    // Fast path: no rotation, and the source window is entirely inside the
+    // source, so each row is a straight copy (plus arithmetic)
+    IndexType s0 = sourceCenter[0] - half, s1 = sourceCenter[1] - half;
+    if (rotation == 0 && s0 >= src.base0 && s0 + n <= src.base0 + src.width
+                      && s1 >= src.base1 && s1 + n <= src.base1 + src.height) {
+        for (IndexType j = jFirst; j < jLast; ++j) {
+            IndexType kj = j - t1, ki = iFirst - t0;
+            accumulateRow(e.cell(iFirst, j), s.cell(iFirst, j),
+                          src.cell(s0 + ki, s1 + kj),
+                          mask.weights() + kj * stride + ki, count, t, simd);
+        }
+        return;
+    }
+
+    // General case: rotate target offsets back into the source. The source
+    // of target cell (i, j) is sourceCenter + R(-rotation) * (i, j) - targetCenter.
+    float c  = float(std::cos(rotation)),
+          sn = float(std::sin(rotation));
+    float cx = float(sourceCenter[0] - src.base0),
+          cy = float(sourceCenter[1] - src.base1);
+    for (IndexType j = jFirst; j < jLast; ++j) {
+        IndexType kj = j - t1, ki = iFirst - t0;
+        float dx = float(iFirst - targetCenter[0]),
+              dy = float(j - targetCenter[1]);
+        float qx = cx + c * dx + sn * dy, qy = cy - sn * dx + c * dy;
+        accumulateRotatedRow(e.cell(iFirst, j), s.cell(iFirst, j), src,
+                             qx, qy, c, -sn,
+                             mask.weights() + kj * stride + ki, count, t, simd);
+    }
+}
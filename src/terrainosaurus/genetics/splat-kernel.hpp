@@ -0,0 +1,80 @@
+/*
+ * File: splat-kernel.hpp
+ *
+ * Author: Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes.
+ *
+ * Description:
+ *      This file declares splatKernel(), which renders a single transformed
+ *      terrain patch (i.e., a Gene) into a heightfield. Given a source
+ *      heightfield, it:
+ *          * rotates the source by 'rotation' radians around 'sourceCenter'
+ *            (sampling it bilinearly)
+ *          * scales the rotated elevations by 'scale', then adds 'offset'
+ *          * weights the result by a blending mask, centered on
+ *            'targetCenter'
+ *          * adds the weighted elevations into 'elevations' and the weights
+ *            themselves into 'sum'
+ *      all in a single pass over the target window. With 'sign' = -1, the
+ *      same values are subtracted instead, undoing an earlier splat. The
+ *      subtracted values are the exact negations of the added ones, but the
+ *      running sums are rounded after every addition, so the undoing is
+ *      only approximate (which is why updateRendering() starts over from
+ *      scratch every so often).
+ *
+ *      Reading off the edge of the source takes the value of the nearest
+ *      edge cell, just as reading off the edge of a raster does. Cells of
+ *      the target window that fall outside 'elevations' are skipped.
+ *
+ * Implementation notes:
+ *      The unrotated case (rotation == 0, with the whole source window inside
+ *      the source) is the common one, and needs no resampling at all: each
+ *      row of the window is a contiguous run of cells in the source, target
+ *      and mask, and is processed 8 (AVX2) or 4 (NEON) cells at a time. The
+ *      rotated case is also vectorized with AVX2 (using gathers for the
+ *      bilinear lookups). Everything else falls back to scalar code, which
+ *      calculates exactly the same thing.
+ *
+ *      With GCC or Clang on x86, the AVX2 code is always compiled (with the
+ *      "target" attribute), and used if the CPU supports it, so default
+ *      builds get it without -mavx2. Other compilers use it only when
+ *      targeting AVX2 anyway. NEON is part of the ARM64 baseline.
+ *      setSplatVectorized(false) forces the scalar code, so that the two
+ *      can be compared (see src/test/splat_kernel.cpp).
+ *
+ *      The mask is read a row at a time, each row starting stride() floats
+ *      after the one before (see BlendKernel::weights()). Rows start on a
+ *      cache line, so unless the splat is clipped on its left edge, the
+ *      AVX2 code reads the mask weights with aligned loads. The heightfields
+ *      are inca rasters, whose alignment we don't control, so they are
+ *      always read with unaligned loads.
+ */
+
+#ifndef TERRAINOSAURUS_GENETICS_SPLAT_KERNEL
+#define TERRAINOSAURUS_GENETICS_SPLAT_KERNEL
+
+// Import library configuration
+#include <terrainosaurus/terrainosaurus-common.h>
+
+// Import blending mask definition
+#include <terrainosaurus/data/BlendKernelBank.hpp>
+
+// This is part of the Terrainosaurus terrain generation engine
+namespace terrainosaurus {
+    // Add (sign = 1) or subtract (sign = -1) one transformed, masked patch
+    void splatKernel(Heightfield & elevations, Heightfield & sum,
+                     const Heightfield & source, const Pixel & sourceCenter,
+                     scalar_t rotation, scalar_t scale, scalar_t offset,
+                     const Pixel & targetCenter, const BlendKernel & mask,
+                     scalar_t sign);
+
+    // Whether splatKernel() uses SIMD code (true by default, if the CPU has
+    // it). Turning it off forces the scalar code; this is meant for testing,
+    // and should not be changed while splats are being rendered.
+    bool splatVectorized();
+    void setSplatVectorized(bool enabled);
+};
+
+#endif
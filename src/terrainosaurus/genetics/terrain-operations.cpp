@@ -14,22 +14,243 @@
 
 // Import function prototypes and class definitions
 #include "terrain-operations.hpp"
+#include "splat-kernel.hpp"
 
 // Import raster operations
 #include <inca/raster/operators/arithmetic>
 #include <inca/raster/operators/statistic>
 #include <inca/raster/operators/select>
-#include <inca/raster/operators/linear_map>
-#include <inca/raster/operators/rotate>
+#include <inca/raster/operators/gradient>
 
 // Import Timer definition
 #include <inca/util/Timer>
 
+// Import STL algorithms
+#include <algorithm>
+
 using namespace inca;
 using namespace inca::math;
 using namespace inca::raster;
 using namespace terrainosaurus;
 
+typedef ChromosomeRenderCache           RenderCache;
+typedef RenderCache::Splat              Splat;
+typedef RenderCache::Stat               Stat;
+typedef RenderCache::Buffers            Buffers;
+
+
+// Local helper functions for rendering chromosomes
+namespace {
+    // How many incremental updates we allow before re-rendering a chromosome
+    // from scratch. Subtracting a gene's contribution doesn't exactly undo
+    // adding it (in floating point), so we start over every so often to keep
+    // rounding errors from piling up.
+    const SizeType maxIncrementalUpdates = 32;
+
+    // Capture the parameters needed to render (or un-render) a Gene
+    Splat splatOf(const TerrainChromosome::Gene & g) {
+        Splat s;
+        s.terrainSample = &g.terrainSample();
+        s.sourceCenter  = g.sourceCenter();
+        s.targetCenter  = g.targetCenter();
+        s.rotation      = g.rotation();
+        s.scale         = g.scale();
+        s.offset        = g.offset();
+        return s;
+    }
+
+    // Add (or remove) the masked, transformed source data for a Gene to the
+    // HF, and the mask itself to sum
+    void renderSplat(Heightfield & elevations, Heightfield & sum,
+                     const Splat & s, TerrainLOD lod, bool remove) {
+        const TerrainSample::LOD & sample = *s.terrainSample;
+        scalar_t mean = sample.localElevationMean(s.sourceCenter);
+        splatKernel(elevations, sum, sample.elevations(), s.sourceCenter,
+                    s.rotation, s.scale, s.offset + mean * (1 - s.scale),
+                    s.targetCenter,
+                    BlendKernelBank::instance().kernel(BlendKernelBank::Gaussian, lod),
+                    remove ? scalar_t(-1) : scalar_t(1));
+    }
+
+    // The range of cells [first, last) touched by a splat, grown by 'border'
+    // cells on each side and clipped to the bounds of 'hf'
+    void splatBounds(Pixel & first, Pixel & last, const Splat & s,
+                     TerrainLOD lod, IndexType border, const Heightfield & hf) {
+        Dimension size(gaussianMask(lod).sizes());
+        first = s.targetCenter - size / 2;
+        last  = first + size;
+        for (IndexType d = 0; d < 2; ++d) {
+            first[d] = std::max(first[d] - border, hf.base(d));
+            last[d]  = std::min(last[d] + border, hf.extent(d) + 1);
+        }
+    }
+
+    // Re-blend the elevations in the cells [first, last)
+    void blendElevations(Buffers & b, const Pixel & first,
+                                      const Pixel & last) {
+        Pixel px;
+        for (px[1] = first[1]; px[1] < last[1]; ++px[1])
+            for (px[0] = first[0]; px[0] < last[0]; ++px[0])
+                b.elevations(px) = b.elevationSums(px) / b.weightSums(px);
+    }
+
+    // Recalculate the slopes in the cells [first, last)
+    void calculateSlopes(Buffers & b, TerrainLOD lod, const Pixel & first,
+                                                      const Pixel & last) {
+        scalar_t mps = metersPerSampleForLOD(lod);
+        auto gradient = raster::gradient(b.elevations, mps);
+        Pixel px;
+        for (px[1] = first[1]; px[1] < last[1]; ++px[1])
+            for (px[0] = first[0]; px[0] < last[0]; ++px[0]) {
+                Vector2D g = gradient(px);
+                b.slopes(px) = std::sqrt(g[0] * g[0] + g[1] * g[1]);
+            }
+    }
+
+    // Split the 'length' cells of a row starting at 'start' into stretches
+    // lying in a single region, calling 'f(regionID, first, count)' for
+    // each one (with zero-based region IDs). Cells outside of any region are
+    // skipped.
+    template <typename Function>
+    void forEachRegionRun(const MapRasterization::LOD & map,
+                          const Pixel & start, SizeType length, Function f) {
+        IDType regions = IDType(map.regionCount());
+        Pixel px(start), first;
+        IndexType end = start[0] + IndexType(length);
+        while (px[0] < end) {
+            IDType id = map.regionID(px);
+            first = px;
+            do {
+                ++px[0];
+            } while (px[0] < end && map.regionID(px) == id);
+            if (id > 0 && id <= regions)
+                f(id - 1, first, SizeType(px[0] - first[0]));
+        }
+    }
+
+    // Call 'f(first, count)' for each run of cells along a row in the union
+    // of the rectangles [firsts[i], lasts[i]), so that overlapping
+    // rectangles don't visit any cell twice
+    template <typename Function>
+    void forEachDirtyRun(const std::vector<Pixel> & firsts,
+                         const std::vector<Pixel> & lasts, Function f) {
+        if (firsts.empty())
+            return;
+        IndexType top = firsts[0][1], bottom = lasts[0][1];
+        for (IndexType i = 1; i < IndexType(firsts.size()); ++i) {
+            top    = std::min(top, firsts[i][1]);
+            bottom = std::max(bottom, lasts[i][1]);
+        }
+
+        std::vector< std::pair<IndexType, IndexType> > spans;
+        Pixel px;
+        for (px[1] = top; px[1] < bottom; ++px[1]) {
+            spans.clear();
+            for (IndexType i = 0; i < IndexType(firsts.size()); ++i)
+                if (firsts[i][1] <= px[1] && px[1] < lasts[i][1]
+                        && firsts[i][0] < lasts[i][0])
+                    spans.push_back(std::make_pair(firsts[i][0], lasts[i][0]));
+            std::sort(spans.begin(), spans.end());
+            for (IndexType k = 0; k < IndexType(spans.size()); ) {
+                IndexType end = spans[k].second;
+                px[0] = spans[k].first;
+                for (++k; k < IndexType(spans.size())
+                          && spans[k].first <= end; ++k)
+                    end = std::max(end, spans[k].second);
+                f(px, SizeType(end - px[0]));
+            }
+        }
+    }
+
+    // Gather the elevation & slope statistics for one region from scratch
+    void accumulateRegion(Buffers & b, const MapRasterization::LOD & map,
+                          IDType regionID) {
+        const MapRasterization::LOD::Region & bounds = map.regionBounds(regionID);
+        StatisticsAccumulator & elevations = b.regionElevations[regionID],
+                              & slopes     = b.regionSlopes[regionID];
+        elevations.reset();
+        slopes.reset();
+        SizeType width = SizeType(bounds.extent(0) - bounds.base(0) + 1);
+        Pixel px;
+        px[0] = bounds.base(0);
+        for (px[1] = bounds.base(1); px[1] <= bounds.extent(1); ++px[1])
+            forEachRegionRun(map, px, width,
+                    [&](IDType rID, const Pixel & first, SizeType count) {
+                if (rID == regionID) {
+                    elevations.add(&b.elevations(first), count);
+                    slopes.add(&b.slopes(first), count);
+                }
+            });
+    }
+
+    // Hand a region's running statistics over to its Statistics objects
+    void storeRegionStatistics(RenderCache & rc, IDType regionID) {
+        const Buffers & b = *rc.buffers;
+        b.regionElevations[regionID].store(rc.regionElevationStatistics[regionID]);
+        b.regionSlopes[regionID].store(rc.regionSlopeStatistics[regionID]);
+    }
+
+    // Render the chromosome into its cache from scratch
+    void renderAll(TerrainChromosome & c, const MapRasterization::LOD & map) {
+        RenderCache & rc = c.renderCache();
+        rc.levelOfDetail = c.levelOfDetail();
+        rc.map           = &map;
+        rc.updates       = 0;
+
+        // Start from empty (in buffers of our own)
+        Buffers & b = rc.modifiableBuffers(true);
+        b.elevationSums.setSizes(c.heightfieldSizes());
+        b.weightSums.setSizes(c.heightfieldSizes());
+        b.elevations.setSizes(c.heightfieldSizes());
+        b.slopes.setSizes(c.heightfieldSizes());
+        fill(b.elevationSums, 0.0f);
+        fill(b.weightSums, 0.0f);
+
+        // Splat each gene, remembering what we did
+        rc.splats.setSizes(c.sizes());
+        rc.modified.setSizes(c.sizes());
+        Pixel idx;
+        for (idx[0] = 0; idx[0] < IndexType(c.size(0)); ++idx[0])
+            for (idx[1] = 0; idx[1] < IndexType(c.size(1)); ++idx[1]) {
+                rc.splats(idx) = splatOf(c.gene(idx));
+                rc.modified(idx) = false;
+                renderSplat(b.elevationSums, b.weightSums, rc.splats(idx),
+                            rc.levelOfDetail, false);
+            }
+
+        // Blend the result and measure it, a row at a time
+        Pixel first, last;
+        for (IndexType d = 0; d < 2; ++d) {
+            first[d] = b.elevations.base(d);
+            last[d]  = b.elevations.extent(d) + 1;
+        }
+        blendElevations(b, first, last);
+        calculateSlopes(b, rc.levelOfDetail, first, last);
+        SizeType regions = map.regionCount();
+        b.regionElevations.assign(regions, StatisticsAccumulator());
+        b.regionSlopes.assign(regions, StatisticsAccumulator());
+        Pixel px;
+        px[0] = first[0];
+        for (px[1] = first[1]; px[1] < last[1]; ++px[1])
+            forEachRegionRun(map, px, b.elevations.size(0),
+                    [&](IDType rID, const Pixel & start, SizeType count) {
+                b.regionElevations[rID].add(&b.elevations(start), count);
+                b.regionSlopes[rID].add(&b.slopes(start), count);
+            });
+        rc.regionElevationStatistics.resize(regions);
+        rc.regionSlopeStatistics.resize(regions);
+        for (IDType rID = 0; rID < IDType(regions); ++rID)
+            storeRegionStatistics(rc, rID);
+
+        // We don't currently measure edges
+        rc.emptyStatistics.reset();
+        rc.emptyStatistics.finish();
+
+        rc.valid = true;
+    }
+}
+
+
 
 void terrainosaurus::naiveBlend(TerrainSample::LOD & tsl, int borderWidth) {
     const MapRasterization::LOD & map = tsl.mapRasterization();
@@ -146,25 +367,7 @@ void terrainosaurus::renderChromosome(TerrainSample::LOD & tsl,
 void terrainosaurus::renderGene(Heightfield & elevations,
                                 Heightfield & sum,
                                 const TerrainChromosome::Gene & g) {
-    // Select the source region and apply the gene's transformation to it
-    const GrayscaleImage & mask = gaussianMask(g.levelOfDetail());
-    Dimension size(mask.sizes());
-    Pixel stS = g.sourceCenter() - size / 2,
-          edS = stS + size,
-          stT = g.targetCenter() - size / 2,
-          edT = stT + size;
-
-    // Add the transformed, masked pixels to the HF and the mask itself to sum
-    const TerrainSample::LOD & sample = g.terrainSample();
-    scalar_t mean = sample.localElevationMean(g.sourceCenter());
-    selectBE(elevations, stT, edT) += mask *
-            selectBE(
-                linear_map(
-                    rotate(sample.elevations(), g.rotation(), g.sourceCenter()),
-                    g.scale(), g.offset() + mean * (1 - g.scale())
-                ),
-                stS, edS);
-    selectBE(sum, stT, edT) += mask;
+    renderSplat(elevations, sum, splatOf(g), g.levelOfDetail(), false);
 
 #if 0
     cerr << "ElevationRange of mask: " << range(*g.mask) << endl;
@@ -176,6 +379,117 @@ void terrainosaurus::renderGene(Heightfield & elevations,
 #endif
 }
 
+// Bring the chromosome's cached rendering up-to-date with its genes
+void terrainosaurus::updateRendering(TerrainChromosome & c,
+                                     const MapRasterization::LOD & map) {
+    RenderCache & rc = c.renderCache();
+
+    // If the cache doesn't match the chromosome's shape, we can't use it
+    const Heightfield::SizeArray & hfSizes = c.heightfieldSizes();
+    if (! rc.valid || ! rc.buffers
+            || rc.levelOfDetail != c.levelOfDetail() || rc.map != &map
+            || rc.splats.size(0) != c.size(0)
+            || rc.splats.size(1) != c.size(1)
+            || rc.buffers->elevations.size(0) != hfSizes[0]
+            || rc.buffers->elevations.size(1) != hfSizes[1]
+            || rc.updates >= maxIncrementalUpdates) {
+        renderAll(c, map);
+        return;
+    }
+
+    // Find the genes that have changed. If it's most of them, it's cheaper
+    // just to start over.
+    std::vector<Pixel> changed;
+    Pixel idx;
+    for (idx[0] = 0; idx[0] < IndexType(c.size(0)); ++idx[0])
+        for (idx[1] = 0; idx[1] < IndexType(c.size(1)); ++idx[1])
+            if (rc.modified(idx))
+                changed.push_back(idx);
+    if (changed.empty())
+        return;
+    if (2 * changed.size() > c.size()) {
+        renderAll(c, map);
+        return;
+    }
+
+    // From here on, we change the rendering, so it must be ours alone
+    Buffers & b = rc.modifiableBuffers();
+
+    // Swap out the old version of each changed gene for the new one,
+    // keeping track of all the cells affected by either one
+    std::vector<Pixel> firsts, lasts;
+    Pixel first, last;
+    for (IndexType i = 0; i < IndexType(changed.size()); ++i) {
+        Splat & s = rc.splats(changed[i]);
+        splatBounds(first, last, s, rc.levelOfDetail, 0, b.elevations);
+        firsts.push_back(first);    lasts.push_back(last);
+        renderSplat(b.elevationSums, b.weightSums, s, rc.levelOfDetail, true);
+
+        s = splatOf(c.gene(changed[i]));
+        splatBounds(first, last, s, rc.levelOfDetail, 0, b.elevations);
+        firsts.push_back(first);    lasts.push_back(last);
+        renderSplat(b.elevationSums, b.weightSums, s, rc.levelOfDetail, false);
+
+        rc.modified(changed[i]) = false;
+    }
+
+    // The slopes also change one cell further out, since the gradient looks
+    // at neighbors
+    std::vector<Pixel> slopeFirsts(firsts.size()), slopeLasts(lasts.size());
+    for (IndexType i = 0; i < IndexType(firsts.size()); ++i)
+        for (IndexType d = 0; d < 2; ++d) {
+            slopeFirsts[i][d] = std::max(firsts[i][d] - 1, b.elevations.base(d));
+            slopeLasts[i][d]  = std::min(lasts[i][d] + 1,
+                                         b.elevations.extent(d) + 1);
+        }
+
+    // Take the affected cells' old values out of their regions' statistics.
+    // Taking away a region's minimum or maximum can't be undone that way, so
+    // such a region is gathered again from scratch instead.
+    SizeType regions = map.regionCount();
+    std::vector<bool> touched(regions, false), rebuild(regions, false);
+    forEachDirtyRun(slopeFirsts, slopeLasts,
+            [&](const Pixel & start, SizeType length) {
+        forEachRegionRun(map, start, length,
+                [&](IDType rID, const Pixel & px, SizeType count) {
+            touched[rID] = true;
+            const scalar_t * elevations = &b.elevations(px),
+                           * slopes     = &b.slopes(px);
+            for (SizeType k = 0; k < count && ! rebuild[rID]; ++k)
+                if (! b.regionElevations[rID].remove(elevations[k])
+                        || ! b.regionSlopes[rID].remove(slopes[k]))
+                    rebuild[rID] = true;
+        });
+    });
+
+    // Re-blend the affected cells, then recalculate the slopes
+    for (IndexType i = 0; i < IndexType(firsts.size()); ++i)
+        blendElevations(b, firsts[i], lasts[i]);
+    for (IndexType i = 0; i < IndexType(slopeFirsts.size()); ++i)
+        calculateSlopes(b, rc.levelOfDetail, slopeFirsts[i], slopeLasts[i]);
+
+    // Put the new values back in, and update the Statistics objects of only
+    // the regions containing affected cells
+    forEachDirtyRun(slopeFirsts, slopeLasts,
+            [&](const Pixel & start, SizeType length) {
+        forEachRegionRun(map, start, length,
+                [&](IDType rID, const Pixel & px, SizeType count) {
+            if (! rebuild[rID]) {
+                b.regionElevations[rID].add(&b.elevations(px), count);
+                b.regionSlopes[rID].add(&b.slopes(px), count);
+            }
+        });
+    });
+    for (IDType rID = 0; rID < IDType(regions); ++rID) {
+        if (rebuild[rID])
+            accumulateRegion(b, map, rID);
+        if (touched[rID])
+            storeRegionStatistics(rc, rID);
+    }
+
+    ++rc.updates;
+}
+
 // Compute the aggregate fitness of a TerrainLibrary LOD
 scalar_t terrainosaurus::terrainLibraryFitness(const TerrainLibrary::LOD & tl,
                                                bool print) {
@@ -254,47 +568,76 @@ scalar_t terrainosaurus::terrainSampleFitness(const TerrainSample::LOD & ts,
 
 // Compute the similarity between a region within a TerrainSample
 // and a reference TerrainType
+namespace {
+    RegionSimilarityMeasure regionSimilarity(const TerrainType::LOD & tt,
+                                             const Stat & elevationStats,
+                                             const Stat & slopeStats,
+                                             const Stat & edgeLengthStats,
+                                             const Stat & edgeScaleStats,
+                                             const Stat & edgeStrengthStats,
+                                             IDType regionID, SizeType area,
+                                             bool print) {
+        // The multi-valued fitness measure we're calculating
+        RegionSimilarityMeasure fitness;
+
+        // Compute aggregate region fitness
+        fitness.elevation()    = tt.elevationDistribution().match(elevationStats);
+        fitness.slope()        = tt.slopeDistribution().match(slopeStats);
+        fitness.edgeLength()   = tt.edgeLengthDistribution().match(edgeLengthStats);
+        fitness.edgeScale()    = tt.edgeScaleDistribution().match(edgeScaleStats);
+        fitness.edgeStrength() = tt.edgeStrengthDistribution().match(edgeStrengthStats);
+        fitness.overall() = tt.elevationWeight() * fitness.elevation()
+                          + tt.slopeWeight() * fitness.slope();
+
+        fitness.overall() += tt.edgeLengthWeight() * (std::isnan(fitness.edgeLength())
+                                                        ? 0.5f
+                                                        : fitness.edgeLength());
+        fitness.overall() += tt.edgeScaleWeight() * (std::isnan(fitness.edgeScale())
+                                                        ? 0.5f
+                                                        : fitness.edgeScale());
+        fitness.overall() += tt.edgeStrengthWeight() * (std::isnan(fitness.edgeStrength())
+                                                        ? 0.5f
+                                                        : fitness.edgeStrength());
+
+        // Barf out the fitness thingy
+        if (print) {
+            INCA_INFO("      Region " << regionID
+                      << "  fitness(" << fitness.overall() << ')'
+                      << "  area(" << area << ')')
+            INCA_INFO("        Elevation     " << fitness.elevation())
+            INCA_INFO("        Slope         " << fitness.slope())
+            INCA_INFO("        Edge Length   " << fitness.edgeLength())
+            INCA_INFO("        Edge Scale    " << fitness.edgeScale())
+            INCA_INFO("        Edge Strength " << fitness.edgeStrength())
+        }
+
+        return fitness;
+    }
+}
+
 RegionSimilarityMeasure
 terrainosaurus::terrainRegionSimilarity(const TerrainSample::LOD & ts,
                                         IDType regionID, bool print) {
-    // The multi-valued fitness measure we're calculating
-    RegionSimilarityMeasure values, ref, fitness;
-
-    // Find the measurements for the reference TT
-    const TerrainType::LOD & tt = ts.regionTerrainType(regionID);
-
-    // Compute aggregate region fitness
-    fitness.elevation()    = tt.elevationDistribution().match(ts.regionElevationStatistics(regionID));
-    fitness.slope()        = tt.slopeDistribution().match(ts.regionSlopeStatistics(regionID));
-    fitness.edgeLength()   = tt.edgeLengthDistribution().match(ts.regionEdgeLengthStatistics(regionID));
-    fitness.edgeScale()    = tt.edgeScaleDistribution().match(ts.regionEdgeScaleStatistics(regionID));
-    fitness.edgeStrength() = tt.edgeStrengthDistribution().match(ts.regionEdgeStrengthStatistics(regionID));
-    fitness.overall() = tt.elevationWeight() * fitness.elevation()
-                      + tt.slopeWeight() * fitness.slope();
-
-    fitness.overall() += tt.edgeLengthWeight() * (std::isnan(fitness.edgeLength())
-                                                    ? 0.5f
-                                                    : fitness.edgeLength());
-    fitness.overall() += tt.edgeScaleWeight() * (std::isnan(fitness.edgeScale())
-                                                    ? 0.5f
-                                                    : fitness.edgeScale());
-    fitness.overall() += tt.edgeStrengthWeight() * (std::isnan(fitness.edgeStrength())
-                                                    ? 0.5f
-                                                    : fitness.edgeStrength());
-        
-    // Barf out the fitness thingy
-    if (print) {
-        INCA_INFO("      Region " << regionID
-                  << "  fitness(" << fitness.overall() << ')'
-                  << "  area(" << ts.regionArea(regionID) << ')')
-        INCA_INFO("        Elevation     " << fitness.elevation())
-        INCA_INFO("        Slope         " << fitness.slope())
-        INCA_INFO("        Edge Length   " << fitness.edgeLength())
-        INCA_INFO("        Edge Scale    " << fitness.edgeScale())
-        INCA_INFO("        Edge Strength " << fitness.edgeStrength())
-    }
+    return regionSimilarity(ts.regionTerrainType(regionID),
+                            ts.regionElevationStatistics(regionID),
+                            ts.regionSlopeStatistics(regionID),
+                            ts.regionEdgeLengthStatistics(regionID),
+                            ts.regionEdgeScaleStatistics(regionID),
+                            ts.regionEdgeStrengthStatistics(regionID),
+                            regionID, ts.regionArea(regionID), print);
+}
 
-    return fitness;
+RegionSimilarityMeasure
+terrainosaurus::terrainRegionSimilarity(const TerrainChromosome & c,
+                                        IDType regionID, bool print) {
+    const RenderCache & rc = c.renderCache();
+    return regionSimilarity(rc.map->regionTerrainType(regionID),
+                            rc.regionElevationStatistics[regionID],
+                            rc.regionSlopeStatistics[regionID],
+                            rc.emptyStatistics,
+                            rc.emptyStatistics,
+                            rc.emptyStatistics,
+                            regionID, rc.map->regionArea(regionID), print);
 }
 
 
@@ -24,6 +24,10 @@
  *      chromosome and a gene (respectively) back into a set of elevation
  *      values (pixels) in a heightfield. This must be done after each
  *      iteration of the GA in order to evaluate the fitness of a chromosome.
+ *      Since a typical mutation changes only a few genes, the GA instead uses
+ *      updateRendering(...), which keeps a rendering of the chromosome
+ *      (along with its per-region statistics) in the chromosome's
+ *      RenderCache and re-splats only those genes that have changed.
  *
  *      The evaluateFitness(...) function examines a chromosome to determine
  *      its fitness according to a variety of metrics, and returns an overall
@@ -66,6 +70,13 @@ namespace terrainosaurus {
     void renderGene(Heightfield & hf, Heightfield & sum,
                     const TerrainChromosome::Gene & g);
 
+    // Bring the chromosome's RenderCache up-to-date with its genes,
+    // computing region statistics against 'map'. Only the genes that have
+    // changed since the last update are re-rendered, and the statistics of
+    // the regions they touch are updated over just the cells that changed.
+    void updateRendering(TerrainChromosome & c,
+                         const MapRasterization::LOD & map);
+
     // Compute the aggregate fitness of an LOD of a TerrainLibrary, TerrainType,
     // or TerrainSample, defined as the average of the fitnesses of each
     // consitutent subpart (TerrainType, TerrainSample, or region), weighted
@@ -85,6 +96,12 @@ namespace terrainosaurus {
     RegionSimilarityMeasure terrainRegionSimilarity(const TerrainSample::LOD & ts,
                                                     IDType regionID,
                                                     bool print = false);
+
+    // Same as above, but for a region of a chromosome's cached rendering
+    // (which must be up-to-date)
+    RegionSimilarityMeasure terrainRegionSimilarity(const TerrainChromosome & c,
+                                                    IDType regionID,
+                                                    bool print = false);
      
     // Heightfield measurement operations for a particular slot in a Chromosome.
     // These operations return average values across the region of the pattern
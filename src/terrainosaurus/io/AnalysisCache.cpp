@@ -0,0 +1,220 @@
+/*
+ * File: AnalysisCache.cpp
+ *
+ * Author: Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes.
+ *
+ * Description:
+ */
+
+// Include precompiled header
+#include <terrainosaurus/precomp.h>
+
+// Import class definitions
+#include "AnalysisCache.hpp"
+
+// Import file-related exception definitions
+#include <inca/io/FileExceptions.hpp>
+
+// Import stream definitions
+#include <istream>
+#include <ostream>
+#include <iterator>
+
+using namespace inca::io;
+using namespace terrainosaurus;
+
+typedef AnalysisCache::Header   Header;
+typedef AnalysisCache::Section  Section;
+
+
+// Magic string identifying an analysis cache file
+const char AnalysisCache::magic[16] = "TerrainosaurusA";
+
+
+// Local helper functions
+namespace {
+    // Round 'n' up to the next payload boundary
+    std::uint64_t align(std::uint64_t n) {
+        std::uint64_t a = AnalysisCache::payloadAlignment;
+        return (n + a - 1) / a * a;
+    }
+
+    // The offset of the first payload, given the number of sections
+    std::uint64_t firstPayloadOffset(SizeType sectionCount) {
+        return align(sizeof(Header) + sectionCount * sizeof(Section));
+    }
+}
+
+
+/*---------------------------------------------------------------------------*
+ | AnalysisCache constructors
+ *---------------------------------------------------------------------------*/
+AnalysisCache::AnalysisCache(const std::string & filename)
+    : _filename(filename), _data(NULL), _size(0) { }
+
+AnalysisCachePtr AnalysisCache::open(const std::string & filename) {
+    AnalysisCachePtr cache(new AnalysisCache(filename));
+    cache->_file.reset(new MappedFile(filename));
+    cache->_data = cache->_file->data();
+    cache->_size = cache->_file->size();
+    cache->_parse();
+    return cache;
+}
+
+AnalysisCachePtr AnalysisCache::read(std::istream & is) {
+    AnalysisCachePtr cache(new AnalysisCache(""));
+    cache->_buffer.assign(std::istreambuf_iterator<char>(is),
+                          std::istreambuf_iterator<char>());
+    cache->_data = cache->_buffer.empty() ? NULL : &cache->_buffer[0];
+    cache->_size = cache->_buffer.size();
+    cache->_parse();
+    return cache;
+}
+
+void AnalysisCache::_parse() {
+    // Check the header, to make sure this file is what we think it is
+    Header & h = _header;
+    if (_size < sizeof(Header)) {
+        FileFormatException e(_filename);
+        e << "File is too short to be an analysis cache file";
+        throw e;
+    }
+    std::memcpy(&h, _data, sizeof(Header));
+    if (std::memcmp(h.magic, magic, sizeof(magic)) != 0) {
+        FileFormatException e(_filename);
+        e << "File does not have the correct magic header. Are you sure "
+             "this is a cache file?";
+        throw e;
+    }
+    if (h.byteOrder != byteOrderMark) {
+        FileFormatException e(_filename);
+        e << "Cache file was written on a machine with a different byte order";
+        throw e;
+    }
+    if (h.version != formatVersion) {
+        FileFormatException e(_filename);
+        e << "Cache file has format version " << h.version
+          << ", not the current version " << formatVersion;
+        throw e;
+    }
+
+    // Read the section table, and make sure every section is really there
+    if (_size < firstPayloadOffset(h.sectionCount)) {
+        FileFormatException e(_filename);
+        e << "Cache file ended prematurely (in the section table)";
+        throw e;
+    }
+    _sections.resize(h.sectionCount);
+    if (h.sectionCount > 0)
+        std::memcpy(&_sections[0], _data + sizeof(Header),
+                    h.sectionCount * sizeof(Section));
+    for (IndexType i = 0; i < IndexType(_sections.size()); ++i) {
+        const Section & s = _sections[i];
+        if (s.offset % payloadAlignment != 0 || s.offset > _size
+                                             || s.length > _size - s.offset) {
+            FileFormatException e(_filename);
+            e << "Cache file ended prematurely (section " << s.id
+              << " runs past the end of the file)";
+            throw e;
+        }
+    }
+}
+
+
+/*---------------------------------------------------------------------------*
+ | Section access
+ *---------------------------------------------------------------------------*/
+TerrainLOD AnalysisCache::levelOfDetail() const {
+    for (TerrainLOD lod = TerrainLOD::minimum(); lod <= TerrainLOD::maximum(); ++lod)
+        if (int(lod) == _header.levelOfDetail)
+            return lod;
+    return TerrainLOD_Overflow;
+}
+
+const Section * AnalysisCache::section(SectionID id) const {
+    for (IndexType i = 0; i < IndexType(_sections.size()); ++i)
+        if (_sections[i].id == std::uint32_t(id))
+            return &_sections[i];
+    return NULL;
+}
+
+char const * AnalysisCache::sectionData(SectionID id) const {
+    const Section * s = section(id);
+    return s == NULL ? NULL : _data + s->offset;
+}
+
+SizeType AnalysisCache::sectionLength(SectionID id) const {
+    const Section * s = section(id);
+    return s == NULL ? 0 : SizeType(s->length);
+}
+
+void AnalysisCache::_checkRaster(const Section & s,
+                                 SizeType elementSize) const {
+    SizeType count = 1;
+    for (IndexType d = 0; d < 2; ++d)
+        count *= SizeType(std::max(s.extents[d] - s.bases[d] + 1, 0));
+    if (s.elementSize != elementSize || s.length != count * elementSize) {
+        FileFormatException e(_filename);
+        e << "Cache section " << s.id << " has " << s.elementSize
+          << "-byte elements, but " << elementSize << "-byte elements were "
+             "expected";
+        throw e;
+    }
+}
+
+
+/*---------------------------------------------------------------------------*
+ | AnalysisCacheWriter implementation
+ *---------------------------------------------------------------------------*/
+Section AnalysisCacheWriter::_newSection(SectionID id, SizeType elementSize,
+                                         SizeType length) {
+    Section s;
+    std::memset(&s, 0, sizeof(Section));
+    s.id          = std::uint32_t(id);
+    s.elementSize = std::uint32_t(elementSize);
+    s.length      = length;
+    return s;
+}
+
+void AnalysisCacheWriter::addBlob(SectionID id, const std::string & blob) {
+    _blobs.push_back(shared_ptr<std::string>(new std::string(blob)));
+    _sections.push_back(_newSection(id, 0, blob.size()));
+    _payloads.push_back(_blobs.back()->data());
+}
+
+void AnalysisCacheWriter::write(std::ostream & os) const {
+    // Lay out the payloads, each on its own page boundary
+    std::vector<Section> sections(_sections);
+    std::uint64_t offset = firstPayloadOffset(sections.size());
+    for (IndexType i = 0; i < IndexType(sections.size()); ++i) {
+        sections[i].offset = offset;
+        offset = align(offset + sections[i].length);
+    }
+
+    // Write the header and section table
+    Header h;
+    std::memset(&h, 0, sizeof(Header));
+    std::memcpy(h.magic, AnalysisCache::magic, sizeof(h.magic));
+    h.version       = AnalysisCache::formatVersion;
+    h.byteOrder     = AnalysisCache::byteOrderMark;
+    h.levelOfDetail = int(_levelOfDetail);
+    h.sectionCount  = sections.size();
+    h.sourceHash    = _sourceHash;
+    h.parameterHash = _parameterHash;
+    os.write((char const *)&h, sizeof(Header));
+    if (! sections.empty())
+        os.write((char const *)&sections[0], sections.size() * sizeof(Section));
+
+    // Write each payload, padding up to its starting offset
+    std::uint64_t position = sizeof(Header) + sections.size() * sizeof(Section);
+    for (IndexType i = 0; i < IndexType(sections.size()); ++i) {
+        for (; position < sections[i].offset; ++position)
+            os.put('\0');
+        if (sections[i].length > 0)
+            os.write(_payloads[i], sections[i].length);
+        position += sections[i].length;
+    }
+}
@@ -0,0 +1,257 @@
+/** -*- C++ -*-
+ *
+ * \file    AnalysisCache.hpp
+ *
+ * \author  Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes only.
+ *
+ * Description:
+ *      The AnalysisCache class provides read access to a TerrainSample::LOD
+ *      analysis cache file, and the AnalysisCacheWriter class creates one.
+ *
+ *      A cache file consists of a fixed-size header, followed by a table
+ *      describing each section in the file, followed by the section payloads
+ *      themselves:
+ *
+ *          Header          magic string, format version, byte-order mark,
+ *                          LOD, source & parameter fingerprints, and
+ *                          number of sections
+ *          Section table   one entry per section, giving the section's ID,
+ *                          element size, raster bounds (if it is a raster),
+ *                          and the offset & length of its payload
+ *          Payloads        each one starting on a page boundary
+ *
+ *      Raster sections hold the raw raster elements, in the same order as
+ *      they are stored in memory. Other sections (statistics, features) are
+ *      opaque blobs, interpreted by the TerrainSample::LOD IOstream code.
+ *
+ * Implementation notes:
+ *      Where the platform supports it, the file is memory-mapped, rather than
+ *      read. Opening a cache then costs only reading the header and section
+ *      table, and a section's pages are read from disk only when (and if)
+ *      that section is actually used. TerrainSample::LOD takes advantage of
+ *      this by paging in each raster on first access (see
+ *      attachAnalysisCache() in terrainosaurus-iostream.hpp), and by
+ *      evicting rasters back to the file when memory is tight (see
+ *      ResidencyManager.hpp).
+ *
+ *      Since inca rasters own their storage, a raster paged in from the cache
+ *      is copied out of the mapping (a single memcpy), rather than used in
+ *      place. Because payloads are page-aligned, this copy is as cheap as it
+ *      gets.
+ *
+ *      The header records fingerprints of the source data (the DEM & terrain
+ *      type map) and of the analysis parameters (see
+ *      TerrainSample::LOD::analysisFingerprint()) that the cache was
+ *      calculated from. A cache is current exactly when both match, no
+ *      matter what the file timestamps say.
+ *
+ *      Whenever the layout of the file (or of anything stored in it) changes,
+ *      formatVersion must be incremented, so that old caches are discarded
+ *      rather than misinterpreted.
+ */
+
+#ifndef TERRAINOSAURUS_IO_ANALYSIS_CACHE
+#define TERRAINOSAURUS_IO_ANALYSIS_CACHE
+
+// Import library configuration
+#include <terrainosaurus/terrainosaurus-common.h>
+
+// Import fixed-size integer & container definitions
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <iosfwd>
+
+// Import raster & LOD definitions
+#include <inca/raster/MultiArrayRaster>
+#include <terrainosaurus/data/TerrainLOD.hpp>
+
+// Import file mapping definition
+#include "MappedFile.hpp"
+
+// This is part of the Terrainosaurus terrain generation engine
+namespace terrainosaurus {
+    // Forward declarations
+    class AnalysisCache;
+    class AnalysisCacheWriter;
+
+    // Pointer typedefs
+    typedef shared_ptr<AnalysisCache>       AnalysisCachePtr;
+    typedef shared_ptr<AnalysisCache const> AnalysisCacheConstPtr;
+};
+
+
+class terrainosaurus::AnalysisCache {
+/*---------------------------------------------------------------------------*
+ | Type & constant definitions
+ *---------------------------------------------------------------------------*/
+public:
+    // The sections that may appear in a cache file
+    enum SectionID {
+        ElevationSection            = 1,
+        GradientSection             = 2,
+        LocalElevationMeanSection   = 3,
+        LocalGradientMeanSection    = 4,
+        LocalElevationLimitsSection = 5,
+        LocalSlopeLimitsSection     = 6,
+        MeasurementSection          = 7,    // Spectrum & global statistics
+        FeatureSection              = 8,    // Peaks, edges & ridges
+    };
+
+    // File format constants
+    static const char           magic[16];
+    static const std::uint32_t  formatVersion   = 2;
+    static const std::uint32_t  byteOrderMark   = 0x01020304;
+    static const std::uint64_t  payloadAlignment = 4096;
+
+    // On-disk structures
+    struct Header {
+        char            magic[16];
+        std::uint32_t   version;
+        std::uint32_t   byteOrder;
+        std::int32_t    levelOfDetail;
+        std::uint32_t   sectionCount;
+        std::uint64_t   sourceHash,     // Fingerprint of the source files
+                        parameterHash;  // Fingerprint of analysis parameters
+    };
+    struct Section {
+        std::uint32_t   id;
+        std::uint32_t   elementSize;    // Zero for non-raster sections
+        std::int32_t    bases[2],
+                        extents[2];
+        std::uint64_t   offset,
+                        length;
+    };
+
+
+/*---------------------------------------------------------------------------*
+ | Constructors & destructor
+ *---------------------------------------------------------------------------*/
+public:
+    // Open (memory-map, if possible) a cache file. Throws
+    // inca::io::FileAccessException if the file can't be opened, and
+    // inca::io::FileFormatException if it isn't a (current) cache file.
+    static AnalysisCachePtr open(const std::string & filename);
+
+    // Read a cache file from a stream (always reads the whole thing)
+    static AnalysisCachePtr read(std::istream & is);
+
+protected:
+    // Constructor (only open() and read() create these)
+    explicit AnalysisCache(const std::string & filename);
+
+    // Validate the header & section table
+    void _parse();
+
+    std::string         _filename;
+    MappedFilePtr       _file;          // The mapped file, if we opened it...
+    std::vector<char>   _buffer;        // ...or its contents, if we read it
+    char const *        _data;          // Wherever the contents are...
+    std::uint64_t       _size;          // ...and how big they are
+    Header              _header;
+    std::vector<Section> _sections;
+
+
+/*---------------------------------------------------------------------------*
+ | Section access
+ *---------------------------------------------------------------------------*/
+public:
+    const std::string & filename() const { return _filename; }
+    bool mapped() const { return _file && _file->mapped(); }
+    TerrainLOD levelOfDetail() const;
+    std::uint64_t sourceHash() const    { return _header.sourceHash; }
+    std::uint64_t parameterHash() const { return _header.parameterHash; }
+
+    // Section lookup (returns NULL if there's no such section)
+    const Section * section(SectionID id) const;
+    bool hasSection(SectionID id) const { return section(id) != NULL; }
+
+    // Raw section payload
+    char const * sectionData(SectionID id) const;
+    SizeType sectionLength(SectionID id) const;
+
+    // Copy a raster section into 'r', returning false if there's no such
+    // section. Throws inca::io::FileFormatException if the section's
+    // element type doesn't match the raster's.
+    template <typename T, inca::SizeType dim>
+    bool readRaster(SectionID id,
+                    inca::raster::MultiArrayRaster<T, dim> & r) const {
+        typedef inca::raster::MultiArrayRaster<T, dim> Raster;
+        const Section * s = section(id);
+        if (s == NULL)
+            return false;
+        _checkRaster(*s, sizeof(T));
+
+        typename Raster::IndexArray bs, ex;
+        for (IndexType d = 0; d < IndexType(dim); ++d) {
+            bs[d] = s->bases[d];
+            ex[d] = s->extents[d];
+        }
+        r.setBounds(bs, ex);
+        if (r.size() > 0)
+            std::memcpy(r.elements(), _data + s->offset, r.size() * sizeof(T));
+        return true;
+    }
+
+protected:
+    void _checkRaster(const Section & s, SizeType elementSize) const;
+};
+
+
+class terrainosaurus::AnalysisCacheWriter {
+/*---------------------------------------------------------------------------*
+ | Type definitions
+ *---------------------------------------------------------------------------*/
+public:
+    typedef AnalysisCache::SectionID    SectionID;
+    typedef AnalysisCache::Section      Section;
+
+
+/*---------------------------------------------------------------------------*
+ | Constructor
+ *---------------------------------------------------------------------------*/
+public:
+    explicit AnalysisCacheWriter(TerrainLOD lod, std::uint64_t sourceHash,
+                                                 std::uint64_t parameterHash)
+        : _levelOfDetail(lod), _sourceHash(sourceHash),
+          _parameterHash(parameterHash) { }
+
+
+/*---------------------------------------------------------------------------*
+ | Section creation & output
+ *---------------------------------------------------------------------------*/
+public:
+    // Add a raster section. The raster must outlive the writer.
+    template <typename T, inca::SizeType dim>
+    void addRaster(SectionID id,
+                   const inca::raster::MultiArrayRaster<T, dim> & r) {
+        Section s = _newSection(id, sizeof(T), r.size() * sizeof(T));
+        for (IndexType d = 0; d < IndexType(dim) && d < 2; ++d) {
+            s.bases[d]   = r.base(d);
+            s.extents[d] = r.extent(d);
+        }
+        _sections.push_back(s);
+        _payloads.push_back(reinterpret_cast<char const *>(r.elements()));
+    }
+
+    // Add a non-raster section. The blob is copied.
+    void addBlob(SectionID id, const std::string & blob);
+
+    // Write the whole thing out
+    void write(std::ostream & os) const;
+
+protected:
+    Section _newSection(SectionID id, SizeType elementSize, SizeType length);
+
+    TerrainLOD                  _levelOfDetail;
+    std::uint64_t               _sourceHash,
+                                _parameterHash;
+    std::vector<Section>        _sections;
+    std::vector<char const *>   _payloads;
+    std::vector<shared_ptr<std::string> > _blobs;
+};
+
+#endif
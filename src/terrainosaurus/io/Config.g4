@@ -57,7 +57,8 @@ sectionList:
 applicationSection:
     '[' 'Application' ']' EOL
         ( blankLine
-        | cacheDirectoryAssignment )*
+        | cacheDirectoryAssignment
+        | workerThreadsAssignment )*
     ;
 
 // [Boundary GA] section
@@ -101,6 +102,10 @@ heightfieldGASection :
 cacheDirectoryAssignment:
     'cache' 'directory' '=' path EOL;
 
+// worker threads = n
+workerThreadsAssignment returns [int value]:
+    'worker' 'threads' '=' integer EOL { $value = $integer.value; };
+
 
 /*---------------------------------------------------------------------------*
  | Genetic algorithm parameters (common to HF and B GAs)
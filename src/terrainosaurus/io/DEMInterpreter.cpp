@@ -19,11 +19,32 @@ using namespace terrainosaurus;
 // Import container definitions
 #include <vector>
 
-// Import standard library math functions
+// Import standard library math & memory functions
 #include <cmath>
-
-// Import IOstream file stream definitions
-#include <fstream>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+// Import SIMD intrinsics. With GCC & Clang on x86, the SSSE3 code is compiled
+// regardless of the target flags, and used only if the CPU turns out to
+// support it. Elsewhere, it's there only if the compiler targets SSSE3.
+#if defined(__SSSE3__)
+#   define DEM_SSSE3
+#   define DEM_SSSE3_TARGET
+#elif (defined(__GNUC__) || defined(__clang__)) \
+        && (defined(__x86_64__) || defined(__i386__))
+#   define DEM_SSSE3
+#   define DEM_SSSE3_TARGET __attribute__((target("ssse3")))
+#endif
+#if defined(DEM_SSSE3)
+#   include <immintrin.h>
+#endif
+
+// Import IOstream stream buffer definitions
+#include <streambuf>
+
+// Import file mapping definition
+#include "MappedFile.hpp"
 
 // Import file-related exception definitions
 #include <inca/io/FileExceptions.hpp>
@@ -36,6 +57,251 @@ const std::size_t DEMInterpreter::BUFFER_SIZE = 41;
 const std::size_t DEMInterpreter::CHUNK_SIZE = 1024;
 
 
+// Local helper classes & functions
+namespace {
+    // A read-only stream buffer over a block of memory, so that the stream
+    // parsing functions can read straight out of a mapped file
+    class MemoryStreamBuffer : public std::streambuf {
+    public:
+        MemoryStreamBuffer(char const * data, std::size_t size) {
+            char * begin = const_cast<char *>(data);
+            setg(begin, begin, begin + size);
+        }
+
+        // How far we've read
+        std::size_t position() const { return gptr() - eback(); }
+    };
+
+    inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+    inline bool isSpace(char c) {
+        return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+    }
+
+    // Interpret a fixed-width field as an integer (just like atoi())
+    int fieldInteger(char const * p, std::size_t numBytes) {
+        char const * end = p + numBytes;
+        while (p < end && isSpace(*p))
+            ++p;
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+            negative = (*p++ == '-');
+        int value = 0;
+        while (p < end && isDigit(*p))
+            value = value * 10 + (*p++ - '0');
+        return negative ? -value : value;
+    }
+
+    // Parse the next whitespace-separated integer in [p, end), advancing
+    // 'p' past it (just like 'is >> value'). Returns false if there isn't
+    // one. This is the general (but slow) version -- see nextInteger().
+    bool nextIntegerSlowly(char const * & p, char const * end, int & value) {
+        while (p < end && isSpace(*p))
+            ++p;
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+            negative = (*p++ == '-');
+        if (p == end || ! isDigit(*p))
+            return false;
+        int v = 0;
+        do {
+            v = v * 10 + (*p++ - '0');
+        } while (p < end && isDigit(*p));
+        value = (negative ? -v : v);
+        return true;
+    }
+
+// The fast version works on 8 bytes at a time, which needs them to be
+// loaded with the first one in the low byte
+#if defined(_MSC_VER) \
+        || (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#   define DEM_WORD_PARSING
+#endif
+
+#if defined(DEM_WORD_PARSING)
+    typedef std::uint64_t Word;
+    const Word lowBits  = 0x0101010101010101ULL,
+               highBits = 0x8080808080808080ULL;
+
+    // Load 8 bytes, wherever they are
+    inline Word loadWord(char const * p) {
+        Word w;
+        std::memcpy(&w, p, sizeof(Word));
+        return w;
+    }
+
+    // Set the high bit of each byte of 'w' that isn't a digit
+    inline Word notDigits(Word w) {
+        Word low = w & ~highBits;
+        Word atLeast0 = low + lowBits * (0x80 - '0'),
+             above9   = low + lowBits * (0x80 - '9' - 1);
+        return (w | ~atLeast0 | above9) & highBits;
+    }
+
+    // Parse the 6-character field at 'p', if it's an integer, right-
+    // justified, and not followed by another digit. 'p' must have at least
+    // 8 bytes after it.
+    inline bool fieldInteger6(char const * p, int & value) {
+        const Word field = 0x0000FFFFFFFFFFFFULL,
+                   last  = 0x0000800000000000ULL,   // High bit of [5]
+                   after = 0x0080000000000000ULL;   // High bit of [6]
+        Word w = loadWord(p);
+        Word nonDigits = notDigits(w);
+
+        // [5] must be a digit, and [6] must not be. The bytes before the
+        // digits, [0, L), must be spaces, except for maybe a '-' in [L - 1].
+        Word prefix  = ((nonDigits & field) >> 7) * 0xFF,
+             top     = prefix & ~(prefix >> 8),
+             unusual = (w ^ (lowBits * ' ')) & prefix;
+        if ((nonDigits & (last | after)) != after
+                || (prefix & (prefix + 1)) != 0
+                || (unusual != 0 && unusual != (top & (lowBits * ('-' ^ ' ')))))
+            return false;
+
+        // The low nibbles of the digits are their values. Combine pairs,
+        // then pairs of pairs... (after D. Lemire, "Fast Integer Parsing")
+        Word d = (w & ~prefix & field & (lowBits * 0x0F)) << 16;
+        d = d * 10 + (d >> 8);
+        d = ((d & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))
+           + ((d >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32))) >> 32;
+        int v = int(d);
+        value = (unusual != 0 ? -v : v);
+        return true;
+    }
+#endif
+
+    // Parse the next whitespace-separated integer in [p, end), advancing
+    // 'p' past it (just like 'is >> value'). Returns false if there isn't
+    // one.
+    //
+    // DEM elevations are right-justified in six-character fields, so the
+    // number of spaces and digits varies from one to the next, and the
+    // branches in a byte-at-a-time loop are mispredicted about once per
+    // number. So if the next six bytes are such a field, it's checked and
+    // converted all at once, and 'p' moves ahead by exactly six, without
+    // waiting to find out where the number ends. Anything else (a newline,
+    // a '+', a wider number, or being too near the end) is left to
+    // nextIntegerSlowly(), which gets exactly the same answer.
+    inline bool nextInteger(char const * & p, char const * end, int & value) {
+#if defined(DEM_WORD_PARSING)
+        if (end - p >= std::ptrdiff_t(sizeof(Word)) && fieldInteger6(p, value)) {
+            p += 6;
+            return true;
+        }
+#endif
+        // (Copying 'p' & 'value' keeps the caller's from having to live in
+        // memory, just because this call takes their addresses)
+        char const * q = p;
+        int v;
+        bool found = nextIntegerSlowly(q, end, v);
+        p = q;
+        if (found)
+            value = v;
+        return found;
+    }
+
+#if defined(DEM_SSSE3)
+    // Whether the CPU we're running on can execute the SSSE3 code
+    bool cpuHasSSSE3() {
+#   if defined(__SSSE3__)
+        return true;
+#   else
+        static const bool has = __builtin_cpu_supports("ssse3");
+        return has;
+#   endif
+    }
+
+    // Parse elevations two at a time with SSSE3, for as long as the next 12
+    // bytes are a pair of six-character fields that nextInteger() would
+    // parse the same way (see fieldInteger6()), and 'count' allows.
+    // Each elevation 'e' is stored at 'cell' as e * zScale + datum, moving
+    // 'cell' along by 'stride'. Returns how many it did.
+    DEM_SSSE3_TARGET
+    std::size_t elevationPairsSSSE3(char const * & p, char const * end,
+                                    std::size_t count,
+                                    Heightfield::ElementType * & cell,
+                                    std::size_t stride,
+                                    double zScale, double datum) {
+        const __m128i zero   = _mm_set1_epi8('0'),
+                      nine   = _mm_set1_epi8(9),
+                      space  = _mm_set1_epi8(' '),
+                      minus  = _mm_set1_epi8('-'),
+                      // Right-justify each field in 8 bytes...
+                      spread = _mm_setr_epi8(-1, -1, 0, 1,  2,  3,  4,  5,
+                                             -1, -1, 6, 7,  8,  9, 10, 11),
+                      // ...and combine pairs, then pairs of pairs
+                      tens     = _mm_setr_epi8(10, 1, 10, 1, 10, 1, 10, 1,
+                                               10, 1, 10, 1, 10, 1, 10, 1),
+                      hundreds = _mm_setr_epi16(100, 1, 100, 1,
+                                                100, 1, 100, 1);
+        char const * q = p;
+        Heightfield::ElementType * c = cell;
+        std::size_t done = 0;
+        while (done + 2 <= count && end - q >= std::ptrdiff_t(sizeof(__m128i))) {
+            __m128i bytes  = _mm_loadu_si128(reinterpret_cast<__m128i const *>(q));
+            __m128i values = _mm_sub_epi8(bytes, zero);
+            __m128i digits = _mm_cmpeq_epi8(_mm_min_epu8(values, nine), values);
+            __m128i minuses = _mm_cmpeq_epi8(bytes, minus);
+            __m128i blanks = _mm_or_si128(_mm_cmpeq_epi8(bytes, space), minuses);
+            unsigned d = unsigned(_mm_movemask_epi8(digits)),
+                     b = unsigned(_mm_movemask_epi8(blanks)),
+                     m = unsigned(_mm_movemask_epi8(minuses));
+
+            // Each field must end in a run of digits, not followed by another
+            // digit, and begin with spaces, except maybe for a '-' just before
+            // the digits
+            unsigned dA = d & 0x3F, dB = (d >> 6) & 0x3F;
+            if (((dA | (dA - 1)) ^ 0x3F) | ((dB | (dB - 1)) ^ 0x3F)
+                    | (d & 0x1040) | (~(d | b) & 0xFFF) | (m & ~(d >> 1) & 0xFFF))
+                break;
+
+            __m128i quads = _mm_madd_epi16(
+                _mm_maddubs_epi16(_mm_shuffle_epi8(_mm_and_si128(values, digits),
+                                                   spread), tens),
+                hundreds);
+            std::int32_t fours[4];
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(fours), quads);
+            int vA = fours[0] * 10000 + fours[1],
+                vB = fours[2] * 10000 + fours[3];
+            if (m & 0x03F)  vA = -vA;
+            if (m & 0xFC0)  vB = -vB;
+            *c = Heightfield::ElementType(vA * zScale + datum);     c += stride;
+            *c = Heightfield::ElementType(vB * zScale + datum);     c += stride;
+            q += 12;
+            done += 2;
+        }
+        p = q;
+        cell = c;
+        return done;
+    }
+#endif
+
+    // Parse elevations in bulk, for as long as that's easy (see above),
+    // returning how many were done. The rest are left for nextInteger().
+    inline std::size_t elevationPairs(char const * & p, char const * end,
+                                      std::size_t count,
+                                      Heightfield::ElementType * & cell,
+                                      std::size_t stride,
+                                      double zScale, double datum) {
+#if defined(DEM_SSSE3)
+        if (cpuHasSSSE3())
+            return elevationPairsSSSE3(p, end, count, cell, stride,
+                                       zScale, datum);
+#endif
+        return 0;
+    }
+
+    // Interpret a fixed-width field as a double (just like atof())
+    double fieldDouble(char const * p, std::size_t numBytes) {
+        char field[32];
+        if (numBytes > sizeof(field) - 1)
+            numBytes = sizeof(field) - 1;
+        std::memcpy(field, p, numBytes);
+        field[numBytes] = '\0';
+        return atof(field);
+    }
+}
+
+
 // Constructor
 DEMInterpreter::DEMInterpreter(Heightfield & hf)
     : buffer(new char[BUFFER_SIZE]), raster(hf), filename(this) { }
@@ -44,16 +310,45 @@ DEMInterpreter::DEMInterpreter(Heightfield & hf)
 // Parse from the file named with the filename property
 void DEMInterpreter::parse() {
     std::string path(filename);
-    std::ifstream file(path.c_str());
-    if (! file) {
-        FileAccessException e(path);
-        e << "Unable to read DEM file [" << path
-          << "]: check directory/file permissions";
-        throw e;
-    }
+    MappedFile file(path);
+    parse(file.data(), file.size());
+}
+
+
+// Parse the in-memory file
+void DEMInterpreter::parse(char const * data, std::size_t size) {
+    // Header information (this is small, so we parse it the slow way)
+    MemoryStreamBuffer header(data, size);
+    std::istream is(&header);
+    parseRecordTypeA(is);
+
+    // Same bookkeeping as for the stream version (see below)
+    std::size_t chunkCount = 0;
+    std::size_t eolCount = 0;
+    std::size_t pos = header.position();
 
-    parse(file);
-    file.close();
+    // Elevation profile data in S -> N columns
+    IndexType r = 1;
+    for (IndexType c = 1; c <= IndexType(raster.size(0)); c++) {
+        // This is where we last were
+        std::size_t baseline = CHUNK_SIZE * chunkCount + eolCount;
+
+        // Figure out how far we've advanced, skipping to the start of the
+        // next chunk (and past its newline, if it has one)
+        std::size_t end = pos;
+        while (baseline < end) {
+            baseline += CHUNK_SIZE;
+            chunkCount++;
+            if (baseline < size && data[baseline] == '\n') {
+                eolCount++;
+                baseline++;
+            }
+            pos = baseline;
+        }
+
+        // Parse the record
+        pos = parseRecordTypeB(r, c, data, pos, size);
+    }
 }
 
 
@@ -547,6 +842,110 @@ void DEMInterpreter::parseRecordTypeB(IndexType r, IndexType c, std::istream & i
 }
 
 
+// Parse the B-record (elevation profile) starting at offset 'pos' in an
+// in-memory file, returning the offset just past its last elevation. This is
+// the same as the stream version, minus all the commentary.
+std::size_t DEMInterpreter::parseRecordTypeB(IndexType r, IndexType c,
+                                             char const * data,
+                                             std::size_t pos,
+                                             std::size_t size) {
+    // Elements 1 - 5 are fixed-width, and take up the first 144 bytes
+    static const std::size_t HEADER_SIZE = 144;
+    if (pos + HEADER_SIZE > size) {
+        std::string path(filename);
+        FileFormatException e(path);
+        e << "DEM file ended prematurely (in profile " << c << ')';
+        throw e;
+    }
+    char const * p = data + pos;
+    std::size_t row = fieldInteger(p +  0, 6);
+    std::size_t col = fieldInteger(p +  6, 6);
+    if (row != r || col != c) {
+        INCA_WARNING("parseRecordTypeB(" << r << ", " << c << "): Incorrect "
+                     "profile identifier (" << row << ", " << col << ")")
+    }
+    std::size_t pRows = fieldInteger(p + 12, 6);
+    double startX = fieldDouble(p + 24, 24);
+    double startY = fieldDouble(p + 48, 24);
+    double referenceDatum = fieldDouble(p + 72, 24);
+    pos += HEADER_SIZE;
+
+    // Where this profile goes in the grid
+    double dx = startX - extents[0][0];
+    double dy = startY - extents[0][1];
+    double cos_phi = std::cos(deviationAngle);
+    double sin_phi = std::sin(deviationAngle);
+    IndexType startCol = IndexType((dx * cos_phi + dy * sin_phi) / resolution[0]);
+    IndexType startRow = IndexType((dx * -sin_phi + dy * cos_phi) / resolution[1]);
+    IndexType endRow   = startRow + IndexType(pRows);
+    IndexType rows     = IndexType(raster.size(1));
+    bool colInBounds = (startCol >= 0 && startCol < IndexType(raster.size(0)));
+    if (! colInBounds || startRow < 0 || endRow > rows)
+        INCA_WARNING("parseRecordTypeB(" << r << ", " << c << "): profile "
+                     "extends outside the grid -- clipping it")
+
+    // Fill in out-of bounds areas below and above
+    if (colInBounds) {
+        for (IndexType thisRow = 0; thisRow < startRow && thisRow < rows; thisRow++)
+            raster(startCol, thisRow) = Heightfield::ElementType(OUT_OF_BOUNDS);
+        for (IndexType thisRow = std::max(endRow, IndexType(0)); thisRow < rows; thisRow++)
+            raster(startCol, thisRow) = Heightfield::ElementType(OUT_OF_BOUNDS);
+    }
+
+    // Fill in the valid area in the middle. Elevations are whitespace
+    // separated integers, which may span chunk boundaries (and newlines).
+    // Any that fall outside the grid are read, but thrown away, so we split
+    // the profile into [startRow, firstRow) below the grid, [firstRow,
+    // lastRow) in it, and [lastRow, endRow) above it.
+    IndexType firstRow = std::min(std::max(startRow, IndexType(0)), endRow),
+              lastRow  = std::max(std::min(endRow, rows), firstRow);
+    if (! colInBounds)
+        firstRow = lastRow = endRow;
+    double zScale = resolution[2];
+    char const * cursor = data + pos,
+               * end    = data + size;
+    int val;
+    for (IndexType thisRow = startRow; thisRow < firstRow; thisRow++)
+        if (! nextInteger(cursor, end, val))
+            missingElevation(c, std::size_t(cursor - data));
+    if (firstRow < lastRow) {
+        Heightfield::ElementType * cell = &raster(startCol, firstRow);
+        std::size_t width = raster.size(0);
+        IndexType thisRow = firstRow;
+        while (true) {
+            // As many as we can in bulk, then one (e.g., the one after a
+            // chunk boundary) the careful way
+            thisRow += IndexType(elevationPairs(cursor, end,
+                                                std::size_t(lastRow - thisRow),
+                                                cell, width,
+                                                zScale, referenceDatum));
+            if (thisRow == lastRow)
+                break;
+            if (! nextInteger(cursor, end, val))
+                missingElevation(c, std::size_t(cursor - data));
+            *cell = Heightfield::ElementType(val * zScale + referenceDatum);
+            cell += width;
+            thisRow++;
+        }
+    }
+    for (IndexType thisRow = lastRow; thisRow < endRow; thisRow++)
+        if (! nextInteger(cursor, end, val))
+            missingElevation(c, std::size_t(cursor - data));
+    return std::size_t(cursor - data);
+}
+
+
+// Complain that profile 'c' ran out of elevations at 'offset' (this is kept
+// out of parseRecordTypeB() so as not to clutter up its inner loop)
+void DEMInterpreter::missingElevation(IndexType c, std::size_t offset) {
+    std::string path(filename);
+    FileFormatException e(path);
+    e << "Expected an elevation at offset " << offset
+      << " (in profile " << c << ')';
+    throw e;
+}
+
+
 // Low-level function to read an arbitrary number of bytes into the buffer
 std::size_t DEMInterpreter::readBytes(std::size_t numBytes, std::istream & is) {
     if (numBytes > BUFFER_SIZE - 1) {
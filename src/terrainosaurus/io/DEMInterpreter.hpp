@@ -97,14 +97,27 @@ public:
  | Constructors & properties
  *---------------------------------------------------------------------------*/
 public:
-    // Parse the file
+    // Parse the file named by the 'filename' property. This memory-maps the
+    // file and parses it in place, which is much faster than parsing it as
+    // a stream.
     void parse();
+
+    // Parse a file that's already in memory ('data' holds all 'size' bytes
+    // of it). Record A is parsed just as from a stream, but the elevation
+    // profiles (the bulk of the file) are parsed directly from 'data' into
+    // the raster.
+    void parse(char const * data, std::size_t size);
+
+    // Parse a file from a stream (slow, but works for any stream)
     void parse(std::istream & is);
 
 protected:
     void parseRecordTypeA(std::istream & is);
     void parseRecordTypeB(IndexType r, IndexType c, std::istream & is);
+    std::size_t parseRecordTypeB(IndexType r, IndexType c, char const * data,
+                                 std::size_t pos, std::size_t size);
     void parseRecordTypeC(std::istream & is);
+    void missingElevation(IndexType c, std::size_t offset);
 
 
 /*---------------------------------------------------------------------------*
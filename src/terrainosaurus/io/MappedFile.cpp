@@ -0,0 +1,90 @@
+/*
+ * File: MappedFile.cpp
+ *
+ * Author: Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes.
+ *
+ * Description:
+ */
+
+// Include precompiled header
+#include <terrainosaurus/precomp.h>
+
+// Import class definition
+#include "MappedFile.hpp"
+
+// Import file-related exception definitions
+#include <inca/io/FileExceptions.hpp>
+
+// Import memory-mapping (or file stream) definitions
+#ifndef _WIN32
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <fcntl.h>
+#   include <unistd.h>
+#else
+#   include <fstream>
+#   include <iterator>
+#endif
+
+using namespace inca::io;
+using namespace terrainosaurus;
+
+
+// Constructor
+MappedFile::MappedFile(const std::string & filename)
+        : _filename(filename), _data(NULL), _size(0), _mapped(false) {
+#ifndef _WIN32
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        FileAccessException e(filename);
+        e << "Unable to open file [" << filename << "]: does it exist?";
+        throw e;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        FileAccessException e(filename);
+        e << "Unable to determine the size of file [" << filename << ']';
+        throw e;
+    }
+
+    // Empty files can't be mapped (but then, they don't need to be)
+    if (st.st_size > 0) {
+        void * data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            ::close(fd);
+            FileAccessException e(filename);
+            e << "Unable to map file [" << filename << ']';
+            throw e;
+        }
+        _data   = static_cast<char const *>(data);
+        _size   = SizeType(st.st_size);
+        _mapped = true;
+    }
+    ::close(fd);                    // The mapping keeps the file open
+
+#else
+    // No mmap here...we'll just have to read the whole thing
+    std::ifstream file(filename.c_str(), std::ios::binary);
+    if (! file) {
+        FileAccessException e(filename);
+        e << "Unable to open file [" << filename << "]: does it exist?";
+        throw e;
+    }
+    _buffer.assign(std::istreambuf_iterator<char>(file),
+                   std::istreambuf_iterator<char>());
+    _data = _buffer.empty() ? NULL : &_buffer[0];
+    _size = _buffer.size();
+#endif
+}
+
+// Destructor
+MappedFile::~MappedFile() {
+#ifndef _WIN32
+    if (_mapped)
+        munmap(const_cast<char *>(_data), _size);
+#endif
+}
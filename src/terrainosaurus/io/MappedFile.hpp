@@ -0,0 +1,78 @@
+/** -*- C++ -*-
+ *
+ * \file    MappedFile.hpp
+ *
+ * \author  Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes only.
+ *
+ * Description:
+ *      The MappedFile class provides read-only access to the entire contents
+ *      of a file as a block of memory. The file stays open for as long as
+ *      the MappedFile exists.
+ *
+ * Implementation notes:
+ *      Where the platform supports it, the file is memory-mapped, so that
+ *      opening it costs almost nothing, and pages are read from disk only
+ *      when they are touched. Elsewhere, the whole file is read into a
+ *      buffer up front.
+ */
+
+#ifndef TERRAINOSAURUS_IO_MAPPED_FILE
+#define TERRAINOSAURUS_IO_MAPPED_FILE
+
+// Import library configuration
+#include <terrainosaurus/terrainosaurus-common.h>
+
+// Import container definitions
+#include <string>
+#include <vector>
+
+// This is part of the Terrainosaurus terrain generation engine
+namespace terrainosaurus {
+    // Forward declarations
+    class MappedFile;
+
+    // Pointer typedefs
+    typedef shared_ptr<MappedFile>          MappedFilePtr;
+    typedef shared_ptr<MappedFile const>    MappedFileConstPtr;
+};
+
+
+class terrainosaurus::MappedFile {
+/*---------------------------------------------------------------------------*
+ | Constructors & destructor
+ *---------------------------------------------------------------------------*/
+public:
+    // Open (and map) the file. Throws inca::io::FileAccessException if the
+    // file can't be opened.
+    explicit MappedFile(const std::string & filename);
+
+    // Destructor (unmaps the file)
+    ~MappedFile();
+
+private:
+    // Not copyable (who would own the mapping?)
+    MappedFile(const MappedFile &);
+    MappedFile & operator=(const MappedFile &);
+
+
+/*---------------------------------------------------------------------------*
+ | Accessor functions
+ *---------------------------------------------------------------------------*/
+public:
+    const std::string & filename() const { return _filename; }
+    char const * data() const   { return _data; }
+    SizeType size() const       { return _size; }
+    bool mapped() const         { return _mapped; }
+
+protected:
+    std::string         _filename;
+    char const *        _data;          // The file contents...
+    SizeType            _size;          // ...and how big they are
+    bool                _mapped;        // Did we mmap it or read it?
+    std::vector<char>   _buffer;        // File contents, if we read it
+};
+
+#endif
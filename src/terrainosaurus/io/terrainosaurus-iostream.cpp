@@ -9,9 +9,6 @@
  * Description:
  */
 
-// TODO: Perhaps it would be worthwhile to split 'load', 'analyze' and 'study'
-// records for the TerrainSample::LOD...
-
 // Include precompiled header
 #include <terrainosaurus/precomp.h>
 
@@ -28,6 +25,7 @@
 #include "PrimitivesBaseListener.hpp"
 #include "FailFastErrorListener.hpp"
 #include "DEMInterpreter.hpp"
+#include "AnalysisCache.hpp"
 
 // Import file-related exception definitions
 #include <inca/util/UnsupportedOperationException.hpp>
@@ -37,6 +35,9 @@
 #include <inca/raster/operators/arithmetic>
 #include <inca/raster/operators/select>
 
+// Import string stream definitions
+#include <sstream>
+
 // How many pixels to trim from each side of a DEM file
 #define TRIM 30
 
@@ -152,6 +153,21 @@ void read(std::istream & is, Feature & f) {
     read(is, f.scaleStats);
 }
 
+// Features aren't plain old data, so they have to be written one-by-one
+void write(std::ostream & os, const std::vector<Feature> & v) {
+    int n = v.size();
+    os.write((char const *)&n, sizeof(int));
+    for (int i = 0; i < n; ++i)
+        write(os, v[i]);
+}
+void read(std::istream & is, std::vector<Feature> & v) {
+    int n;
+    is.read((char *)&n, sizeof(int));
+    v.resize(n);
+    for (int i = 0; i < n; ++i)
+        read(is, v[i]);
+}
+
 
 class TerrainLibraryBuilder : public TPrimitivesBaseListener<TerrainLibraryListener, TerrainLibraryParser>
 {
@@ -483,24 +499,14 @@ ostream & terrainosaurus::operator<<(ostream & os, const Map & m) {
 }
 
 
-// IOstream operators for (de)serializing Heightfields
-istream & terrainosaurus::operator>>(istream & is, Heightfield & hf) {
-    typedef Heightfield::ElementType Scalar;
-
-    Heightfield temp;
-    DEMInterpreter dem(temp);
-
-    // Attempt to parse the stream
-    dem.parse(is);
-    
+// Trim & rescale a freshly parsed DEM, and store it in 'hf'
+void importDEM(Heightfield & hf, const Heightfield & temp,
+               const DEMInterpreter & dem) {
     // Trim it and store it to the right place
     Pixel       start(TRIM);
     Dimension   size(temp.sizes());
     size -= Dimension(2 * TRIM);
 
-    // FIXME: This is just here until DFT works with all shapes
-    size[0] = size[1] = std::min((size[0] / 2) * 2, (size[1] / 2) * 2);
-
     // Put the loaded data into the correct LOD
     scalar_t resX = scalar_t(dem.resolution[0]);
     scalar_t resY = scalar_t(dem.resolution[1]);
@@ -520,10 +526,30 @@ istream & terrainosaurus::operator>>(istream & is, Heightfield & hf) {
     } else {
         hf = selectBS(temp, start, size);
     }
+}
 
+// IOstream operators for (de)serializing Heightfields
+istream & terrainosaurus::operator>>(istream & is, Heightfield & hf) {
+    Heightfield temp;
+    DEMInterpreter dem(temp);
+
+    // Attempt to parse the stream
+    dem.parse(is);
+    importDEM(hf, temp, dem);
     return is;
 }
 
+// Load a DEM file (much faster than going through a stream)
+void terrainosaurus::loadDEM(Heightfield & hf, const std::string & filename) {
+    Heightfield temp;
+    DEMInterpreter dem(temp);
+
+    // Attempt to parse the file
+    dem.filename = filename;
+    dem.parse();
+    importDEM(hf, temp, dem);
+}
+
 ostream & terrainosaurus::operator<<(ostream & os, const Heightfield & m) {
     throw UnsupportedOperationException("Serialization of Heightfields not implemented");
     return os;
@@ -532,95 +558,121 @@ ostream & terrainosaurus::operator<<(ostream & os, const Heightfield & m) {
 
 // IOstream operators for (de)serializing instances of TerrainSample::LOD
 istream & terrainosaurus::operator>>(istream & is, TerrainSample::LOD & ts) {
-    // Read the magic header, to make sure this file is what we think it is
-    // If the header is not present, we throw an exception
-    char header[15];
-    is.get(header, 15);
-    if (std::string("Terrainosaurus") != header)
-        throw FileFormatException("File does not have the correct magic "
-                                  "header. Are you sure this is a cache file?");
-
-    // Read the LOD and dimensions
-    TerrainLOD lod;
-    is.read((char*)&lod, sizeof(TerrainLOD));
+    // Slurp in the whole file (there's no mmap-ing a stream)
+    attachAnalysisCache(ts, AnalysisCache::read(is));
+    return is;
+}
+ostream & terrainosaurus::operator<<(ostream & os, const TerrainSample::LOD & ts) {
+    // We don't know where this came from, so it'll never be current
+    writeAnalysisCache(os, ts, 0);
+    return os;
+}
+
+// Write a TerrainSample::LOD to a cache file
+void terrainosaurus::writeAnalysisCache(ostream & os,
+                                        const TerrainSample::LOD & ts,
+                                        std::uint64_t sourceHash) {
+    // Make sure we have stuff to store first
+    ts.ensureStudied();
+
+    // Each of the rasters gets its own section. We go through the accessor
+    // functions, in case some of these haven't been paged in yet.
+    AnalysisCacheWriter cache(ts.levelOfDetail(), sourceHash,
+                              TerrainSample::LOD::analysisFingerprint(
+                                    ts.levelOfDetail()));
+    cache.addRaster(AnalysisCache::ElevationSection,
+                    ts.elevations());
+    cache.addRaster(AnalysisCache::GradientSection,
+                    ts.gradients());
+    cache.addRaster(AnalysisCache::LocalElevationMeanSection,
+                    ts.localElevationMeans());
+    cache.addRaster(AnalysisCache::LocalGradientMeanSection,
+                    ts.localGradientMeans());
+    cache.addRaster(AnalysisCache::LocalElevationLimitsSection,
+                    ts.localElevationLimitss());
+    cache.addRaster(AnalysisCache::LocalSlopeLimitsSection,
+                    ts.localSlopeLimitss());
+
+    // The non-raster measurements all go together
+    std::ostringstream measurements;
+    write(measurements, ts._frequencySpectrum);
+    write(measurements, ts._globalElevationStatistics);
+    write(measurements, ts._globalSlopeStatistics);
+    write(measurements, ts._globalEdgeLengthStatistics);
+    write(measurements, ts._globalEdgeScaleStatistics);
+    write(measurements, ts._globalEdgeStrengthStatistics);
+    cache.addBlob(AnalysisCache::MeasurementSection, measurements.str());
+
+    // As do each of the feature sets
+    std::ostringstream features;
+    write(features, ts._peaks);
+    write(features, ts._edges);
+    write(features, ts._ridges);
+    cache.addBlob(AnalysisCache::FeatureSection, features.str());
+
+    cache.write(os);
+    INCA_DEBUG("Stream pointer os " << os.tellp())
+}
 
+// Initialize a TerrainSample::LOD from an analysis cache
+void terrainosaurus::attachAnalysisCache(TerrainSample::LOD & ts,
+                                         AnalysisCachePtr cache) {
     // Warn if this doesn't seem like the right LOD
-    if (lod != ts.levelOfDetail())
-        INCA_WARNING("Uh oh...stream contains " << lod
+    if (cache->levelOfDetail() != ts.levelOfDetail())
+        INCA_WARNING("Uh oh...cache contains " << cache->levelOfDetail()
                      << ", not expected " << ts.levelOfDetail())
 
-    int filepos;
+    // Make sure it's got everything we need
+    static const AnalysisCache::SectionID required[] = {
+        AnalysisCache::ElevationSection,
+        AnalysisCache::GradientSection,
+        AnalysisCache::LocalElevationMeanSection,
+        AnalysisCache::LocalGradientMeanSection,
+        AnalysisCache::LocalElevationLimitsSection,
+        AnalysisCache::LocalSlopeLimitsSection,
+        AnalysisCache::MeasurementSection,
+        AnalysisCache::FeatureSection,
+    };
+    for (IndexType i = 0; i < IndexType(sizeof(required) / sizeof(required[0])); ++i)
+        if (! cache->hasSection(required[i])) {
+            FileFormatException e(cache->filename());
+            e << "Cache file is missing section " << required[i];
+            throw e;
+        }
+
+    // The non-raster measurements are small, so we read those right away
     try {
-        // Read in each of the rasters
-        filepos = is.tellg();   read(is, ts._elevations);
-        filepos = is.tellg();   read(is, ts._gradients);
-        filepos = is.tellg();   read(is, ts._localElevationMeans);
-        filepos = is.tellg();   read(is, ts._localGradientMeans);
-        filepos = is.tellg();   read(is, ts._localElevationLimits);
-        filepos = is.tellg();   read(is, ts._localSlopeLimits);
-
-        // Write out each of the non-raster measurements
-        filepos = is.tellg();   read(is, ts._frequencySpectrum);
-        filepos = is.tellg();   read(is, ts._globalElevationStatistics);
-        filepos = is.tellg();   read(is, ts._globalSlopeStatistics);
-        filepos = is.tellg();   read(is, ts._globalEdgeLengthStatistics);
-        filepos = is.tellg();   read(is, ts._globalEdgeScaleStatistics);
-        filepos = is.tellg();   read(is, ts._globalEdgeStrengthStatistics);
-
-        // Write out each of the feature sets
-        filepos = is.tellg();   read(is, ts._peaks);
-        filepos = is.tellg();   read(is, ts._edges);
-        filepos = is.tellg();   read(is, ts._ridges);
-
-        // We should now be at the end of the file
-        INCA_DEBUG("Stream pointer is " << is.tellg())
-
-        // Nothing more to do here...
-        ts._loaded = true;
-        ts._analyzed = true;
-        ts._studied = true;
+        std::istringstream measurements(std::string(
+                cache->sectionData(AnalysisCache::MeasurementSection),
+                cache->sectionLength(AnalysisCache::MeasurementSection)));
+        measurements.exceptions(std::ios::badbit | std::ios::eofbit);
+        read(measurements, ts._frequencySpectrum);
+        read(measurements, ts._globalElevationStatistics);
+        read(measurements, ts._globalSlopeStatistics);
+        read(measurements, ts._globalEdgeLengthStatistics);
+        read(measurements, ts._globalEdgeScaleStatistics);
+        read(measurements, ts._globalEdgeStrengthStatistics);
+
+        std::istringstream features(std::string(
+                cache->sectionData(AnalysisCache::FeatureSection),
+                cache->sectionLength(AnalysisCache::FeatureSection)));
+        features.exceptions(std::ios::badbit | std::ios::eofbit);
+        read(features, ts._peaks);
+        read(features, ts._edges);
+        read(features, ts._ridges);
 
     } catch (std::exception &) {
-        inca::io::FileFormatException e("");
-        e << "Cache file ended prematurely (file pointer was " << filepos << ")";
+        FileFormatException e(cache->filename());
+        e << "Cache file has a truncated measurement or feature section";
         throw e;
     }
-    
-    return is;
-}
-ostream & terrainosaurus::operator<<(ostream & os, const TerrainSample::LOD & ts) {
-    // Make sure we have stuff to store first
-    ts.ensureStudied();
 
-    // Write the magic header string to the os
-    os << "Terrainosaurus";
-
-    // Write the LOD and sizes of this TerrainSample
-    TerrainLOD lod = ts.levelOfDetail();
-    os.write((char*)&lod, sizeof(TerrainLOD));
-
-    // Write out each of the rasters
-    write(os, ts._elevations);
-    write(os, ts._gradients);
-    write(os, ts._localElevationMeans);
-    write(os, ts._localGradientMeans);
-    write(os, ts._localElevationLimits);
-    write(os, ts._localSlopeLimits);
-
-    // Write out each of the non-raster measurements
-    write(os, ts._frequencySpectrum);
-    write(os, ts._globalElevationStatistics);
-    write(os, ts._globalSlopeStatistics);
-    write(os, ts._globalEdgeLengthStatistics);
-    write(os, ts._globalEdgeScaleStatistics);
-    write(os, ts._globalEdgeStrengthStatistics);
-
-    // Write out each of the feature sets
-    write(os, ts._peaks);
-    write(os, ts._edges);
-    write(os, ts._ridges);
+    // The rasters stay put until somebody asks for them
+    ts._attachCache(cache);
 
-    INCA_DEBUG("Stream pointer os " << os.tellp())
-    
-    return os;
+    // Nothing more to do here...(the 'loaded' flag goes last, since anybody
+    // who sees it will go on to look at the others)
+    ts._studied = true;
+    ts._analyzed = true;
+    ts._loaded = true;
 }
@@ -35,10 +35,32 @@ namespace terrainosaurus {
     // IOstream operators for (de)serializing Heightfields
     std::istream & operator>>(std::istream & is, Heightfield & hf);
     std::ostream & operator<<(std::ostream & os, const Heightfield & hf);
+
+    // Load a USGS DEM file by name. This is the fast way: it memory-maps the
+    // file, rather than reading it through a stream.
+    void loadDEM(Heightfield & hf, const std::string & filename);
+
+    // Which version of the DEM import (the trimming & rescaling done after
+    // parsing) the loaders do. This must be incremented whenever the import
+    // changes what a DEM turns into (e.g., its shape), since that changes
+    // everything cached about it, even though the file itself hasn't changed.
+    //      1: cropped to an even-sized square
+    //      2: trimmed only, keeping the DEM's own shape
+    static const std::uint32_t demImportRevision = 2;
     
     // IOstream operators for (de)serializing TerrainSample::LOD cache files
+    // (see AnalysisCache.hpp for the file format)
     std::istream & operator>>(std::istream & is, TerrainSample::LOD & ts);
     std::ostream & operator<<(std::ostream & os, const TerrainSample::LOD & ts);
+
+    // Initialize a TerrainSample::LOD from an already-opened cache file. The
+    // LOD's rasters are paged in from the cache as they are needed.
+    void attachAnalysisCache(TerrainSample::LOD & ts, AnalysisCachePtr cache);
+
+    // Write a TerrainSample::LOD cache file, recording the fingerprint of the
+    // source files it was calculated from (operator<< records none).
+    void writeAnalysisCache(std::ostream & os, const TerrainSample::LOD & ts,
+                            std::uint64_t sourceHash);
 };
 
 #endif
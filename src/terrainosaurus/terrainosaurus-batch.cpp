@@ -0,0 +1,423 @@
+/**
+ * \file    terrainosaurus-batch.cpp
+ *
+ * \author  Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes.
+ *
+ * Description:
+ *      This file implements terrainosaurus-batch, a non-interactive version
+ *      of Terrainosaurus that runs the whole terrain generation pipeline
+ *      from the command-line and exits, without ever creating a window:
+ *
+ *          1. load a terrain type map (.map) and terrain library (.ttl)
+ *          2. scan-convert the map into a MapRasterization
+ *          3. run the HeightfieldGA from a starting LOD to a target LOD
+ *          4. write the generated terrain to disk
+ *
+ *      Usage:
+ *          terrainosaurus-batch [options] file.map [file.ttl] -o output
+ *
+ *      Options:
+ *          -o, --output FILE   where to write the generated terrain. If FILE
+ *                              ends in .r32 or .raw, the elevations are
+ *                              written as raw, native-endian 32-bit floats
+ *                              (dimension 0 varying fastest). Otherwise, the
+ *                              terrain is written as an analysis cache file.
+ *          -j, --threads N     number of worker threads (overrides the
+ *                              config file)
+ *          -s, --seed N        random seed (default: from the system clock)
+ *          --start-lod L       coarsest LOD to generate (default: coarsest)
+ *          --target-lod L      finest LOD to generate (default: 30m)
+ *          -t, --timing        print a per-LOD timing table on stdout (plus
+ *                              the gene measurement cache's hit counts)
+ *          -p, --progress      report the progress of terrain library
+ *                              preloading (with an estimate of the time
+ *                              remaining) on stderr
+ *          --trace FILE        record a trace of where the time went (sample
+ *                              loading & analysis, GA setup and each step of
+ *                              every generation, on every thread) and write
+ *                              it to FILE in Chrome's trace-event JSON format
+ *          --memory-budget MB  keep no more than MB megabytes of terrain
+ *                              library rasters in memory, evicting the least
+ *                              recently used ones back to their analysis
+ *                              caches (default: no limit). With --timing,
+ *                              the eviction & reload counts are printed too.
+ *          --tile-size N       generate the terrain in tiles of NxN cells at
+ *                              the target LOD, one at a time, blending them
+ *                              together where they overlap, so that maps too
+ *                              large to generate all at once can still be
+ *                              done (see TiledTerrainGenerator.hpp). The
+ *                              output must be a .r32 or .raw file. With
+ *                              --timing, the per-LOD times are those of the
+ *                              last tile.
+ *          --tile-overlap N    how many cells each tile extends into its
+ *                              neighbors (default: the window size at the
+ *                              target LOD)
+ *
+ *      LODs may be given either by name (LOD_30m) or by sample spacing in
+ *      meters (30m, or just 30).
+ *
+ *      The configuration file and terrain library are located exactly as for
+ *      the interactive application (see TerrainosaurusApplication.hpp).
+ *
+ * Implementation notes:
+ *      BatchApplication is a TerrainosaurusApplication, since the data and
+ *      genetics code finds its configuration and file locations through
+ *      TerrainosaurusApplication::instance(). It just replaces main(), so
+ *      that no GUI is ever constructed.
+ */
+
+// Include precompiled header
+#include <terrainosaurus/precomp.h>
+
+// Import application class definition
+#include "TerrainosaurusApplication.hpp"
+
+// Import data & algorithm definitions
+#include <terrainosaurus/data/MapRasterization.hpp>
+#include <terrainosaurus/genetics/HeightfieldGA.hpp>
+#include <terrainosaurus/genetics/terrain-operations.hpp>
+#include <terrainosaurus/genetics/TiledTerrainGenerator.hpp>
+#include <terrainosaurus/util/WorkerPool.hpp>
+#include <terrainosaurus/util/FFTPlanCache.hpp>
+#include <terrainosaurus/util/Trace.hpp>
+#include <terrainosaurus/data/ResidencyManager.hpp>
+#include <terrainosaurus/io/terrainosaurus-iostream.hpp>
+#include <inca/io/FileExceptions.hpp>
+
+// Import Timer definition
+#include <inca/util/Timer>
+
+// Import I/O & string definitions
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <cstdlib>
+#include <memory>
+
+using namespace terrainosaurus;
+
+// How wide a border naiveBlend gives each region (as in the UI)
+#define BORDER_WIDTH    2
+
+
+// Forward declaration
+namespace terrainosaurus {
+    class BatchApplication;
+};
+
+
+// The batch application class
+class terrainosaurus::BatchApplication : public TerrainosaurusApplication {
+public:
+    // Constructor
+    explicit BatchApplication()
+        : _startLOD(TerrainLOD::minimum()), _targetLOD(LOD_30m),
+          _threads(0), _seed(0), _haveSeed(false), _timing(false),
+          _progress(false), _memoryBudget(0), _tileSize(0),
+          _tileOverlap(0) { }
+
+    // Run the whole pipeline, then exit
+    int main(int & argc, char **& argv);
+
+    // Get command-line arguments, then do the normal application setup
+    void setup(int & argc, char **& argv);
+
+protected:
+    // Parse an LOD given as "LOD_30m", "30m" or "30"
+    TerrainLOD parseLOD(const std::string & s);
+
+    // Get the argument to a command-line option
+    std::string optionArgument(const std::string & option,
+                               int & argc, char **& argv);
+
+    // Write the generated terrain to disk
+    void storeTerrain(const TerrainSample::LOD & tsl,
+                      const std::string & path) const;
+
+    TerrainLOD  _startLOD, _targetLOD;
+    std::string _outputFilename;
+    std::string _traceFilename;
+    int         _threads;
+    unsigned    _seed;
+    bool        _haveSeed;
+    bool        _timing;
+    bool        _progress;
+    double      _memoryBudget;      // In megabytes
+    int         _tileSize;          // Zero for no tiling
+    int         _tileOverlap;       // Zero for the default
+};
+
+
+// Pick out the batch-specific options, and pass everything else on to the
+// usual TerrainosaurusApplication setup
+void BatchApplication::setup(int & argc, char **& argv) {
+    std::vector<std::string> passThru(1, argv[0]);
+    std::string arg;
+    while (argc > 1) {
+        arg = shift(argc, argv);
+        if (arg == "-o" || arg == "--output")
+            _outputFilename = optionArgument(arg, argc, argv);
+        else if (arg == "-j" || arg == "--threads")
+            _threads = std::atoi(optionArgument(arg, argc, argv).c_str());
+        else if (arg == "-s" || arg == "--seed") {
+            _seed = unsigned(std::strtoul(optionArgument(arg, argc, argv).c_str(), NULL, 10));
+            _haveSeed = true;
+        } else if (arg == "--start-lod")
+            _startLOD = parseLOD(optionArgument(arg, argc, argv));
+        else if (arg == "--target-lod")
+            _targetLOD = parseLOD(optionArgument(arg, argc, argv));
+        else if (arg == "-t" || arg == "--timing")
+            _timing = true;
+        else if (arg == "-p" || arg == "--progress")
+            _progress = true;
+        else if (arg == "--trace")
+            _traceFilename = optionArgument(arg, argc, argv);
+        else if (arg == "--memory-budget")
+            _memoryBudget = std::atof(optionArgument(arg, argc, argv).c_str());
+        else if (arg == "--tile-size")
+            _tileSize = std::atoi(optionArgument(arg, argc, argv).c_str());
+        else if (arg == "--tile-overlap")
+            _tileOverlap = std::atoi(optionArgument(arg, argc, argv).c_str());
+        else if (arg.length() > 1 && arg[0] == '-')
+            exit(1, "Unrecognized option \"" + arg + "\"");
+        else
+            passThru.push_back(arg);
+    }
+
+    // Sanity check what we got
+    if (_outputFilename.empty())
+        exit(1, "No output file specified (use -o FILE)");
+    if (_startLOD > _targetLOD)
+        exit(1, "Starting LOD is finer than the target LOD");
+    if (_threads < 0)
+        exit(1, "Thread count must not be negative");
+    if (_memoryBudget < 0)
+        exit(1, "Memory budget must not be negative");
+    if (_tileSize < 0 || _tileOverlap < 0)
+        exit(1, "Tile size & overlap must not be negative");
+    if (_tileSize > 0) {
+        std::string ext = _outputFilename.length() >= 4
+                        ? _outputFilename.substr(_outputFilename.length() - 4) : "";
+        if (ext != ".r32" && ext != ".raw")
+            exit(1, "Tiled generation can only write .r32 or .raw files");
+    }
+
+    // Do the normal setup with the remaining (filename) arguments
+    std::vector<char *> args;
+    for (IndexType i = 0; i < IndexType(passThru.size()); ++i)
+        args.push_back(const_cast<char *>(passThru[i].c_str()));
+    int argCount = int(args.size());
+    char ** argValues = &args[0];
+    TerrainosaurusApplication::setup(argCount, argValues);
+    if (_mapFilenames.size() != 1)
+        exit(1, "Exactly one .map file must be specified");
+    if (! _terrainFilenames.empty())
+        INCA_WARNING("Ignoring terrain files on the command-line")
+
+    // Override the config file & random seed if we were asked to
+    if (_threads > 0) {
+        setWorkerThreads(_threads);
+        WorkerPool::instance().setWorkerCount(_threads);
+        FFTPlanCache::instance().setThreadCount(_threads);
+    }
+    if (_haveSeed)
+        srand(_seed);
+
+    // Set the memory budget before anything is loaded, so that everything
+    // loaded is subject to it
+    if (_memoryBudget > 0)
+        ResidencyManager::instance().setBudget(
+                SizeType(_memoryBudget * 1024.0 * 1024.0));
+
+    // Start tracing right away, so that we see the setup too
+    if (! _traceFilename.empty()) {
+        Tracer::instance().setThreadName("main");
+        Tracer::instance().setEnabled(true);
+    }
+}
+
+std::string BatchApplication::optionArgument(const std::string & option,
+                                             int & argc, char **& argv) {
+    if (argc <= 1)
+        exit(1, "Option \"" + option + "\" requires an argument");
+    return shift(argc, argv);
+}
+
+TerrainLOD BatchApplication::parseLOD(const std::string & s) {
+    for (TerrainLOD lod = TerrainLOD::minimum(); lod <= TerrainLOD::maximum(); ++lod) {
+        std::ostringstream name, meters;
+        name << lod;
+        meters << metersPerSampleForLOD(lod);
+        if (s == name.str() || s == meters.str() || s == meters.str() + "m")
+            return lod;
+    }
+    exit(1, "Unrecognized LOD \"" + s + "\"");
+    return TerrainLOD_Underflow;
+}
+
+
+// Run the whole pipeline
+int BatchApplication::main(int & argc, char **& argv) {
+    setup(argc, argv);
+
+    inca::Timer<float, false> rasterizeTime, storeTime, tiledTime;
+    HeightfieldGA untiledGA;
+    std::unique_ptr<TiledTerrainGenerator> tiler;
+    HeightfieldGA * ga = &untiledGA;
+    int status = 0;
+    try {
+        MapPtr map = loadMap(_mapFilenames[0]);
+        if (_tileSize > 0) {
+            tiler.reset(new TiledTerrainGenerator(map));
+            tiler->setTileSize(_tileSize);
+            tiler->setTileOverlap(_tileOverlap);
+            ga = &tiler->ga();
+        }
+
+        if (_progress) {
+            // One line per percent is plenty
+            int lastPercent = -1;
+            ga->setPreloadProgressCallback(
+                    [lastPercent](const TerrainPrefetcher::Progress & p) mutable {
+                int percent = int(100 * p.fraction());
+                if (percent != lastPercent) {
+                    std::cerr << "preload: " << p << std::endl;
+                    lastPercent = percent;
+                }
+            });
+        }
+
+        // A tiled run does everything (including writing the result) a tile
+        // at a time
+        if (tiler) {
+            tiledTime.start(true);
+            tiler->run(_startLOD, _targetLOD, _outputFilename);
+            tiledTime.stop();
+            INCA_INFO("[" << _outputFilename << "]: storing complete ("
+                      << tiler->sizes().stringifyElements("x") << " samples)")
+
+        } else {
+            // Scan-convert the map at the finest LOD we'll need. Coarser
+            // LODs are resampled from this one.
+            MapRasterizationPtr mr(new MapRasterization(map));
+            TraceSpan rasterizeSpan("rasterize map", "io");
+            rasterizeTime.start(true);
+            (*mr)[_targetLOD].createFromMap(*map);
+            rasterizeTime.stop();
+            rasterizeSpan.end();
+
+            // Generate the terrain
+            TerrainSamplePtr ts(new TerrainSample());
+            TerrainSamplePtr ps(new TerrainSample());
+            ts->setMapRasterization(mr);
+            ps->setMapRasterization(mr);
+            ga->setTerrainSample(ts);
+            ga->setPatternSample(ps);
+
+            // Make the starting pattern just as the UI does, at the LOD
+            // before the GA's first (or the first, if that's the coarsest)
+            TerrainLOD baseLOD = (_startLOD == TerrainLOD::minimum())
+                                        ? _startLOD : _startLOD - 1;
+            {
+                TraceSpan baseSpan("base pattern", "ga");
+                naiveBlend((*ps)[baseLOD], BORDER_WIDTH);
+            }
+            ga->run(_startLOD, _targetLOD);
+
+            // Write out the result
+            TraceSpan storeSpan("store terrain", "io");
+            storeTime.start(true);
+            storeTerrain((*ts)[_targetLOD], _outputFilename);
+            storeTime.stop();
+        }
+
+    } catch (inca::StreamException & e) {
+        INCA_ERROR("Terrain generation failed: " << e)
+        status = 1;
+    }
+
+    // Write out the trace, even if something went wrong (when it's most
+    // likely to be wanted)
+    if (! _traceFilename.empty()) {
+        Tracer::instance().setEnabled(false);
+        try {
+            Tracer::instance().writeChromeTrace(_traceFilename);
+        } catch (inca::StreamException & e) {
+            INCA_ERROR("Unable to write trace: " << e)
+            status = 1;
+        }
+    }
+    if (status != 0)
+        return status;
+
+    // Report where the time went, one LOD per line, in a form that's easy
+    // to collect from many runs
+    if (_timing) {
+        std::cout << "lod\tsetup_s\tprocessing_s\ttotal_s\n";
+        for (TerrainLOD lod = _startLOD; lod <= _targetLOD; ++lod)
+            std::cout << lod << '\t' << ga->setupTime(lod)
+                             << '\t' << ga->processingTime(lod)
+                             << '\t' << ga->lodTime(lod) << '\n';
+        std::cout << "rasterize\t\t\t" << rasterizeTime() << '\n'
+                  << "preload\t\t\t"   << ga->loadingTime() << '\n'
+                  << "store\t\t\t"     << storeTime() << '\n'
+                  << "generate\t\t\t"  << (tiler ? tiledTime() : ga->totalTime()) << '\n'
+                  << "threads\t\t\t"   << WorkerPool::instance().workerCount() << '\n'
+                  << "gene_cache_hits\t\t\t"   << ga->measurementCache().geneHits() << '\n'
+                  << "gene_cache_misses\t\t\t" << ga->measurementCache().geneMisses() << '\n';
+        if (tiler)
+            std::cout << "tiles\t\t\t" << tiler->tileCount() << '\n';
+        if (ResidencyManager::instance().enabled()) {
+            const ResidencyManager & rm = ResidencyManager::instance();
+            std::cout << "resident_lods\t\t\t"   << rm.residentCount() << '\n'
+                      << "resident_bytes\t\t\t"  << rm.residentBytes() << '\n'
+                      << "evictions\t\t\t"       << rm.evictionCount() << '\n'
+                      << "evicted_bytes\t\t\t"   << rm.evictedBytes() << '\n'
+                      << "reloads\t\t\t"         << rm.reloadCount() << '\n'
+                      << "reloaded_bytes\t\t\t"  << rm.reloadedBytes() << '\n';
+        }
+        std::cout.flush();
+    }
+    return 0;
+}
+
+
+// Write the generated terrain to disk
+void BatchApplication::storeTerrain(const TerrainSample::LOD & tsl,
+                                    const std::string & path) const {
+    INCA_INFO("[" << path << "]: storing generated terrain")
+    std::string ext = path.length() >= 4 ? path.substr(path.length() - 4) : "";
+    bool raw = (ext == ".r32" || ext == ".raw");
+
+    // Try to open the file and scream if we fail
+    std::ofstream file(path.c_str(), std::ios::out | std::ios::binary);
+    if (! file) {
+        inca::io::FileAccessException e(path);
+        e << "Unable to write terrain file [" << path
+          << "]: check directory/file permissions";
+        throw e;
+    }
+
+    if (raw) {
+        const Heightfield & hf = tsl.elevations();
+        for (IndexType j = hf.base(1); j <= hf.extent(1); ++j)
+            for (IndexType i = hf.base(0); i <= hf.extent(0); ++i) {
+                float z = hf(i, j);
+                file.write(reinterpret_cast<char const *>(&z), sizeof(float));
+            }
+    } else {
+        file << tsl;
+    }
+    file.close();
+
+    INCA_INFO("[" << path << "]: storing complete ("
+              << tsl.sizes().stringifyElements("x") << " samples)")
+}
+
+
+// This macro expands to a main() function that instantiates the application
+// and launches it
+APPLICATION_MAIN(terrainosaurus::BatchApplication);
@@ -0,0 +1,869 @@
+/**
+ * \file    terrainosaurus-bench.cpp
+ *
+ * \author  Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes.
+ *
+ * Description:
+ *      This file implements terrainosaurus-bench, which times the expensive
+ *      parts of the terrain pipeline on synthetic data and reports the
+ *      results in a machine-readable form, so that they can be compared
+ *      from one version to the next.
+ *
+ *      Usage:
+ *          terrainosaurus-bench [options]
+ *
+ *      Options:
+ *          -o, --output FILE   where to write the results (default: stdout)
+ *          -f, --format FMT    "json" or "csv" (default: csv if FILE ends in
+ *                              .csv, and json otherwise)
+ *          -r, --repeat N      timed runs of each benchmark (default: 5),
+ *                              after one untimed warm-up run
+ *          -j, --threads N     number of worker threads (overrides the
+ *                              config file)
+ *          -s, --seed N        seed for the terrain & the GA (default: 1)
+ *          --max-lod L         finest LOD to benchmark (default: 30m)
+ *          --population N      GA population size (overrides the config
+ *                              file)
+ *          --filter TEXT       only run the benchmarks whose names contain
+ *                              TEXT (e.g., "io/" or "fitness")
+ *          --trace FILE        also record a trace of every run (with the
+ *                              phases inside it), and write it to FILE in
+ *                              Chrome's trace-event JSON format. Tracing has
+ *                              a (small) cost of its own, so the times
+ *                              reported are best taken from untraced runs.
+ *
+ *      Each benchmark is run at each LOD from the coarsest up to --max-lod:
+ *          io/dem-parse                    loadDEM() of a USGS ASCII DEM
+ *          io/cache-store                  writing an analysis cache file
+ *          io/cache-load                   opening an analysis cache file
+ *                                          and paging in all of its rasters
+ *          analysis/gradient               the per-cell gradient
+ *          analysis/spectrum               the FFT magnitude spectrum
+ *          analysis/scale-space            gaussianScaleSpace()
+ *          analysis/scale-space-project    Inca's scale_space_project(), for
+ *                                          comparison
+ *          analysis/scale-space-features   gaussianScaleSpace() + ridges
+ *          analysis/analyze                TerrainSample::LOD::analyze()
+ *          analysis/study                  TerrainSample::LOD::study()
+ *          ga/generation                   one GA generation (including
+ *                                          rendering the best chromosome)
+ *          ga/render-chromosome            renderChromosome()
+ *          ga/fitness/gene-compatibility   each of the GA's fitness
+ *          ga/fitness/region-similarity    operators, on one chromosome
+ *          ga/fitness/region-update        region similarity after one gene
+ *                                          has changed (which should update
+ *                                          the rendering incrementally)
+ *      (the ga/ benchmarks start at the second-coarsest LOD, since the GA
+ *      never runs at the coarsest).
+ *
+ *      For every benchmark and LOD, the results give the number of cells
+ *      processed and the min/median/mean/max times (in seconds) over the
+ *      timed runs.
+ *
+ * Implementation notes:
+ *      All the terrain is fractal noise generated from the seed, and is
+ *      defined in world coordinates, so that every LOD of a terrain shows
+ *      the same landscape. Every LOD covers the same ground (EXTENT meters
+ *      on a side). The DEM is written from that same noise into the cache
+ *      directory before it is parsed (and deleted afterwards), which keeps
+ *      the benchmark independent of whatever DEMs happen to be installed.
+ *
+ *      The terrain library is built in memory (two terrain types, with two
+ *      samples each), and so never touches the analysis cache. Like
+ *      terrainosaurus-batch, BenchApplication is a TerrainosaurusApplication
+ *      only so that the rest of the code can find its configuration.
+ */
+
+// Include precompiled header
+#include <terrainosaurus/precomp.h>
+
+// Import application class definition
+#include "TerrainosaurusApplication.hpp"
+
+// Import data & algorithm definitions
+#include <terrainosaurus/data/MapRasterization.hpp>
+#include <terrainosaurus/data/scale-space.hpp>
+#include <terrainosaurus/data/windowed-statistics.hpp>
+#include <terrainosaurus/genetics/HeightfieldGA.hpp>
+#include <terrainosaurus/genetics/terrain-operations.hpp>
+#include <terrainosaurus/util/WorkerPool.hpp>
+#include <terrainosaurus/util/FFTPlanCache.hpp>
+#include <terrainosaurus/util/Trace.hpp>
+#include <terrainosaurus/io/terrainosaurus-iostream.hpp>
+#include <inca/io/FileExceptions.hpp>
+
+// Import raster operators & algorithms
+#include <inca/raster/operators/gradient>
+#include <inca/raster/algorithms/scale_space_project>
+#include <inca/raster/algorithms/find_ridges>
+
+// Import I/O, string, container & time definitions
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <chrono>
+
+using namespace terrainosaurus;
+
+
+// How much ground (in meters) each synthetic terrain covers. This is a
+// whole number of samples at every LOD.
+#define EXTENT          25920
+
+// How much loadDEM() trims off each edge of a DEM
+#define DEM_BORDER      30
+
+// Border width for the naive blend that starts off the GA (see
+// TerrainSampleWindow.cpp)
+#define BORDER_WIDTH    2
+
+
+// Local helper functions
+namespace {
+    // How many samples across a synthetic terrain is at an LOD
+    SizeType extentSamples(TerrainLOD lod) {
+        return SizeType(EXTENT / metersPerSampleForLOD(lod) + 0.5f);
+    }
+
+    // A pseudo-random value in [-1, 1) for each lattice point. This is a
+    // hash, rather than a random number generator, so that the terrain
+    // doesn't depend on the order in which it's generated (or on rand()).
+    double latticeValue(IndexType x, IndexType y, unsigned seed) {
+        std::uint32_t h = std::uint32_t(x) * 0x8da6b343u
+                        ^ std::uint32_t(y) * 0xd8163841u
+                        ^ std::uint32_t(seed) * 0xcb1ab31fu;
+        h ^= h >> 13;
+        h *= 0x5bd1e995u;
+        h ^= h >> 15;
+        return double(h >> 8) / double(1 << 23) - 1.0;
+    }
+
+    // Smoothly interpolated lattice noise
+    double valueNoise(double x, double y, unsigned seed) {
+        double fx = std::floor(x), fy = std::floor(y);
+        IndexType ix = IndexType(fx), iy = IndexType(fy);
+        double tx = x - fx, ty = y - fy;
+        tx = tx * tx * (3 - 2 * tx);
+        ty = ty * ty * (3 - 2 * ty);
+        double v00 = latticeValue(ix,     iy,     seed),
+               v10 = latticeValue(ix + 1, iy,     seed),
+               v01 = latticeValue(ix,     iy + 1, seed),
+               v11 = latticeValue(ix + 1, iy + 1, seed);
+        return (v00 * (1 - tx) + v10 * tx) * (1 - ty)
+             + (v01 * (1 - tx) + v11 * tx) * ty;
+    }
+
+    // An n x n fractal (fBm) terrain at an LOD. Features range in size from
+    // 8km down to the finest the LOD can represent, so finer LODs have more
+    // octaves of detail, but are otherwise the same landscape.
+    Heightfield fractalHeightfield(SizeType n, TerrainLOD lod,
+                                   unsigned seed, scalar_t relief) {
+        Heightfield hf(SizeArray(n, n));
+        double mps = metersPerSampleForLOD(lod);
+        for (IndexType j = 0; j < IndexType(n); ++j)
+            for (IndexType i = 0; i < IndexType(n); ++i) {
+                double x = i * mps, y = j * mps;
+                double z = 0.0, amplitude = 0.5;
+                unsigned octave = 0;
+                for (double wavelength = 8000.0; wavelength >= 2 * mps;
+                                                 wavelength /= 2, ++octave) {
+                    z += amplitude * valueNoise(x / wavelength, y / wavelength,
+                                                seed * 31 + octave);
+                    amplitude /= 2;
+                }
+                hf(i, j) = scalar_t(1000.0 + relief * z);
+            }
+        return hf;
+    }
+
+
+    // Fixed-width fields of a DEM record
+    void demText(std::string & r, const std::string & s, SizeType width) {
+        std::string field(s, 0, std::min(s.length(), std::size_t(width)));
+        r += field + std::string(width - field.length(), ' ');
+    }
+    void demInteger(std::string & r, long v, int width) {
+        char field[32];
+        std::snprintf(field, sizeof(field), "%*ld", width, v);
+        r += field;
+    }
+    void demReal(std::string & r, double v, int width) {
+        char field[32];
+        std::snprintf(field, sizeof(field), "%*.*E", width,
+                      width >= 24 ? 15 : 5, v);
+        r += field;
+    }
+    void demPad(std::string & r, SizeType blockSize = 1024) {
+        if (r.length() % blockSize != 0)
+            r += std::string(blockSize - r.length() % blockSize, ' ');
+    }
+
+    // Write a heightfield as a USGS ASCII DEM, with one profile per column
+    // and elevations in whole meters. This fills in only what DEMInterpreter
+    // looks at (and leaves off the optional 1988 fields).
+    void writeDEM(const std::string & path, const Heightfield & hf,
+                  TerrainLOD lod) {
+        std::ofstream file(path.c_str(), std::ios::out | std::ios::binary);
+        if (! file) {
+            inca::io::FileAccessException e(path);
+            e << "Unable to write DEM file [" << path
+              << "]: check directory/file permissions";
+            throw e;
+        }
+
+        IndexType cols = IndexType(hf.size(0)),
+                  rows = IndexType(hf.size(1));
+        double mps = metersPerSampleForLOD(lod),
+               width  = (cols - 1) * mps,
+               height = (rows - 1) * mps;
+        scalar_t zMin = hf(0, 0), zMax = hf(0, 0);
+        for (IndexType j = 0; j < rows; ++j)
+            for (IndexType i = 0; i < cols; ++i) {
+                zMin = std::min(zMin, hf(i, j));
+                zMax = std::max(zMax, hf(i, j));
+            }
+
+        // Record A: the header
+        std::string record;
+        demText(record, "terrainosaurus-bench synthetic terrain", 40);
+        demText(record, "", 40 + 29 + 26);  // Comment, filler, SE corner
+        demInteger(record, 1, 1);           // Process code
+        demText(record, "", 1 + 3 + 4);     // Filler, section, origin
+        demInteger(record, 1, 6);           // DEM level
+        demInteger(record, 1, 6);           // Elevation pattern (regular)
+        demInteger(record, 1, 6);           // Coordinate system (UTM)
+        demInteger(record, 13, 6);          // UTM zone
+        for (IndexType i = 0; i < 15; ++i)
+            demReal(record, 0.0, 24);       // Projection parameters
+        demInteger(record, 2, 6);           // Horizontal units (meters)
+        demInteger(record, 2, 6);           // Vertical units (meters)
+        demInteger(record, 4, 6);           // Sides of the boundary
+        double corners[4][2] = { { 0.0, 0.0 }, { 0.0, height },
+                                 { width, height }, { width, 0.0 } };
+        for (IndexType i = 0; i < 4; ++i) {
+            demReal(record, corners[i][0], 24);
+            demReal(record, corners[i][1], 24);
+        }
+        demReal(record, std::floor(zMin), 24);
+        demReal(record, std::ceil(zMax), 24);
+        demReal(record, 0.0, 24);           // Deviation angle
+        demInteger(record, 0, 6);           // No accuracy record
+        demReal(record, mps, 12);           // Resolution
+        demReal(record, mps, 12);
+        demReal(record, 1.0, 12);
+        demInteger(record, 1, 6);           // Profile rows & columns
+        demInteger(record, cols, 6);
+        demPad(record);
+        file.write(record.data(), record.length());
+
+        // Record B: one elevation profile per column, running south to
+        // north. Elevations never straddle a 1024-byte block.
+        for (IndexType i = 0; i < cols; ++i) {
+            record.clear();
+            scalar_t pMin = hf(i, 0), pMax = hf(i, 0);
+            for (IndexType j = 0; j < rows; ++j) {
+                pMin = std::min(pMin, hf(i, j));
+                pMax = std::max(pMax, hf(i, j));
+            }
+            demInteger(record, 1, 6);
+            demInteger(record, i + 1, 6);
+            demInteger(record, rows, 6);
+            demInteger(record, 1, 6);
+            demReal(record, i * mps, 24);   // Start coordinates
+            demReal(record, 0.0, 24);
+            demReal(record, 0.0, 24);       // Local datum
+            demReal(record, std::floor(pMin), 24);
+            demReal(record, std::ceil(pMax), 24);
+            for (IndexType j = 0; j < rows; ++j) {
+                if (record.length() % 1024 + 6 > 1024)
+                    demPad(record);
+                demInteger(record, long(std::floor(hf(i, j) + 0.5f)), 6);
+            }
+            demPad(record);
+            file.write(record.data(), record.length());
+        }
+        file.close();
+    }
+
+
+    // Counts what the scale-space feature detectors find
+    struct FeatureCounter {
+        FeatureCounter() : features(0), points(0) { }
+
+        template <class P>
+        void operator()(const P & p, scalar_t s) { ++points; }
+        void begin() { ++features; }
+        void end() { }
+
+        SizeType features, points;
+    };
+
+    // The scales the feature detectors look at (as in TerrainSample.cpp)
+    std::vector<scalar_t> featureScales() {
+        std::vector<scalar_t> scales;
+        scales.push_back(0.0f);
+        scales.push_back(1.0f);
+        scales.push_back(2.0f);
+        scales.push_back(3.0f);
+        return scales;
+    }
+
+
+    // How long 'work' takes, in seconds
+    double timeIt(const std::function<void ()> & work) {
+        typedef std::chrono::steady_clock Clock;
+        Clock::time_point start = Clock::now();
+        work();
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+}
+
+
+// Forward declaration
+namespace terrainosaurus {
+    class BenchApplication;
+};
+
+
+// The benchmarking application class
+class terrainosaurus::BenchApplication : public TerrainosaurusApplication {
+public:
+    // The timings of one benchmark at one LOD
+    struct Result {
+        std::string         name;
+        TerrainLOD          lod;
+        SizeType            cells;      // How much terrain was processed
+        std::vector<double> seconds;    // One per timed run, sorted
+
+        double min()    const { return seconds.front(); }
+        double max()    const { return seconds.back(); }
+        double median() const {
+            SizeType n = seconds.size();
+            return (seconds[(n - 1) / 2] + seconds[n / 2]) / 2;
+        }
+        double mean()   const {
+            double sum = 0.0;
+            for (IndexType i = 0; i < IndexType(seconds.size()); ++i)
+                sum += seconds[i];
+            return sum / seconds.size();
+        }
+    };
+
+    // Constructor
+    explicit BenchApplication()
+        : _maxLOD(LOD_30m), _repeats(5), _threads(0), _population(0),
+          _seed(1) { }
+
+    // Run all the benchmarks, then exit
+    int main(int & argc, char **& argv);
+
+    // Get command-line arguments, then do the normal application setup
+    void setup(int & argc, char **& argv);
+
+protected:
+    // Parse an LOD given as "LOD_30m", "30m" or "30"
+    TerrainLOD parseLOD(const std::string & s);
+
+    // Get the argument to a command-line option
+    std::string optionArgument(const std::string & option,
+                               int & argc, char **& argv);
+
+    // The groups of benchmarks
+    void benchmarkIO(TerrainLOD lod);
+    void benchmarkAnalysis(TerrainLOD lod);
+    void benchmarkGA(TerrainLOD lod, MapRasterizationPtr mr,
+                     TerrainSamplePtr ps);
+
+    // Build the synthetic terrain library & map
+    TerrainLibraryPtr syntheticLibrary() const;
+    MapRasterizationPtr syntheticMap(TerrainLibraryPtr tl) const;
+
+    // Whether any benchmark whose name starts with 'prefix' is to be run
+    bool wanted(const std::string & prefix) const;
+
+    // Run 'trial' (which returns how long the interesting part of it took)
+    // once to warm up, and then once for each timed run
+    void measure(const std::string & name, TerrainLOD lod, SizeType cells,
+                 const std::function<double ()> & trial);
+
+    // Where to put temporary files
+    std::string scratchFilename(TerrainLOD lod, const std::string & ext) const;
+
+    // Write out the results
+    void writeJSON(std::ostream & os) const;
+    void writeCSV(std::ostream & os) const;
+
+    TerrainLOD          _maxLOD;
+    int                 _repeats;
+    int                 _threads;
+    int                 _population;
+    unsigned            _seed;
+    std::string         _outputFilename, _format, _filter, _traceFilename;
+    std::vector<Result> _results;
+};
+
+
+// Pick out the bench-specific options, and pass everything else on to the
+// usual TerrainosaurusApplication setup
+void BenchApplication::setup(int & argc, char **& argv) {
+    std::vector<std::string> passThru(1, argv[0]);
+    std::string arg;
+    while (argc > 1) {
+        arg = shift(argc, argv);
+        if (arg == "-o" || arg == "--output")
+            _outputFilename = optionArgument(arg, argc, argv);
+        else if (arg == "-f" || arg == "--format")
+            _format = optionArgument(arg, argc, argv);
+        else if (arg == "-r" || arg == "--repeat")
+            _repeats = std::atoi(optionArgument(arg, argc, argv).c_str());
+        else if (arg == "-j" || arg == "--threads")
+            _threads = std::atoi(optionArgument(arg, argc, argv).c_str());
+        else if (arg == "-s" || arg == "--seed")
+            _seed = unsigned(std::strtoul(optionArgument(arg, argc, argv).c_str(), NULL, 10));
+        else if (arg == "--max-lod")
+            _maxLOD = parseLOD(optionArgument(arg, argc, argv));
+        else if (arg == "--population")
+            _population = std::atoi(optionArgument(arg, argc, argv).c_str());
+        else if (arg == "--filter")
+            _filter = optionArgument(arg, argc, argv);
+        else if (arg == "--trace")
+            _traceFilename = optionArgument(arg, argc, argv);
+        else if (arg.length() > 1 && arg[0] == '-')
+            exit(1, "Unrecognized option \"" + arg + "\"");
+        else
+            passThru.push_back(arg);
+    }
+
+    // Sanity check what we got
+    if (_format.empty()) {
+        std::string ext = _outputFilename.length() >= 4
+                        ? _outputFilename.substr(_outputFilename.length() - 4) : "";
+        _format = (ext == ".csv" ? "csv" : "json");
+    }
+    if (_format != "json" && _format != "csv")
+        exit(1, "Unrecognized output format \"" + _format + "\" (use json or csv)");
+    if (_repeats < 1)
+        exit(1, "Repeat count must be at least 1");
+    if (_threads < 0)
+        exit(1, "Thread count must not be negative");
+    if (_population < 0)
+        exit(1, "Population size must not be negative");
+
+    // Do the normal setup with whatever's left
+    std::vector<char *> args;
+    for (IndexType i = 0; i < IndexType(passThru.size()); ++i)
+        args.push_back(const_cast<char *>(passThru[i].c_str()));
+    int argCount = int(args.size());
+    char ** argValues = &args[0];
+    TerrainosaurusApplication::setup(argCount, argValues);
+
+    // Override the config file if we were asked to
+    if (_threads > 0) {
+        setWorkerThreads(_threads);
+        WorkerPool::instance().setWorkerCount(_threads);
+        FFTPlanCache::instance().setThreadCount(_threads);
+    }
+    if (_population > 0)
+        setHeightfieldGAPopulationSize(_population);
+    if (! _traceFilename.empty()) {
+        Tracer::instance().setThreadName("main");
+        Tracer::instance().setEnabled(true);
+    }
+}
+
+std::string BenchApplication::optionArgument(const std::string & option,
+                                             int & argc, char **& argv) {
+    if (argc <= 1)
+        exit(1, "Option \"" + option + "\" requires an argument");
+    return shift(argc, argv);
+}
+
+TerrainLOD BenchApplication::parseLOD(const std::string & s) {
+    for (TerrainLOD lod = TerrainLOD::minimum(); lod <= TerrainLOD::maximum(); ++lod) {
+        std::ostringstream name, meters;
+        name << lod;
+        meters << metersPerSampleForLOD(lod);
+        if (s == name.str() || s == meters.str() || s == meters.str() + "m")
+            return lod;
+    }
+    exit(1, "Unrecognized LOD \"" + s + "\"");
+    return TerrainLOD_Underflow;
+}
+
+
+// Run all the benchmarks
+int BenchApplication::main(int & argc, char **& argv) {
+    setup(argc, argv);
+
+    try {
+        // Everything that doesn't need the GA
+        for (TerrainLOD lod = TerrainLOD::minimum(); lod <= _maxLOD; ++lod) {
+            benchmarkIO(lod);
+            benchmarkAnalysis(lod);
+        }
+
+        // The GA needs a library, a map, and a pattern to start from (made
+        // just as the interactive application makes it)
+        if (wanted("ga/generation") || wanted("ga/render-chromosome")
+                                    || wanted("ga/fitness/")) {
+            TerrainLibraryPtr tl = syntheticLibrary();
+            MapRasterizationPtr mr = syntheticMap(tl);
+            TerrainSamplePtr ps(new TerrainSample());
+            ps->setMapRasterization(mr);
+            srand(_seed);
+            naiveBlend((*ps)[TerrainLOD::minimum()], BORDER_WIDTH);
+            for (TerrainLOD lod = TerrainLOD::minimum() + 1; lod <= _maxLOD; ++lod)
+                benchmarkGA(lod, mr, ps);
+        }
+
+    } catch (inca::StreamException & e) {
+        INCA_ERROR("Benchmarking failed: " << e)
+        return 1;
+    }
+
+    // Write out the trace
+    if (! _traceFilename.empty()) {
+        Tracer::instance().setEnabled(false);
+        try {
+            Tracer::instance().writeChromeTrace(_traceFilename);
+        } catch (inca::StreamException & e) {
+            INCA_ERROR("Unable to write trace: " << e)
+            return 1;
+        }
+    }
+
+    // Write out the results
+    if (_outputFilename.empty() || _outputFilename == "-") {
+        if (_format == "csv")   writeCSV(std::cout);
+        else                    writeJSON(std::cout);
+        std::cout.flush();
+    } else {
+        std::ofstream file(_outputFilename.c_str());
+        if (! file) {
+            INCA_ERROR("Unable to write results file [" << _outputFilename
+                       << "]: check directory/file permissions")
+            return 1;
+        }
+        if (_format == "csv")   writeCSV(file);
+        else                    writeJSON(file);
+    }
+    return 0;
+}
+
+
+/*---------------------------------------------------------------------------*
+ | The benchmarks
+ *---------------------------------------------------------------------------*/
+// Reading & writing terrain files
+void BenchApplication::benchmarkIO(TerrainLOD lod) {
+    SizeType n = extentSamples(lod);
+
+    // Parse a DEM (with an extra border, which loadDEM() trims off)
+    if (wanted("io/dem-parse")) {
+        std::string path = scratchFilename(lod, "dem");
+        writeDEM(path, fractalHeightfield(n + 2 * DEM_BORDER, lod, _seed, 600.0f), lod);
+        measure("io/dem-parse", lod, n * n, [&]() {
+            Heightfield hf;
+            return timeIt([&]() { loadDEM(hf, path); });
+        });
+        std::remove(path.c_str());
+    }
+
+    // Store & load an analysis cache file
+    if (wanted("io/cache-")) {
+        std::string path = scratchFilename(lod, "cache");
+        TerrainSamplePtr ts(new TerrainSample());
+        const TerrainSample::LOD & tsl = (*ts)[lod];
+        (*ts)[lod].createFromRaster(fractalHeightfield(n, lod, _seed, 600.0f));
+        tsl.ensureStudied();
+
+        measure("io/cache-store", lod, n * n, [&]() {
+            return timeIt([&]() {
+                std::ofstream file(path.c_str(), std::ios::binary);
+                writeAnalysisCache(file, tsl, 0);
+                file.close();
+            });
+        });
+
+        // Make sure there's something to load, even if we skipped storing
+        if (! wanted("io/cache-store")) {
+            std::ofstream file(path.c_str(), std::ios::binary);
+            writeAnalysisCache(file, tsl, 0);
+        }
+        measure("io/cache-load", lod, n * n, [&]() {
+            TerrainSamplePtr loaded(new TerrainSample());
+            return timeIt([&]() {
+                TerrainSample::LOD & l = (*loaded)[lod];
+                attachAnalysisCache(l, AnalysisCache::open(path));
+                l.cellsBegin();     // This pages in every raster
+            });
+        });
+        std::remove(path.c_str());
+    }
+}
+
+// The individual parts of analyze() & study()
+void BenchApplication::benchmarkAnalysis(TerrainLOD lod) {
+    SizeType n = extentSamples(lod);
+    Heightfield hf = fractalHeightfield(n, lod, _seed, 600.0f);
+
+    // The gradient, calculated just as analyze() does it
+    measure("analysis/gradient", lod, n * n, [&]() {
+        VectorMap gradients(hf.sizes());
+        return timeIt([&]() {
+            scalar_t mps = metersPerSampleForLOD(lod);
+            auto gradient = inca::raster::gradient(hf, mps);
+            IndexType b0 = hf.base(0), e0 = hf.extent(0);
+            parallelFor(hf.base(1), hf.extent(1) + 1,
+                        windowedTileSize(hf.size(1), 1),
+                        [&](IndexType first, IndexType last) {
+                Pixel px;
+                for (px[1] = first; px[1] < last; ++px[1])
+                    for (px[0] = b0; px[0] <= e0; ++px[0])
+                        gradients(px) = gradient(px);
+            });
+        });
+    });
+
+    measure("analysis/spectrum", lod, n * n, [&]() {
+        std::vector<float> magnitudes;
+        return timeIt([&]() {
+            FFTPlanCache::instance().magnitudeSpectrum(magnitudes, hf);
+        });
+    });
+
+    measure("analysis/scale-space", lod, n * n, [&]() {
+        std::vector<scalar_t> scales = featureScales();
+        return timeIt([&]() {
+            ScaleSpaceImage scaleSpace;
+            gaussianScaleSpace(scaleSpace, hf, scales);
+        });
+    });
+    measure("analysis/scale-space-project", lod, n * n, [&]() {
+        std::vector<scalar_t> scales = featureScales();
+        return timeIt([&]() {
+            ScaleSpaceImage scaleSpace;
+            inca::raster::scale_space_project(scaleSpace, hf, scales);
+        });
+    });
+    measure("analysis/scale-space-features", lod, n * n, [&]() {
+        std::vector<scalar_t> scales = featureScales();
+        return timeIt([&]() {
+            ScaleSpaceImage scaleSpace;
+            gaussianScaleSpace(scaleSpace, hf, scales);
+            FeatureCounter ridges;
+            ridges = inca::raster::find_ridges(scaleSpace, scales, ridges);
+        });
+    });
+
+    // The whole of analyze() & study(), on a fresh sample each time
+    measure("analysis/analyze", lod, n * n, [&]() {
+        TerrainSamplePtr ts(new TerrainSample());
+        TerrainSample::LOD & tsl = (*ts)[lod];
+        tsl.createFromRaster(hf);
+        return timeIt([&]() { tsl.analyze(); });
+    });
+    measure("analysis/study", lod, n * n, [&]() {
+        TerrainSamplePtr ts(new TerrainSample());
+        TerrainSample::LOD & tsl = (*ts)[lod];
+        tsl.createFromRaster(hf);
+        tsl.ensureAnalyzed();
+        return timeIt([&]() { tsl.study(); });
+    });
+}
+
+// The GA, at one LOD. Each run of the GA starts from the coarsest LOD, but
+// only the work at 'lod' is counted.
+void BenchApplication::benchmarkGA(TerrainLOD lod, MapRasterizationPtr mr,
+                                   TerrainSamplePtr ps) {
+    SizeType cells = (*mr)[lod].size();
+    HeightfieldGA ga;
+    ga.setPatternSample(ps);
+    ga.setEvolutionCycles(1);
+
+    // Run the GA (always at least once, since the rest need its population)
+    TerrainLOD coarsest = TerrainLOD::minimum();
+    bool ran = false;
+    std::function<double ()> generation = [&]() {
+        TerrainSamplePtr ts(new TerrainSample());
+        ts->setMapRasterization(mr);
+        (*ts)[coarsest] = (*ps)[coarsest];
+        ga.setTerrainSample(ts);
+        srand(_seed);
+        ga.run(coarsest, lod);
+        ran = true;
+        return double(ga.processingTime(lod));
+    };
+    measure("ga/generation", lod, cells, generation);
+    if (! ran)
+        generation();
+
+    // Render & evaluate one of the resulting chromosomes from scratch
+    TerrainChromosome & c = ga.chromosome(0);
+    TerrainSamplePtr rs(new TerrainSample());
+    measure("ga/render-chromosome", lod, cells, [&]() {
+        return timeIt([&]() { renderChromosome((*rs)[lod], c); });
+    });
+    measure("ga/fitness/gene-compatibility", lod, cells, [&]() {
+        ga.measurementCache().clear();
+        return timeIt([&]() { ga.fitnessOperator(0)(c); });
+    });
+    measure("ga/fitness/region-similarity", lod, cells, [&]() {
+        c.renderCache().valid = false;
+        return timeIt([&]() { ga.fitnessOperator(1)(c); });
+    });
+
+    // The same, the way the GA actually does it: after a full rendering,
+    // the other fitness operator and a mutation of one gene. This should
+    // re-splat only that gene, which we can tell by the cache having done an
+    // incremental update.
+    measure("ga/fitness/region-update", lod, cells, [&]() {
+        c.renderCache().valid = false;
+        ga.fitnessOperator(1)(c);
+        ga.fitnessOperator(0)(c);
+        TerrainChromosome::Gene & g = c.gene(c.size(0) / 2, c.size(1) / 2);
+        g.setOffset(g.offset() + scalar_t(1));
+        double t = timeIt([&]() { ga.fitnessOperator(1)(c); });
+        if (c.renderCache().updates != 1)
+            INCA_WARNING("ga/fitness/region-update at " << lod
+                         << ": rendering was not updated incrementally")
+        return t;
+    });
+}
+
+
+/*---------------------------------------------------------------------------*
+ | Synthetic data
+ *---------------------------------------------------------------------------*/
+// Two terrain types (gentle & rugged), each with two samples, generated at
+// every LOD
+TerrainLibraryPtr BenchApplication::syntheticLibrary() const {
+    TerrainLibraryPtr tl(new TerrainLibrary());
+
+    // Terrain type 0 must be the "Void" type. TerrainLibrary creates it on
+    // first use -- but only for the first library ever used.
+    if (tl->size() == 0)
+        tl->addTerrainType("Void");
+
+    static const char * names[] = { "Synthetic Hills", "Synthetic Mountains" };
+    static const scalar_t reliefs[] = { 150.0f, 900.0f };
+    for (IndexType t = 0; t < 2; ++t) {
+        TerrainTypePtr tt = tl->addTerrainType(names[t]);
+        for (IndexType s = 0; s < 2; ++s) {
+            TerrainSamplePtr ts(new TerrainSample());
+            unsigned seed = _seed + 100 * unsigned(t + 1) + unsigned(s);
+            for (TerrainLOD lod = TerrainLOD::minimum(); lod <= _maxLOD; ++lod)
+                (*ts)[lod].createFromRaster(
+                    fractalHeightfield(extentSamples(lod), lod, seed, reliefs[t]));
+            tt->addTerrainSample(ts);
+        }
+    }
+    return tl;
+}
+
+// A map that's half hills and half mountains
+MapRasterizationPtr BenchApplication::syntheticMap(TerrainLibraryPtr tl) const {
+    SizeType n = extentSamples(_maxLOD);
+    IDMap ids(SizeArray(n, n));
+    for (IndexType j = 0; j < IndexType(n); ++j)
+        for (IndexType i = 0; i < IndexType(n); ++i)
+            ids(i, j) = (i < IndexType(n / 2) ? 1 : 2);
+    return MapRasterizationPtr(new MapRasterization(ids, _maxLOD, tl));
+}
+
+
+/*---------------------------------------------------------------------------*
+ | Timing & results
+ *---------------------------------------------------------------------------*/
+bool BenchApplication::wanted(const std::string & prefix) const {
+    return _filter.empty() || prefix.find(_filter) != std::string::npos
+                           || _filter.find(prefix) == 0;
+}
+
+void BenchApplication::measure(const std::string & name, TerrainLOD lod,
+                               SizeType cells,
+                               const std::function<double ()> & trial) {
+    if (! wanted(name))
+        return;
+    INCA_INFO("Benchmarking " << name << " [" << lod << "]")
+
+    Result r;
+    r.name  = name;
+    r.lod   = lod;
+    r.cells = cells;
+    for (int i = 0; i <= _repeats; ++i) {     // The first is a warm-up
+        TraceSpan span("benchmark", "bench");
+        if (span) {
+            span.setArgument("name", name);
+            span.setArgument("lod", lod);
+            span.setArgument("run", i);
+        }
+        double seconds = trial();
+        if (i > 0)
+            r.seconds.push_back(seconds);
+    }
+    std::sort(r.seconds.begin(), r.seconds.end());
+    _results.push_back(r);
+
+    INCA_INFO("    median " << r.median() << " seconds (" << r.min()
+              << " - " << r.max() << ")")
+}
+
+std::string BenchApplication::scratchFilename(TerrainLOD lod,
+                                              const std::string & ext) const {
+    std::ostringstream ss;
+    ss << cacheDirectory() << "terrainosaurus-bench ("
+       << metersPerSampleForLOD(lod) << "m)." << ext;
+    return ss.str();
+}
+
+void BenchApplication::writeJSON(std::ostream & os) const {
+    os << std::setprecision(9)
+       << "{\n"
+       << "  \"program\": \"terrainosaurus-bench\",\n"
+       << "  \"threads\": " << WorkerPool::instance().workerCount() << ",\n"
+       << "  \"repeats\": " << _repeats << ",\n"
+       << "  \"seed\": " << _seed << ",\n"
+       << "  \"extent_m\": " << EXTENT << ",\n"
+       << "  \"population\": " << heightfieldGAPopulationSize() << ",\n"
+       << "  \"results\": [";
+    for (IndexType i = 0; i < IndexType(_results.size()); ++i) {
+        const Result & r = _results[i];
+        os << (i == 0 ? "\n" : ",\n")
+           << "    { \"name\": \"" << r.name << "\", \"lod\": \"" << r.lod
+           << "\", \"cells\": " << r.cells
+           << ", \"runs\": " << r.seconds.size()
+           << ", \"min_s\": " << r.min()
+           << ", \"median_s\": " << r.median()
+           << ", \"mean_s\": " << r.mean()
+           << ", \"max_s\": " << r.max() << " }";
+    }
+    os << "\n  ]\n}\n";
+}
+
+void BenchApplication::writeCSV(std::ostream & os) const {
+    os << std::setprecision(9)
+       << "name,lod,cells,runs,min_s,median_s,mean_s,max_s\n";
+    for (IndexType i = 0; i < IndexType(_results.size()); ++i) {
+        const Result & r = _results[i];
+        os << r.name << ',' << r.lod << ',' << r.cells << ','
+           << r.seconds.size() << ',' << r.min() << ',' << r.median() << ','
+           << r.mean() << ',' << r.max() << '\n';
+    }
+}
+
+
+// This macro expands to a main() function that instantiates the application
+// and launches it
+APPLICATION_MAIN(terrainosaurus::BenchApplication);
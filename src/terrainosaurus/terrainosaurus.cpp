@@ -0,0 +1,26 @@
+/**
+ * \file    terrainosaurus.cpp
+ *
+ * \author  Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes.
+ *
+ * Description:
+ *      This file contains the entry point for the interactive Terrainosaurus
+ *      application. It lives apart from the TerrainosaurusApplication class
+ *      so that other programs (e.g., terrainosaurus-batch and
+ *      terrainosaurus-bench) can link against that class and still provide
+ *      their own main().
+ */
+
+// Include precompiled header
+#include <terrainosaurus/precomp.h>
+
+// Import application class definition
+#include "TerrainosaurusApplication.hpp"
+
+
+// This macro expands to a main() function that instantiates the application
+// and launches it
+APPLICATION_MAIN(terrainosaurus::TerrainosaurusApplication);
@@ -309,49 +309,19 @@ void MapEditorWindowWidget::refineBoundary(Map::Edge & e, TerrainLOD targetLOD)
 
 
 void MapEditorWindowWidget::generateHeightfieldForView() {
-    // Create an IDMap of the appropriate size
-    IDMap ids(renderer().viewport().bounds());
-
-    // Render the map, sans decorations, with the terrain type as the color
-    // HACK--this should create an off-screen context, sized appropriately
-    // for the rendered region at its LOD. Right now, just using the screen
-    // view as the rendered area
-    _mapView->object()->renderFacesAsTerrainTypeIDs(true);
-    GL::glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-    GL::glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    GL::glBegin(GL_QUADS);
-        GL::glColor3ub(0, 0, 0x02);
-        GL::glVertex2i(-1000, -1000);
-        GL::glVertex2i(1000, -1000);
-        GL::glVertex2i(1000, 1000);
-        GL::glVertex2i(-1000, 1000);
-    GL::glEnd();
-    render();
-    _mapView->object()->renderFacesAsTerrainTypeIDs(false);
-    
-    // Copy the framebuffer into it
-    GL::glReadBuffer(GL_BACK);
-    GL::glReadPixels(ids.base(0), ids.base(1),
-                     ids.size(0), ids.size(1),
-                     GL_RGBA, GL_UNSIGNED_BYTE, ids.elements());
-
-    // Decode "colors" back to terrain types
-    for (IndexType y = ids.base(1); y <= ids.extent(1); ++y)
-        for (IndexType x = ids.base(0); x <= ids.extent(0); ++x) {
-            IDType id = ids(x, y);
-            ids(x, y) = (id & 0xFF0000) >> 16
-                      | (id & 0x00FF00)
-                      | (id & 0x0000FF) << 16;
-        }
+    // Scan-convert the whole map on the CPU. Unlike reading back the
+    // framebuffer, this doesn't depend on the window size, or on what's
+    // currently on the screen.
+    MapRasterizationPtr mr(new MapRasterization(_map));
+    (*mr)[LOD_30m].ensureLoaded();
 
     TerrainosaurusApplication & app = TerrainosaurusApplication::instance();
 #if 1
     // Generate a base terrain from it
-    MapRasterizationPtr mr(new MapRasterization(ids, LOD_30m,
-                                                _map->terrainLibrary()));
     app.createTerrainSampleWindow(mr);
 #else
     // Display it as greyscale
+    const IDMap & ids = (*mr)[LOD_30m].terrainTypeIDs();
     Heightfield tmp(ids.bounds());
     for (IndexType y = ids.base(1); y <= ids.extent(1); ++y)
         for (IndexType x = ids.base(0); x <= ids.extent(0); ++x)
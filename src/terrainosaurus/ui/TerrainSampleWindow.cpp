@@ -151,6 +151,18 @@ public:
         _terrainSample = ts;
         _heightfieldGA.setPatternSample(ps);
         _heightfieldGA.setTerrainSample(ts);
+
+        // The GUI is blocked while the GA preloads the terrain library, so
+        // the console is the only place we can show how it's going
+        int lastStep = -1;
+        _heightfieldGA.setPreloadProgressCallback(
+                [lastStep](const TerrainPrefetcher::Progress & p) mutable {
+            int step = int(20 * p.fraction());      // Every 5%
+            if (step != lastStep) {
+                INCA_INFO("Preloading terrain library: " << p)
+                lastStep = step;
+            }
+        });
         _multiplexor->selectWidget("Terrain View");
         
         // Choose the best LOD to start with
@@ -0,0 +1,48 @@
+/*
+ * File: ContentHash.cpp
+ *
+ * Author: Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes.
+ *
+ * Description:
+ */
+
+// Include precompiled header
+#include <terrainosaurus/precomp.h>
+
+// Import function prototypes and class definitions
+#include "ContentHash.hpp"
+
+// Import file-related exception definitions
+#include <inca/io/FileExceptions.hpp>
+
+// Import file stream definitions
+#include <fstream>
+
+using namespace terrainosaurus;
+
+
+std::uint64_t terrainosaurus::hashFile(const std::string & filename) {
+    std::ifstream file(filename.c_str(), std::ios::binary);
+    if (! file) {
+        inca::io::FileAccessException e(filename);
+        e << "Unable to read file [" << filename << "] for hashing";
+        throw e;
+    }
+
+    // Hash it a chunk at a time, so we don't need the whole thing in memory
+    ContentHash hash;
+    std::vector<char> buffer(1 << 20);
+    while (file) {
+        file.read(&buffer[0], buffer.size());
+        hash(&buffer[0], SizeType(file.gcount()));
+    }
+    if (file.bad()) {
+        inca::io::FileAccessException e(filename);
+        e << "Error while reading file [" << filename << "] for hashing";
+        throw e;
+    }
+    return hash.value();
+}
@@ -0,0 +1,97 @@
+/** -*- C++ -*-
+ *
+ * \file    ContentHash.hpp
+ *
+ * \author  Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes only.
+ *
+ * Description:
+ *      The ContentHash class computes a 64-bit fingerprint of a stream of
+ *      bytes, fed to it piece by piece. It is used to decide whether a cached
+ *      result is still current: two fingerprints are equal if (with
+ *      overwhelming probability) the same data went into both.
+ *
+ *      The hashFile() function fingerprints the entire contents of a file.
+ *
+ * Implementation notes:
+ *      This uses 64-bit FNV-1a, which is plenty good for detecting changes
+ *      (it is NOT a cryptographic hash), and is simple and fast enough to
+ *      run over a full-size DEM every time a cache is checked.
+ *
+ *      Values are hashed using their in-memory representation, so
+ *      fingerprints are only comparable between machines with the same byte
+ *      order (as with the analysis cache files themselves).
+ */
+
+#ifndef TERRAINOSAURUS_UTIL_CONTENT_HASH
+#define TERRAINOSAURUS_UTIL_CONTENT_HASH
+
+// Import library configuration
+#include <terrainosaurus/terrainosaurus-common.h>
+
+// Import fixed-size integer & container definitions
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// This is part of the Terrainosaurus terrain generation engine
+namespace terrainosaurus {
+    // Forward declarations
+    class ContentHash;
+
+    // Fingerprint the contents of a file. Throws
+    // inca::io::FileAccessException if the file can't be read.
+    std::uint64_t hashFile(const std::string & filename);
+};
+
+
+class terrainosaurus::ContentHash {
+/*---------------------------------------------------------------------------*
+ | Constructor
+ *---------------------------------------------------------------------------*/
+public:
+    ContentHash() : _value(offsetBasis) { }
+
+
+/*---------------------------------------------------------------------------*
+ | Hashing functions
+ *---------------------------------------------------------------------------*/
+public:
+    // Add a block of raw bytes
+    ContentHash & operator()(void const * data, SizeType length) {
+        unsigned char const * p = static_cast<unsigned char const *>(data);
+        for (SizeType i = 0; i < length; ++i) {
+            _value ^= p[i];
+            _value *= prime;
+        }
+        return *this;
+    }
+
+    // Add a single (plain-old-data) value
+    template <typename T>
+    ContentHash & operator()(const T & value) {
+        return (*this)(&value, sizeof(T));
+    }
+
+    // Add each element of a vector (and how many there were)
+    template <typename T>
+    ContentHash & operator()(const std::vector<T> & values) {
+        (*this)(std::uint64_t(values.size()));
+        for (IndexType i = 0; i < IndexType(values.size()); ++i)
+            (*this)(values[i]);
+        return *this;
+    }
+
+    // The fingerprint of everything added so far
+    std::uint64_t value() const { return _value; }
+
+protected:
+    static const std::uint64_t offsetBasis = 14695981039346656037ULL;
+    static const std::uint64_t prime       = 1099511628211ULL;
+
+    std::uint64_t _value;
+};
+
+#endif
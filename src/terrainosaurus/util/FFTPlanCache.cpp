@@ -0,0 +1,154 @@
+/*
+ * File: FFTPlanCache.cpp
+ *
+ * Author: Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes.
+ *
+ * Description:
+ */
+
+// Include precompiled header
+#include <terrainosaurus/precomp.h>
+
+// Import class definition
+#include "FFTPlanCache.hpp"
+
+// Import FFTW
+#include <fftw3.h>
+
+// Import math & memory functions
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+using namespace terrainosaurus;
+
+
+// Local helper functions
+namespace {
+    // A buffer allocated by FFTW (and so aligned the way FFTW wants)
+    template <typename T>
+    struct FFTWBuffer {
+        explicit FFTWBuffer(SizeType n)
+            : data(static_cast<T *>(fftwf_malloc(n * sizeof(T)))) { }
+        ~FFTWBuffer() { fftwf_free(data); }
+        T * data;
+    private:
+        FFTWBuffer(const FFTWBuffer &);
+        FFTWBuffer & operator=(const FFTWBuffer &);
+    };
+}
+
+
+// The application-wide plan cache
+FFTPlanCache & FFTPlanCache::instance() {
+    static FFTPlanCache cache;
+    return cache;
+}
+
+
+// Constructor
+FFTPlanCache::FFTPlanCache() : _threads(1) {
+#ifdef TERRAINOSAURUS_FFTW_THREADS
+    fftwf_init_threads();
+#endif
+}
+
+// Destructor
+FFTPlanCache::~FFTPlanCache() {
+    _clear();
+}
+
+
+// Calculate |DFT(hf)| for the non-negative half of dimension 0
+void FFTPlanCache::magnitudeSpectrum(std::vector<float> & magnitudes,
+                                     const Heightfield & hf) {
+    SizeType width  = hf.size(0),
+             height = hf.size(1),
+             half   = width / 2 + 1;
+    magnitudes.resize(half * height);
+    if (width == 0 || height == 0)
+        return;
+
+    fftwf_plan plan = _plan(width, height);
+
+    // Copy the elevations into an aligned buffer, and transform them
+    FFTWBuffer<float>           in(width * height);
+    FFTWBuffer<fftwf_complex>   out(half * height);
+    std::memcpy(in.data, hf.elements(), width * height * sizeof(float));
+    fftwf_execute_dft_r2c(plan, in.data, out.data);
+
+    for (SizeType i = 0; i < half * height; ++i)
+        magnitudes[i] = std::sqrt(out.data[i][0] * out.data[i][0]
+                                + out.data[i][1] * out.data[i][1]);
+}
+
+
+// Find the plan for this shape, making it if this is the first time
+fftwf_plan FFTPlanCache::_plan(SizeType width, SizeType height) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    PlanMap::const_iterator it = _plans.find(Shape(width, height));
+    if (it != _plans.end())
+        return it->second;
+
+    // Since this plan will be used many times, it's worth letting FFTW
+    // measure what's fastest. Measuring scribbles on the arrays, so we give
+    // it its own. FFTW's dimensions are slowest-varying first.
+    INCA_DEBUG("Planning " << width << "x" << height << " FFT")
+    FFTWBuffer<float>           in(width * height);
+    FFTWBuffer<fftwf_complex>   out((width / 2 + 1) * height);
+#ifdef TERRAINOSAURUS_FFTW_THREADS
+    fftwf_plan_with_nthreads(int(_threads));
+#endif
+    fftwf_plan plan = fftwf_plan_dft_r2c_2d(int(height), int(width),
+                                            in.data, out.data, FFTW_MEASURE);
+    _plans[Shape(width, height)] = plan;
+    return plan;
+}
+
+// Throw away all the plans (which is only safe once no transforms are using
+// them, i.e., when the cache is destroyed)
+void FFTPlanCache::_clear() {
+    for (PlanMap::iterator it = _plans.begin(); it != _plans.end(); ++it)
+        fftwf_destroy_plan(it->second);
+    _plans.clear();
+    for (SizeType i = 0; i < _replaced.size(); ++i)
+        fftwf_destroy_plan(_replaced[i]);
+    _replaced.clear();
+}
+
+
+// Cache statistics
+SizeType FFTPlanCache::planCount() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _plans.size();
+}
+
+
+// Multithreaded transforms
+SizeType FFTPlanCache::threadCount() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _threads;
+}
+void FFTPlanCache::setThreadCount(SizeType n) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    n = std::max(n, SizeType(1));
+    if (! threadingSupported() || n == _threads)
+        return;
+    // Existing plans were made for the old thread count, so we'll make new
+    // ones. Transforms in progress may still be using the old ones, though,
+    // so we keep them around until the end.
+    for (PlanMap::iterator it = _plans.begin(); it != _plans.end(); ++it)
+        _replaced.push_back(it->second);
+    _plans.clear();
+    _threads = n;
+}
+bool FFTPlanCache::threadingSupported() {
+#ifdef TERRAINOSAURUS_FFTW_THREADS
+    return true;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,123 @@
+/** -*- C++ -*-
+ *
+ * \file    FFTPlanCache.hpp
+ *
+ * \author  Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes only.
+ *
+ * Description:
+ *      The FFTPlanCache class computes Fourier transforms of heightfields
+ *      using FFTW, keeping the FFTW "plan" for each raster shape it has seen,
+ *      so that the (expensive) planning is done only once per shape, rather
+ *      than once per transform. Since a run of the GA analyzes many
+ *      heightfields of just a few different sizes (one per LOD), nearly every
+ *      transform reuses an existing plan.
+ *
+ *      Heightfields are real-valued, so their transforms are conjugate-
+ *      symmetric, and only about half of each transform need be calculated
+ *      (and stored): the part with non-negative frequencies in dimension 0.
+ *      For a heightfield of W x H cells, the transform is therefore
+ *      (W / 2 + 1) x H complex values, with dimension 0 varying fastest.
+ *      Any rectangular size is allowed.
+ *
+ *      By default, each transform runs on a single thread (several
+ *      transforms may run at once, though). If Terrainosaurus is built with
+ *      TERRAINOSAURUS_FFTW_THREADS defined (and linked with the threaded
+ *      FFTW library), setThreadCount() allows each transform to be split
+ *      across several threads.
+ *
+ * Implementation notes:
+ *      FFTW's planner is not thread-safe, but executing an existing plan is,
+ *      so planning is done under a lock, and transforms are run with FFTW's
+ *      "new-array" execute functions on buffers belonging to the caller. All
+ *      buffers are allocated with fftwf_malloc, so they have the alignment
+ *      the plans were made for.
+ *
+ *      A plan is used outside the lock, after _plan() returns it, so there's
+ *      no telling when the last transform using it finishes. Plans replaced
+ *      by setThreadCount() are therefore kept, unused, until the cache
+ *      itself goes away. (Destroying a plan must also be serialized with the
+ *      planner, so it can't be left to whichever transform finishes last.)
+ */
+
+#ifndef TERRAINOSAURUS_UTIL_FFT_PLAN_CACHE
+#define TERRAINOSAURUS_UTIL_FFT_PLAN_CACHE
+
+// Import library configuration
+#include <terrainosaurus/terrainosaurus-common.h>
+
+// Import container & threading definitions
+#include <map>
+#include <vector>
+#include <utility>
+#include <mutex>
+
+// FFTW's plan handle (so that we don't need to include fftw3.h here)
+struct fftwf_plan_s;
+
+// This is part of the Terrainosaurus terrain generation engine
+namespace terrainosaurus {
+    // Forward declarations
+    class FFTPlanCache;
+};
+
+
+class terrainosaurus::FFTPlanCache {
+/*---------------------------------------------------------------------------*
+ | Access to the application-wide cache
+ *---------------------------------------------------------------------------*/
+public:
+    static FFTPlanCache & instance();
+
+
+/*---------------------------------------------------------------------------*
+ | Constructor & destructor
+ *---------------------------------------------------------------------------*/
+public:
+    explicit FFTPlanCache();
+    ~FFTPlanCache();
+
+
+/*---------------------------------------------------------------------------*
+ | Transforms
+ *---------------------------------------------------------------------------*/
+public:
+    // Calculate the magnitude of the DFT of 'hf', for the non-negative half
+    // of dimension 0. 'magnitudes' is resized to (W / 2 + 1) x H values,
+    // dimension 0 varying fastest. The remaining magnitudes follow from
+    // |F(u, v)| = |F(W - u, (H - v) mod H)|.
+    void magnitudeSpectrum(std::vector<float> & magnitudes,
+                           const Heightfield & hf);
+
+    // How many distinct shapes we have plans for
+    SizeType planCount() const;
+
+    // How many threads each transform may use. Changing this replaces the
+    // existing plans (they were made for the old thread count), but the old
+    // ones are kept until the cache is destroyed, since transforms already
+    // in progress may still be using them. So it's safe to change at any
+    // time, though it's best done at startup. This has no effect unless
+    // Terrainosaurus was built with threaded FFTW support.
+    SizeType threadCount() const;
+    void setThreadCount(SizeType n);
+    static bool threadingSupported();
+
+protected:
+    // Find (or make) the plan for a W x H real-to-complex transform
+    fftwf_plan_s * _plan(SizeType width, SizeType height);
+
+    // Throw away all plans, current and replaced
+    void _clear();
+
+    typedef std::pair<SizeType, SizeType>       Shape;
+    typedef std::map<Shape, fftwf_plan_s *>     PlanMap;
+
+    PlanMap             _plans;
+    std::vector<fftwf_plan_s *> _replaced;  // Old plans, maybe still in use
+    SizeType            _threads;
+    mutable std::mutex  _mutex;
+};
+
+#endif
@@ -0,0 +1,219 @@
+/*
+ * File: Trace.cpp
+ *
+ * Author: Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes.
+ *
+ * Description:
+ */
+
+// Include precompiled header
+#include <terrainosaurus/precomp.h>
+
+// Import class definitions
+#include "Trace.hpp"
+
+// Import file-related exception definitions
+#include <inca/io/FileExceptions.hpp>
+
+// Import stream definitions
+#include <fstream>
+#include <iomanip>
+
+using namespace terrainosaurus;
+
+
+// Local helper functions
+namespace {
+    // Write 's' as a quoted JSON string
+    void writeJSONString(std::ostream & os, const std::string & s) {
+        os << '"';
+        for (std::string::const_iterator it = s.begin(); it != s.end(); ++it) {
+            unsigned char c = *it;
+            switch (c) {
+            case '"':   os << "\\\"";   break;
+            case '\\':  os << "\\\\";   break;
+            case '\n':  os << "\\n";    break;
+            case '\t':  os << "\\t";    break;
+            case '\r':  os << "\\r";    break;
+            default:
+                if (c < 0x20) {
+                    char fill = os.fill('0');
+                    os << "\\u" << std::hex << std::setw(4) << int(c) << std::dec;
+                    os.fill(fill);
+                } else {
+                    os << char(c);
+                }
+            }
+        }
+        os << '"';
+    }
+
+    // Microseconds from 'epoch' to 't'
+    double microseconds(Tracer::Clock::time_point epoch,
+                        Tracer::Clock::time_point t) {
+        return std::chrono::duration<double, std::micro>(t - epoch).count();
+    }
+
+    // Whether a formatted number is something JSON can represent
+    bool isJSONNumber(const std::string & s) {
+        return ! s.empty() && s.find_first_of("niNI") == std::string::npos;
+    }
+}
+
+
+/*---------------------------------------------------------------------------*
+ | Tracer implementation
+ *---------------------------------------------------------------------------*/
+std::atomic<bool> Tracer::_enabled(false);
+
+// Access to the application-wide tracer
+Tracer & Tracer::instance() {
+    static Tracer tracer;
+    return tracer;
+}
+
+// Constructor
+Tracer::Tracer() : _epoch(Clock::now()) { }
+
+
+// Recording
+void Tracer::setEnabled(bool e) {
+    _enabled.store(e, std::memory_order_relaxed);
+}
+
+void Tracer::record(const char * name, const char * category,
+                    Clock::time_point begin, Clock::time_point end,
+                    const std::string & arguments) {
+    ThreadLog & log = _threadLog();
+    Event ev;
+    ev.name      = name;
+    ev.category  = category;
+    ev.begin     = begin;
+    ev.end       = end;
+    ev.arguments = arguments;
+    std::lock_guard<std::mutex> lock(log.mutex);
+    log.events.push_back(ev);
+}
+
+void Tracer::setThreadName(const std::string & name) {
+    ThreadLog & log = _threadLog();
+    std::lock_guard<std::mutex> lock(log.mutex);
+    log.name = name;
+}
+
+void Tracer::clear() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (IndexType i = 0; i < IndexType(_logs.size()); ++i) {
+        std::lock_guard<std::mutex> logLock(_logs[i]->mutex);
+        _logs[i]->events.clear();
+    }
+}
+
+SizeType Tracer::eventCount() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    SizeType count = 0;
+    for (IndexType i = 0; i < IndexType(_logs.size()); ++i) {
+        std::lock_guard<std::mutex> logLock(_logs[i]->mutex);
+        count += _logs[i]->events.size();
+    }
+    return count;
+}
+
+// The calling thread's log. Each thread finds its own log without locking
+// after the first time.
+Tracer::ThreadLog & Tracer::_threadLog() {
+    static thread_local ThreadLog * threadLog = NULL;
+    if (! threadLog) {
+        ThreadLogPtr log(new ThreadLog());
+        std::lock_guard<std::mutex> lock(_mutex);
+        log->id = IndexType(_logs.size()) + 1;
+        std::ostringstream name;
+        name << "thread " << log->id;
+        log->name = name.str();
+        _logs.push_back(log);
+        threadLog = log.get();
+    }
+    return *threadLog;
+}
+
+
+// Output
+void Tracer::writeChromeTrace(std::ostream & os) const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::ios::fmtflags flags = os.flags();
+    std::streamsize precision = os.precision();
+    os << std::fixed << std::setprecision(3);
+
+    os << "{\"traceEvents\":[";
+    bool first = true;
+    for (IndexType i = 0; i < IndexType(_logs.size()); ++i) {
+        ThreadLog & log = *_logs[i];
+        std::lock_guard<std::mutex> logLock(log.mutex);
+
+        // Label the thread...
+        os << (first ? "\n" : ",\n")
+           << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+           << log.id << ",\"args\":{\"name\":";
+        writeJSONString(os, log.name);
+        os << "}}";
+        first = false;
+
+        //...then write out everything it did, as "complete" events
+        for (IndexType j = 0; j < IndexType(log.events.size()); ++j) {
+            const Event & ev = log.events[j];
+            os << ",\n{\"name\":";
+            writeJSONString(os, ev.name);
+            os << ",\"cat\":";
+            writeJSONString(os, ev.category);
+            os << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << log.id
+               << ",\"ts\":"  << microseconds(_epoch, ev.begin)
+               << ",\"dur\":" << microseconds(ev.begin, ev.end);
+            if (! ev.arguments.empty())
+                os << ",\"args\":{" << ev.arguments << '}';
+            os << '}';
+        }
+    }
+    os << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+    os.flags(flags);
+    os.precision(precision);
+}
+
+void Tracer::writeChromeTrace(const std::string & filename) const {
+    std::ofstream file(filename.c_str());
+    if (! file) {
+        inca::io::FileAccessException e(filename);
+        e << "Unable to write trace file [" << filename
+          << "]: check directory/file permissions";
+        throw e;
+    }
+    writeChromeTrace(file);
+    file.close();
+    if (! file) {
+        inca::io::FileAccessException e(filename);
+        e << "Error while writing trace file [" << filename << ']';
+        throw e;
+    }
+    INCA_INFO("[" << filename << "]: wrote " << eventCount() << " trace events")
+}
+
+
+/*---------------------------------------------------------------------------*
+ | TraceSpan implementation
+ *---------------------------------------------------------------------------*/
+void TraceSpan::_addArgument(const char * key, const std::string & value,
+                             bool numeric) {
+    std::ostringstream ss;
+    if (! _arguments.empty())
+        ss << ',';
+    writeJSONString(ss, key);
+    ss << ':';
+    if (numeric && isJSONNumber(value))
+        ss << value;
+    else
+        writeJSONString(ss, value);
+    _arguments += ss.str();
+}
@@ -0,0 +1,229 @@
+/** -*- C++ -*-
+ *
+ * \file    Trace.hpp
+ *
+ * \author  Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes only.
+ *
+ * Description:
+ *      The Tracer class records a timeline of "spans" (named, timed pieces
+ *      of work, like analyzing one TerrainSample LOD, or one generation's
+ *      crossover step) on every thread, and writes them out in the Chrome
+ *      trace-event JSON format, so that a run may be inspected visually
+ *      (e.g., with chrome://tracing or Perfetto) or aggregated by a script.
+ *      There is one application-wide tracer (Tracer::instance()), which
+ *      starts out disabled.
+ *
+ *      Spans are normally recorded with a TraceSpan, which times the scope
+ *      in which it is declared:
+ *
+ *          TraceSpan span("analyze", "data");
+ *          if (span)
+ *              span.setArgument("sample", name());
+ *
+ *      Spans on the same thread nest according to their times, so a span
+ *      opened inside another one shows up beneath it in the viewer. Work
+ *      whose beginning and end aren't in the same scope may be recorded
+ *      directly with Tracer::record().
+ *
+ * Implementation notes:
+ *      Tracing must be cheap enough to leave in the hot paths. When it is
+ *      disabled, a TraceSpan costs one relaxed atomic load (no clock is
+ *      read, and nothing is allocated), and arguments are only formatted
+ *      when the span is active (hence the "if (span)" idiom above).
+ *
+ *      When it is enabled, each thread appends to its own event log, so
+ *      threads don't contend with one another. The logs belong to the
+ *      tracer (not to their threads), so the events from a worker thread
+ *      that has since exited are still written out.
+ *
+ *      The name and category of a span must be string literals (or at
+ *      least outlive the tracer), since only the pointers are stored.
+ */
+
+#ifndef TERRAINOSAURUS_UTIL_TRACE
+#define TERRAINOSAURUS_UTIL_TRACE
+
+// Import library configuration
+#include <terrainosaurus/terrainosaurus-common.h>
+
+// Import container, threading & time definitions
+#include <string>
+#include <sstream>
+#include <iosfwd>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <type_traits>
+
+// This is part of the Terrainosaurus terrain generation engine
+namespace terrainosaurus {
+    // Forward declarations
+    class Tracer;
+    class TraceSpan;
+};
+
+
+class terrainosaurus::Tracer {
+/*---------------------------------------------------------------------------*
+ | Type definitions
+ *---------------------------------------------------------------------------*/
+public:
+    typedef std::chrono::steady_clock   Clock;
+
+protected:
+    // One finished span
+    struct Event {
+        const char *        name;
+        const char *        category;
+        Clock::time_point   begin, end;
+        std::string         arguments;      // JSON members, or empty
+    };
+
+    // Everything recorded by one thread
+    struct ThreadLog {
+        IndexType           id;             // Small, sequential thread ID
+        std::string         name;           // What to call the thread
+        std::vector<Event>  events;
+        std::mutex          mutex;          // Held while appending/writing
+    };
+    typedef std::shared_ptr<ThreadLog>  ThreadLogPtr;
+
+
+/*---------------------------------------------------------------------------*
+ | Access to the application-wide tracer
+ *---------------------------------------------------------------------------*/
+public:
+    static Tracer & instance();
+
+    // Whether spans are being recorded. This is checked on every span, so
+    // it's kept out here where it can be inlined.
+    static bool enabled() {
+        return _enabled.load(std::memory_order_relaxed);
+    }
+
+
+/*---------------------------------------------------------------------------*
+ | Constructor
+ *---------------------------------------------------------------------------*/
+protected:
+    explicit Tracer();
+
+
+/*---------------------------------------------------------------------------*
+ | Recording
+ *---------------------------------------------------------------------------*/
+public:
+    // Start/stop recording spans. Spans already open when tracing is
+    // enabled are not recorded.
+    void setEnabled(bool e);
+
+    // Record a finished span on the calling thread. 'arguments' is a list of
+    // comma-separated JSON object members (see TraceSpan::setArgument()).
+    void record(const char * name, const char * category,
+                Clock::time_point begin, Clock::time_point end,
+                const std::string & arguments = std::string());
+
+    // Give the calling thread a name (shown in place of its ID)
+    void setThreadName(const std::string & name);
+
+    // Throw away everything recorded so far
+    void clear();
+
+    // How many spans have been recorded
+    SizeType eventCount() const;
+
+
+/*---------------------------------------------------------------------------*
+ | Output
+ *---------------------------------------------------------------------------*/
+public:
+    // Write everything recorded so far as a Chrome trace-event JSON object,
+    // with times in microseconds since the tracer was created
+    void writeChromeTrace(std::ostream & os) const;
+
+    // Same thing, but to a file (throws a FileAccessException if the file
+    // can't be written)
+    void writeChromeTrace(const std::string & filename) const;
+
+protected:
+    // The calling thread's log (created the first time it's needed)
+    ThreadLog & _threadLog();
+
+    static std::atomic<bool>    _enabled;
+
+    Clock::time_point           _epoch;     // Time zero in the output
+    std::vector<ThreadLogPtr>   _logs;      // One per thread (guarded by _mutex)
+    mutable std::mutex          _mutex;
+};
+
+
+class terrainosaurus::TraceSpan {
+/*---------------------------------------------------------------------------*
+ | Constructor & destructor
+ *---------------------------------------------------------------------------*/
+public:
+    // Start timing (if tracing is enabled)
+    explicit TraceSpan(const char * name, const char * category)
+        : _name(name), _category(category), _active(Tracer::enabled()) {
+        if (_active)
+            _begin = Tracer::Clock::now();
+    }
+
+    // Stop timing and record the span (unless it was already ended)
+    ~TraceSpan() {
+        if (_active)
+            end();
+    }
+
+private:
+    // Spans can't be copied (they'd be recorded twice)
+    TraceSpan(const TraceSpan &);
+    TraceSpan & operator=(const TraceSpan &);
+
+
+/*---------------------------------------------------------------------------*
+ | Span properties
+ *---------------------------------------------------------------------------*/
+public:
+    // Whether this span is being recorded
+    bool active() const { return _active; }
+    explicit operator bool() const { return _active; }
+
+    // Attach a named value to the span. Numbers and bools are written as
+    // JSON numbers and bools, and anything else as a JSON string (formatted
+    // with <<). Does nothing if the span isn't active.
+    template <typename T>
+    void setArgument(const char * key, const T & value) {
+        if (! _active)
+            return;
+        std::ostringstream ss;
+        ss << std::boolalpha << value;
+        _addArgument(key, ss.str(), std::is_arithmetic<T>::value);
+    }
+
+    // Stop timing early and record the span
+    void end() {
+        if (! _active)
+            return;
+        _active = false;
+        Tracer::instance().record(_name, _category, _begin,
+                                  Tracer::Clock::now(), _arguments);
+    }
+
+protected:
+    void _addArgument(const char * key, const std::string & value,
+                      bool numeric);
+
+    const char *                _name;
+    const char *                _category;
+    bool                        _active;
+    Tracer::Clock::time_point   _begin;
+    std::string                 _arguments;
+};
+
+#endif
@@ -0,0 +1,198 @@
+/*
+ * File: WorkerPool.cpp
+ *
+ * Author: Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes.
+ *
+ * Description:
+ */
+
+// Include precompiled header
+#include <terrainosaurus/precomp.h>
+
+// Import class definition
+#include "WorkerPool.hpp"
+
+// Import tracing support (to label the worker threads)
+#include "Trace.hpp"
+
+// Import time definitions
+#include <chrono>
+
+using namespace terrainosaurus;
+
+
+/*---------------------------------------------------------------------------*
+ | WorkerPool implementation
+ *---------------------------------------------------------------------------*/
+// Access to the application-wide pool
+WorkerPool & WorkerPool::instance() {
+    static WorkerPool pool;
+    return pool;
+}
+
+// Constructor
+WorkerPool::WorkerPool(SizeType workers) : _stopping(false) {
+    setWorkerCount(workers);
+}
+
+// Destructor
+WorkerPool::~WorkerPool() {
+    _stop();
+}
+
+// Worker count (including the thread that submits work)
+SizeType WorkerPool::workerCount() const {
+    return _threads.size() + 1;
+}
+void WorkerPool::setWorkerCount(SizeType n) {
+    // Zero means "as many as the hardware supports"
+    if (n == 0)
+        n = std::max(std::thread::hardware_concurrency(), 1u);
+
+    if (n == workerCount())
+        return;
+
+    INCA_INFO("WorkerPool: using " << n << " worker thread(s)")
+    _stop();
+    _start(n - 1);
+}
+
+void WorkerPool::_start(SizeType threads) {
+    _stopping = false;
+    for (SizeType i = 0; i < threads; ++i)
+        _threads.push_back(std::thread(&WorkerPool::_workerLoop, this,
+                                       IndexType(i + 1)));
+}
+
+void WorkerPool::_stop() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _wakeup.notify_all();
+    for (SizeType i = 0; i < _threads.size(); ++i)
+        _threads[i].join();
+    _threads.clear();
+
+    // Anything left in the queue gets run right here
+    while (runPendingTask()) { }
+}
+
+void WorkerPool::_workerLoop(IndexType index) {
+    std::ostringstream name;
+    name << "worker " << index;
+    Tracer::instance().setThreadName(name.str());
+
+    while (true) {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _wakeup.wait(lock, [this]() {
+                return _stopping || ! _queue.empty();
+            });
+            if (_queue.empty())     // Then we must be stopping
+                return;
+            task = _queue.front();
+            _queue.pop_front();
+        }
+        task();
+    }
+}
+
+
+// Task execution
+void WorkerPool::submit(const Task & t) {
+    // With no background threads, there's nobody else to run it
+    if (_threads.empty()) {
+        t();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _queue.push_back(t);
+    }
+    _wakeup.notify_one();
+}
+
+bool WorkerPool::runPendingTask() {
+    Task task;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_queue.empty())
+            return false;
+        task = _queue.front();
+        _queue.pop_front();
+    }
+    task();
+    return true;
+}
+
+
+/*---------------------------------------------------------------------------*
+ | TaskGroup implementation
+ *---------------------------------------------------------------------------*/
+// Constructor
+TaskGroup::TaskGroup(WorkerPool & pool) : _pool(pool), _pending(0) { }
+
+// Destructor
+TaskGroup::~TaskGroup() {
+    _waitForAll();
+}
+
+// Submit a task to the pool as part of this group
+void TaskGroup::run(const WorkerPool::Task & t) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        ++_pending;
+    }
+
+    _pool.submit([this, t]() {
+        std::exception_ptr error;
+        try {
+            t();
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (error && ! _error)
+            _error = error;
+        if (--_pending == 0)
+            _finished.notify_all();
+    });
+}
+
+// Wait for all tasks in this group to finish
+void TaskGroup::wait() {
+    _waitForAll();
+
+    // Pass along the first error, if there was one
+    std::exception_ptr error;
+    std::swap(error, _error);
+    if (error)
+        std::rethrow_exception(error);
+}
+
+void TaskGroup::_waitForAll() {
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_pending == 0)
+                return;
+        }
+
+        // Rather than sitting idle, help with whatever is queued up. If
+        // there isn't anything, our tasks must be running elsewhere, so we
+        // nap until one of them finishes.
+        if (! _pool.runPendingTask()) {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _finished.wait_for(lock, std::chrono::milliseconds(1), [this]() {
+                return _pending == 0;
+            });
+        }
+    }
+}
@@ -0,0 +1,175 @@
+/** -*- C++ -*-
+ *
+ * \file    WorkerPool.hpp
+ *
+ * \author  Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes only.
+ *
+ * Description:
+ *      The WorkerPool class owns a fixed set of worker threads which execute
+ *      tasks (arbitrary function objects) taken from a shared queue. There is
+ *      one application-wide pool (accessible via WorkerPool::instance()),
+ *      whose size is set from the "worker threads" property in
+ *      terrainosaurus.conf.
+ *
+ *      Tasks are normally submitted through a TaskGroup, which keeps track
+ *      of a related set of tasks and allows the submitting thread to wait for
+ *      all of them to complete. The parallelFor() function uses a TaskGroup
+ *      to split a range of indices into chunks and process them in parallel.
+ *
+ * Implementation notes:
+ *      A thread waiting on a TaskGroup does not go to sleep while there is
+ *      still work in the queue. Instead, it "helps" by running queued tasks
+ *      itself. This makes it safe for a task to create and wait on a nested
+ *      TaskGroup (e.g., a parallel pass that is itself run concurrently with
+ *      other passes) without the risk of every worker blocking at once.
+ *
+ *      A worker count of 1 means "run everything on the calling thread", in
+ *      which case no threads are started and submitted tasks run immediately.
+ *      A worker count of 0 means "use one worker per hardware thread".
+ */
+
+#ifndef TERRAINOSAURUS_UTIL_WORKER_POOL
+#define TERRAINOSAURUS_UTIL_WORKER_POOL
+
+// Import library configuration
+#include <terrainosaurus/terrainosaurus-common.h>
+
+// Import threading & container definitions
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <deque>
+#include <vector>
+
+// This is part of the Terrainosaurus terrain generation engine
+namespace terrainosaurus {
+    // Forward declarations
+    class WorkerPool;
+    class TaskGroup;
+};
+
+
+class terrainosaurus::WorkerPool {
+/*---------------------------------------------------------------------------*
+ | Type definitions
+ *---------------------------------------------------------------------------*/
+public:
+    typedef std::function<void ()>  Task;
+
+
+/*---------------------------------------------------------------------------*
+ | Access to the application-wide pool
+ *---------------------------------------------------------------------------*/
+public:
+    static WorkerPool & instance();
+
+
+/*---------------------------------------------------------------------------*
+ | Constructors & destructor
+ *---------------------------------------------------------------------------*/
+public:
+    explicit WorkerPool(SizeType workers = 1);
+    ~WorkerPool();
+
+    // Worker count (including the thread that submits work)
+    SizeType workerCount() const;
+    void setWorkerCount(SizeType n);
+
+protected:
+    // Start/stop the background threads
+    void _start(SizeType threads);
+    void _stop();
+
+    // The function that each background thread runs ('index' counts from
+    // 1, and is only used to name the thread in traces)
+    void _workerLoop(IndexType index);
+
+
+/*---------------------------------------------------------------------------*
+ | Task execution
+ *---------------------------------------------------------------------------*/
+public:
+    // Add a task to the queue (or, if there are no background threads, just
+    // run it right now)
+    void submit(const Task & t);
+
+    // Run one queued task on the calling thread, if there are any. Returns
+    // true iff a task was run.
+    bool runPendingTask();
+
+protected:
+    std::vector<std::thread>    _threads;
+    std::deque<Task>            _queue;
+    std::mutex                  _mutex;
+    std::condition_variable     _wakeup;
+    bool                        _stopping;
+};
+
+
+class terrainosaurus::TaskGroup {
+/*---------------------------------------------------------------------------*
+ | Constructors & destructor
+ *---------------------------------------------------------------------------*/
+public:
+    explicit TaskGroup(WorkerPool & pool = WorkerPool::instance());
+
+    // Waits for any outstanding tasks (but does not rethrow their errors)
+    ~TaskGroup();
+
+
+/*---------------------------------------------------------------------------*
+ | Task execution
+ *---------------------------------------------------------------------------*/
+public:
+    // Submit a task to the pool as part of this group
+    void run(const WorkerPool::Task & t);
+
+    // Wait for all tasks in this group to finish. If any task threw an
+    // exception, the first such exception is rethrown here.
+    void wait();
+
+protected:
+    // Block until the pending count drops to zero
+    void _waitForAll();
+
+    WorkerPool &            _pool;
+    SizeType                _pending;
+    std::exception_ptr      _error;
+    std::mutex              _mutex;
+    std::condition_variable _finished;
+};
+
+
+// Parallel looping construct
+namespace terrainosaurus {
+    // Process the index range [begin, end) in parallel, by calling
+    // f(first, last) on consecutive, non-overlapping chunks [first, last),
+    // each (except possibly the last) having 'grain' indices.
+    template <typename Function>
+    void parallelFor(IndexType begin, IndexType end, SizeType grain,
+                     Function f) {
+        if (grain < 1)
+            grain = 1;
+
+        // Don't bother with the pool if there's only one chunk
+        if (end - begin <= IndexType(grain)) {
+            if (end > begin)
+                f(begin, end);
+            return;
+        }
+
+        TaskGroup group;
+        for (IndexType first = begin; first < end; first += IndexType(grain)) {
+            IndexType last = std::min(first + IndexType(grain), end);
+            group.run([f, first, last]() { f(first, last); });
+        }
+        group.wait();
+    }
+};
+
+#endif
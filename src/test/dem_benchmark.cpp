@@ -0,0 +1,115 @@
+/*
+ * File: dem_benchmark.cpp
+ *
+ * Author: Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes.
+ *
+ * Description:
+ *      This program measures how fast the DEMInterpreter can parse a DEM
+ *      file, both through a stream (the old way) and from a memory-mapped
+ *      file (the fast way), and checks that both produce the same raster.
+ *      The two are run alternately and the best time for each is reported,
+ *      along with whether the mapped path meets its 10x target.
+ */
+
+#include <terrainosaurus/io/DEMInterpreter.hpp>
+#include <terrainosaurus/io/MappedFile.hpp>
+using namespace terrainosaurus;
+
+#include <inca/util/Timer>
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstdlib>
+using namespace std;
+
+typedef inca::Timer<float, false> Timer;
+
+// How much faster the mapped path is supposed to be than the stream path
+const float TARGET_SPEEDUP = 10.0f;
+
+
+// Are these two rasters exactly the same?
+bool identical(const Heightfield & a, const Heightfield & b) {
+    if (a.size(0) != b.size(0) || a.size(1) != b.size(1))
+        return false;
+    for (IndexType i = a.base(0); i <= a.extent(0); ++i)
+        for (IndexType j = a.base(1); j <= a.extent(1); ++j)
+            if (a(i, j) != b(i, j))
+                return false;
+    return true;
+}
+
+int main(int argc, char **argv) {
+    // Gripe if we didn't get a .dem file
+    if (argc < 2) {
+        cerr << "Usage " << argv[0] << " <dem file> [iterations]\n";
+        return 1;
+    }
+    std::string filename(argv[1]);
+    int iterations = (argc > 2 ? atoi(argv[2]) : 10);
+    if (iterations < 1)
+        iterations = 1;
+
+    // How big is it?
+    SizeType bytes;
+    {
+        MappedFile file(filename);
+        bytes = file.size();
+    }
+
+    // Parse it both ways, alternately, keeping the fastest time for each.
+    // Alternating the two means they both see the same machine, and taking
+    // the best (rather than the mean) throws out the runs where something
+    // else got in the way.
+    Heightfield streamed, mapped;
+    float streamSec = 0.0f, mappedSec = 0.0f;
+    for (int i = 0; i < iterations; ++i) {
+        Timer streamTime;
+        streamTime.start(true);
+        {
+            DEMInterpreter dem(streamed);
+            std::ifstream file(filename.c_str());
+            dem.parse(file);
+        }
+        streamTime.stop();
+        if (i == 0 || streamTime() < streamSec)
+            streamSec = streamTime();
+
+        Timer mappedTime;
+        mappedTime.start(true);
+        {
+            DEMInterpreter dem(mapped);
+            dem.filename = filename;
+            dem.parse();
+        }
+        mappedTime.stop();
+        if (i == 0 || mappedTime() < mappedSec)
+            mappedSec = mappedTime();
+    }
+
+    // Report the results
+    float mb = bytes / (1024.0f * 1024.0f);
+    cerr << filename << ": " << bytes << " bytes, "
+         << mapped.size(0) << " x " << mapped.size(1) << " samples, "
+         << iterations << " iterations\n"
+         << "  stream: " << streamSec * 1000 << " ms ("
+                         << mb / streamSec << " MB/s)\n"
+         << "  mapped: " << mappedSec * 1000 << " ms ("
+                         << mb / mappedSec << " MB/s)\n"
+         << "  speedup: " << streamSec / mappedSec << "x (target "
+                          << TARGET_SPEEDUP << "x: "
+                          << (streamSec / mappedSec >= TARGET_SPEEDUP ? "met"
+                                                                      : "NOT met")
+                          << ")\n";
+
+    // Make sure the fast way is also the right way
+    if (! identical(streamed, mapped)) {
+        cerr << "  ERROR: mapped result differs from stream result\n";
+        return 1;
+    }
+    return 0;
+}
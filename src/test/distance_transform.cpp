@@ -0,0 +1,233 @@
+/*
+ * File: distance_transform.cpp
+ *
+ * Author: Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes.
+ *
+ * Description:
+ *      This program checks the Felzenszwalb-Huttenlocher distance transforms
+ *      in distance-transform.hpp against a brute-force one, which finds the
+ *      boundary cells and then measures the distance from every cell to
+ *      every one of them:
+ *
+ *          - the signed transform of an empty region (no cells have the ID)
+ *            and of a full one (all of them do), which have no boundary at
+ *            all, so every cell must be "far away" and have no nearest cell
+ *          - single-cell regions in the middle, on an edge and in a corner
+ *          - regions running along the edges of the map (whose edges are
+ *            not boundaries), and maps only one cell wide or high
+ *          - blobby maps with several IDs, for both the signed and unsigned
+ *            transforms, with bases other than zero, and big enough to be
+ *            split into several bands
+ *
+ *      The distances must be exactly the same, since both are square roots
+ *      of the same integers. Where several boundary cells are equally near,
+ *      either may be reported as the nearest, so the nearest cell is only
+ *      checked for being a boundary cell at the right distance.
+ *
+ *      It prints what it finds and returns non-zero if anything is off.
+ */
+
+#include <terrainosaurus/data/distance-transform.hpp>
+using namespace terrainosaurus;
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <limits>
+using namespace std;
+
+
+// How many checks have failed
+int failures = 0;
+
+// Report a measured error, and whether it is within tolerance
+void check(const char * what, double error, double tolerance) {
+    bool ok = (error <= tolerance);
+    cerr << (ok ? "  ok    " : "  FAIL  ") << what << ": " << error
+         << " (tolerance " << tolerance << ")\n";
+    if (! ok)
+        failures++;
+}
+
+// What a cell with no boundary anywhere should be given
+const scalar_t FAR_AWAY = numeric_limits<scalar_t>::max();
+
+// Whether two IDs are on the same side of a boundary (for the signed
+// transform of region 'id', or for the unsigned one if 'id' is negative)
+bool sameSide(IDType a, IDType b, IDType id, bool isSigned) {
+    return isSigned ? ((a == id) == (b == id)) : (a == b);
+}
+
+// Whether cell (i, j) (relative to the bases) is a boundary cell, by
+// looking at its 4-neighbors
+bool isBoundary(const IDMap & ids, IndexType i, IndexType j,
+                IDType id, bool isSigned) {
+    IndexType w = IndexType(ids.size(0)), h = IndexType(ids.size(1)),
+              b0 = ids.base(0), b1 = ids.base(1);
+    IDType c = ids(b0 + i, b1 + j);
+    return (i > 0     && ! sameSide(c, ids(b0 + i - 1, b1 + j), id, isSigned))
+        || (i < w - 1 && ! sameSide(c, ids(b0 + i + 1, b1 + j), id, isSigned))
+        || (j > 0     && ! sameSide(c, ids(b0 + i, b1 + j - 1), id, isSigned))
+        || (j < h - 1 && ! sameSide(c, ids(b0 + i, b1 + j + 1), id, isSigned));
+}
+
+// Run a transform and compare it with the brute-force one
+void testTransform(const char * what, const IDMap & ids,
+                   bool isSigned, IDType id = 0) {
+    cerr << what << " (" << ids.size(0) << " x " << ids.size(1) << ", "
+         << (isSigned ? "signed" : "unsigned") << ")\n";
+    DistanceField distances;
+    NearestCellMap nearest;
+    if (isSigned)   signedDistanceTransform(distances, ids, id, &nearest);
+    else            boundaryDistanceTransform(distances, ids, &nearest);
+
+    // Find all the boundary cells
+    IndexType w = IndexType(ids.size(0)), h = IndexType(ids.size(1)),
+              b0 = ids.base(0), b1 = ids.base(1);
+    vector<bool> boundary(w * h);
+    vector<IndexType> boundaryCells;
+    for (IndexType j = 0; j < h; ++j)
+        for (IndexType i = 0; i < w; ++i)
+            if (isBoundary(ids, i, j, id, isSigned)) {
+                boundary[i + j * w] = true;
+                boundaryCells.push_back(i + j * w);
+            }
+
+    // Then measure the distance from each cell to each of them
+    double worst = 0.0;
+    int wrongSign = 0, wrongNearest = 0;
+    for (IndexType j = 0; j < h; ++j)
+        for (IndexType i = 0; i < w; ++i) {
+            long long best = -1;
+            for (size_t k = 0; k < boundaryCells.size(); ++k) {
+                long long di = boundaryCells[k] % w - i,
+                          dj = boundaryCells[k] / w - j,
+                          d  = di * di + dj * dj;
+                if (best < 0 || d < best)
+                    best = d;
+            }
+            scalar_t expected = (best < 0) ? FAR_AWAY
+                                           : scalar_t(std::sqrt(double(best)));
+            scalar_t got = distances(b0 + i, b1 + j);
+            bool inside = ! isSigned || ids(b0 + i, b1 + j) == id;
+            if ((got < 0) == inside && got != 0)
+                wrongSign++;
+            worst = std::max(worst, double(std::abs(std::abs(got) - expected)));
+
+            // The nearest cell must be a boundary cell that far away (or
+            // nothing, if there are none)
+            IndexType cell = nearest(b0 + i, b1 + j);
+            if (cell < 0 || cell >= w * h) {
+                if (best >= 0)
+                    wrongNearest++;
+            } else {
+                long long di = cell % w - i, dj = cell / w - j;
+                if (! boundary[cell] || di * di + dj * dj != best)
+                    wrongNearest++;
+            }
+        }
+    check("  distance error", worst, 0.0);
+    check("  cells with the wrong sign", wrongSign, 0);
+    check("  cells with the wrong nearest cell", wrongNearest, 0);
+}
+
+// Make a 'width' x 'height' map starting at 'bases', full of 'fill'
+void blankMap(IDMap & ids, SizeType width, SizeType height, IDType fill,
+              IndexType base0 = 0, IndexType base1 = 0) {
+    ids.setBounds(IndexArray(base0, base1),
+                  IndexArray(base0 + IndexType(width) - 1,
+                             base1 + IndexType(height) - 1));
+    for (IndexType j = 0; j < IndexType(height); ++j)
+        for (IndexType i = 0; i < IndexType(width); ++i)
+            ids(base0 + i, base1 + j) = fill;
+}
+
+// Make a map of blobs around 'seeds' random points, each cell taking the ID
+// of the nearest one, with the occasional cell of a random ID thrown in
+void blobbyMap(IDMap & ids, SizeType width, SizeType height, int seeds,
+               IndexType base0, IndexType base1, std::mt19937 & random) {
+    blankMap(ids, width, height, 0, base0, base1);
+    vector<IndexType> x(seeds), y(seeds);
+    for (int k = 0; k < seeds; ++k) {
+        x[k] = IndexType(random() % width);
+        y[k] = IndexType(random() % height);
+    }
+    for (IndexType j = 0; j < IndexType(height); ++j)
+        for (IndexType i = 0; i < IndexType(width); ++i) {
+            int closest = 0;
+            long long best = -1;
+            for (int k = 0; k < seeds; ++k) {
+                long long d = (i - x[k]) * (i - x[k]) + (j - y[k]) * (j - y[k]);
+                if (best < 0 || d < best) {
+                    best = d;
+                    closest = k;
+                }
+            }
+            ids(base0 + i, base1 + j) = (random() % 50 == 0)
+                                            ? IDType(random() % seeds)
+                                            : IDType(closest);
+        }
+}
+
+int main(int argc, char **argv) {
+    std::mt19937 random(1);
+    IDMap ids;
+
+    // No boundary at all
+    blankMap(ids, 23, 17, 0);
+    testTransform("Empty region", ids, true, 1);
+    testTransform("Full region", ids, true, 0);
+    testTransform("One ID everywhere", ids, false);
+
+    // Single cells, away from the edges and on them
+    blankMap(ids, 23, 17, 0);
+    ids(11, 8) = 1;
+    testTransform("Single cell in the middle", ids, true, 1);
+    testTransform("Everything but a single cell", ids, true, 0);
+    blankMap(ids, 23, 17, 0);
+    ids(0, 9) = 1;
+    testTransform("Single cell on an edge", ids, true, 1);
+    blankMap(ids, 23, 17, 0);
+    ids(22, 16) = 1;
+    testTransform("Single cell in a corner", ids, true, 1);
+    testTransform("Single cell in a corner", ids, false);
+    blankMap(ids, 1, 1, 0);
+    testTransform("Single cell, all alone", ids, true, 0);
+
+    // Regions along the edges of the map
+    blankMap(ids, 31, 19, 0);
+    for (IndexType j = 0; j < 19; ++j)
+        ids(0, j) = ids(1, j) = 1;
+    for (IndexType i = 20; i < 31; ++i)
+        for (IndexType j = 12; j < 19; ++j)
+            ids(i, j) = 1;
+    testTransform("Regions along the edges", ids, true, 1);
+    testTransform("Regions along the edges", ids, false);
+    blankMap(ids, 37, 1, 0);
+    for (IndexType i = 10; i < 15; ++i)
+        ids(i, 0) = 1;
+    testTransform("One row", ids, true, 1);
+    blankMap(ids, 1, 41, 0);
+    ids(0, 0) = ids(0, 40) = 1;
+    testTransform("One column", ids, true, 1);
+
+    // Blobs, with bases other than zero, small and large
+    blobbyMap(ids, 29, 23, 3, -5, 7, random);
+    testTransform("Blobs", ids, true, 1);
+    testTransform("Blobs", ids, false);
+    blobbyMap(ids, 97, 71, 6, 3, -40, random);
+    testTransform("Blobs", ids, true, 2);
+    testTransform("Blobs", ids, false);
+
+    if (failures == 0) {
+        cerr << "All checks passed\n";
+        return 0;
+    } else {
+        cerr << failures << " check(s) failed\n";
+        return 1;
+    }
+}
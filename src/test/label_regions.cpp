@@ -0,0 +1,269 @@
+/*
+ * File: label_regions.cpp
+ *
+ * Author: Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes.
+ *
+ * Description:
+ *      This program checks the union-find region labeller in
+ *      label-regions.hpp against a flood fill (the way MapRasterization used
+ *      to find regions): scanning the map a row at a time, and flooding each
+ *      4-connected region from the first cell of it that the scan finds.
+ *      The region numbers (and so their order), seeds, bounds and areas must
+ *      all be exactly the same, for:
+ *
+ *          - a map of nothing but zeroes (no regions), and one with a
+ *            single ID everywhere
+ *          - concave regions: combs whose teeth are found before the spine
+ *            joining them (and after), and a spiral
+ *          - nested regions: rings within rings, with islands of the same
+ *            ID as an outer ring (which are separate regions) and holes of
+ *            ID zero
+ *          - a checkerboard, in which no two cells are 4-connected
+ *          - random maps with bases other than zero, tall enough to be split
+ *            into several bands, so that regions cross the seams
+ *          - maps only one cell wide or high
+ *
+ *      It prints what it finds and returns non-zero if anything is off.
+ */
+
+#include <terrainosaurus/data/label-regions.hpp>
+using namespace terrainosaurus;
+
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <random>
+#include <algorithm>
+using namespace std;
+
+typedef IDMap::Region Region;
+
+
+// How many checks have failed
+int failures = 0;
+
+// Report a measured error, and whether it is within tolerance
+void check(const char * what, double error, double tolerance) {
+    bool ok = (error <= tolerance);
+    cerr << (ok ? "  ok    " : "  FAIL  ") << what << ": " << error
+         << " (tolerance " << tolerance << ")\n";
+    if (! ok)
+        failures++;
+}
+
+// What the flood fill finds about each region
+struct Flooded {
+    vector<IDType>      labels;     // Region of each cell, row by row
+    vector<Pixel>       seeds;
+    vector<IndexType>   minimum[2], maximum[2];
+    vector<SizeType>    areas;
+};
+
+// Find the regions of 'ids' by flood-filling each one in turn, in scan order
+void floodRegions(Flooded & f, const IDMap & ids) {
+    IndexType w = IndexType(ids.size(0)), h = IndexType(ids.size(1)),
+              b0 = ids.base(0), b1 = ids.base(1);
+    f.labels.assign(w * h, 0);
+    for (IndexType j = 0; j < h; ++j)
+        for (IndexType i = 0; i < w; ++i) {
+            IDType id = ids(b0 + i, b1 + j);
+            if (id == 0 || f.labels[i + j * w] != 0)
+                continue;
+
+            // Hey! We found a new region!
+            IDType region = IDType(f.seeds.size() + 1);
+            f.seeds.push_back(Pixel(b0 + i, b1 + j));
+            IndexType lo[2] = { i, j }, hi[2] = { i, j };
+            SizeType area = 0;
+            deque<IndexType> frontier(1, i + j * w);
+            f.labels[i + j * w] = region;
+            while (! frontier.empty()) {
+                IndexType c = frontier.front(), x = c % w, y = c / w;
+                frontier.pop_front();
+                ++area;
+                lo[0] = std::min(lo[0], x);     hi[0] = std::max(hi[0], x);
+                lo[1] = std::min(lo[1], y);     hi[1] = std::max(hi[1], y);
+                IndexType nx[4] = { x - 1, x + 1, x,     x     },
+                          ny[4] = { y,     y,     y - 1, y + 1 };
+                for (int k = 0; k < 4; ++k) {
+                    if (nx[k] < 0 || nx[k] >= w || ny[k] < 0 || ny[k] >= h)
+                        continue;
+                    IndexType n = nx[k] + ny[k] * w;
+                    if (f.labels[n] == 0 && ids(b0 + nx[k], b1 + ny[k]) == id) {
+                        f.labels[n] = region;
+                        frontier.push_back(n);
+                    }
+                }
+            }
+            f.minimum[0].push_back(b0 + lo[0]);     f.maximum[0].push_back(b0 + hi[0]);
+            f.minimum[1].push_back(b1 + lo[1]);     f.maximum[1].push_back(b1 + hi[1]);
+            f.areas.push_back(area);
+        }
+}
+
+// Label the regions of 'ids' both ways, and compare
+void testLabelling(const char * what, const IDMap & ids) {
+    cerr << what << " (" << ids.size(0) << " x " << ids.size(1) << ")\n";
+    IDMap regionIDs;
+    vector<Region> bounds;
+    vector<Pixel> seeds;
+    vector<SizeType> areas;
+    labelRegions(regionIDs, bounds, seeds, areas, ids);
+
+    Flooded f;
+    floodRegions(f, ids);
+
+    IndexType w = IndexType(ids.size(0)), h = IndexType(ids.size(1)),
+              b0 = ids.base(0), b1 = ids.base(1);
+    int wrongLabels = 0, wrongRegions = 0;
+    for (IndexType j = 0; j < h; ++j)
+        for (IndexType i = 0; i < w; ++i)
+            if (regionIDs(b0 + i, b1 + j) != f.labels[i + j * w])
+                wrongLabels++;
+    SizeType n = std::min(f.seeds.size(), seeds.size());
+    for (SizeType r = 0; r < n; ++r) {
+        bool same = seeds[r][0] == f.seeds[r][0]
+                 && seeds[r][1] == f.seeds[r][1]
+                 && areas[r] == f.areas[r];
+        for (int d = 0; d < 2; ++d)
+            same = same && bounds[r].base(d)   == f.minimum[d][r]
+                        && bounds[r].extent(d) == f.maximum[d][r];
+        if (! same)
+            wrongRegions++;
+    }
+
+    cerr << "  " << f.seeds.size() << " regions\n";
+    check("  difference in region count",
+          std::abs(double(seeds.size()) - double(f.seeds.size())), 0);
+    check("  lists of different lengths",
+          (bounds.size() != seeds.size()) + (areas.size() != seeds.size()), 0);
+    check("  cells with the wrong region", wrongLabels, 0);
+    check("  regions with the wrong seed, bounds or area", wrongRegions, 0);
+}
+
+// Make a 'width' x 'height' map starting at 'bases', full of 'fill'
+void blankMap(IDMap & ids, SizeType width, SizeType height, IDType fill,
+              IndexType base0 = 0, IndexType base1 = 0) {
+    ids.setBounds(IndexArray(base0, base1),
+                  IndexArray(base0 + IndexType(width) - 1,
+                             base1 + IndexType(height) - 1));
+    for (IndexType j = 0; j < IndexType(height); ++j)
+        for (IndexType i = 0; i < IndexType(width); ++i)
+            ids(base0 + i, base1 + j) = fill;
+}
+
+// Fill the rectangle [i0, i1] x [j0, j1] of 'ids' with 'id'
+void fillRect(IDMap & ids, IndexType i0, IndexType j0,
+              IndexType i1, IndexType j1, IDType id) {
+    for (IndexType j = j0; j <= j1; ++j)
+        for (IndexType i = i0; i <= i1; ++i)
+            ids(ids.base(0) + i, ids.base(1) + j) = id;
+}
+
+// Draw a square ring, 'thickness' cells thick, with its outer edge 'inset'
+// cells in from the edges of a square 'size' map
+void ring(IDMap & ids, IndexType size, IndexType inset, IndexType thickness,
+          IDType id) {
+    IndexType lo = inset, hi = size - 1 - inset;
+    fillRect(ids, lo, lo, hi, lo + thickness - 1, id);
+    fillRect(ids, lo, hi - thickness + 1, hi, hi, id);
+    fillRect(ids, lo, lo, lo + thickness - 1, hi, id);
+    fillRect(ids, hi - thickness + 1, lo, hi, hi, id);
+}
+
+int main(int argc, char **argv) {
+    std::mt19937 random(1);
+    IDMap ids;
+
+    // Nothing, and everything
+    blankMap(ids, 23, 17, 0);
+    testLabelling("No regions", ids);
+    blankMap(ids, 23, 17, 4);
+    testLabelling("One region", ids);
+
+    // Combs, with the teeth reached before the spine (so that they have to
+    // be joined up later) and after it. The map is tall enough that the
+    // teeth cross seams between bands.
+    blankMap(ids, 41, 70, 2);
+    for (IndexType i = 1; i < 40; i += 4)
+        fillRect(ids, i, 0, i + 1, 64, 1);
+    fillRect(ids, 0, 65, 40, 69, 1);
+    testLabelling("Comb, teeth first", ids);
+    blankMap(ids, 41, 70, 2);
+    fillRect(ids, 0, 0, 40, 4, 1);
+    for (IndexType i = 1; i < 40; i += 4)
+        fillRect(ids, i, 5, i + 1, 69, 1);
+    testLabelling("Comb, spine first", ids);
+
+    // A spiral, winding in from the edges
+    blankMap(ids, 60, 60, 2);
+    {
+        IndexType lo = 0, hi = 59;
+        while (lo + 2 <= hi) {
+            fillRect(ids, lo, lo, hi, lo, 1);           // Bottom
+            fillRect(ids, hi, lo, hi, hi, 1);           // Right
+            fillRect(ids, lo, hi, hi, hi, 1);           // Top
+            fillRect(ids, lo, lo + 2, lo, hi, 1);       // Left (with a gap)
+            if (lo + 2 <= hi - 2)
+                fillRect(ids, lo, lo + 2, lo + 2, lo + 2, 1);  // Turn in
+            lo += 2;
+            hi -= 2;
+        }
+    }
+    testLabelling("Spiral", ids);
+
+    // Rings within rings, with an island of the outer ring's ID, and holes
+    blankMap(ids, 50, 50, 0);
+    ring(ids, 50, 0, 4, 1);
+    ring(ids, 50, 4, 5, 2);
+    ring(ids, 50, 9, 3, 1);
+    fillRect(ids, 12, 12, 37, 37, 3);
+    fillRect(ids, 20, 20, 29, 29, 1);
+    fillRect(ids, 23, 23, 26, 26, 0);
+    fillRect(ids, 24, 24, 24, 24, 1);
+    ids(ids.base(0) + 2, ids.base(1) + 2) = 0;
+    testLabelling("Nested rings", ids);
+
+    // A checkerboard, which is all single-cell regions
+    blankMap(ids, 19, 21, 0);
+    for (IndexType j = 0; j < 21; ++j)
+        for (IndexType i = 0; i < 19; ++i)
+            ids(i, j) = IDType(1 + (i + j) % 2);
+    testLabelling("Checkerboard", ids);
+
+    // Random maps, with regions of all shapes
+    for (int trial = 0; trial < 4; ++trial) {
+        SizeType width  = 1 + random() % 90,
+                 height = 40 + random() % 120;
+        IDType types = IDType(2 + random() % 3);
+        blankMap(ids, width, height, 0, -7, 12);
+        for (IndexType j = 0; j < IndexType(height); ++j)
+            for (IndexType i = 0; i < IndexType(width); ++i)
+                ids(-7 + i, 12 + j) = (random() % 3 != 0)
+                                        ? IDType((i / 7 + j / 5) % types)
+                                        : IDType(random() % types);
+        testLabelling("Random", ids);
+    }
+
+    // Thin maps
+    blankMap(ids, 37, 1, 0);
+    fillRect(ids, 3, 0, 9, 0, 1);
+    fillRect(ids, 10, 0, 12, 0, 2);
+    fillRect(ids, 20, 0, 36, 0, 1);
+    testLabelling("One row", ids);
+    blankMap(ids, 1, 53, 1);
+    fillRect(ids, 0, 17, 0, 18, 0);
+    fillRect(ids, 0, 30, 0, 40, 3);
+    testLabelling("One column", ids);
+
+    if (failures == 0) {
+        cerr << "All checks passed\n";
+        return 0;
+    } else {
+        cerr << failures << " check(s) failed\n";
+        return 1;
+    }
+}
@@ -0,0 +1,194 @@
+/*
+ * File: scale_space.cpp
+ *
+ * Author: Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes.
+ *
+ * Description:
+ *      This program checks the Gaussian blurs in scale-space.hpp against a
+ *      brute-force Gaussian. The scales the feature detectors use are all
+ *      small enough to be done by convolution, so this is the only thing
+ *      that exercises the recursive filter used for large blurs:
+ *
+ *          - an impulse blurred by a small sigma must match the discrete
+ *            analogue of the Gaussian, and one blurred by a large sigma
+ *            must be close to the sampled Gaussian, both keeping its mass
+ *          - a constant heightfield must stay constant, edges included
+ *          - a scale space built in steps (some of them large enough to
+ *            use the recursive filter) must match blurring the original
+ *            heightfield directly to each scale, away from the edges
+ *
+ *      It prints what it finds and returns non-zero if anything is off.
+ */
+
+#include <terrainosaurus/data/scale-space.hpp>
+using namespace terrainosaurus;
+
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+using namespace std;
+
+
+// How many checks have failed
+int failures = 0;
+
+// Report a measured error, and whether it is within tolerance
+void check(const char * what, double error, double tolerance) {
+    bool ok = (error <= tolerance);
+    cerr << (ok ? "  ok    " : "  FAIL  ") << what << ": " << error
+         << " (tolerance " << tolerance << ")\n";
+    if (! ok)
+        failures++;
+}
+
+// The sampled, normalized 1D Gaussian, out to 'radius' cells either side
+vector<double> sampledGaussian(double sigma, int radius) {
+    vector<double> g(2 * radius + 1);
+    double sum = 0.0;
+    for (int r = -radius; r <= radius; ++r)
+        sum += g[r + radius] = std::exp(-0.5 * r * r / (sigma * sigma));
+    for (int r = 0; r <= 2 * radius; ++r)
+        g[r] /= sum;
+    return g;
+}
+
+// The discrete analogue of the Gaussian (e^-t I_n(t), with t = sigma^2),
+// out to 'radius' cells either side, with the Bessel functions summed from
+// their power series
+vector<double> discreteGaussian(double sigma, int radius) {
+    vector<double> g(2 * radius + 1);
+    double t = sigma * sigma;
+    for (int r = 0; r <= radius; ++r) {
+        double term = std::pow(t / 2, r) / std::exp(std::lgamma(r + 1.0)),
+               sum = 0.0;
+        for (int k = 0; k < 100 && term > 0.0; ++k) {
+            sum += term;
+            term *= (t / 2) * (t / 2) / ((k + 1.0) * (k + 1.0 + r));
+        }
+        g[radius + r] = g[radius - r] = std::exp(-t) * sum;
+    }
+    return g;
+}
+
+// Blur an impulse in the middle of a big, empty heightfield, and compare it
+// with 'g' (the expected 1D profile). Returns the variance of the result.
+double blurImpulse(scalar_t sigma, const vector<double> & g,
+                   double tolerance) {
+    int n = int(g.size()), c = n / 2;
+    Heightfield hf(SizeArray(n, n)), blurred;
+    for (int j = 0; j < n; ++j)
+        for (int i = 0; i < n; ++i)
+            hf(i, j) = 0.0f;
+    hf(c, c) = 1.0f;
+    gaussianBlur(blurred, hf, sigma);
+
+    double peak = g[c] * g[c], worst = 0.0, mass = 0.0, variance = 0.0;
+    for (int j = 0; j < n; ++j)
+        for (int i = 0; i < n; ++i) {
+            double v = blurred(i, j);
+            worst = std::max(worst, std::abs(v - g[i] * g[j]));
+            mass += v;
+            variance += v * ((i - c) * (i - c) + (j - c) * (j - c)) / 2.0;
+        }
+    check("error at the peak", std::abs(blurred(c, c) - peak) / peak,
+          tolerance);
+    check("worst error, relative to the peak", worst / peak,
+          3 * tolerance);
+    check("change in mass", std::abs(mass - 1.0), 1e-3);
+    return variance;
+}
+
+// Small blurs are convolutions with the discrete analogue of the Gaussian,
+// which should come out almost exactly (the kernel is cut off 4 standard
+// deviations out, which loses a little of the variance)
+void testConvolution(scalar_t sigma) {
+    cerr << "Impulse, sigma " << sigma << " (convolution)\n";
+    int radius = 16 * int(std::ceil(sigma));
+    double variance = blurImpulse(sigma,
+                                  discreteGaussian(sigma, radius), 1e-3);
+    check("relative error in variance",
+          std::abs(variance / (sigma * sigma) - 1.0), 1e-2);
+}
+
+// Large blurs are recursive, which approximates the sampled Gaussian near
+// the peak, but has heavier tails: its variance comes out about 1.2 sigma^2
+void testRecursive(scalar_t sigma) {
+    cerr << "Impulse, sigma " << sigma << " (recursive)\n";
+    int radius = 16 * int(std::ceil(sigma));
+    double variance = blurImpulse(sigma,
+                                  sampledGaussian(sigma, radius), 0.02);
+    check("variance, relative to sigma^2, less 1.2",
+          std::abs(variance / (sigma * sigma) - 1.2), 0.05);
+}
+
+// Blur something flat, which shouldn't change at all
+void testConstant(scalar_t sigma) {
+    cerr << "Constant, sigma " << sigma << '\n';
+    int w = 61, h = 37;
+    Heightfield hf(SizeArray(w, h)), blurred;
+    for (int j = 0; j < h; ++j)
+        for (int i = 0; i < w; ++i)
+            hf(i, j) = 100.0f;
+    gaussianBlur(blurred, hf, sigma);
+
+    double worst = 0.0;
+    for (int j = 0; j < h; ++j)
+        for (int i = 0; i < w; ++i)
+            worst = std::max(worst, std::abs(blurred(i, j) - 100.0));
+    check("worst change", worst, 1e-2);
+}
+
+// Build a scale space in steps, and compare each level with blurring the
+// heightfield directly. The steps from 2 to 5 and 5 to 9 are large enough
+// for the recursive filter.
+void testScaleSpace() {
+    cerr << "Scale space, scales 0 2 5 9\n";
+    int n = 160, margin = 50;
+    Heightfield hf(SizeArray(n, n));
+    srand(1);
+    for (int j = 0; j < n; ++j)
+        for (int i = 0; i < n; ++i)
+            hf(i, j) = scalar_t(rand() % 1000);
+
+    vector<scalar_t> scales;
+    scales.push_back(0.0f);
+    scales.push_back(2.0f);
+    scales.push_back(5.0f);
+    scales.push_back(9.0f);
+    ScaleSpaceImage scaleSpace;
+    gaussianScaleSpace(scaleSpace, hf, scales);
+
+    for (IndexType k = 0; k < IndexType(scales.size()); ++k) {
+        Heightfield direct;
+        gaussianBlur(direct, hf, scales[k]);
+        double worst = 0.0;
+        for (int j = margin; j < n - margin; ++j)
+            for (int i = margin; i < n - margin; ++i)
+                worst = std::max(worst, double(std::abs(
+                            scaleSpace(i, j, k) - direct(i, j))));
+        cerr << "  level " << k << " (sigma " << scales[k] << ")\n";
+        check("worst difference from a direct blur", worst, 1.0);
+    }
+}
+
+int main(int argc, char **argv) {
+    testConvolution(1.0f);
+    testConvolution(2.5f);
+    testRecursive(4.0f);
+    testRecursive(10.0f);
+    testConstant(1.5f);
+    testConstant(6.0f);
+    testScaleSpace();
+
+    if (failures == 0) {
+        cerr << "All checks passed\n";
+        return 0;
+    } else {
+        cerr << failures << " check(s) failed\n";
+        return 1;
+    }
+}
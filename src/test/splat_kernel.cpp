@@ -0,0 +1,191 @@
+/*
+ * File: splat_kernel.cpp
+ *
+ * Author: Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes.
+ *
+ * Description:
+ *      This program checks that the SIMD code in splatKernel() (AVX2 or
+ *      NEON, whichever this machine has) calculates the same thing as the
+ *      scalar code, by doing each splat both ways into identical
+ *      heightfields:
+ *
+ *          - unrotated, with the whole window inside the target (so the
+ *            mask weights are read with aligned loads)
+ *          - unrotated, clipped on each edge and corner of the target (the
+ *            left edge making the mask reads unaligned)
+ *          - unrotated, but with the source window hanging off the edge of
+ *            the source (which goes through the general case)
+ *          - rotated by various angles, inside the target and clipped
+ *          - subtracting (sign = -1) rather than adding
+ *
+ *      The mask is an odd size, so that every row has a scalar tail. Both
+ *      do the same arithmetic in the same order, so they should agree to
+ *      the last bit; the tolerance only allows for a compiler contracting
+ *      the scalar code into fused multiply-adds.
+ *
+ *      If this machine has no SIMD code to test, it says so, and compares
+ *      the scalar code with itself.
+ *
+ *      It prints what it finds and returns non-zero if anything is off.
+ */
+
+#include <terrainosaurus/genetics/splat-kernel.hpp>
+using namespace terrainosaurus;
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <algorithm>
+using namespace std;
+
+
+// How many checks have failed
+int failures = 0;
+
+// Report a measured error, and whether it is within tolerance
+void check(const char * what, double error, double tolerance) {
+    bool ok = (error <= tolerance);
+    cerr << (ok ? "  ok    " : "  FAIL  ") << what << ": " << error
+         << " (tolerance " << tolerance << ")\n";
+    if (! ok)
+        failures++;
+}
+
+// Fill a heightfield with smooth-ish random terrain
+void randomTerrain(Heightfield & hf, SizeType width, SizeType height,
+                   std::mt19937 & random) {
+    std::uniform_real_distribution<float> noise(-5.0f, 5.0f);
+    hf.setSizes(width, height);
+    for (IndexType j = 0; j < IndexType(height); ++j)
+        for (IndexType i = 0; i < IndexType(width); ++i)
+            hf(i, j) = 1000.0f + 300.0f * std::sin(0.07f * i)
+                                        * std::cos(0.05f * j) + noise(random);
+}
+
+// The largest difference between two heightfields of the same size,
+// relative to the largest magnitude in either
+double difference(const Heightfield & a, const Heightfield & b) {
+    double worst = 0.0, largest = 1.0;
+    SizeType n = a.size(0) * a.size(1);
+    for (SizeType k = 0; k < n; ++k) {
+        worst   = std::max(worst, double(std::abs(a.elements()[k]
+                                                  - b.elements()[k])));
+        largest = std::max(largest, double(std::abs(a.elements()[k])));
+    }
+    return worst / largest;
+}
+
+// A target to splat into, with whatever was splatted there before
+struct Target {
+    Heightfield elevations, sums;
+};
+
+// Splat into both targets, once with SIMD code and once without
+void splatBoth(Target & simd, Target & scalar, const Heightfield & source,
+               const Pixel & sourceCenter, scalar_t rotation,
+               const Pixel & targetCenter, const BlendKernel & mask,
+               scalar_t sign) {
+    setSplatVectorized(true);
+    splatKernel(simd.elevations, simd.sums, source, sourceCenter, rotation,
+                1.25f, -40.0f, targetCenter, mask, sign);
+    setSplatVectorized(false);
+    splatKernel(scalar.elevations, scalar.sums, source, sourceCenter, rotation,
+                1.25f, -40.0f, targetCenter, mask, sign);
+}
+
+// Do a bunch of splats both ways, and compare the results
+void testSplats(const char * what, const Heightfield & source,
+                const BlendKernel & mask, const vector<Pixel> & sourceCenters,
+                const vector<Pixel> & targetCenters, scalar_t rotation,
+                scalar_t sign = 1) {
+    cerr << what << '\n';
+    Target simd, scalar;
+    std::mt19937 random(2);
+    randomTerrain(simd.elevations, 97, 83, random);
+    simd.sums.setSizes(97, 83);
+    std::fill(const_cast<float *>(simd.sums.elements()),
+              const_cast<float *>(simd.sums.elements()) + 97 * 83, 1.0f);
+    scalar = simd;
+
+    for (size_t k = 0; k < targetCenters.size(); ++k)
+        splatBoth(simd, scalar, source, sourceCenters[k % sourceCenters.size()],
+                  rotation, targetCenters[k], mask, sign);
+    check("elevation sums", difference(simd.elevations, scalar.elevations), 1e-6);
+    check("weight sums",    difference(simd.sums, scalar.sums), 1e-6);
+}
+
+int main(int argc, char **argv) {
+    std::mt19937 random(1);
+
+    // An odd-sized mask with no zero weights, so that every cell counts
+    const SizeType n = 29;
+    vector<float> weights(n * n);
+    std::uniform_real_distribution<float> weight(0.05f, 1.0f);
+    for (size_t k = 0; k < weights.size(); ++k)
+        weights[k] = weight(random);
+    BlendKernel mask;
+    mask.set(n, weights);
+
+    Heightfield source;
+    randomTerrain(source, 128, 96, random);
+
+    setSplatVectorized(true);
+    if (splatVectorized())
+        cerr << "Comparing the SIMD code with the scalar code\n";
+    else
+        cerr << "No SIMD code to test on this machine; comparing the scalar "
+                "code with itself\n";
+
+    // Source centers well inside the source, and hanging off its edges
+    vector<Pixel> inside, offEdge;
+    inside.push_back(Pixel(64, 48));
+    inside.push_back(Pixel(20, 30));
+    inside.push_back(Pixel(100, 70));
+    offEdge.push_back(Pixel(3, 48));
+    offEdge.push_back(Pixel(64, 1));
+    offEdge.push_back(Pixel(125, 94));
+    offEdge.push_back(Pixel(-10, 100));
+
+    // Target centers inside the 97 x 83 target, and on each edge & corner
+    vector<Pixel> unclipped, clipped;
+    unclipped.push_back(Pixel(48, 41));
+    unclipped.push_back(Pixel(15, 15));
+    unclipped.push_back(Pixel(81, 67));
+    clipped.push_back(Pixel(5, 41));        // Left (unaligned mask reads)
+    clipped.push_back(Pixel(93, 41));       // Right
+    clipped.push_back(Pixel(48, 2));        // Bottom
+    clipped.push_back(Pixel(48, 80));       // Top
+    clipped.push_back(Pixel(0, 0));         // Corners
+    clipped.push_back(Pixel(96, 82));
+    clipped.push_back(Pixel(-13, 41));      // Only the last column
+    clipped.push_back(Pixel(110, 41));      // Only the first column
+    clipped.push_back(Pixel(200, 200));     // Nothing at all
+
+    testSplats("Unrotated, unclipped", source, mask, inside, unclipped, 0);
+    testSplats("Unrotated, clipped", source, mask, inside, clipped, 0);
+    testSplats("Unrotated, off the edge of the source",
+               source, mask, offEdge, unclipped, 0);
+    testSplats("Unrotated, subtracted", source, mask, inside, clipped, 0, -1);
+
+    scalar_t angles[] = { 0.3f, 1.0f, -2.2f, 3.14159265f };
+    for (size_t a = 0; a < sizeof(angles) / sizeof(angles[0]); ++a) {
+        cerr << "Rotated by " << angles[a] << ":\n";
+        testSplats(" unclipped", source, mask, inside, unclipped, angles[a]);
+        testSplats(" clipped", source, mask, inside, clipped, angles[a]);
+        testSplats(" off the edge of the source",
+                   source, mask, offEdge, clipped, angles[a]);
+        testSplats(" subtracted", source, mask, offEdge, unclipped, angles[a], -1);
+    }
+
+    if (failures == 0) {
+        cerr << "All checks passed\n";
+        return 0;
+    } else {
+        cerr << failures << " check(s) failed\n";
+        return 1;
+    }
+}
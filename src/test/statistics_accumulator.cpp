@@ -0,0 +1,265 @@
+/*
+ * File: statistics_accumulator.cpp
+ *
+ * Author: Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes.
+ *
+ * Description:
+ *      This program checks that a Statistics object filled in by a
+ *      StatisticsAccumulator reports the same things as one that ran its own
+ *      two passes over the same samples:
+ *
+ *          - elevation-like (normal), slope-like (exponential) and
+ *            integer-valued samples, added in runs of various lengths
+ *          - the same samples split into bands and merged, in order and not
+ *          - samples replaced one at a time, by remove() and add()
+ *          - runs with NaNs in them (which both ignore)
+ *          - a handful of samples, and samples that are all the same
+ *
+ *      Everything but the histogram must agree to within single-precision
+ *      rounding (the Statistics object sums in single precision, so over
+ *      many samples, that's the larger error). The moments are compared in
+ *      units of the standard deviation. The histogram is built from finer
+ *      bins, so each bucket may be off by a fraction of a bin's worth of
+ *      samples.
+ *
+ *      It prints what it finds and returns non-zero if anything is off.
+ */
+
+#include <terrainosaurus/data/StatisticsAccumulator.hpp>
+using namespace terrainosaurus;
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <limits>
+using namespace std;
+
+typedef StatisticsAccumulator::Stat Stat;
+
+
+// How many checks have failed
+int failures = 0;
+
+// Report a measured error, and whether it is within tolerance
+void check(const char * what, double error, double tolerance) {
+    bool ok = (error <= tolerance);
+    cerr << (ok ? "  ok    " : "  FAIL  ") << what << ": " << error
+         << " (tolerance " << tolerance << ")\n";
+    if (! ok)
+        failures++;
+}
+
+// The relative difference between two quantities (absolute near zero)
+double difference(double a, double b) {
+    if (a != a || b != b)
+        return (a != a && b != b) ? 0.0 : numeric_limits<double>::infinity();
+    return std::abs(a - b) / std::max(1.0, std::max(std::abs(a), std::abs(b)));
+}
+
+// Run a Statistics object's own two passes over 'samples'
+void twoPass(Stat & s, const vector<scalar_t> & samples) {
+    s.reset();
+    for (int pass = 1; pass <= 2; ++pass) {
+        for (size_t k = 0; k < samples.size(); ++k)
+            if (samples[k] == samples[k])
+                s(samples[k]);
+        s.finish();
+    }
+}
+
+// Compare a filled-in Statistics object with the real thing
+void compare(const Stat & filled, const Stat & reference,
+             bool histogram = true, double bucketTolerance = 5e-3) {
+    check("sample size", std::abs(double(filled.sampleSize())
+                                  - reference.sampleSize()), 0.0);
+
+    double worst = 0.0;
+    worst = std::max(worst, difference(filled.mean(),     reference.mean()));
+    worst = std::max(worst, difference(filled.sum(),      reference.sum()));
+    worst = std::max(worst, difference(filled.min(),      reference.min()));
+    worst = std::max(worst, difference(filled.max(),      reference.max()));
+    worst = std::max(worst, difference(filled.range(),    reference.range()));
+    worst = std::max(worst, difference(filled.variance(), reference.variance()));
+    worst = std::max(worst, difference(filled.stddev(),   reference.stddev()));
+    if (reference.variance() > 0) {
+        worst = std::max(worst, difference(filled.skewness(),
+                                           reference.skewness()));
+        worst = std::max(worst, difference(filled.kurtosis(),
+                                           reference.kurtosis()));
+    }
+    check("worst difference in the summary statistics", worst, 1e-4);
+
+    // The moments & k-statistics are compared in units of the standard
+    // deviation, since the odd ones may be close to zero
+    double sigma = std::sqrt(double(reference.variance()));
+    if (! (sigma > 0))
+        sigma = 1.0;
+    worst = 0.0;
+    if (filled.centralMomentCount() != reference.centralMomentCount())
+        worst = numeric_limits<double>::infinity();
+    else
+        for (int i = 1; i < reference.centralMomentCount(); ++i)
+            worst = std::max(worst, std::abs(filled.centralMoment(i)
+                                             - reference.centralMoment(i))
+                                    / std::pow(sigma, i));
+    check("worst difference in the central moments", worst, 1e-3);
+
+    worst = 0.0;
+    if (filled.kStatisticCount() != reference.kStatisticCount())
+        worst = numeric_limits<double>::infinity();
+    else if (reference.sampleSize() > 3)
+        for (int i = 2; i < reference.kStatisticCount(); ++i)
+            worst = std::max(worst, std::abs(filled.k(i) - reference.k(i))
+                                    / std::pow(sigma, i));
+    check("worst difference in the k-statistics", worst, 1e-3);
+
+    if (! histogram)
+        return;
+    worst = 0.0;
+    if (filled.histogramBucketCount() != reference.histogramBucketCount())
+        worst = numeric_limits<double>::infinity();
+    else {
+        worst = difference(filled.histogramBucketSize(),
+                           reference.histogramBucketSize());
+        for (int i = 0; i < reference.histogramBucketCount(); ++i)
+            worst = std::max(worst, std::abs(double(filled.histogramBucket(i))
+                                             - reference.histogramBucket(i))
+                                    / std::max(1, reference.sampleSize()));
+    }
+    check("worst bucket difference, as a fraction of the samples", worst,
+          bucketTolerance);
+}
+
+// Add the samples in runs of 'run' at a time (the last one shorter)
+void addInRuns(StatisticsAccumulator & a, const vector<scalar_t> & samples,
+               size_t run) {
+    for (size_t k = 0; k < samples.size(); k += run)
+        a.add(&samples[k], std::min(run, samples.size() - k));
+}
+
+// All in one accumulator, in runs of a few different lengths
+void testSingle(const char * what, const vector<scalar_t> & samples) {
+    cerr << what << ", " << samples.size() << " samples\n";
+    Stat reference, filled;
+    twoPass(reference, samples);
+    size_t runs[] = { 1, 7, 1000, samples.size() };
+    for (size_t r = 0; r < 4; ++r) {
+        StatisticsAccumulator a;
+        addInRuns(a, samples, runs[r]);
+        a.store(filled);
+        cerr << " runs of " << runs[r] << '\n';
+        compare(filled, reference);
+    }
+}
+
+// Split into bands, accumulated separately then merged (forwards & backwards)
+void testMerged(const char * what, const vector<scalar_t> & samples,
+                size_t band) {
+    cerr << what << ", in bands of " << band << ", merged\n";
+    Stat reference, filled;
+    twoPass(reference, samples);
+    vector<StatisticsAccumulator> bands;
+    for (size_t k = 0; k < samples.size(); k += band) {
+        bands.push_back(StatisticsAccumulator());
+        bands.back().add(&samples[k], std::min(band, samples.size() - k));
+    }
+
+    StatisticsAccumulator forwards, backwards;
+    for (size_t b = 0; b < bands.size(); ++b) {
+        forwards.merge(bands[b]);
+        backwards.merge(bands[bands.size() - 1 - b]);
+    }
+    forwards.store(filled);
+    compare(filled, reference);
+    backwards.store(filled);
+    compare(filled, reference);
+}
+
+// Replace some of the samples, one at a time, by taking away the old value
+// and adding the new one (starting over if that takes away an extremum)
+void testReplaced(const char * what, vector<scalar_t> samples,
+                  std::mt19937 & random) {
+    cerr << what << ", with samples replaced\n";
+    std::normal_distribution<float> value(1200.0f, 300.0f);
+    StatisticsAccumulator a;
+    a.add(&samples[0], samples.size());
+    int restarts = 0;
+    for (size_t k = 0; k < samples.size(); k += 17) {
+        scalar_t old = samples[k];
+        samples[k] = value(random);
+        if (a.remove(old)) {
+            a.add(samples[k]);
+        } else {
+            a.reset();
+            a.add(&samples[0], samples.size());
+            ++restarts;
+        }
+    }
+    cerr << "  (" << restarts << " restarts)\n";
+
+    Stat reference, filled;
+    twoPass(reference, samples);
+    a.store(filled);
+    compare(filled, reference);
+}
+
+int main(int argc, char **argv) {
+    std::mt19937 random(1);
+
+    vector<scalar_t> elevations(100000);
+    std::normal_distribution<float> elevation(1200.0f, 300.0f);
+    for (size_t k = 0; k < elevations.size(); ++k)
+        elevations[k] = elevation(random);
+
+    vector<scalar_t> slopes(30000);
+    std::exponential_distribution<float> slope(3.0f);
+    for (size_t k = 0; k < slopes.size(); ++k)
+        slopes[k] = slope(random);
+
+    // Lots of samples right on bucket boundaries
+    vector<scalar_t> integers(20000);
+    for (size_t k = 0; k < integers.size(); ++k)
+        integers[k] = scalar_t(int(random() % 41) - 20);
+
+    vector<scalar_t> holes(elevations.begin(), elevations.begin() + 5000);
+    for (size_t k = 3; k < holes.size(); k += 97)
+        holes[k] = numeric_limits<scalar_t>::quiet_NaN();
+    holes[0] = numeric_limits<scalar_t>::quiet_NaN();
+
+    testSingle("Elevations", elevations);
+    testSingle("Slopes", slopes);
+    testSingle("Integers", integers);
+    testSingle("With NaNs", holes);
+    testMerged("Elevations", elevations, 1201);
+    testMerged("Slopes", slopes, 64);
+    testReplaced("Elevations", elevations, random);
+
+    cerr << "A few samples\n";
+    vector<scalar_t> few(elevations.begin(), elevations.begin() + 5);
+    Stat reference, filled;
+    StatisticsAccumulator a;
+    a.add(&few[0], few.size());
+    twoPass(reference, few);
+    a.store(filled);
+    compare(filled, reference, true, 1e-6);
+
+    cerr << "All the same\n";
+    vector<scalar_t> flat(1000, 42.0f);
+    a.reset();
+    a.add(&flat[0], flat.size());
+    twoPass(reference, flat);
+    a.store(filled);
+    compare(filled, reference, false);
+
+    if (failures == 0) {
+        cerr << "All checks passed\n";
+        return 0;
+    } else {
+        cerr << failures << " check(s) failed\n";
+        return 1;
+    }
+}
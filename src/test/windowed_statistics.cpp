@@ -0,0 +1,216 @@
+/*
+ * File: windowed_statistics.cpp
+ *
+ * Author: Ryan L. Saunders
+ *
+ * Copyright 2005, Ryan L. Saunders. Permission is granted to use and
+ *      distribute this file freely for educational purposes.
+ *
+ * Description:
+ *      This program checks the windowed statistics that study() gathers
+ *      (windowed-statistics.hpp) against the way it used to gather them,
+ *      applying mean() or range() to selectBS(r, px - w / 2, w) around every
+ *      cell:
+ *
+ *          - local elevation means and limits of a random heightfield
+ *          - local gradient means of a random vector map
+ *          - window sizes from 1 up to larger than the raster itself, odd
+ *            and even, so that some windows hang off two opposite edges
+ *          - cells near the edges (where the window reads off the raster)
+ *            reported separately from those in the interior
+ *          - a raster big enough to be split into several tiles, so that
+ *            the halos between tiles are exercised too
+ *
+ *      The limits must be exactly the same. The means are summed in double
+ *      precision, where mean() sums in single precision, so they may differ
+ *      by as much as the rounding error of the old float sum, which grows
+ *      with the size of the window (this is why study()'s analysis
+ *      fingerprint changed along with them).
+ *
+ *      It prints what it finds and returns non-zero if anything is off.
+ */
+
+#include <terrainosaurus/data/windowed-statistics.hpp>
+using namespace terrainosaurus;
+
+#include <inca/raster/operators/select>
+#include <inca/raster/operators/statistic>
+using namespace inca::raster;
+
+#include <iostream>
+#include <sstream>
+#include <random>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+using namespace std;
+
+
+// How many checks have failed
+int failures = 0;
+
+// Report a measured error, and whether it is within tolerance
+void check(const string & what, double error, double tolerance) {
+    bool ok = (error <= tolerance);
+    cerr << (ok ? "  ok    " : "  FAIL  ") << what << ": " << error
+         << " (tolerance " << tolerance << ")\n";
+    if (! ok)
+        failures++;
+}
+
+// The worst errors seen near the edges and in the interior
+struct Errors {
+    Errors() : edge(0.0), interior(0.0) { }
+    void note(bool nearEdge, double error) {
+        double & worst = (nearEdge ? edge : interior);
+        worst = std::max(worst, error);
+    }
+    double edge, interior;
+};
+
+// Is the window around 'px' partly off the edge of a 'sizes' raster?
+bool nearEdge(const Pixel & px, const SizeArray & sizes, SizeType w) {
+    IndexType half = IndexType(w / 2);
+    for (int d = 0; d < 2; ++d)
+        if (px[d] - half < 0 || px[d] - half + IndexType(w) > IndexType(sizes[d]))
+            return true;
+    return false;
+}
+
+// The difference between two means, relative to the largest magnitude in
+// the raster (which is what the rounding error of a sum scales with)
+double meanError(double a, double b, double scale) {
+    return std::abs(a - b) / scale;
+}
+
+// How far off a single-precision sum of a 'w' x 'w' window may be, relative
+// to the largest magnitude in it
+double meanTolerance(SizeType w) {
+    return std::max(1e-6, double(numeric_limits<float>::epsilon()) * w * w);
+}
+
+// Compare windowed means & limits of 'hf' with the old way
+void testHeightfield(const Heightfield & hf, SizeType w) {
+    Heightfield means;
+    VectorMap   limits;
+    windowedMeans(means, hf, w);
+    windowedLimits(limits, hf, w);
+
+    double scale = 1.0;
+    for (IndexType i = 0; i < IndexType(hf.size(0)); ++i)
+        for (IndexType j = 0; j < IndexType(hf.size(1)); ++j)
+            scale = std::max(scale, double(std::abs(hf(i, j))));
+
+    Errors meanErrors, limitErrors;
+    SizeArray windowSizes(w);
+    Pixel px;
+    for (px[0] = 0; px[0] < IndexType(hf.size(0)); ++px[0])
+        for (px[1] = 0; px[1] < IndexType(hf.size(1)); ++px[1]) {
+            Pixel start(px[0] - IndexType(w / 2), px[1] - IndexType(w / 2));
+            bool edge = nearEdge(px, hf.sizes(), w);
+            scalar_t oldMean = mean(selectBS(hf, start, windowSizes));
+            Vector2D oldLimits(range(selectBS(hf, start, windowSizes)));
+            meanErrors.note(edge, meanError(means(px), oldMean, scale));
+            limitErrors.note(edge, std::max(std::abs(limits(px)[0] - oldLimits[0]),
+                                            std::abs(limits(px)[1] - oldLimits[1])));
+        }
+
+    ostringstream what;
+    what << "  " << w << " x " << w << " window: ";
+    check(what.str() + "elevation means (interior)", meanErrors.interior,
+          meanTolerance(w));
+    check(what.str() + "elevation means (edges)",    meanErrors.edge,
+          meanTolerance(w));
+    check(what.str() + "elevation limits (interior)", limitErrors.interior, 0.0);
+    check(what.str() + "elevation limits (edges)",    limitErrors.edge,     0.0);
+}
+
+// Compare windowed means of 'vm' with the old way
+void testVectorMap(const VectorMap & vm, SizeType w) {
+    VectorMap means;
+    windowedMeans(means, vm, w);
+
+    double scale = 1.0;
+    for (IndexType i = 0; i < IndexType(vm.size(0)); ++i)
+        for (IndexType j = 0; j < IndexType(vm.size(1)); ++j)
+            scale = std::max(scale, double(std::max(std::abs(vm(i, j)[0]),
+                                                    std::abs(vm(i, j)[1]))));
+
+    Errors errors;
+    SizeArray windowSizes(w);
+    Pixel px;
+    for (px[0] = 0; px[0] < IndexType(vm.size(0)); ++px[0])
+        for (px[1] = 0; px[1] < IndexType(vm.size(1)); ++px[1]) {
+            Pixel start(px[0] - IndexType(w / 2), px[1] - IndexType(w / 2));
+            Vector2D oldMean = mean(selectBS(vm, start, windowSizes));
+            errors.note(nearEdge(px, vm.sizes(), w),
+                        std::max(meanError(means(px)[0], oldMean[0], scale),
+                                 meanError(means(px)[1], oldMean[1], scale)));
+        }
+
+    ostringstream what;
+    what << "  " << w << " x " << w << " window: ";
+    check(what.str() + "gradient means (interior)", errors.interior,
+          meanTolerance(w));
+    check(what.str() + "gradient means (edges)",    errors.edge,
+          meanTolerance(w));
+}
+
+// Fill a heightfield with rough random terrain
+void randomTerrain(Heightfield & hf, SizeType width, SizeType height,
+                   std::mt19937 & random) {
+    std::uniform_real_distribution<float> noise(-50.0f, 50.0f);
+    hf.setSizes(width, height);
+    for (IndexType i = 0; i < IndexType(width); ++i)
+        for (IndexType j = 0; j < IndexType(height); ++j)
+            hf(i, j) = 1500.0f + 400.0f * std::sin(0.11f * i)
+                                        * std::cos(0.07f * j) + noise(random);
+}
+
+// Fill a vector map with random gradients
+void randomGradients(VectorMap & vm, SizeType width, SizeType height,
+                     std::mt19937 & random) {
+    std::uniform_real_distribution<float> slope(-2.0f, 2.0f);
+    vm.setSizes(width, height);
+    for (IndexType i = 0; i < IndexType(width); ++i)
+        for (IndexType j = 0; j < IndexType(height); ++j)
+            vm(i, j) = Vector2D(slope(random), slope(random));
+}
+
+int main(int argc, char **argv) {
+    std::mt19937 random(1);
+
+    // Window sizes: trivial, odd, even, and bigger than the small raster
+    const SizeType windowSizes[] = { 1, 2, 5, 8, 11, 40, 64 };
+    const SizeType count = sizeof(windowSizes) / sizeof(windowSizes[0]);
+
+    // A small, non-square raster
+    cerr << "61 x 47 raster\n";
+    Heightfield small;
+    VectorMap smallGradients;
+    randomTerrain(small, 61, 47, random);
+    randomGradients(smallGradients, 61, 47, random);
+    for (SizeType k = 0; k < count; ++k) {
+        testHeightfield(small, windowSizes[k]);
+        testVectorMap(smallGradients, windowSizes[k]);
+    }
+
+    // A larger one, which gets split into tiles
+    cerr << "300 x 211 raster\n";
+    Heightfield large;
+    VectorMap largeGradients;
+    randomTerrain(large, 300, 211, random);
+    randomGradients(largeGradients, 300, 211, random);
+    for (SizeType k = 0; k < count; k += 2) {
+        testHeightfield(large, windowSizes[k]);
+        testVectorMap(largeGradients, windowSizes[k]);
+    }
+
+    if (failures == 0) {
+        cerr << "All checks passed\n";
+        return 0;
+    } else {
+        cerr << failures << " check(s) failed\n";
+        return 1;
+    }
+}